@@ -5,6 +5,9 @@
 //
 // Options:
 // - DS_NO_STDLIB: Disables the use of the standard library
+// - DS_NO_SIMD: Disables the SSE2/AVX2 code paths and uses the scalar fallbacks
+// - DS_NO_THREADS: Disables the worker threads and runs the parallel utilities
+// on the calling thread
 //
 // ## MEMORY MANAGEMENT
 //
@@ -29,6 +32,9 @@
 // - DS_PQ_IMPLEMENTATION: Use the priority queue implementation
 // - DS_LL_IMPLEMENTATION: Use the linked list implementation
 // - DS_HM_IMPLEMENTATION: Use the hash map implementation
+// - DS_SI_IMPLEMENTATION: Use the string interner implementation
+// - DS_HASH_IMPLEMENTATION: Use the hash functions implementation
+// - DS_UTF8_IMPLEMENTATION: Use the UTF-8 utilities implementation
 //
 // ## LOGGING
 //
@@ -79,6 +85,50 @@
 #define NULL ((void *)0)
 #endif
 
+// SIMD
+//
+// Some of the string utilities have vectorized implementations that are used
+// when the compiler targets SSE2, SSE4.2 or AVX2 (e.g. -mavx2 or
+// -march=native). The scalar fallbacks are always available.
+#if !defined(DS_NO_SIMD) && defined(__AVX2__)
+#define DS_AVX2
+#include <immintrin.h>
+#endif
+
+#if !defined(DS_NO_SIMD) && defined(__SSE2__)
+#define DS_SSE2
+#include <emmintrin.h>
+#endif
+
+#if !defined(DS_NO_SIMD) && defined(__SSE4_2__)
+#define DS_SSE42
+#include <nmmintrin.h>
+#endif
+
+// POSIX
+//
+// The utilities that work with file descriptors (writev, mmap, ...) are only
+// available on POSIX systems with the standard library.
+#if !defined(DS_NO_STDLIB) && (defined(__unix__) || defined(__APPLE__))
+#define DS_POSIX
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <dirent.h>
+#endif
+
+// THREADS
+//
+// The parallel utilities split their work between POSIX threads (link with
+// -pthread). Without threads they do all the work on the calling thread.
+#if defined(DS_POSIX) && !defined(DS_NO_THREADS)
+#define DS_THREADS
+#include <pthread.h>
+#endif
+
 #ifndef DSHDEF
 #ifdef DSH_STATIC
 #define DSHDEF static
@@ -154,6 +204,16 @@ DSHDEF void ds_list_allocator_free(ds_list_allocator *allocator, void *ptr);
 DSHDEF void ds_list_allocator_clear(ds_list_allocator *allocator);
 DSHDEF void ds_list_allocator_dump(ds_list_allocator allocator);
 
+// DS_ALLOCATOR_CUSTOM
+//
+// Defined when the user provides their own allocator macros. Memory that the
+// library would otherwise get from the system directly (see
+// DS_DA_MMAP_THRESHOLD) then goes through the user's allocator as well.
+#if defined(DS_ALLOCATOR) || defined(DS_MALLOC) || defined(DS_REALLOC) ||     \
+    defined(DS_FREE)
+#define DS_ALLOCATOR_CUSTOM
+#endif
+
 // DS_ALLOCATOR
 //
 // The DS_ALLOCATOR macro is used to select the appropriate allocator
@@ -283,6 +343,27 @@ DSHDEF void ds_list_allocator_dump(ds_list_allocator allocator);
     } while (0)
 #endif // DS_MEMCPY
 
+// DS_MEMMOVE
+//
+// The DS_MEMMOVE macro is used to copy memory between buffers that may overlap
+#if defined(DS_MEMMOVE) // ok
+#elif !defined(DS_NO_STDLIB)
+#define DS_MEMMOVE(dst, src, size) memmove(dst, src, size)
+#else
+#define DS_MEMMOVE(dst, src, sz)                                               \
+    do {                                                                       \
+        if ((char *)dst < (char *)src) {                                       \
+            for (unsigned long i = 0; i < sz; i++) {                           \
+                ((char *)dst)[i] = ((char *)src)[i];                           \
+            }                                                                  \
+        } else {                                                               \
+            for (unsigned long i = sz; i > 0; i--) {                           \
+                ((char *)dst)[i - 1] = ((char *)src)[i - 1];                   \
+            }                                                                  \
+        }                                                                      \
+    } while (0)
+#endif // DS_MEMMOVE
+
 // DS_MEMCMP
 //
 // The DS_MEMCMP macro is used to compare memory
@@ -376,7 +457,8 @@ static inline void *allocator_realloc(void *allocator, void *ptr, unsigned long
 //
 // The DS_REALLOC macro is used to reallocate memory
 // using the selected allocator implementation.
-#if defined(DS_ARENA_ALLOCATOR_IMPLEMENTATION)
+#if defined(DS_REALLOC) // ok
+#elif defined(DS_ARENA_ALLOCATOR_IMPLEMENTATION)
 #define DS_REALLOC(allocator, ptr, old_sz, new_sz) allocator_realloc(allocator, ptr, old_sz, new_sz)
 #elif defined(DS_LIST_ALLOCATOR_IMPLEMENTATION)
 #define DS_REALLOC(allocator, ptr, old_sz, new_sz) allocator_realloc(allocator, ptr, old_sz, new_sz)
@@ -516,17 +598,58 @@ typedef struct ds_dynamic_array {
         unsigned long item_size;
         unsigned long count;
         unsigned long capacity;
+        boolean mapped;
 } ds_dynamic_array;
 
 #ifndef DS_DA_INIT_CAPACITY
 #define DS_DA_INIT_CAPACITY 8192
 #endif
 
+// DS_DA_MMAP_THRESHOLD
+//
+// When the items of a dynamic array grow past this many bytes they are moved
+// into their own anonymous memory mapping, and further growth is done with
+// mremap. The kernel then moves the pages instead of copying the bytes, so
+// very large arrays stop paying for the doubling copy. Smaller arrays keep
+// using DS_REALLOC. This is only enabled on Linux with the default malloc
+// allocator, and only for arrays initialized without an allocator; define
+// DS_DA_NO_MMAP to disable it.
+#ifndef DS_DA_MMAP_THRESHOLD
+#define DS_DA_MMAP_THRESHOLD (64UL * 1024 * 1024)
+#endif
+
+#if defined(__linux__) && !defined(DS_NO_STDLIB) && !defined(DS_DA_NO_MMAP) && \
+    !defined(DS_ARENA_ALLOCATOR_IMPLEMENTATION) &&                             \
+    !defined(DS_LIST_ALLOCATOR_IMPLEMENTATION) && !defined(DS_ALLOCATOR_CUSTOM)
+#include <sys/mman.h>
+#include <unistd.h>
+// glibc hides MAP_ANONYMOUS in the strict C modes (-std=c99, -std=c11)
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#if !defined(MAP_ANONYMOUS) &&                                                 \
+    (defined(__x86_64__) || defined(__i386__) || defined(__aarch64__) ||      \
+     defined(__arm__) || defined(__riscv))
+#define MAP_ANONYMOUS 0x20
+#endif
+#ifdef MAP_ANONYMOUS
+#define DS_DA_MMAP
+#ifndef MREMAP_MAYMOVE
+// mremap is only declared by glibc when _GNU_SOURCE is defined
+#define MREMAP_MAYMOVE 1
+extern void *mremap(void *old_address, size_t old_size, size_t new_size,
+                    int flags, ...);
+#endif
+#endif
+#endif
+
 DSHDEF void ds_dynamic_array_init_allocator(ds_dynamic_array *da,
                                             unsigned long item_size,
                                             DS_ALLOCATOR *allocator);
 DSHDEF void ds_dynamic_array_init(ds_dynamic_array *da,
                                   unsigned long item_size);
+DSHDEF ds_result ds_dynamic_array_reserve(ds_dynamic_array *da,
+                                          unsigned long capacity);
 DSHDEF ds_result ds_dynamic_array_append(ds_dynamic_array *da,
                                          const void *item);
 DSHDEF ds_result ds_dynamic_array_pop(ds_dynamic_array *da, const void **item);
@@ -562,6 +685,23 @@ typedef struct ds_string_slice {
 
 #define DS_STRING_SLICE(string) ((ds_string_slice){.str = string, .len = DS_STRLEN((string))})
 
+// CHARACTER CLASS
+//
+// The character class is a lookup table of bytes. It is used to tokenize by
+// many delimiters at once. Classes with at most DS_CHAR_CLASS_SIMD_MAX
+// characters are also scanned with SIMD compares.
+#ifndef DS_CHAR_CLASS_SIMD_MAX
+#define DS_CHAR_CLASS_SIMD_MAX 4
+#endif
+
+typedef struct ds_char_class {
+        unsigned char table[256];
+        char chars[DS_CHAR_CLASS_SIMD_MAX];
+        unsigned int count;
+} ds_char_class;
+
+DSHDEF void ds_char_class_init(ds_char_class *cc, const char *chars);
+
 DSHDEF void ds_string_slice_init_allocator(ds_string_slice *ss, char *str,
                                            unsigned long len,
                                            DS_ALLOCATOR *allocator);
@@ -572,6 +712,32 @@ DSHDEF boolean ds_string_slice_tokenize(ds_string_slice *ss, char delimiter,
 DSHDEF boolean ds_string_slice_take_while_pred(ds_string_slice *ss,
                                                boolean (*predicate)(char),
                                                ds_string_slice *token);
+DSHDEF boolean ds_string_slice_tokenize_class(ds_string_slice *ss,
+                                              const ds_char_class *cc,
+                                              ds_string_slice *token);
+DSHDEF boolean ds_string_slice_take_while_class(ds_string_slice *ss,
+                                                const ds_char_class *cc,
+                                                ds_string_slice *token);
+DSHDEF ds_result ds_string_slice_split(ds_string_slice *ss, char delimiter,
+                                       ds_dynamic_array *tokens);
+DSHDEF ds_result ds_string_slice_split_class(ds_string_slice *ss,
+                                             const ds_char_class *cc,
+                                             ds_dynamic_array *tokens);
+
+// The parallel split gives every thread at least DS_SPLIT_PARALLEL_MIN bytes of
+// the string slice, so small inputs are split on the calling thread.
+#ifndef DS_SPLIT_PARALLEL_MIN
+#define DS_SPLIT_PARALLEL_MIN (1UL << 20)
+#endif
+
+DSHDEF ds_result ds_string_slice_split_parallel(ds_string_slice *ss,
+                                                char delimiter,
+                                                ds_dynamic_array *tokens,
+                                                unsigned long threads);
+DSHDEF ds_result ds_string_slice_split_class_parallel(ds_string_slice *ss,
+                                                      const ds_char_class *cc,
+                                                      ds_dynamic_array *tokens,
+                                                      unsigned long threads);
 DSHDEF void ds_string_slice_trim_left_ws(ds_string_slice *ss);
 DSHDEF void ds_string_slice_trim_right_ws(ds_string_slice *ss);
 DSHDEF void ds_string_slice_trim_left(ds_string_slice *ss, char chr);
@@ -585,29 +751,372 @@ DSHDEF boolean ds_string_slice_starts_with_pred(ds_string_slice *ss,
                                                 boolean (*predicate)(char));
 DSHDEF void ds_string_slice_step(ds_string_slice *ss, int count);
 DSHDEF boolean ds_string_slice_empty(ds_string_slice *ss);
+DSHDEF ds_result ds_string_slice_to_long(ds_string_slice *ss, long *value);
+DSHDEF ds_result ds_string_slice_to_ulong(ds_string_slice *ss,
+                                          unsigned long *value);
+DSHDEF ds_result ds_string_slice_to_hex(ds_string_slice *ss,
+                                        unsigned long *value);
+DSHDEF ds_result ds_string_slice_to_double(ds_string_slice *ss, double *value);
+DSHDEF boolean ds_string_slice_find(ds_string_slice *ss, ds_string_slice *needle,
+                                    unsigned long *index);
+DSHDEF boolean ds_string_slice_rfind(ds_string_slice *ss,
+                                     ds_string_slice *needle,
+                                     unsigned long *index);
+DSHDEF unsigned long ds_string_slice_count(ds_string_slice *ss,
+                                           ds_string_slice *needle);
 DSHDEF void ds_string_slice_free(ds_string_slice *ss);
 
+// UTF-8
+//
+// The UTF-8 utilities validate, count and decode the code points of a string
+// slice. Validation checks 32 bytes at a time with AVX2 and skips ASCII runs
+// with SSE2. The scalar fallbacks do not need the standard library.
+#define DS_UTF8_REPLACEMENT 0xFFFD
+
+DSHDEF boolean ds_string_slice_utf8_valid(ds_string_slice *ss,
+                                          unsigned long *index);
+DSHDEF unsigned long ds_string_slice_utf8_count(ds_string_slice *ss);
+DSHDEF boolean ds_string_slice_utf8_next(ds_string_slice *ss,
+                                         unsigned int *codepoint);
+
 // STRING BUILDER
 //
 // The string builder is a simple utility to build strings. You can append
 // formatted strings to the string builder, and then build the final string.
 // The string builder will automatically grow as needed.
+//
+// A string builder can also be attached to a sink (a FILE*, a file descriptor
+// or a custom callback). The buffered output is then handed to the sink each
+// time it reaches the threshold, so the memory used stays bounded by the
+// threshold no matter how much is appended. Call ds_string_builder_flush to
+// write out the rest before freeing the string builder.
+#ifndef DS_SB_SINK_THRESHOLD
+#define DS_SB_SINK_THRESHOLD (64 * 1024)
+#endif
+
 typedef struct ds_string_builder {
         ds_dynamic_array items;
+        ds_result (*sink)(void *context, const char *str, unsigned long len);
+        void *context;
+        unsigned long threshold;
 } ds_string_builder;
 
 DSHDEF void ds_string_builder_init_allocator(ds_string_builder *sb,
                                              DS_ALLOCATOR *allocator);
 DSHDEF void ds_string_builder_init(ds_string_builder *sb);
+DSHDEF void ds_string_builder_init_sink_allocator(
+    ds_string_builder *sb,
+    ds_result (*sink)(void *context, const char *str, unsigned long len),
+    void *context, unsigned long threshold, DS_ALLOCATOR *allocator);
+DSHDEF void ds_string_builder_init_sink(
+    ds_string_builder *sb,
+    ds_result (*sink)(void *context, const char *str, unsigned long len),
+    void *context, unsigned long threshold);
+#ifndef DS_NO_STDIO
+DSHDEF void ds_string_builder_init_file(ds_string_builder *sb, FILE *file,
+                                        unsigned long threshold);
+#endif
+DSHDEF void ds_string_builder_init_fd(ds_string_builder *sb, int fd,
+                                      unsigned long threshold);
+DSHDEF ds_result ds_string_builder_flush(ds_string_builder *sb);
 DSHDEF ds_result ds_string_builder_append(ds_string_builder *sb,
                                           const char *format, ...);
 DSHDEF ds_result ds_string_builder_appendn(ds_string_builder *sb,
                                            const char *str, unsigned long len);
 DSHDEF ds_result ds_string_builder_appendc(ds_string_builder *sb, char chr);
+DSHDEF ds_result ds_string_builder_append_long(ds_string_builder *sb,
+                                               long value);
+DSHDEF ds_result ds_string_builder_append_ulong(ds_string_builder *sb,
+                                                unsigned long value);
+DSHDEF ds_result ds_string_builder_append_double(ds_string_builder *sb,
+                                                 double value, int precision);
 DSHDEF ds_result ds_string_builder_build(ds_string_builder *sb, char **str);
+DSHDEF ds_result ds_string_builder_take(ds_string_builder *sb, char **str);
+DSHDEF void ds_string_builder_release(DS_ALLOCATOR *allocator, char *str,
+                                      unsigned long len);
 DSHDEF void ds_string_builder_to_slice(ds_string_builder *sb, ds_string_slice *ss);
 DSHDEF void ds_string_builder_free(ds_string_builder *sb);
 
+// STRING
+//
+// The string is an owned, immutable, NUL terminated string. It is as large as
+// three pointers, and strings of up to DS_STRING_SMALL_CAPACITY bytes (22 on
+// 64 bit targets) are stored inline in it, so short strings (e.g. tokens and
+// hash map keys) do not allocate. Longer strings are allocated with the
+// allocator of the string, which is then kept next to the pointer. The last
+// byte of the struct tells the two apart: it is the length of an inline
+// string, and it has its top bit set for an allocated one. A zeroed string is
+// an empty string. Use DS_STRING_STR and DS_STRING_LEN to get the characters
+// and the length, and ds_string_to_slice for a string slice view.
+typedef struct ds_string {
+        union {
+                struct {
+                        char *str;
+                        DS_ALLOCATOR *allocator;
+                        unsigned long len; // tagged with DS_STRING_HEAP_LEN
+                } heap;
+                char small[sizeof(char *) + sizeof(DS_ALLOCATOR *) +
+                           sizeof(unsigned long)];
+        } data;
+} ds_string;
+
+#define DS_STRING_SMALL_CAPACITY                                               \
+    (sizeof(char *) + sizeof(DS_ALLOCATOR *) + sizeof(unsigned long) - 2)
+
+// The tag byte is the last byte of heap.len, so the length of an allocated
+// string is stored shifted away from it on big endian targets
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define DS_STRING_HEAP_LEN(len) (((unsigned long)(len) << 8) | 0x80UL)
+#define DS_STRING_HEAP_UNTAG(len) ((len) >> 8)
+#else
+#define DS_STRING_HEAP_LEN(len)                                                \
+    ((unsigned long)(len) | (0x80UL << (8 * (sizeof(unsigned long) - 1))))
+#define DS_STRING_HEAP_UNTAG(len)                                              \
+    ((len) & ~(0x80UL << (8 * (sizeof(unsigned long) - 1))))
+#endif
+
+#define DS_STRING_TAG(string)                                                  \
+    ((unsigned char)(string)->data.small[DS_STRING_SMALL_CAPACITY + 1])
+#define DS_STRING_IS_HEAP(string) ((DS_STRING_TAG(string) & 0x80) != 0)
+
+#define DS_STRING_STR(string)                                                  \
+    (DS_STRING_IS_HEAP(string) ? (string)->data.heap.str                       \
+                               : (string)->data.small)
+#define DS_STRING_LEN(string)                                                  \
+    (DS_STRING_IS_HEAP(string) ? DS_STRING_HEAP_UNTAG((string)->data.heap.len) \
+                               : (unsigned long)DS_STRING_TAG(string))
+
+DSHDEF ds_result ds_string_init_allocator(ds_string *string, const char *str,
+                                          unsigned long len,
+                                          DS_ALLOCATOR *allocator);
+DSHDEF ds_result ds_string_init(ds_string *string, const char *str,
+                                unsigned long len);
+DSHDEF ds_result ds_string_slice_to_string(ds_string_slice *ss,
+                                           ds_string *string);
+DSHDEF ds_result ds_string_builder_build_string(ds_string_builder *sb,
+                                                ds_string *string);
+DSHDEF ds_result ds_string_copy(ds_string *string, ds_string *copy);
+DSHDEF void ds_string_to_slice(ds_string *string, ds_string_slice *ss);
+DSHDEF boolean ds_string_equals(ds_string *string, ds_string *other);
+DSHDEF void ds_string_free(ds_string *string);
+
+// LINE ITERATOR
+//
+// The line iterator yields the lines of a buffer as string slices that point
+// straight into the buffer (e.g. a file read with ds_io_read or a memory mapped
+// file), so no line is copied. Both "\n" and "\r\n" line endings are handled.
+// The input can also be fed incrementally in chunks; a line that is split
+// across two chunks is carried over in an internal string builder.
+typedef struct ds_line_iterator {
+        ds_string_slice rest;
+        ds_string_builder carry;
+        boolean carry_used;
+        boolean finished;
+        boolean failed; // the line could not be carried over
+} ds_line_iterator;
+
+DSHDEF void ds_line_iterator_init_allocator(ds_line_iterator *it, char *buffer,
+                                            unsigned long len,
+                                            DS_ALLOCATOR *allocator);
+DSHDEF void ds_line_iterator_init(ds_line_iterator *it, char *buffer,
+                                  unsigned long len);
+DSHDEF void ds_line_iterator_init_stream_allocator(ds_line_iterator *it,
+                                                   DS_ALLOCATOR *allocator);
+DSHDEF void ds_line_iterator_init_stream(ds_line_iterator *it);
+DSHDEF void ds_line_iterator_feed(ds_line_iterator *it, char *chunk,
+                                  unsigned long len);
+DSHDEF void ds_line_iterator_finish(ds_line_iterator *it);
+DSHDEF boolean ds_line_iterator_next(ds_line_iterator *it,
+                                     ds_string_slice *line);
+DSHDEF void ds_line_iterator_free(ds_line_iterator *it);
+DSHDEF unsigned long ds_string_slice_count_lines(ds_string_slice *ss);
+
+// ROPE BUILDER
+//
+// The rope builder builds large strings in a list of fixed size chunks, so
+// the bytes that were already written are never moved or copied when it
+// grows. It can be flushed to a file descriptor with writev, or linearized
+// into a single string once the whole output is needed in memory.
+#ifndef DS_RB_CHUNK_SIZE
+#define DS_RB_CHUNK_SIZE (64 * 1024)
+#endif
+
+typedef struct ds_rope_chunk {
+        char *data;
+        unsigned long len;
+        unsigned long capacity;
+} ds_rope_chunk;
+
+typedef struct ds_rope_builder {
+        DS_ALLOCATOR *allocator;
+        ds_dynamic_array chunks; // ds_rope_chunk
+        unsigned long chunk_size;
+        unsigned long len;
+} ds_rope_builder;
+
+DSHDEF void ds_rope_builder_init_allocator(ds_rope_builder *rb,
+                                           unsigned long chunk_size,
+                                           DS_ALLOCATOR *allocator);
+DSHDEF void ds_rope_builder_init(ds_rope_builder *rb);
+DSHDEF ds_result ds_rope_builder_append(ds_rope_builder *rb,
+                                        const char *format, ...);
+DSHDEF ds_result ds_rope_builder_appendn(ds_rope_builder *rb, const char *str,
+                                         unsigned long len);
+DSHDEF ds_result ds_rope_builder_appendc(ds_rope_builder *rb, char chr);
+DSHDEF ds_result ds_rope_builder_build(ds_rope_builder *rb, char **str);
+DSHDEF long ds_rope_builder_flush(ds_rope_builder *rb, int fd);
+DSHDEF void ds_rope_builder_clear(ds_rope_builder *rb);
+DSHDEF void ds_rope_builder_free(ds_rope_builder *rb);
+
+// STRING MATCHER
+//
+// The string matcher searches a string slice for many patterns at once in a
+// single pass (Aho-Corasick). The patterns are compiled into a table driven
+// automaton, so every byte of the input costs one table lookup no matter how
+// many patterns there are.
+typedef struct ds_string_match {
+        unsigned long pattern; // id of the pattern, in the order they were added
+        unsigned long index;   // index of the match in the string slice
+        unsigned long len;     // length of the pattern
+} ds_string_match;
+
+typedef struct ds_string_matcher {
+        DS_ALLOCATOR *allocator;
+        ds_dynamic_array transitions; // unsigned int, 256 for each state
+        ds_dynamic_array states;      // ds_string_matcher_state
+        ds_dynamic_array patterns;    // unsigned long (pattern length)
+        boolean built;
+} ds_string_matcher;
+
+DSHDEF void ds_string_matcher_init_allocator(ds_string_matcher *sm,
+                                             DS_ALLOCATOR *allocator);
+DSHDEF void ds_string_matcher_init(ds_string_matcher *sm);
+DSHDEF ds_result ds_string_matcher_add(ds_string_matcher *sm,
+                                       ds_string_slice *pattern);
+DSHDEF ds_result ds_string_matcher_build(ds_string_matcher *sm);
+DSHDEF boolean ds_string_matcher_find(ds_string_matcher *sm,
+                                      ds_string_slice *ss,
+                                      ds_string_match *match);
+DSHDEF ds_result ds_string_matcher_find_all(ds_string_matcher *sm,
+                                            ds_string_slice *ss,
+                                            ds_dynamic_array *matches);
+DSHDEF void ds_string_matcher_free(ds_string_matcher *sm);
+
+// PATTERN
+//
+// The pattern compiles globs and a practical subset of regular expressions
+// into a table driven DFA, so a string slice is matched or searched in a
+// single pass without backtracking. Many patterns can be compiled into the
+// same DFA and matched at once; the matches report which pattern matched.
+//
+// Globs support *, ?, [abc], [a-z], [!abc], {alt1,alt2} and \ escapes. A * also
+// matches /. Regular expressions support literals, ., [...] classes with
+// ranges and negation, \d \w \s (and \D \W \S), |, (...), (?:...), *, +, ?,
+// {m}, {m,} and {m,n}. A ^ at the very start and a $ at the very end anchor
+// the whole pattern (so ^a|b is ^(a|b)); they are not supported elsewhere.
+// Both work on bytes; DS_PATTERN_ICASE folds ASCII letters.
+//
+// The bytes that behave the same in every pattern are grouped into classes,
+// so each DFA state only has a transition for each class. A search finds the
+// end of the first match with the forward DFA and then its start with a DFA
+// of the reversed patterns.
+#define DS_PATTERN_GLOB 0
+#define DS_PATTERN_REGEX 1
+#define DS_PATTERN_ICASE 2
+
+#ifndef DS_PATTERN_MAX_STATES
+#define DS_PATTERN_MAX_STATES 10000
+#endif
+
+#ifndef DS_PATTERN_MAX_NODES
+#define DS_PATTERN_MAX_NODES (1024 * 1024)
+#endif
+
+typedef struct ds_pattern_dfa {
+        ds_dynamic_array transitions; // unsigned int, class_count for each state
+        ds_dynamic_array states;      // ds_pattern_dfa_state
+        ds_dynamic_array accepts;     // unsigned int, ids of accepted patterns
+} ds_pattern_dfa;
+
+typedef struct ds_pattern {
+        DS_ALLOCATOR *allocator;
+        ds_dynamic_array nodes;    // ds_pattern_node, the NFA of all patterns
+        ds_dynamic_array sets;     // unsigned char[32], byte sets of the NFA
+        ds_dynamic_array patterns; // ds_pattern_info
+        unsigned char classes[256];
+        unsigned int class_count;
+        ds_pattern_dfa forward;
+        ds_pattern_dfa reverse;
+        unsigned int match_start;
+        unsigned int search_start;
+        unsigned int reverse_start;
+        boolean built;
+} ds_pattern;
+
+DSHDEF void ds_pattern_init_allocator(ds_pattern *pt, DS_ALLOCATOR *allocator);
+DSHDEF void ds_pattern_init(ds_pattern *pt);
+DSHDEF ds_result ds_pattern_add(ds_pattern *pt, ds_string_slice *source,
+                                unsigned int flags);
+DSHDEF ds_result ds_pattern_build(ds_pattern *pt);
+DSHDEF boolean ds_pattern_match(ds_pattern *pt, ds_string_slice *ss,
+                                unsigned long *pattern);
+DSHDEF ds_result ds_pattern_match_all(ds_pattern *pt, ds_string_slice *ss,
+                                      ds_dynamic_array *patterns);
+DSHDEF boolean ds_pattern_search(ds_pattern *pt, ds_string_slice *ss,
+                                 ds_string_match *match);
+DSHDEF void ds_pattern_free(ds_pattern *pt);
+
+// STRING INTERNER
+//
+// The string interner maps the contents of string slices to canonical string
+// slices and integer ids. Each distinct string is stored once (NUL terminated)
+// in arena style blocks that are never moved, so the canonical slices stay
+// valid until the interner is freed. Two interned strings are equal exactly
+// when their ids (or their str pointers) are equal, so comparing them does not
+// need DS_MEMCMP. The lookups use an open addressing hash table, and the table
+// can be saved to and loaded from a buffer.
+#ifndef DS_SI_BLOCK_SIZE
+#define DS_SI_BLOCK_SIZE (64 * 1024)
+#endif
+
+typedef struct ds_string_interner_slot {
+        unsigned long hash;
+        unsigned long id; // id + 1, 0 for an empty slot
+} ds_string_interner_slot;
+
+typedef struct ds_string_interner {
+        DS_ALLOCATOR *allocator;
+        ds_dynamic_array strings; // ds_string_slice, indexed by id
+        ds_dynamic_array blocks;  // char *
+        unsigned long block_used;
+        unsigned long block_size;
+        ds_string_interner_slot *slots;
+        unsigned long capacity;
+} ds_string_interner;
+
+DSHDEF void ds_string_interner_init_allocator(ds_string_interner *si,
+                                              DS_ALLOCATOR *allocator);
+DSHDEF void ds_string_interner_init(ds_string_interner *si);
+DSHDEF ds_result ds_string_interner_intern(ds_string_interner *si,
+                                           ds_string_slice *ss,
+                                           unsigned long *id);
+DSHDEF ds_result ds_string_interner_intern_slice(ds_string_interner *si,
+                                                 ds_string_slice *ss,
+                                                 ds_string_slice *interned);
+DSHDEF ds_result ds_string_interner_lookup(ds_string_interner *si,
+                                           ds_string_slice *ss,
+                                           unsigned long *id);
+DSHDEF ds_result ds_string_interner_get(ds_string_interner *si,
+                                        unsigned long id,
+                                        ds_string_slice *ss);
+DSHDEF unsigned long ds_string_interner_count(ds_string_interner *si);
+DSHDEF ds_result ds_string_interner_save(ds_string_interner *si,
+                                         ds_string_builder *sb);
+DSHDEF ds_result ds_string_interner_load(ds_string_interner *si,
+                                         const char *buffer,
+                                         unsigned long len);
+DSHDEF void ds_string_interner_free(ds_string_interner *si);
+
 // IO
 //
 // The io utils are a simple set of utilities to read and write files.
@@ -619,6 +1128,498 @@ DSHDEF long ds_io_read(const char *filename, char **buffer, const char *mode);
 DSHDEF long ds_io_write(const char *filename, char *buffer,
                         unsigned long buffer_len, const char *mode);
 
+// The file is mapped read-only and the string slice is a view of the mapping,
+// so nothing is copied up front and the pages are read in by the kernel as
+// they are touched. Release the view with ds_io_unmap. On systems without mmap
+// the file is read into memory instead.
+DSHDEF ds_result ds_io_map(const char *filename, ds_string_slice *ss);
+DSHDEF void ds_io_unmap(ds_string_slice *ss);
+
+// LZ
+//
+// A fast LZ77 compressor for the LZ4 block and frame formats, so compressed
+// files can also be read and written with the lz4 tool. The compressor finds
+// matches with a single probe of a small hash table and skips faster through
+// input that does not compress, which favors speed over ratio. The decoder
+// checks every length and offset, so a corrupted input fails instead of
+// reading or writing out of bounds.
+//
+// The frames are written with independent blocks and without checksums. The
+// decoder reads any frame written by the lz4 tool (linked blocks, checksums
+// and skippable frames, but not dictionaries), and concatenated frames are
+// decoded as one stream. Use "z" in the mode of ds_io_read and ds_io_write,
+// DS_IO_WRITER_LZ with ds_io_writer_open and ds_io_reader_open_lz to read and
+// write compressed files.
+#define DS_LZ_MAGIC 0x184D2204
+#define DS_LZ_BLOCK_MAX (4 * 1024 * 1024)
+
+typedef struct ds_lz_decoder {
+        DS_ALLOCATOR *allocator;
+        long (*source)(void *context, char *buffer, unsigned long len);
+        void *context;
+        char *input;             // the compressed block
+        char *output;            // the history window, then the block
+        unsigned long allocated; // the block size the buffers have room for
+        unsigned long block_max; // the block size of the current frame
+        unsigned long history;   // the bytes of history in front of the block
+        char *start;             // the decompressed bytes not returned yet
+        char *end;
+        unsigned int flags; // the flags of the current frame
+        boolean in_frame;
+        boolean failed;
+} ds_lz_decoder;
+
+DSHDEF unsigned long ds_lz_compress_bound(unsigned long len);
+DSHDEF long ds_lz_compress(const char *src, unsigned long len, char *dst,
+                           unsigned long capacity);
+DSHDEF long ds_lz_decompress(const char *src, unsigned long len, char *dst,
+                             unsigned long capacity);
+DSHDEF void ds_lz_decoder_init_allocator(
+    ds_lz_decoder *decoder,
+    long (*source)(void *context, char *buffer, unsigned long len),
+    void *context, DS_ALLOCATOR *allocator);
+DSHDEF void ds_lz_decoder_init(ds_lz_decoder *decoder,
+                               long (*source)(void *context, char *buffer,
+                                              unsigned long len),
+                               void *context);
+DSHDEF long ds_lz_decoder_read(void *context, char *buffer, unsigned long len);
+DSHDEF void ds_lz_decoder_free(ds_lz_decoder *decoder);
+
+// IO READER
+//
+// The reader streams a file through a fixed amount of memory. It yields the
+// input as chunks or as delimited records, which are string slices into the
+// buffer of the reader and stay valid until the next call. A record that is
+// split across two reads is carried over in front of the next read, so records
+// are always contiguous. Records can be up to capacity bytes long, or up to the
+// maximum set with ds_io_reader_set_max_record, in which case the carry area
+// grows as needed. With read_ahead a worker thread reads the next block while
+// the current one is being consumed (this needs DS_THREADS, otherwise the
+// reads are done inline). The reader uses 2 * (capacity + max record) bytes at
+// most, or twice that with read_ahead.
+//
+// The source reads up to len bytes into buffer and returns the number of bytes
+// read, 0 at the end of the input or -1 in case of an error. When the reader
+// stops, failed tells an error apart from the end of the input.
+#ifndef DS_IO_READER_CAPACITY
+#define DS_IO_READER_CAPACITY (1024 * 1024)
+#endif
+
+typedef struct ds_io_reader {
+        DS_ALLOCATOR *allocator;
+        long (*source)(void *context, char *buffer, unsigned long len);
+        void *context;
+        unsigned long capacity;   // the size of a read
+        unsigned long carry;      // the size of the carry area
+        unsigned long max_record; // the longest record, the carry area grows to
+        char *blocks[2];          // carry area, then read area of capacity bytes
+        unsigned int current;
+        char *start; // the bytes not yet consumed, in blocks[current]
+        char *end;
+        boolean eof;
+        boolean failed;
+        int owned; // file descriptor opened by ds_io_reader_open, or -1
+        ds_lz_decoder *decoder; // opened by ds_io_reader_open_lz, or NULL
+#ifndef DS_NO_STDIO
+        FILE *owned_file;
+#endif
+#ifdef DS_THREADS
+        boolean read_ahead;
+        boolean requested; // the thread is reading into the other block
+        boolean ready;     // the thread is done, and returned length
+        boolean stop;
+        long length;
+        pthread_t thread;
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+#endif
+} ds_io_reader;
+
+DSHDEF ds_result ds_io_reader_init_source_allocator(
+    ds_io_reader *reader,
+    long (*source)(void *context, char *buffer, unsigned long len),
+    void *context, unsigned long capacity, boolean read_ahead,
+    DS_ALLOCATOR *allocator);
+DSHDEF ds_result ds_io_reader_init_source(
+    ds_io_reader *reader,
+    long (*source)(void *context, char *buffer, unsigned long len),
+    void *context, unsigned long capacity, boolean read_ahead);
+#ifndef DS_NO_STDIO
+DSHDEF ds_result ds_io_reader_init_file(ds_io_reader *reader, FILE *file,
+                                        unsigned long capacity,
+                                        boolean read_ahead);
+#endif
+DSHDEF ds_result ds_io_reader_init_fd(ds_io_reader *reader, int fd,
+                                      unsigned long capacity,
+                                      boolean read_ahead);
+DSHDEF ds_result ds_io_reader_open(ds_io_reader *reader, const char *filename,
+                                   unsigned long capacity, boolean read_ahead);
+DSHDEF ds_result ds_io_reader_open_lz(ds_io_reader *reader,
+                                      const char *filename,
+                                      unsigned long capacity,
+                                      boolean read_ahead);
+DSHDEF void ds_io_reader_set_max_record(ds_io_reader *reader,
+                                        unsigned long max_record);
+DSHDEF boolean ds_io_reader_read(ds_io_reader *reader, ds_string_slice *chunk);
+DSHDEF boolean ds_io_reader_read_record(ds_io_reader *reader, char delimiter,
+                                        ds_string_slice *record);
+DSHDEF boolean ds_io_reader_read_line(ds_io_reader *reader,
+                                      ds_string_slice *line);
+DSHDEF void ds_io_reader_free(ds_io_reader *reader);
+
+// IO CSV
+//
+// The CSV reader splits CSV (RFC 4180) into records of fields. The input is
+// classified 64 bytes at a time into bitmasks of quotes, delimiters and
+// newlines, and the quoted regions are found with a prefix xor of the quote
+// mask, so the field boundaries are found without looking at every byte. The
+// fields are string slices into the input, and only the fields with escaped
+// ("") quotes are copied to be unescaped. Quotes are expected around whole
+// fields, and both "\n" and "\r\n" line endings are handled.
+//
+// The input is either a buffer in memory, or a reader for streaming, in which
+// case a record is limited to the maximum record length of the reader.
+typedef struct ds_io_csv {
+        DS_ALLOCATOR *allocator;
+        ds_io_reader *reader; // the input when streaming, or NULL
+        char *start;          // the input not parsed yet, when in memory
+        char *end;
+        char delimiter;
+        ds_dynamic_array ends;       // unsigned long, field ends in the record
+        ds_string_builder unescaped; // the fields with escaped quotes
+        unsigned long long pending;  // separators of the block not handled yet
+        unsigned long long newlines; // the separators that end a record
+        unsigned long long quoted;   // all ones inside a quoted region
+        unsigned long block;         // the offset of the block in the record
+        unsigned long scanned;       // bytes of the record that were classified
+        boolean failed;
+} ds_io_csv;
+
+DSHDEF void ds_io_csv_init_allocator(ds_io_csv *csv, char *buffer,
+                                     unsigned long len, char delimiter,
+                                     DS_ALLOCATOR *allocator);
+DSHDEF void ds_io_csv_init(ds_io_csv *csv, char *buffer, unsigned long len,
+                           char delimiter);
+DSHDEF void ds_io_csv_init_reader(ds_io_csv *csv, ds_io_reader *reader,
+                                  char delimiter);
+DSHDEF boolean ds_io_csv_next(ds_io_csv *csv, ds_dynamic_array *fields);
+DSHDEF void ds_io_csv_free(ds_io_csv *csv);
+
+// IO WRITER
+//
+// The writer buffers the output to a file descriptor and writes it out in
+// large blocks. A write that does not fit in the buffer goes out together
+// with the buffered bytes in a single writev, so large writes are not copied.
+// With DS_IO_WRITER_DIRECT the file is opened with O_DIRECT (where available)
+// to bypass the page cache: the buffer is aligned to DS_IO_WRITER_ALIGNMENT
+// and only whole blocks are written, until a flush writes the unaligned tail
+// through the page cache. With DS_IO_WRITER_LZ the output is compressed into
+// LZ4 frames, one block per buffer (of at most DS_LZ_BLOCK_MAX bytes), and
+// DS_IO_WRITER_DIRECT is ignored. Each flush ends the frame, so the file is
+// complete after every flush. Call ds_io_writer_flush to write out the rest
+// before freeing the writer.
+#define DS_IO_WRITER_APPEND 1
+#define DS_IO_WRITER_DIRECT 2
+#define DS_IO_WRITER_LZ 4
+
+#ifndef DS_IO_WRITER_CAPACITY
+#define DS_IO_WRITER_CAPACITY (1024 * 1024)
+#endif
+
+#ifndef DS_IO_WRITER_ALIGNMENT
+#define DS_IO_WRITER_ALIGNMENT 4096
+#endif
+
+// O_DIRECT is only declared by glibc when _GNU_SOURCE is defined
+#if defined(O_DIRECT)
+#define DS_O_DIRECT O_DIRECT
+#elif defined(__linux__) && (defined(__x86_64__) || defined(__i386__))
+#define DS_O_DIRECT 040000
+#elif defined(__linux__) && (defined(__aarch64__) || defined(__arm__))
+#define DS_O_DIRECT 0200000
+#endif
+
+typedef struct ds_io_writer {
+        DS_ALLOCATOR *allocator;
+        int fd;
+        boolean owned;
+        char *memory; // the allocation, the buffer is aligned inside it
+        char *buffer;
+        unsigned long capacity;
+        unsigned long count;
+        unsigned long alignment; // 0 unless the file is opened with O_DIRECT
+        char *frame;    // the compressed block with DS_IO_WRITER_LZ, or NULL
+        boolean framed; // a frame was started and not ended yet
+} ds_io_writer;
+
+DSHDEF ds_result ds_io_writer_init_allocator(ds_io_writer *writer, int fd,
+                                             unsigned long capacity,
+                                             DS_ALLOCATOR *allocator);
+DSHDEF ds_result ds_io_writer_init(ds_io_writer *writer, int fd,
+                                   unsigned long capacity);
+DSHDEF ds_result ds_io_writer_open(ds_io_writer *writer, const char *filename,
+                                   unsigned int flags, unsigned long capacity);
+DSHDEF ds_result ds_io_writer_write(ds_io_writer *writer, const char *str,
+                                    unsigned long len);
+DSHDEF ds_result ds_io_writer_writev(ds_io_writer *writer,
+                                     const ds_string_slice *slices,
+                                     unsigned long count);
+DSHDEF ds_result ds_io_writer_flush(ds_io_writer *writer);
+DSHDEF void ds_io_writer_free(ds_io_writer *writer);
+
+// IO BATCH
+//
+// The batch runs many reads and writes at once and completes them out of
+// order. Each request reads or writes len bytes at offset in a file
+// descriptor. A read with a NULL buffer gets a buffer of len bytes from the
+// allocator of the batch (e.g. an arena), which the caller frees. When a
+// request completes, result is the number of bytes transferred or -errno.
+//
+// On Linux the requests go through io_uring (5.6 or newer) with raw system
+// calls. Elsewhere, or when io_uring is not available, they are run by a pool
+// of DS_IO_BATCH_THREADS worker threads (or inline without DS_THREADS). At
+// most depth requests can be in flight. The requests must stay valid until
+// they complete.
+#define DS_IO_OP_READ 0
+#define DS_IO_OP_WRITE 1
+
+#ifndef DS_IO_BATCH_THREADS
+#define DS_IO_BATCH_THREADS 8
+#endif
+
+#if defined(__linux__) && defined(DS_POSIX) && !defined(DS_IO_NO_URING)
+#define DS_IO_URING
+#include <sys/syscall.h>
+#endif
+
+// syscall, pread and pwrite are not declared by glibc in the strict modes
+// (e.g. -std=c99 without feature test macros)
+#if defined(DS_IO_URING) && defined(__GLIBC__) && !defined(__USE_MISC)
+extern long syscall(long number, ...);
+#endif
+#if defined(DS_POSIX) && defined(__GLIBC__) && !defined(__USE_XOPEN2K8) &&     \
+    !defined(__USE_UNIX98)
+extern ssize_t pread(int fd, void *buf, size_t count, off_t offset);
+extern ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset);
+#endif
+
+typedef struct ds_io_request {
+        unsigned int op; // DS_IO_OP_READ or DS_IO_OP_WRITE
+        int fd;
+        char *buffer;
+        unsigned long len;
+        unsigned long offset;
+        long result;
+        void *data; // for the caller
+} ds_io_request;
+
+typedef struct ds_io_batch {
+        DS_ALLOCATOR *allocator;
+        unsigned int depth;
+        unsigned long pending; // submitted and not completed yet
+        int ring;              // the io_uring file descriptor, or -1
+#ifdef DS_IO_URING
+        void *sq_map;
+        unsigned long sq_map_size;
+        void *cq_map;
+        unsigned long cq_map_size;
+        void *sqes;
+        unsigned long sqes_size;
+        unsigned int *sq_head;
+        unsigned int *sq_tail;
+        unsigned int *sq_mask;
+        unsigned int *sq_array;
+        unsigned int *cq_head;
+        unsigned int *cq_tail;
+        unsigned int *cq_mask;
+        void *cqes;
+        unsigned int unsubmitted;
+#endif
+        ds_io_request **queue; // depth requests for the workers
+        unsigned long queue_head;
+        unsigned long queue_count;
+        ds_io_request **done; // depth completed requests
+        unsigned long done_head;
+        unsigned long done_count;
+#ifdef DS_THREADS
+        pthread_t *threads;
+        unsigned long thread_count;
+        boolean stop;
+        pthread_mutex_t mutex;
+        pthread_cond_t work;
+        pthread_cond_t finished;
+#endif
+} ds_io_batch;
+
+DSHDEF ds_result ds_io_batch_init_allocator(ds_io_batch *batch,
+                                            unsigned int depth,
+                                            DS_ALLOCATOR *allocator);
+DSHDEF ds_result ds_io_batch_init(ds_io_batch *batch, unsigned int depth);
+DSHDEF ds_result ds_io_batch_submit(ds_io_batch *batch,
+                                    ds_io_request *requests,
+                                    unsigned long count);
+DSHDEF boolean ds_io_batch_complete(ds_io_batch *batch,
+                                    ds_io_request **request);
+DSHDEF ds_result ds_io_batch_run(ds_io_batch *batch, ds_io_request *requests,
+                                 unsigned long count);
+DSHDEF void ds_io_batch_free(ds_io_batch *batch);
+
+// IO LOADER
+//
+// The loader reads many files concurrently on worker threads. The contents of
+// all the files share one block of memory allocated with the allocator of the
+// loader (e.g. an arena), so freeing them is a single free or clear. The
+// files are sized first and read afterwards, so a file that grows in between
+// is cut to the size it had. The files keep the order of the paths, and each
+// has its own error.
+#ifndef DS_IO_LOADER_THREADS
+#define DS_IO_LOADER_THREADS 16
+#endif
+
+typedef struct ds_io_file {
+        const char *path;
+        ds_string_slice content; // NUL terminated, in the memory of the loader
+        int error;               // 0, or the errno of the failure
+} ds_io_file;
+
+typedef struct ds_io_loader {
+        DS_ALLOCATOR *allocator;
+        ds_io_file *files;
+        unsigned long count;
+        char *memory;
+        unsigned long next; // the next file for the workers
+} ds_io_loader;
+
+DSHDEF void ds_io_loader_init_allocator(ds_io_loader *loader,
+                                        DS_ALLOCATOR *allocator);
+DSHDEF void ds_io_loader_init(ds_io_loader *loader);
+DSHDEF ds_result ds_io_loader_load(ds_io_loader *loader, const char **paths,
+                                   unsigned long count, unsigned long threads);
+DSHDEF void ds_io_loader_free(ds_io_loader *loader);
+
+// IO WALK
+//
+// The walker visits a directory tree on worker threads: each subdirectory it
+// finds is queued and read by the next idle worker. On Linux the directories
+// are read with getdents64 into buffers of DS_IO_WALK_BUFFER bytes, so one
+// system call returns thousands of entries, and elsewhere with readdir. The
+// type of an entry comes from its directory entry, and it is only stat'ed when
+// the file system does not report it. Symbolic links are reported, and not
+// followed.
+//
+// The include and exclude patterns (built ds_pattern, e.g. globs) match the
+// path of an entry relative to the root. Since a * also matches /, the glob
+// *.c matches at any depth. An excluded entry is skipped, and so is the tree
+// below an excluded directory. With include patterns only the entries that
+// match are reported, but every directory that is not excluded is walked.
+//
+// The entries are reported to the callback, which is called from all the
+// workers at the same time and stops the walk by returning false. Without a
+// callback they are appended to the entries of the walker, in no particular
+// order, with the paths allocated with the allocator of the walker.
+#define DS_IO_WALK_FILE 0
+#define DS_IO_WALK_DIRECTORY 1
+#define DS_IO_WALK_LINK 2
+#define DS_IO_WALK_OTHER 3
+
+#ifndef DS_IO_WALK_THREADS
+#define DS_IO_WALK_THREADS 8
+#endif
+
+#ifndef DS_IO_WALK_BUFFER
+#define DS_IO_WALK_BUFFER (256 * 1024)
+#endif
+
+#ifndef DS_IO_WALK_PATH
+#define DS_IO_WALK_PATH 4096
+#endif
+
+typedef struct ds_io_entry {
+        ds_string_slice path;   // the root, then the relative path (NUL ended)
+        unsigned long relative; // the offset of the relative path in path
+        unsigned int type;      // DS_IO_WALK_FILE, DS_IO_WALK_DIRECTORY, ...
+} ds_io_entry;
+
+typedef struct ds_io_walker {
+        DS_ALLOCATOR *allocator;
+        ds_pattern *include; // NULL to report every entry
+        ds_pattern *exclude; // NULL to walk every entry
+        boolean (*callback)(void *context, const ds_io_entry *entry);
+        void *context;
+        ds_dynamic_array entries; // ds_io_entry, when there is no callback
+        ds_dynamic_array blocks;  // char *, the memory of the paths
+        unsigned long errors;     // entries that could not be read
+        ds_dynamic_array queue;   // char *, the directories to read
+        unsigned long active;     // the directories queued or being read
+        boolean stop;
+        boolean failed;
+#ifdef DS_THREADS
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+#endif
+} ds_io_walker;
+
+DSHDEF void ds_io_walker_init_allocator(ds_io_walker *walker,
+                                        DS_ALLOCATOR *allocator);
+DSHDEF void ds_io_walker_init(ds_io_walker *walker);
+DSHDEF void ds_io_walker_set_filters(ds_io_walker *walker, ds_pattern *include,
+                                     ds_pattern *exclude);
+DSHDEF void ds_io_walker_set_callback(
+    ds_io_walker *walker,
+    boolean (*callback)(void *context, const ds_io_entry *entry),
+    void *context);
+DSHDEF ds_result ds_io_walker_walk(ds_io_walker *walker, const char *root,
+                                   unsigned long threads);
+DSHDEF void ds_io_walker_free(ds_io_walker *walker);
+
+// IO LOG
+//
+// The log appends records to a file durably: ds_io_log_append returns once
+// the record is on disk. Each record is framed by its length and the CRC32C
+// of the length and the contents. When the log is opened it is scanned, and a
+// torn tail left by a crash (a record cut short or with a bad checksum) is
+// truncated, so the log always ends after its last complete record. The
+// records can be read back with ds_io_map and ds_io_log_next.
+//
+// With DS_IO_LOG_GROUP_COMMIT many threads can append at once. The records
+// that arrive while a commit is in progress are written together by the next
+// commit, with a single write and fdatasync, so the cost of a sync is shared
+// by all of them. Without it (or without DS_THREADS) every append is its own
+// write and fdatasync, and the appends must not be concurrent. After a failed
+// append the log must be reopened.
+#define DS_IO_LOG_GROUP_COMMIT 1
+#define DS_IO_LOG_HEADER 8 // the length and the checksum of a record
+
+typedef struct ds_io_log {
+        DS_ALLOCATOR *allocator;
+        int fd;
+        unsigned long size; // the end of the last complete record
+        boolean group_commit;
+        boolean failed; // a write failed, the log must be reopened
+#ifdef DS_THREADS
+        char *pending; // the framed records of the next commit
+        unsigned long pending_count;
+        unsigned long pending_capacity;
+        char *committing; // the framed records of the commit in progress
+        unsigned long committing_capacity;
+        unsigned long started;   // the number of commits started
+        unsigned long committed; // the number of commits on disk
+        boolean leader;          // a commit is in progress
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+#endif
+} ds_io_log;
+
+DSHDEF ds_result ds_io_log_open_allocator(ds_io_log *log, const char *filename,
+                                          unsigned int flags,
+                                          DS_ALLOCATOR *allocator);
+DSHDEF ds_result ds_io_log_open(ds_io_log *log, const char *filename,
+                                unsigned int flags);
+DSHDEF ds_result ds_io_log_append(ds_io_log *log, const char *record,
+                                  unsigned long len);
+DSHDEF boolean ds_io_log_next(ds_string_slice *log, ds_string_slice *record);
+DSHDEF void ds_io_log_free(ds_io_log *log);
+
 
 // PRIORITY QUEUE
 //
@@ -672,6 +1673,34 @@ DSHDEF ds_result ds_linked_list_pop_front(ds_linked_list *ll, void *item);
 DSHDEF boolean ds_linked_list_empty(ds_linked_list *ll);
 DSHDEF void ds_linked_list_free(ds_linked_list *ll);
 
+// HASH
+//
+// Fast non-cryptographic hash functions for keys. ds_hash_bytes is a wyhash
+// style hash that is tuned for short keys, and ds_hash_ulong is an integer
+// mixer. Both use a global seed that can be set with ds_hash_set_seed (e.g. to
+// a random value against hash flooding), and the _seeded variants take the
+// seed explicitly. The ds_hashmap_hash_* and ds_hashmap_compare_* functions
+// can be used directly as ds_hashmap callbacks. ds_crc32c is a checksum for
+// detecting corrupted data.
+DSHDEF void ds_hash_set_seed(unsigned long seed);
+DSHDEF unsigned long ds_hash_bytes_seeded(const void *data, unsigned long len,
+                                          unsigned long seed);
+DSHDEF unsigned long ds_hash_bytes(const void *data, unsigned long len);
+DSHDEF unsigned long ds_hash_string_slice(ds_string_slice *ss);
+DSHDEF unsigned long ds_hash_ulong_seeded(unsigned long value,
+                                          unsigned long seed);
+DSHDEF unsigned long ds_hash_ulong(unsigned long value);
+DSHDEF unsigned int ds_crc32c(unsigned int crc, const void *data,
+                              unsigned long len);
+DSHDEF unsigned long ds_hashmap_hash_str(const void *key);
+DSHDEF unsigned long ds_hashmap_hash_string_slice(const void *key);
+DSHDEF unsigned long ds_hashmap_hash_ulong(const void *key);
+DSHDEF unsigned long ds_hashmap_hash_string(const void *key);
+DSHDEF int ds_hashmap_compare_str(const void *key1, const void *key2);
+DSHDEF int ds_hashmap_compare_string_slice(const void *key1, const void *key2);
+DSHDEF int ds_hashmap_compare_string(const void *key1, const void *key2);
+DSHDEF int ds_hashmap_compare_ulong(const void *key1, const void *key2);
+
 // HASH MAP
 //
 // The hash map is a simple table that uses a hash function to store and
@@ -778,12 +1807,20 @@ DSHDEF void ds_argparse_parser_free(ds_argparse_parser *parser);
 #define DS_SB_IMPLEMENTATION
 #endif // DS_IO_IMPLEMENTATION
 
+#ifdef DS_SI_IMPLEMENTATION
+#define DS_SB_IMPLEMENTATION
+#define DS_HASH_IMPLEMENTATION
+#endif // DS_SI_IMPLEMENTATION
+
 #ifdef DS_SB_IMPLEMENTATION
 #define DS_DA_IMPLEMENTATION
+#define DS_UTF8_IMPLEMENTATION
+#define DS_HASH_IMPLEMENTATION
 #endif // DS_SB_IMPLEMENTATION
 
 #ifdef DS_HM_IMPLEMENTATION
 #define DS_DA_IMPLEMENTATION
+#define DS_HASH_IMPLEMENTATION
 #endif // DS_HM_IMPLEMENTATION
 
 #ifdef DS_PQ_IMPLEMENTATION
@@ -948,6 +1985,7 @@ DSHDEF void ds_dynamic_array_init_allocator(ds_dynamic_array *da,
     da->item_size = item_size;
     da->count = 0;
     da->capacity = 0;
+    da->mapped = false;
 }
 
 // Initialize the dynamic array
@@ -958,30 +1996,121 @@ DSHDEF void ds_dynamic_array_init(ds_dynamic_array *da,
     ds_dynamic_array_init_allocator(da, item_size, NULL);
 }
 
-// Append an item to the dynamic array
+#ifdef DS_DA_MMAP
+// Round a size in bytes up to a multiple of the page size
+static unsigned long ds_dynamic_array_map_size(unsigned long size) {
+    unsigned long page = (unsigned long)sysconf(_SC_PAGESIZE);
+    return (size + page - 1) & ~(page - 1);
+}
+#endif
+
+// Resize the items of the dynamic array to hold new_capacity items
 //
-// Returns 0 if the item was appended successfully, 1 if the array could not be
-// reallocated.
-DSHDEF ds_result ds_dynamic_array_append(ds_dynamic_array *da,
-                                         const void *item) {
+// Returns 0 if the items were resized successfully, 1 if the array could not be
+// reallocated. On failure the array is left unchanged.
+static ds_result ds_dynamic_array_resize(ds_dynamic_array *da,
+                                         unsigned long new_capacity) {
     ds_result result = DS_OK;
 
-    if (da->count >= da->capacity) {
-        unsigned long new_capacity = da->capacity * 2;
-        if (new_capacity == 0) {
-            new_capacity = DS_DA_INIT_CAPACITY;
+    unsigned long old_size = da->capacity * da->item_size;
+    unsigned long new_size = new_capacity * da->item_size;
+    void *items = NULL;
+
+#ifdef DS_DA_MMAP
+    if (new_size >= DS_DA_MMAP_THRESHOLD && da->allocator == NULL) {
+        if (da->mapped) {
+            items = mremap(da->items, ds_dynamic_array_map_size(old_size),
+                           ds_dynamic_array_map_size(new_size),
+                           MREMAP_MAYMOVE);
+        } else {
+            items = mmap(NULL, ds_dynamic_array_map_size(new_size),
+                         PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                         -1, 0);
+            if (items != MAP_FAILED && da->items != NULL) {
+                DS_MEMCPY(items, da->items, da->count * da->item_size);
+                DS_FREE(da->allocator, da->items);
+            }
+        }
+
+        if (items == MAP_FAILED) {
+            DS_LOG_ERROR("Failed to map dynamic array");
+            return_defer(DS_ERR);
         }
 
-        da->items =
-            DS_REALLOC(da->allocator, da->items, da->capacity * da->item_size,
-                       new_capacity * da->item_size);
+        da->items = items;
+        da->capacity = new_capacity;
+        da->mapped = true;
+        return_defer(DS_OK);
+    }
 
-        if (da->items == NULL) {
+    // Shrinking below the threshold moves the items back to the allocator
+    if (da->mapped) {
+        items = DS_MALLOC(da->allocator, new_size);
+        if (items == NULL) {
             DS_LOG_ERROR("Failed to reallocate dynamic array");
             return_defer(DS_ERR);
         }
 
+        DS_MEMCPY(items, da->items,
+                  DS_MIN(da->count * da->item_size, new_size));
+        munmap(da->items, ds_dynamic_array_map_size(old_size));
+
+        da->items = items;
         da->capacity = new_capacity;
+        da->mapped = false;
+        return_defer(DS_OK);
+    }
+#else
+    (void)old_size;
+#endif
+
+    items = DS_REALLOC(da->allocator, da->items, old_size, new_size);
+    if (items == NULL) {
+        DS_LOG_ERROR("Failed to reallocate dynamic array");
+        return_defer(DS_ERR);
+    }
+
+    da->items = items;
+    da->capacity = new_capacity;
+
+defer:
+    return result;
+}
+
+// Reserve space in the dynamic array for at least capacity items
+//
+// The capacity is doubled until it can hold the requested number of items.
+// Returns 0 if the space was reserved successfully, 1 if the array could not be
+// reallocated.
+DSHDEF ds_result ds_dynamic_array_reserve(ds_dynamic_array *da,
+                                          unsigned long capacity) {
+    if (capacity <= da->capacity) {
+        return DS_OK;
+    }
+
+    unsigned long new_capacity = da->capacity;
+    if (new_capacity == 0) {
+        new_capacity = DS_DA_INIT_CAPACITY;
+    }
+    while (new_capacity < capacity) {
+        new_capacity *= 2;
+    }
+
+    return ds_dynamic_array_resize(da, new_capacity);
+}
+
+// Append an item to the dynamic array
+//
+// Returns 0 if the item was appended successfully, 1 if the array could not be
+// reallocated.
+DSHDEF ds_result ds_dynamic_array_append(ds_dynamic_array *da,
+                                         const void *item) {
+    ds_result result = DS_OK;
+
+    if (da->count >= da->capacity) {
+        if (ds_dynamic_array_reserve(da, da->count + 1) != DS_OK) {
+            return_defer(DS_ERR);
+        }
     }
 
     DS_MEMCPY((char *)da->items + da->count * da->item_size, item,
@@ -1024,18 +2153,8 @@ DSHDEF ds_result ds_dynamic_array_append_many(ds_dynamic_array *da,
     ds_result result = DS_OK;
 
     if (da->count + new_items_count > da->capacity) {
-        if (da->capacity == 0) {
-            da->capacity = DS_DA_INIT_CAPACITY;
-        }
-        while (da->count + new_items_count > da->capacity) {
-            da->capacity *= 2;
-        }
-
-        da->items =
-            DS_REALLOC(da->allocator, da->items, da->capacity * da->item_size,
-                       da->capacity * da->item_size);
-        if (da->items == NULL) {
-            DS_LOG_ERROR("Failed to reallocate dynamic array");
+        if (ds_dynamic_array_reserve(da, da->count + new_items_count) !=
+            DS_OK) {
             return_defer(DS_ERR);
         }
     }
@@ -1091,15 +2210,14 @@ DSHDEF ds_result ds_dynamic_array_copy(ds_dynamic_array *da,
                                        ds_dynamic_array *copy) {
     ds_result result = DS_OK;
 
-    copy->items = DS_MALLOC(da->allocator, da->capacity * da->item_size);
-    if (copy->items == NULL) {
+    ds_dynamic_array_init_allocator(copy, da->item_size, da->allocator);
+    if (da->capacity > 0 &&
+        ds_dynamic_array_resize(copy, da->capacity) != DS_OK) {
         DS_LOG_ERROR("Failed to allocate dynamic array items");
         return_defer(DS_ERR);
     }
 
-    copy->item_size = da->item_size;
     copy->count = da->count;
-    copy->capacity = da->capacity;
 
     DS_MEMCPY(copy->items, da->items, da->count * da->item_size);
 
@@ -1194,7 +2312,7 @@ DSHDEF ds_result ds_dynamic_array_delete(ds_dynamic_array *da,
         return_defer(DS_ERR);
     }
 
-    unsigned int n = da->count - index - 1;
+    unsigned long n = da->count - index - 1;
 
     if (n > 0) {
         void *dest = NULL;
@@ -1209,7 +2327,7 @@ DSHDEF ds_result ds_dynamic_array_delete(ds_dynamic_array *da,
             return_defer(DS_ERR);
         }
 
-        DS_MEMCPY(dest, src, n * da->item_size);
+        DS_MEMMOVE(dest, src, n * da->item_size);
     }
 
     da->count -= 1;
@@ -1220,6 +2338,13 @@ defer:
 
 // Free the dynamic array
 DSHDEF void ds_dynamic_array_free(ds_dynamic_array *da) {
+#ifdef DS_DA_MMAP
+    if (da->mapped) {
+        munmap(da->items,
+               ds_dynamic_array_map_size(da->capacity * da->item_size));
+        da->items = NULL;
+    }
+#endif
     if (da->items != NULL) {
         DS_FREE(da->allocator, da->items);
     }
@@ -1228,15 +2353,61 @@ DSHDEF void ds_dynamic_array_free(ds_dynamic_array *da) {
     da->items = NULL;
     da->count = 0;
     da->capacity = 0;
+    da->mapped = false;
 }
 
 #endif // DS_DA_IMPLEMENTATION
 
 #ifdef DS_SB_IMPLEMENTATION
 
+#ifdef DS_POSIX
+#ifndef DS_IOV_MAX
+#define DS_IOV_MAX 1024
+#endif
+
+// Write all the buffers to the file descriptor with writev, retrying on
+// partial writes and interrupts. The iovec array is modified: each iov_len is
+// left with the bytes of the buffer that were not written, which tells what
+// went out before an error.
+//
+// Returns the number of bytes written, or -1 in case of an error.
+static long ds_writev_all(int fd, struct iovec *iov, unsigned long count) {
+    long total = 0;
+
+    while (count > 0) {
+        int batch = (int)DS_MIN(count, DS_IOV_MAX);
+        ssize_t written = writev(fd, iov, batch);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            DS_LOG_ERROR("Failed to write to file descriptor %d", fd);
+            return -1;
+        }
+        total += written;
+
+        while (count > 0 && (unsigned long)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov->iov_len = 0;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+
+    return total;
+}
+#endif
+
 DSHDEF void ds_string_builder_init_allocator(ds_string_builder *sb,
                                              DS_ALLOCATOR *allocator) {
     ds_dynamic_array_init_allocator(&sb->items, sizeof(char), allocator);
+    sb->sink = NULL;
+    sb->context = NULL;
+    sb->threshold = 0;
 }
 
 // Initialize the string builder
@@ -1244,45 +2415,210 @@ DSHDEF void ds_string_builder_init(ds_string_builder *sb) {
     ds_string_builder_init_allocator(sb, NULL);
 }
 
-// Append a formatted string to the string builder
+// Initialize the string builder with a sink and a custom allocator
 //
-// Returns 0 if the string was appended successfully.
-DSHDEF ds_result ds_string_builder_appendn(ds_string_builder *sb,
-                                           const char *str, unsigned long len) {
-    return ds_dynamic_array_append_many(&sb->items, (void **)str, len);
+// The sink is called with the buffered output each time it reaches threshold
+// bytes (DS_SB_SINK_THRESHOLD if threshold is 0). The buffer is allocated
+// once up front.
+DSHDEF void ds_string_builder_init_sink_allocator(
+    ds_string_builder *sb,
+    ds_result (*sink)(void *context, const char *str, unsigned long len),
+    void *context, unsigned long threshold, DS_ALLOCATOR *allocator) {
+    ds_string_builder_init_allocator(sb, allocator);
+    sb->sink = sink;
+    sb->context = context;
+    sb->threshold = threshold > 0 ? threshold : DS_SB_SINK_THRESHOLD;
+
+    // Not being able to allocate here is not fatal, the appends will retry
+    ds_dynamic_array_reserve(&sb->items, sb->threshold + 1);
 }
 
-// Append a formatted string to the string builder
-//
-// Returns 0 if the string was appended successfully.
-DSHDEF ds_result ds_string_builder_append(ds_string_builder *sb,
-                                          const char *format, ...) {
-    ds_result result = DS_OK;
-
-    va_list args;
-    va_start(args, format);
-    int needed = vsnprintf(NULL, 0, format, args);
-    va_end(args);
+// Initialize the string builder with a sink
+DSHDEF void ds_string_builder_init_sink(
+    ds_string_builder *sb,
+    ds_result (*sink)(void *context, const char *str, unsigned long len),
+    void *context, unsigned long threshold) {
+    ds_string_builder_init_sink_allocator(sb, sink, context, threshold, NULL);
+}
 
-    char *buffer = DS_MALLOC(sb->items.allocator, needed + 1);
-    if (buffer == NULL) {
-        DS_LOG_ERROR("Failed to allocate string");
-        return_defer(DS_ERR);
+#ifndef DS_NO_STDIO
+static ds_result ds_string_builder_sink_file(void *context, const char *str,
+                                             unsigned long len) {
+    if (fwrite(str, sizeof(char), len, (FILE *)context) != len) {
+        DS_LOG_ERROR("Failed to write to file");
+        return DS_ERR;
     }
+    return DS_OK;
+}
 
-    va_start(args, format);
-    vsnprintf(buffer, needed + 1, format, args);
-    va_end(args);
+// Initialize the string builder to write to a file
+//
+// The output is written to the file in blocks of threshold bytes.
+DSHDEF void ds_string_builder_init_file(ds_string_builder *sb, FILE *file,
+                                        unsigned long threshold) {
+    ds_string_builder_init_sink(sb, ds_string_builder_sink_file, file,
+                                threshold);
+}
+#endif
 
-    if (ds_dynamic_array_append_many(&sb->items, (void **)buffer, needed) !=
-        DS_OK) {
+static ds_result ds_string_builder_sink_fd(void *context, const char *str,
+                                           unsigned long len) {
+#ifdef DS_POSIX
+    struct iovec iov = {.iov_base = (void *)str, .iov_len = len};
+    return ds_writev_all((int)(long)context, &iov, 1) < 0 ? DS_ERR : DS_OK;
+#else
+    (void)(context);
+    (void)(str);
+    (void)(len);
+    DS_LOG_ERROR("Writing to a file descriptor requires POSIX");
+    return DS_ERR;
+#endif
+}
+
+// Initialize the string builder to write to a file descriptor
+//
+// The output is written to the file descriptor in blocks of threshold bytes.
+DSHDEF void ds_string_builder_init_fd(ds_string_builder *sb, int fd,
+                                      unsigned long threshold) {
+    ds_string_builder_init_sink(sb, ds_string_builder_sink_fd,
+                                (void *)(long)fd, threshold);
+}
+
+// Hand the buffered output of the string builder to its sink
+//
+// The string builder is empty afterwards. Does nothing if the string builder
+// has no sink.
+//
+// Returns 0 if the output was written successfully, 1 if the sink failed.
+DSHDEF ds_result ds_string_builder_flush(ds_string_builder *sb) {
+    ds_result result = DS_OK;
+
+    if (sb->sink == NULL || sb->items.count == 0) {
+        return_defer(DS_OK);
+    }
+
+    if (sb->sink(sb->context, (const char *)sb->items.items,
+                 sb->items.count) != DS_OK) {
         return_defer(DS_ERR);
     }
 
+    sb->items.count = 0;
+
 defer:
-    if (buffer != NULL) {
-        DS_FREE(sb->items.allocator, buffer);
+    return result;
+}
+
+// Flush the string builder if it has a sink and the buffer is full
+static ds_result ds_string_builder_flush_full(ds_string_builder *sb) {
+    if (sb->sink != NULL && sb->items.count >= sb->threshold) {
+        return ds_string_builder_flush(sb);
+    }
+    return DS_OK;
+}
+
+// Append a formatted string to the string builder
+//
+// With a sink, the buffer is topped up to the threshold and flushed, so the
+// sink is handed blocks of exactly threshold bytes. Strings that are larger
+// than the threshold are not buffered, but handed to the sink right after the
+// buffered output.
+//
+// Returns 0 if the string was appended successfully.
+DSHDEF ds_result ds_string_builder_appendn(ds_string_builder *sb,
+                                           const char *str, unsigned long len) {
+    if (sb->sink != NULL && len >= sb->threshold) {
+        if (ds_string_builder_flush(sb) != DS_OK) {
+            return DS_ERR;
+        }
+        return sb->sink(sb->context, str, len);
+    }
+
+    if (sb->sink != NULL && sb->items.count + len > sb->threshold &&
+        sb->items.count < sb->threshold) {
+        unsigned long fit = sb->threshold - sb->items.count;
+        if (ds_dynamic_array_append_many(&sb->items, (void **)str, fit) !=
+                DS_OK ||
+            ds_string_builder_flush(sb) != DS_OK) {
+            return DS_ERR;
+        }
+        str += fit;
+        len -= fit;
+    }
+
+    if (ds_dynamic_array_append_many(&sb->items, (void **)str, len) != DS_OK) {
+        return DS_ERR;
+    }
+
+    return ds_string_builder_flush_full(sb);
+}
+
+// Append a formatted string to the string builder
+//
+// The string is formatted straight into the free space at the end of the
+// string builder. Only if it does not fit, the string builder is grown and the
+// string is formatted again. With a sink the buffer is never grown; a string
+// that does not fit is formatted separately and appended with
+// ds_string_builder_appendn.
+//
+// Returns 0 if the string was appended successfully.
+DSHDEF ds_result ds_string_builder_append(ds_string_builder *sb,
+                                          const char *format, ...) {
+    ds_result result = DS_OK;
+    ds_dynamic_array *items = &sb->items;
+
+    if (ds_dynamic_array_reserve(items, items->count + 1) != DS_OK) {
+        return_defer(DS_ERR);
+    }
+
+    unsigned long available = items->capacity - items->count;
+
+    va_list args;
+    va_start(args, format);
+    int needed = vsnprintf((char *)items->items + items->count, available,
+                           format, args);
+    va_end(args);
+
+    if (needed < 0) {
+        DS_LOG_ERROR("Failed to format string");
+        return_defer(DS_ERR);
+    }
+
+    if ((unsigned long)needed >= available && sb->sink != NULL) {
+        // Growing the buffer of a sink would keep it large for good, so the
+        // string is formatted on its own and handed to appendn, which writes
+        // it out in blocks of at most threshold bytes
+        char *str = DS_MALLOC(items->allocator, needed + 1);
+        if (str == NULL) {
+            DS_LOG_ERROR("Failed to allocate string");
+            return_defer(DS_ERR);
+        }
+
+        va_start(args, format);
+        vsnprintf(str, needed + 1, format, args);
+        va_end(args);
+
+        result = ds_string_builder_appendn(sb, str, needed);
+        DS_FREE(items->allocator, str);
+        return_defer(result);
+    }
+
+    if ((unsigned long)needed >= available) {
+        if (ds_dynamic_array_reserve(items, items->count + needed + 1) !=
+            DS_OK) {
+            return_defer(DS_ERR);
+        }
+
+        va_start(args, format);
+        vsnprintf((char *)items->items + items->count, needed + 1, format,
+                  args);
+        va_end(args);
     }
+
+    items->count += needed;
+
+    result = ds_string_builder_flush_full(sb);
+
+defer:
     return result;
 }
 
@@ -1290,7 +2626,207 @@ defer:
 //
 // Returns 0 if the character was appended successfully.
 DSHDEF ds_result ds_string_builder_appendc(ds_string_builder *sb, char chr) {
-    return ds_dynamic_array_append(&sb->items, &chr);
+    if (ds_dynamic_array_append(&sb->items, &chr) != DS_OK) {
+        return DS_ERR;
+    }
+
+    return ds_string_builder_flush_full(sb);
+}
+
+static const char ds_digit_pairs[] = "00010203040506070809"
+                                     "10111213141516171819"
+                                     "20212223242526272829"
+                                     "30313233343536373839"
+                                     "40414243444546474849"
+                                     "50515253545556575859"
+                                     "60616263646566676869"
+                                     "70717273747576777879"
+                                     "80818283848586878889"
+                                     "90919293949596979899";
+
+// Write the decimal digits of value backwards, ending right before end
+//
+// Returns a pointer to the first digit.
+static char *ds_format_ulong(char *end, unsigned long value) {
+    while (value >= 100) {
+        unsigned long pair = (value % 100) * 2;
+        value /= 100;
+        *--end = ds_digit_pairs[pair + 1];
+        *--end = ds_digit_pairs[pair];
+    }
+
+    if (value >= 10) {
+        *--end = ds_digit_pairs[value * 2 + 1];
+        *--end = ds_digit_pairs[value * 2];
+    } else {
+        *--end = (char)('0' + value);
+    }
+
+    return end;
+}
+
+// Append an unsigned number in decimal to the string builder, without going
+// through printf
+//
+// Returns 0 if the number was appended successfully.
+DSHDEF ds_result ds_string_builder_append_ulong(ds_string_builder *sb,
+                                                unsigned long value) {
+    char buffer[24];
+    char *start = ds_format_ulong(buffer + sizeof(buffer), value);
+    return ds_string_builder_appendn(sb, start,
+                                     buffer + sizeof(buffer) - start);
+}
+
+// Append a signed number in decimal to the string builder, without going
+// through printf
+//
+// Returns 0 if the number was appended successfully.
+DSHDEF ds_result ds_string_builder_append_long(ds_string_builder *sb,
+                                               long value) {
+    char buffer[24];
+    unsigned long magnitude =
+        value < 0 ? 0UL - (unsigned long)value : (unsigned long)value;
+    char *start = ds_format_ulong(buffer + sizeof(buffer), magnitude);
+    if (value < 0) {
+        *--start = '-';
+    }
+    return ds_string_builder_appendn(sb, start,
+                                     buffer + sizeof(buffer) - start);
+}
+
+static const double ds_pow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                  1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                  1e18, 1e19, 1e20, 1e21, 1e22};
+
+static const unsigned long long ds_pow5[] = {
+    1ULL,          5ULL,           25ULL,           125ULL,
+    625ULL,        3125ULL,        15625ULL,        78125ULL,
+    390625ULL,     1953125ULL,     9765625ULL,      48828125ULL,
+    244140625ULL,  1220703125ULL,  6103515625ULL,   30517578125ULL,
+    152587890625ULL, 762939453125ULL};
+
+static void ds_hash_mum(unsigned long long *a, unsigned long long *b);
+
+// Scale the decimals of a number (in [0, 1)) by 10^precision exactly
+//
+// The decimals are mantissa * 2^-(1075 - exponent), so the scaled value is
+// mantissa * 5^precision (at most 93 bits) shifted right by 1075 - exponent -
+// precision bits (at least 36). The bits shifted out are compared with one
+// half into round: -1 if they are less, 0 if equal and 1 if more.
+//
+// Returns the integer part of the scaled value.
+static unsigned long ds_format_decimals(double decimals, int precision,
+                                        int *round) {
+    unsigned long long bits;
+    DS_MEMCPY(&bits, &decimals, sizeof(bits));
+
+    int exponent = (int)((bits >> 52) & 0x7FF);
+    unsigned long long mantissa = bits & ((1ULL << 52) - 1);
+    if (exponent == 0) {
+        exponent = 1;
+    } else {
+        mantissa |= 1ULL << 52;
+    }
+
+    // Past 128 bits the scaled value is 0 and the rest is below one half
+    int shift = 1075 - exponent - precision;
+    if (mantissa == 0 || shift >= 128) {
+        *round = -1;
+        return 0;
+    }
+
+    unsigned long long lo = mantissa;
+    unsigned long long hi = ds_pow5[precision];
+    ds_hash_mum(&lo, &hi);
+
+    unsigned long long scaled, rest_lo, rest_hi, half_lo, half_hi;
+    if (shift >= 64) {
+        scaled = hi >> (shift - 64);
+        rest_hi = shift == 64 ? 0 : hi & ((1ULL << (shift - 64)) - 1);
+        rest_lo = lo;
+        half_hi = shift == 64 ? 0 : 1ULL << (shift - 65);
+        half_lo = shift == 64 ? 1ULL << 63 : 0;
+    } else {
+        scaled = (lo >> shift) | (hi << (64 - shift));
+        rest_hi = 0;
+        rest_lo = lo & ((1ULL << shift) - 1);
+        half_hi = 0;
+        half_lo = 1ULL << (shift - 1);
+    }
+
+    if (rest_hi != half_hi) {
+        *round = rest_hi > half_hi ? 1 : -1;
+    } else {
+        *round = rest_lo > half_lo ? 1 : (rest_lo == half_lo ? 0 : -1);
+    }
+
+    return (unsigned long)scaled;
+}
+
+// Append a number with a fixed number of decimals (like "%.*f") to the string
+// builder
+//
+// Numbers whose scaled value fits in 64 bits are formatted directly. The
+// decimals are scaled with integer arithmetic on the bits of the number and
+// rounded half to even on the exact value, which matches printf. Larger
+// numbers, and more than 17 decimals, fall back to ds_string_builder_append.
+//
+// Returns 0 if the number was appended successfully.
+DSHDEF ds_result ds_string_builder_append_double(ds_string_builder *sb,
+                                                 double value, int precision) {
+    char buffer[48];
+    char *end = buffer + sizeof(buffer);
+    char *start = end;
+
+    if (value != value) {
+        return ds_string_builder_appendn(sb, "nan", 3);
+    }
+    if (value - value != 0) {
+        return value < 0 ? ds_string_builder_appendn(sb, "-inf", 4)
+                         : ds_string_builder_appendn(sb, "inf", 3);
+    }
+
+    if (precision < 0) {
+        precision = 0;
+    }
+
+    double magnitude = value < 0 ? -value : value;
+    if (precision > 17 || magnitude >= 9e18 / ds_pow10[precision]) {
+        return ds_string_builder_append(sb, "%.*f", precision, value);
+    }
+
+    // The decimals are exact, as the integer part is subtracted from the
+    // number without rounding
+    unsigned long integer = (unsigned long)magnitude;
+    int round;
+    unsigned long fraction =
+        ds_format_decimals(magnitude - (double)integer, precision, &round);
+
+    unsigned long last = precision > 0 ? fraction : integer;
+    if (round > 0 || (round == 0 && (last & 1))) {
+        fraction++;
+    }
+    if (fraction >= (unsigned long)ds_pow10[precision]) {
+        fraction = 0;
+        integer++;
+    }
+
+    if (precision > 0) {
+        char *digits = ds_format_ulong(end, fraction);
+        while (end - digits < precision) {
+            *--digits = '0';
+        }
+        start = digits;
+        *--start = '.';
+    }
+
+    start = ds_format_ulong(start, integer);
+    if (value < 0 || (value == 0 && 1 / value < 0)) {
+        *--start = '-';
+    }
+
+    return ds_string_builder_appendn(sb, start, end - start);
 }
 
 // Build the final string from the string builder
@@ -1313,6 +2849,61 @@ defer:
     return result;
 }
 
+// Take the string out of the string builder without copying it
+//
+// The buffer of the string builder is NUL terminated and handed over to str,
+// and the string builder is left empty. The string must be freed with
+// ds_string_builder_release. Buffers that live in their own memory mapping
+// (see DS_DA_MMAP_THRESHOLD) are handed over as well; only the pages past the
+// NUL are given back.
+//
+// Returns 0 if the string was taken successfully, 1 if the string could not
+// be allocated.
+DSHDEF ds_result ds_string_builder_take(ds_string_builder *sb, char **str) {
+    ds_result result = DS_OK;
+    ds_dynamic_array *items = &sb->items;
+
+    // Resize to exactly fit the NUL so that the length of the string tells
+    // ds_string_builder_release whether the buffer is mapped: it is mapped
+    // only if the string and its NUL reach the threshold
+    if ((items->mapped || items->count == items->capacity) &&
+        ds_dynamic_array_resize(items, items->count + 1) != DS_OK) {
+        DS_LOG_ERROR("Failed to allocate string");
+        return_defer(DS_ERR);
+    }
+
+    *str = (char *)items->items;
+    (*str)[items->count] = '\0';
+
+    ds_dynamic_array_init_allocator(items, sizeof(char), items->allocator);
+
+defer:
+    return result;
+}
+
+// Free a string taken out of a string builder
+//
+// The len parameter is the length of the string (without the NUL) and the
+// allocator is the one of the string builder it was taken from.
+DSHDEF void ds_string_builder_release(DS_ALLOCATOR *allocator, char *str,
+                                      unsigned long len) {
+    if (str == NULL) {
+        return;
+    }
+
+#ifdef DS_DA_MMAP
+    if (allocator == NULL && len + 1 >= DS_DA_MMAP_THRESHOLD) {
+        munmap(str, ds_dynamic_array_map_size(len + 1));
+        return;
+    }
+#else
+    (void)allocator;
+    (void)len;
+#endif
+
+    DS_FREE(allocator, str);
+}
+
 // Consumes the string builder into a string slice
 DSHDEF void ds_string_builder_to_slice(ds_string_builder *sb, ds_string_slice *ss) {
     ss->str = (char *)sb->items.items;
@@ -1325,6 +2916,118 @@ DSHDEF void ds_string_builder_free(ds_string_builder *sb) {
     ds_dynamic_array_free(&sb->items);
 }
 
+// Initialize the string with a copy of str using a custom allocator
+//
+// Strings of up to DS_STRING_SMALL_CAPACITY bytes are stored inline and do not
+// allocate.
+//
+// Returns 0 if the string was initialized successfully, 1 if the string could
+// not be allocated.
+DSHDEF ds_result ds_string_init_allocator(ds_string *string, const char *str,
+                                          unsigned long len,
+                                          DS_ALLOCATOR *allocator) {
+    ds_result result = DS_OK;
+    ds_string empty = {0};
+    char *data = string->data.small;
+
+    *string = empty;
+
+    if (len > DS_STRING_SMALL_CAPACITY) {
+        data = DS_MALLOC(allocator, len + 1);
+        if (data == NULL) {
+            DS_LOG_ERROR("Failed to allocate string");
+            return_defer(DS_ERR);
+        }
+        string->data.heap.str = data;
+        string->data.heap.allocator = allocator;
+        string->data.heap.len = DS_STRING_HEAP_LEN(len);
+    } else {
+        string->data.small[DS_STRING_SMALL_CAPACITY + 1] = (char)len;
+    }
+
+    if (len > 0) {
+        DS_MEMCPY(data, str, len);
+    }
+    data[len] = '\0';
+
+defer:
+    return result;
+}
+
+// Initialize the string with a copy of str
+DSHDEF ds_result ds_string_init(ds_string *string, const char *str,
+                                unsigned long len) {
+    return ds_string_init_allocator(string, str, len, NULL);
+}
+
+// Copy the string slice into an owned string
+//
+// The string uses the allocator of the string slice.
+//
+// Returns 0 if the string was created successfully, 1 if the string could
+// not be allocated.
+DSHDEF ds_result ds_string_slice_to_string(ds_string_slice *ss,
+                                           ds_string *string) {
+    return ds_string_init_allocator(string, ss->str, ss->len, ss->allocator);
+}
+
+// Build an owned string from the string builder
+//
+// Unlike ds_string_builder_build, short results are stored inline and do not
+// allocate.
+//
+// Returns 0 if the string was built successfully, 1 if the string could not
+// be allocated.
+DSHDEF ds_result ds_string_builder_build_string(ds_string_builder *sb,
+                                                ds_string *string) {
+    return ds_string_init_allocator(string, (const char *)sb->items.items,
+                                    sb->items.count, sb->items.allocator);
+}
+
+// Copy the string, with the same allocator
+//
+// Returns 0 if the string was copied successfully, 1 if the copy could not be
+// allocated.
+DSHDEF ds_result ds_string_copy(ds_string *string, ds_string *copy) {
+    DS_ALLOCATOR *allocator =
+        DS_STRING_IS_HEAP(string) ? string->data.heap.allocator : NULL;
+    return ds_string_init_allocator(copy, DS_STRING_STR(string),
+                                    DS_STRING_LEN(string), allocator);
+}
+
+// Get a string slice view of the string
+//
+// The string slice points into the string, so it is only valid as long as the
+// string is neither freed nor moved (a short string lives inside the struct).
+// Short strings do not keep their allocator, so their view has none.
+DSHDEF void ds_string_to_slice(ds_string *string, ds_string_slice *ss) {
+    ss->allocator =
+        DS_STRING_IS_HEAP(string) ? string->data.heap.allocator : NULL;
+    ss->str = DS_STRING_STR(string);
+    ss->len = DS_STRING_LEN(string);
+}
+
+// Check if two strings are equal
+//
+// Returns true if the strings have the same contents, false otherwise.
+DSHDEF boolean ds_string_equals(ds_string *string, ds_string *other) {
+    unsigned long len = DS_STRING_LEN(string);
+    return len == DS_STRING_LEN(other) &&
+           DS_MEMCMP(DS_STRING_STR(string), DS_STRING_STR(other), len) == 0;
+}
+
+// Free the string
+//
+// The string is left empty.
+DSHDEF void ds_string_free(ds_string *string) {
+    if (DS_STRING_IS_HEAP(string)) {
+        DS_FREE(string->data.heap.allocator, string->data.heap.str);
+    }
+
+    ds_string empty = {0};
+    *string = empty;
+}
+
 DSHDEF void ds_string_slice_init_allocator(ds_string_slice *ss, char *str,
                                            unsigned long len,
                                            DS_ALLOCATOR *allocator) {
@@ -1339,6 +3042,124 @@ DSHDEF void ds_string_slice_init(ds_string_slice *ss, char *str,
     ds_string_slice_init_allocator(ss, str, len, NULL);
 }
 
+// Initialize a character class from a NUL terminated list of characters
+DSHDEF void ds_char_class_init(ds_char_class *cc, const char *chars) {
+    for (unsigned int i = 0; i < 256; i++) {
+        cc->table[i] = 0;
+    }
+    cc->count = 0;
+
+    for (unsigned long i = 0; chars[i] != '\0'; i++) {
+        unsigned char chr = (unsigned char)chars[i];
+        if (cc->table[chr]) {
+            continue;
+        }
+
+        cc->table[chr] = 1;
+        if (cc->count < DS_CHAR_CLASS_SIMD_MAX) {
+            cc->chars[cc->count] = chars[i];
+        }
+        cc->count++;
+    }
+}
+
+// Find the index of the first occurrence of chr in str
+//
+// Returns len if the character is not found.
+static unsigned long ds_string_index_of(const char *str, unsigned long len,
+                                        char chr) {
+    unsigned long i = 0;
+
+#ifdef DS_AVX2
+    __m256i needle256 = _mm256_set1_epi8(chr);
+    for (; i + 32 <= len; i += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(str + i));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(block, needle256));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+#ifdef DS_SSE2
+    __m128i needle128 = _mm_set1_epi8(chr);
+    for (; i + 16 <= len; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *)(str + i));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(block, needle128));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+    for (; i < len; i++) {
+        if (str[i] == chr) {
+            return i;
+        }
+    }
+
+    return len;
+}
+
+// Find the index of the first character of str that is in the class (or that
+// is not in the class if negate is true)
+//
+// Returns len if no such character is found.
+static unsigned long ds_string_index_of_class(const char *str,
+                                              unsigned long len,
+                                              const ds_char_class *cc,
+                                              boolean negate) {
+    unsigned long i = 0;
+
+    if (cc->count <= DS_CHAR_CLASS_SIMD_MAX && cc->count > 0) {
+#ifdef DS_AVX2
+        for (; i + 32 <= len; i += 32) {
+            __m256i block = _mm256_loadu_si256((const __m256i *)(str + i));
+            __m256i found = _mm256_setzero_si256();
+            for (unsigned int j = 0; j < cc->count; j++) {
+                found = _mm256_or_si256(
+                    found, _mm256_cmpeq_epi8(block, _mm256_set1_epi8(cc->chars[j])));
+            }
+            unsigned int mask = (unsigned int)_mm256_movemask_epi8(found);
+            if (negate) {
+                mask = ~mask;
+            }
+            if (mask != 0) {
+                return i + __builtin_ctz(mask);
+            }
+        }
+#endif
+
+#ifdef DS_SSE2
+        for (; i + 16 <= len; i += 16) {
+            __m128i block = _mm_loadu_si128((const __m128i *)(str + i));
+            __m128i found = _mm_setzero_si128();
+            for (unsigned int j = 0; j < cc->count; j++) {
+                found = _mm_or_si128(
+                    found, _mm_cmpeq_epi8(block, _mm_set1_epi8(cc->chars[j])));
+            }
+            unsigned int mask = (unsigned int)_mm_movemask_epi8(found);
+            if (negate) {
+                mask = ~mask & 0xFFFF;
+            }
+            if (mask != 0) {
+                return i + __builtin_ctz(mask);
+            }
+        }
+#endif
+    }
+
+    for (; i < len; i++) {
+        if (cc->table[(unsigned char)str[i]] != negate) {
+            return i;
+        }
+    }
+
+    return len;
+}
+
 // Tokenize the string slice by a delimiter
 //
 // Returns true if a token was found, false if the string slice is empty.
@@ -1350,22 +3171,19 @@ DSHDEF boolean ds_string_slice_tokenize(ds_string_slice *ss, char delimiter,
         return_defer(false);
     }
 
+    unsigned long index = ds_string_index_of(ss->str, ss->len, delimiter);
+
     token->str = ss->str;
-    token->len = 0;
+    token->len = index;
 
-    for (unsigned int i = 0; i < ss->len; i++) {
-        if (ss->str[i] == delimiter) {
-            token->len = i;
-            ss->str += i + 1;
-            ss->len -= i + 1;
-            return_defer(true);
-        }
+    if (index < ss->len) {
+        ss->str += index + 1;
+        ss->len -= index + 1;
+    } else {
+        ss->str += ss->len;
+        ss->len = 0;
     }
 
-    token->len = ss->len;
-    ss->str += ss->len;
-    ss->len = 0;
-
 defer:
     return result;
 }
@@ -1385,7 +3203,7 @@ DSHDEF boolean ds_string_slice_take_while_pred(ds_string_slice *ss,
     token->str = ss->str;
     token->len = 0;
 
-    for (unsigned int i = 0; i < ss->len; i++) {
+    for (unsigned long i = 0; i < ss->len; i++) {
         if (predicate(ss->str[i]) == 0) {
             token->len = i;
             ss->str += i;
@@ -1402,15 +3220,285 @@ defer:
     return result;
 }
 
-// Trim the left side of the string slice by whitespaces
-DSHDEF void ds_string_slice_trim_left_ws(ds_string_slice *ss) {
-    while (ss->len > 0 && isspace(ss->str[0])) {
-        ss->str++;
-        ss->len--;
-    }
-}
-
-
+// Tokenize the string slice by any of the delimiters in the character class
+//
+// Returns true if a token was found, false if the string slice is empty.
+DSHDEF boolean ds_string_slice_tokenize_class(ds_string_slice *ss,
+                                              const ds_char_class *cc,
+                                              ds_string_slice *token) {
+    boolean result = true;
+
+    if (ss->len == 0 || ss->str == NULL) {
+        return_defer(false);
+    }
+
+    unsigned long index = ds_string_index_of_class(ss->str, ss->len, cc, false);
+
+    token->str = ss->str;
+    token->len = index;
+
+    if (index < ss->len) {
+        ss->str += index + 1;
+        ss->len -= index + 1;
+    } else {
+        ss->str += ss->len;
+        ss->len = 0;
+    }
+
+defer:
+    return result;
+}
+
+// Build a token by taking from the string slice while the characters are in
+// the character class. This is the table driven version of
+// ds_string_slice_take_while_pred.
+//
+// Returns true if a token was found, false if the string slice is empty.
+DSHDEF boolean ds_string_slice_take_while_class(ds_string_slice *ss,
+                                                const ds_char_class *cc,
+                                                ds_string_slice *token) {
+    boolean result = true;
+
+    if (ss->len == 0 || ss->str == NULL) {
+        return_defer(false);
+    }
+
+    unsigned long index = ds_string_index_of_class(ss->str, ss->len, cc, true);
+
+    token->str = ss->str;
+    token->len = index;
+    ss->str += index;
+    ss->len -= index;
+
+defer:
+    return result;
+}
+
+// Split the whole string slice by a delimiter
+//
+// Appends every token (as a ds_string_slice) to the tokens array, in the same
+// order ds_string_slice_tokenize would return them. The string slice itself is
+// not modified. Returns 0 if the tokens were appended successfully, 1 if the
+// array could not be reallocated.
+DSHDEF ds_result ds_string_slice_split(ds_string_slice *ss, char delimiter,
+                                       ds_dynamic_array *tokens) {
+    ds_result result = DS_OK;
+
+    ds_string_slice rest = *ss;
+    ds_string_slice token = {.allocator = ss->allocator};
+    while (ds_string_slice_tokenize(&rest, delimiter, &token)) {
+        if (ds_dynamic_array_append(tokens, &token) != DS_OK) {
+            return_defer(DS_ERR);
+        }
+    }
+
+defer:
+    return result;
+}
+
+// Split the whole string slice by any of the delimiters in the character class
+//
+// Appends every token (as a ds_string_slice) to the tokens array. The string
+// slice itself is not modified. Returns 0 if the tokens were appended
+// successfully, 1 if the array could not be reallocated.
+DSHDEF ds_result ds_string_slice_split_class(ds_string_slice *ss,
+                                             const ds_char_class *cc,
+                                             ds_dynamic_array *tokens) {
+    ds_result result = DS_OK;
+
+    ds_string_slice rest = *ss;
+    ds_string_slice token = {.allocator = ss->allocator};
+    while (ds_string_slice_tokenize_class(&rest, cc, &token)) {
+        if (ds_dynamic_array_append(tokens, &token) != DS_OK) {
+            return_defer(DS_ERR);
+        }
+    }
+
+defer:
+    return result;
+}
+
+// A chunk of the string slice for the parallel split. The chunks end right
+// after a delimiter, so tokenizing them one after the other gives the same
+// tokens as tokenizing the whole string slice.
+typedef struct ds_string_slice_split_job {
+        ds_string_slice chunk;
+        char delimiter;
+        const ds_char_class *cc; // NULL to split by the delimiter
+        ds_string_slice *tokens; // NULL to only count the tokens
+        unsigned long count;
+} ds_string_slice_split_job;
+
+#ifdef DS_THREADS
+static void *ds_string_slice_split_run(void *arg) {
+    ds_string_slice_split_job *job = (ds_string_slice_split_job *)arg;
+    ds_string_slice rest = job->chunk;
+    ds_string_slice token = {.allocator = job->chunk.allocator};
+    unsigned long count = 0;
+
+    while (job->cc != NULL ? ds_string_slice_tokenize_class(&rest, job->cc, &token)
+                           : ds_string_slice_tokenize(&rest, job->delimiter, &token)) {
+        if (job->tokens != NULL) {
+            job->tokens[count] = token;
+        }
+        count++;
+    }
+    job->count = count;
+
+    return NULL;
+}
+
+// Run the jobs on worker threads, and the first one on the calling thread. A
+// job whose thread could not be created also runs on the calling thread.
+static void ds_string_slice_split_jobs(ds_string_slice_split_job *jobs,
+                                       pthread_t *handles, boolean *started,
+                                       unsigned long count) {
+    for (unsigned long i = 1; i < count; i++) {
+        started[i] = pthread_create(&handles[i], NULL, ds_string_slice_split_run,
+                                    &jobs[i]) == 0;
+    }
+    ds_string_slice_split_run(&jobs[0]);
+    for (unsigned long i = 1; i < count; i++) {
+        if (started[i]) {
+            pthread_join(handles[i], NULL);
+        } else {
+            ds_string_slice_split_run(&jobs[i]);
+        }
+    }
+}
+#endif
+
+static ds_result ds_string_slice_split_parallel_impl(ds_string_slice *ss,
+                                                     char delimiter,
+                                                     const ds_char_class *cc,
+                                                     ds_dynamic_array *tokens,
+                                                     unsigned long threads) {
+    ds_result result = DS_OK;
+
+#ifdef DS_THREADS
+    ds_string_slice_split_job *jobs = NULL;
+    pthread_t *handles = NULL;
+    boolean *started = NULL;
+
+    if (threads == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (unsigned long)online : 1;
+    }
+    threads = DS_MIN(threads, ss->len / DS_SPLIT_PARALLEL_MIN);
+#else
+    threads = 1;
+#endif
+
+    if (threads <= 1) {
+        return cc != NULL ? ds_string_slice_split_class(ss, cc, tokens)
+                          : ds_string_slice_split(ss, delimiter, tokens);
+    }
+
+#ifdef DS_THREADS
+    jobs = DS_MALLOC(tokens->allocator,
+                     threads * sizeof(ds_string_slice_split_job));
+    handles = DS_MALLOC(tokens->allocator, threads * sizeof(pthread_t));
+    started = DS_MALLOC(tokens->allocator, threads * sizeof(boolean));
+    if (jobs == NULL || handles == NULL || started == NULL) {
+        DS_LOG_ERROR("Failed to allocate the split jobs");
+        return_defer(DS_ERR);
+    }
+
+    // Move every chunk boundary forward to just after the next delimiter
+    unsigned long start = 0;
+    for (unsigned long i = 0; i < threads; i++) {
+        unsigned long end = ss->len;
+        if (i + 1 < threads) {
+            end = DS_MAX(start, ss->len / threads * (i + 1));
+            end += cc != NULL ? ds_string_index_of_class(ss->str + end,
+                                                         ss->len - end, cc, false)
+                              : ds_string_index_of(ss->str + end, ss->len - end,
+                                                   delimiter);
+            end = DS_MIN(end + 1, ss->len);
+        }
+
+        jobs[i].chunk.allocator = ss->allocator;
+        jobs[i].chunk.str = ss->str + start;
+        jobs[i].chunk.len = end - start;
+        jobs[i].delimiter = delimiter;
+        jobs[i].cc = cc;
+        jobs[i].tokens = NULL;
+        jobs[i].count = 0;
+        start = end;
+    }
+
+    // Count the tokens first, so that every thread can write its tokens in
+    // place and nothing is allocated off the calling thread
+    ds_string_slice_split_jobs(jobs, handles, started, threads);
+
+    unsigned long total = tokens->count;
+    for (unsigned long i = 0; i < threads; i++) {
+        total += jobs[i].count;
+    }
+    if (ds_dynamic_array_reserve(tokens, total) != DS_OK) {
+        return_defer(DS_ERR);
+    }
+
+    ds_string_slice *items = (ds_string_slice *)tokens->items + tokens->count;
+    for (unsigned long i = 0; i < threads; i++) {
+        jobs[i].tokens = items;
+        items += jobs[i].count;
+    }
+    ds_string_slice_split_jobs(jobs, handles, started, threads);
+    tokens->count = total;
+
+defer:
+    if (jobs != NULL) {
+        DS_FREE(tokens->allocator, jobs);
+    }
+    if (handles != NULL) {
+        DS_FREE(tokens->allocator, handles);
+    }
+    if (started != NULL) {
+        DS_FREE(tokens->allocator, started);
+    }
+#endif
+
+    return result;
+}
+
+// Split the whole string slice by a delimiter on many threads
+//
+// The string slice is cut into chunks at delimiters, one for each thread, and
+// the threads write their tokens into the tokens array in place. The tokens
+// are in the same order as with ds_string_slice_split. If threads is 0 it uses
+// one thread per online CPU. Returns 0 if the tokens were appended
+// successfully, 1 if the array could not be reallocated.
+DSHDEF ds_result ds_string_slice_split_parallel(ds_string_slice *ss,
+                                                char delimiter,
+                                                ds_dynamic_array *tokens,
+                                                unsigned long threads) {
+    return ds_string_slice_split_parallel_impl(ss, delimiter, NULL, tokens,
+                                               threads);
+}
+
+// Split the whole string slice by any of the delimiters in the character class
+// on many threads
+//
+// This is the character class version of ds_string_slice_split_parallel.
+// Returns 0 if the tokens were appended successfully, 1 if the array could not
+// be reallocated.
+DSHDEF ds_result ds_string_slice_split_class_parallel(ds_string_slice *ss,
+                                                      const ds_char_class *cc,
+                                                      ds_dynamic_array *tokens,
+                                                      unsigned long threads) {
+    return ds_string_slice_split_parallel_impl(ss, 0, cc, tokens, threads);
+}
+
+// Trim the left side of the string slice by whitespaces
+DSHDEF void ds_string_slice_trim_left_ws(ds_string_slice *ss) {
+    while (ss->len > 0 && isspace(ss->str[0])) {
+        ss->str++;
+        ss->len--;
+    }
+}
+
+
 // Trim the left side of the string slice by whitespaces
 DSHDEF void ds_string_slice_trim_right_ws(ds_string_slice *ss) {
     while (ss->len > 0 && isspace(ss->str[ss->len - 1])) {
@@ -1439,164 +3527,7445 @@ DSHDEF void ds_string_slice_trim(ds_string_slice *ss, char chr) {
     ds_string_slice_trim_right(ss, chr);
 }
 
-// Convert the string slice to an owned string
+// Convert the string slice to an owned string
+//
+// Returns 0 if the string was converted successfully, 1 if the string could not
+// be allocated.
+DSHDEF ds_result ds_string_slice_to_owned(ds_string_slice *ss, char **str) {
+    ds_result result = DS_OK;
+
+    *str = DS_MALLOC(ss->allocator, ss->len + 1);
+    if (*str == NULL) {
+        DS_LOG_ERROR("Failed to allocate string");
+        return_defer(DS_ERR);
+    }
+
+    DS_MEMCPY(*str, ss->str, ss->len);
+    (*str)[ss->len] = '\0';
+
+defer:
+    return result;
+}
+
+// Check if the string slice is equal to a specific string
+//
+// Returns 1 in case the string slice equals str. Returns 0 otherwise
+DSHDEF boolean ds_string_slice_equals(ds_string_slice *ss, ds_string_slice *so) {
+    return ss->len == so->len && DS_MEMCMP(ss->str, so->str, ss->len) == 0;
+}
+
+// Check if the string slice starts with a specific string
+//
+// Returns 1 in case the string slice starts with str. Returns 0 otherwise
+DSHDEF boolean ds_string_slice_starts_with(ds_string_slice *ss,
+                                           ds_string_slice *prefix) {
+    return DS_MEMCMP(ss->str, prefix->str, prefix->len) == 0;
+}
+
+// Check if the string slice starts with a char that matches a predicate function
+//
+// Returns 1 if the string slice starts with a predicate. Returns 0 otherwise.
+DSHDEF boolean ds_string_slice_starts_with_pred(ds_string_slice *ss,
+                                                boolean (*predicate)(char)) {
+    return predicate(*ss->str);
+}
+
+// Step the string slice by one character forward
+DSHDEF void ds_string_slice_step(ds_string_slice *ss, int count) {
+    ss->str += count;
+    ss->len -= count;
+}
+
+// Check if the string slice is empty
+DSHDEF boolean ds_string_slice_empty(ds_string_slice *ss) {
+    return ss->len == 0;
+}
+
+// Parse the digits of an unsigned number in the given base from the string
+// slice, checking for overflow
+//
+// Returns 0 if the whole string slice is a number that fits in an unsigned
+// long, 1 otherwise.
+static ds_result ds_string_slice_parse_digits(const char *str,
+                                              unsigned long len,
+                                              unsigned int base,
+                                              unsigned long *value) {
+    ds_result result = DS_OK;
+    unsigned long limit = ~0UL / base;
+    *value = 0;
+
+    if (len == 0) {
+        return_defer(DS_ERR);
+    }
+
+    for (unsigned long i = 0; i < len; i++) {
+        unsigned char chr = (unsigned char)str[i];
+        unsigned int digit = 0;
+        if (chr >= '0' && chr <= '9') {
+            digit = chr - '0';
+        } else if (chr >= 'a' && chr <= 'f') {
+            digit = chr - 'a' + 10;
+        } else if (chr >= 'A' && chr <= 'F') {
+            digit = chr - 'A' + 10;
+        } else {
+            return_defer(DS_ERR);
+        }
+
+        if (digit >= base || *value > limit ||
+            *value * base > ~0UL - digit) {
+            return_defer(DS_ERR);
+        }
+
+        *value = *value * base + digit;
+    }
+
+defer:
+    return result;
+}
+
+// Parse the string slice as an unsigned decimal number, without allocating
+//
+// Returns 0 if the whole string slice is a number that fits in an unsigned
+// long, 1 if it is not a number or if it overflows.
+DSHDEF ds_result ds_string_slice_to_ulong(ds_string_slice *ss,
+                                          unsigned long *value) {
+    const char *str = ss->str;
+    unsigned long len = ss->len;
+
+    if (len > 0 && str[0] == '+') {
+        str++;
+        len--;
+    }
+
+    return ds_string_slice_parse_digits(str, len, 10, value);
+}
+
+// Parse the string slice as a signed decimal number, without allocating
+//
+// Returns 0 if the whole string slice is a number that fits in a long, 1 if it
+// is not a number or if it overflows.
+DSHDEF ds_result ds_string_slice_to_long(ds_string_slice *ss, long *value) {
+    ds_result result = DS_OK;
+    const char *str = ss->str;
+    unsigned long len = ss->len;
+    boolean negative = false;
+    unsigned long magnitude = 0;
+
+    if (len > 0 && (str[0] == '+' || str[0] == '-')) {
+        negative = str[0] == '-';
+        str++;
+        len--;
+    }
+
+    if (ds_string_slice_parse_digits(str, len, 10, &magnitude) != DS_OK) {
+        return_defer(DS_ERR);
+    }
+
+    unsigned long limit = ~0UL >> 1;
+    if (magnitude > limit + negative) {
+        return_defer(DS_ERR);
+    }
+
+    *value = negative ? (long)(0UL - magnitude) : (long)magnitude;
+
+defer:
+    return result;
+}
+
+// Parse the string slice as a hexadecimal number, with an optional 0x prefix,
+// without allocating
+//
+// Returns 0 if the whole string slice is a number that fits in an unsigned
+// long, 1 if it is not a number or if it overflows.
+DSHDEF ds_result ds_string_slice_to_hex(ds_string_slice *ss,
+                                        unsigned long *value) {
+    const char *str = ss->str;
+    unsigned long len = ss->len;
+
+    if (len > 2 && str[0] == '0' && (str[1] == 'x' || str[1] == 'X')) {
+        str += 2;
+        len -= 2;
+    }
+
+    return ds_string_slice_parse_digits(str, len, 16, value);
+}
+
+// Check if the string slice starts with a word, ignoring the case
+static boolean ds_string_slice_parse_word(const char *str, unsigned long len,
+                                          const char *word) {
+    unsigned long i = 0;
+    for (; word[i] != '\0'; i++) {
+        if (i >= len || (str[i] | 0x20) != word[i]) {
+            return false;
+        }
+    }
+    return i == len;
+}
+
+// Parse the string slice as a floating point number, without allocating
+//
+// Accepts decimal numbers with an optional fraction and exponent, and inf or
+// nan. Numbers with at most 19 significant digits whose value and power of ten
+// are exact doubles are computed directly, which gives the correctly rounded
+// result. The other numbers are parsed with strtod from a stack copy.
+//
+// Returns 0 if the whole string slice is a number that is finite (or the
+// literal inf), 1 if it is not a number or if it overflows.
+DSHDEF ds_result ds_string_slice_to_double(ds_string_slice *ss, double *value) {
+    ds_result result = DS_OK;
+    const char *str = ss->str;
+    const char *end = ss->str + ss->len;
+    boolean negative = false;
+
+    if (str < end && (*str == '+' || *str == '-')) {
+        negative = *str == '-';
+        str++;
+    }
+
+    if (ds_string_slice_parse_word(str, end - str, "inf") ||
+        ds_string_slice_parse_word(str, end - str, "infinity")) {
+        *value = negative ? -1e308 * 10 : 1e308 * 10;
+        return_defer(DS_OK);
+    }
+    if (ds_string_slice_parse_word(str, end - str, "nan")) {
+        // 0.0 / 0.0 has the sign bit set on x86, so the quiet NaN is built
+        // from its bits instead, with the sign of the input
+        unsigned long long bits = 0x7FF8000000000000ULL;
+        if (negative) {
+            bits |= 0x8000000000000000ULL;
+        }
+        DS_MEMCPY(value, &bits, sizeof(bits));
+        return_defer(DS_OK);
+    }
+
+    unsigned long mantissa = 0;
+    int digits = 0;
+    long exponent = 0;
+    boolean any_digit = false;
+    boolean truncated = false;
+
+    for (; str < end && *str >= '0' && *str <= '9'; str++) {
+        any_digit = true;
+        if (mantissa == 0 && *str == '0') {
+            continue;
+        }
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*str - '0');
+            digits++;
+        } else {
+            exponent++;
+            truncated |= *str != '0';
+        }
+    }
+
+    if (str < end && *str == '.') {
+        for (str++; str < end && *str >= '0' && *str <= '9'; str++) {
+            any_digit = true;
+            if (mantissa == 0 && *str == '0') {
+                exponent--;
+                continue;
+            }
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*str - '0');
+                digits++;
+                exponent--;
+            } else {
+                truncated |= *str != '0';
+            }
+        }
+    }
+
+    if (!any_digit) {
+        return_defer(DS_ERR);
+    }
+
+    if (str < end && (*str == 'e' || *str == 'E')) {
+        str++;
+        boolean exponent_negative = false;
+        if (str < end && (*str == '+' || *str == '-')) {
+            exponent_negative = *str == '-';
+            str++;
+        }
+        if (str == end || *str < '0' || *str > '9') {
+            return_defer(DS_ERR);
+        }
+
+        long e = 0;
+        for (; str < end && *str >= '0' && *str <= '9'; str++) {
+            if (e < 100000) {
+                e = e * 10 + (*str - '0');
+            }
+        }
+        exponent += exponent_negative ? -e : e;
+    }
+
+    if (str != end) {
+        return_defer(DS_ERR);
+    }
+
+    if (mantissa == 0) {
+        *value = negative ? -0.0 : 0.0;
+        return_defer(DS_OK);
+    }
+
+    if (!truncated && mantissa <= (1UL << 53)) {
+        double m = (double)mantissa;
+        if (exponent >= 0 && exponent <= 22) {
+            *value = negative ? -(m * ds_pow10[exponent])
+                              : m * ds_pow10[exponent];
+            return_defer(DS_OK);
+        }
+        if (exponent < 0 && exponent >= -22) {
+            *value = negative ? -(m / ds_pow10[-exponent])
+                              : m / ds_pow10[-exponent];
+            return_defer(DS_OK);
+        }
+        if (exponent > 22 && exponent <= 22 + 15 &&
+            m * ds_pow10[exponent - 22] <= (double)(1UL << 53)) {
+            m = m * ds_pow10[exponent - 22] * ds_pow10[22];
+            *value = negative ? -m : m;
+            return_defer(DS_OK);
+        }
+    }
+
+#ifndef DS_NO_STDLIB
+    {
+        char stack[256];
+        char *copy = stack;
+        if (ss->len >= sizeof(stack)) {
+            copy = DS_MALLOC(ss->allocator, ss->len + 1);
+            if (copy == NULL) {
+                DS_LOG_ERROR("Failed to allocate string");
+                return_defer(DS_ERR);
+            }
+        }
+
+        DS_MEMCPY(copy, ss->str, ss->len);
+        copy[ss->len] = '\0';
+        *value = strtod(copy, NULL);
+
+        if (copy != stack) {
+            DS_FREE(ss->allocator, copy);
+        }
+    }
+#else
+    {
+        double m = (double)mantissa;
+        for (; exponent > 22; exponent -= 22) {
+            m *= ds_pow10[22];
+        }
+        for (; exponent < -22; exponent += 22) {
+            m /= ds_pow10[22];
+        }
+        m = exponent >= 0 ? m * ds_pow10[exponent] : m / ds_pow10[-exponent];
+        *value = negative ? -m : m;
+    }
+#endif
+
+    if (*value - *value != 0) {
+        return_defer(DS_ERR);
+    }
+
+defer:
+    return result;
+}
+
+// Free the string slice
+DSHDEF void ds_string_slice_free(ds_string_slice *ss) {
+    ss->allocator = NULL;
+    ss->str = NULL;
+    ss->len = 0;
+}
+
+#ifndef DS_FIND_SHORT_NEEDLE
+#define DS_FIND_SHORT_NEEDLE 32
+#endif
+
+// Find a short needle by checking its first and last bytes for a whole block
+// of positions at once, and comparing the rest only where both match
+static unsigned long ds_string_find_short(const char *str, unsigned long len,
+                                          const char *needle,
+                                          unsigned long needle_len) {
+    unsigned long i = 0;
+    unsigned long last = needle_len - 1;
+
+#ifdef DS_AVX2
+    __m256i first256 = _mm256_set1_epi8(needle[0]);
+    __m256i last256 = _mm256_set1_epi8(needle[last]);
+    for (; i + last + 32 <= len; i += 32) {
+        __m256i block_first = _mm256_loadu_si256((const __m256i *)(str + i));
+        __m256i block_last =
+            _mm256_loadu_si256((const __m256i *)(str + i + last));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(block_first, first256),
+                             _mm256_cmpeq_epi8(block_last, last256)));
+        while (mask != 0) {
+            unsigned long j = i + __builtin_ctz(mask);
+            if (DS_MEMCMP(str + j + 1, needle + 1, needle_len - 1) == 0) {
+                return j;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+#ifdef DS_SSE2
+    __m128i first128 = _mm_set1_epi8(needle[0]);
+    __m128i last128 = _mm_set1_epi8(needle[last]);
+    for (; i + last + 16 <= len; i += 16) {
+        __m128i block_first = _mm_loadu_si128((const __m128i *)(str + i));
+        __m128i block_last = _mm_loadu_si128((const __m128i *)(str + i + last));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(block_first, first128),
+                          _mm_cmpeq_epi8(block_last, last128)));
+        while (mask != 0) {
+            unsigned long j = i + __builtin_ctz(mask);
+            if (DS_MEMCMP(str + j + 1, needle + 1, needle_len - 1) == 0) {
+                return j;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    while (i + needle_len <= len) {
+        unsigned long j = ds_string_index_of(str + i, len - i - last, needle[0]);
+        i += j;
+        if (i + needle_len > len) {
+            break;
+        }
+        if (str[i + last] == needle[last] &&
+            DS_MEMCMP(str + i + 1, needle + 1, needle_len - 1) == 0) {
+            return i;
+        }
+        i++;
+    }
+
+    return len;
+}
+
+// Find a long needle with the Two-Way algorithm (Crochemore-Perrin), which
+// runs in linear time and constant space
+static unsigned long ds_string_find_two_way(const char *str, unsigned long len,
+                                            const char *needle,
+                                            unsigned long needle_len) {
+    const unsigned char *h = (const unsigned char *)str;
+    const unsigned char *z = h + len;
+    const unsigned char *n = (const unsigned char *)needle;
+    unsigned long l = needle_len;
+    unsigned long i, ip, jp, k, p, ms, p0, mem, mem0;
+    unsigned long byteset[256 / (8 * sizeof(unsigned long))] = {0};
+    unsigned long shift[256];
+    unsigned long bits = 8 * sizeof(unsigned long);
+
+    // Byte set of the needle and the bad character shift table
+    for (i = 0; i < l; i++) {
+        byteset[n[i] / bits] |= 1UL << (n[i] % bits);
+        shift[n[i]] = i + 1;
+    }
+
+    // Compute the maximal suffix
+    ip = -1UL;
+    jp = 0;
+    k = p = 1;
+    while (jp + k < l) {
+        if (n[ip + k] == n[jp + k]) {
+            if (k == p) {
+                jp += p;
+                k = 1;
+            } else {
+                k++;
+            }
+        } else if (n[ip + k] > n[jp + k]) {
+            jp += k;
+            k = 1;
+            p = jp - ip;
+        } else {
+            ip = jp++;
+            k = p = 1;
+        }
+    }
+    ms = ip;
+    p0 = p;
+
+    // And with the opposite comparison
+    ip = -1UL;
+    jp = 0;
+    k = p = 1;
+    while (jp + k < l) {
+        if (n[ip + k] == n[jp + k]) {
+            if (k == p) {
+                jp += p;
+                k = 1;
+            } else {
+                k++;
+            }
+        } else if (n[ip + k] < n[jp + k]) {
+            jp += k;
+            k = 1;
+            p = jp - ip;
+        } else {
+            ip = jp++;
+            k = p = 1;
+        }
+    }
+    if (ip + 1 > ms + 1) {
+        ms = ip;
+    } else {
+        p = p0;
+    }
+
+    // Periodic needle?
+    if (DS_MEMCMP(n, n + p, ms + 1) != 0) {
+        mem0 = 0;
+        p = DS_MAX(ms, l - ms - 1) + 1;
+    } else {
+        mem0 = l - p;
+    }
+    mem = 0;
+
+    for (;;) {
+        if ((unsigned long)(z - h) < l) {
+            return len;
+        }
+
+        // Check the last byte first, and shift on a mismatch
+        unsigned char chr = h[l - 1];
+        if (byteset[chr / bits] & (1UL << (chr % bits))) {
+            k = l - shift[chr];
+            if (k) {
+                if (k < mem) {
+                    k = mem;
+                }
+                h += k;
+                mem = 0;
+                continue;
+            }
+        } else {
+            h += l;
+            mem = 0;
+            continue;
+        }
+
+        // Compare the right half
+        for (k = DS_MAX(ms + 1, mem); k < l && n[k] == h[k]; k++) {
+        }
+        if (k < l) {
+            h += k - ms;
+            mem = 0;
+            continue;
+        }
+
+        // Compare the left half
+        for (k = ms + 1; k > mem && n[k - 1] == h[k - 1]; k--) {
+        }
+        if (k <= mem) {
+            return h - (const unsigned char *)str;
+        }
+        h += p;
+        mem = mem0;
+    }
+}
+
+// Find the index of the first occurrence of needle in str
+//
+// Returns len if the needle is not found.
+static unsigned long ds_string_find(const char *str, unsigned long len,
+                                    const char *needle,
+                                    unsigned long needle_len) {
+    if (needle_len == 0) {
+        return 0;
+    }
+    if (needle_len > len) {
+        return len;
+    }
+    if (needle_len == 1) {
+        return ds_string_index_of(str, len, needle[0]);
+    }
+    if (needle_len <= DS_FIND_SHORT_NEEDLE) {
+        return ds_string_find_short(str, len, needle, needle_len);
+    }
+    return ds_string_find_two_way(str, len, needle, needle_len);
+}
+
+// Find the first occurrence of a needle in the string slice
+//
+// Short needles are found with a SIMD filter on their first and last bytes,
+// long needles with the Two-Way algorithm. Returns true if the needle was
+// found, and stores its index in index. Returns false otherwise.
+DSHDEF boolean ds_string_slice_find(ds_string_slice *ss, ds_string_slice *needle,
+                                    unsigned long *index) {
+    unsigned long found = ds_string_find(ss->str, ss->len, needle->str,
+                                         needle->len);
+    if (found == ss->len && needle->len > 0) {
+        return false;
+    }
+
+    *index = found;
+    return true;
+}
+
+// Find the last occurrence of a short needle, like ds_string_find_short but
+// walking the blocks of positions from the end of the string
+static unsigned long ds_string_rfind_short(const char *str, unsigned long len,
+                                           const char *needle,
+                                           unsigned long needle_len) {
+    unsigned long last = needle_len - 1;
+    // The candidate positions left to check are 0..end-1
+    unsigned long end = len - needle_len + 1;
+
+#ifdef DS_AVX2
+    __m256i first256 = _mm256_set1_epi8(needle[0]);
+    __m256i last256 = _mm256_set1_epi8(needle[last]);
+    for (; end >= 32; end -= 32) {
+        unsigned long i = end - 32;
+        __m256i block_first = _mm256_loadu_si256((const __m256i *)(str + i));
+        __m256i block_last =
+            _mm256_loadu_si256((const __m256i *)(str + i + last));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(block_first, first256),
+                             _mm256_cmpeq_epi8(block_last, last256)));
+        while (mask != 0) {
+            unsigned int bit = 31 - __builtin_clz(mask);
+            if (DS_MEMCMP(str + i + bit + 1, needle + 1, needle_len - 1) ==
+                0) {
+                return i + bit;
+            }
+            mask &= ~(1U << bit);
+        }
+    }
+#endif
+
+#ifdef DS_SSE2
+    __m128i first128 = _mm_set1_epi8(needle[0]);
+    __m128i last128 = _mm_set1_epi8(needle[last]);
+    for (; end >= 16; end -= 16) {
+        unsigned long i = end - 16;
+        __m128i block_first = _mm_loadu_si128((const __m128i *)(str + i));
+        __m128i block_last = _mm_loadu_si128((const __m128i *)(str + i + last));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(block_first, first128),
+                          _mm_cmpeq_epi8(block_last, last128)));
+        while (mask != 0) {
+            unsigned int bit = 31 - __builtin_clz(mask);
+            if (DS_MEMCMP(str + i + bit + 1, needle + 1, needle_len - 1) ==
+                0) {
+                return i + bit;
+            }
+            mask &= ~(1U << bit);
+        }
+    }
+#endif
+
+    for (; end > 0; end--) {
+        const char *candidate = str + end - 1;
+        if (candidate[0] == needle[0] && candidate[last] == needle[last] &&
+            DS_MEMCMP(candidate + 1, needle + 1, needle_len - 1) == 0) {
+            return end - 1;
+        }
+    }
+
+    return len;
+}
+
+// Find the last occurrence of a long needle with the Two-Way algorithm. This
+// is ds_string_find_two_way run on the reversed needle and string: byte i of
+// the reversed needle is *(n - i), and the window of the reversed string
+// starts at h and extends to lower addresses.
+static unsigned long ds_string_rfind_two_way(const char *str,
+                                             unsigned long len,
+                                             const char *needle,
+                                             unsigned long needle_len) {
+    const unsigned char *z = (const unsigned char *)str;
+    const unsigned char *h = z + len - 1;
+    unsigned long l = needle_len;
+    const unsigned char *n = (const unsigned char *)needle + l - 1;
+    unsigned long i, ip, jp, k, p, ms, p0, mem, mem0;
+    unsigned long byteset[256 / (8 * sizeof(unsigned long))] = {0};
+    unsigned long shift[256];
+    unsigned long bits = 8 * sizeof(unsigned long);
+
+    // Byte set of the needle and the bad character shift table
+    for (i = 0; i < l; i++) {
+        byteset[*(n - i) / bits] |= 1UL << (*(n - i) % bits);
+        shift[*(n - i)] = i + 1;
+    }
+
+    // Compute the maximal suffix
+    ip = -1UL;
+    jp = 0;
+    k = p = 1;
+    while (jp + k < l) {
+        if (*(n - (ip + k)) == *(n - (jp + k))) {
+            if (k == p) {
+                jp += p;
+                k = 1;
+            } else {
+                k++;
+            }
+        } else if (*(n - (ip + k)) > *(n - (jp + k))) {
+            jp += k;
+            k = 1;
+            p = jp - ip;
+        } else {
+            ip = jp++;
+            k = p = 1;
+        }
+    }
+    ms = ip;
+    p0 = p;
+
+    // And with the opposite comparison
+    ip = -1UL;
+    jp = 0;
+    k = p = 1;
+    while (jp + k < l) {
+        if (*(n - (ip + k)) == *(n - (jp + k))) {
+            if (k == p) {
+                jp += p;
+                k = 1;
+            } else {
+                k++;
+            }
+        } else if (*(n - (ip + k)) < *(n - (jp + k))) {
+            jp += k;
+            k = 1;
+            p = jp - ip;
+        } else {
+            ip = jp++;
+            k = p = 1;
+        }
+    }
+    if (ip + 1 > ms + 1) {
+        ms = ip;
+    } else {
+        p = p0;
+    }
+
+    // Periodic needle?
+    for (i = 0; i < ms + 1 && *(n - i) == *(n - (i + p)); i++) {
+    }
+    if (i < ms + 1) {
+        mem0 = 0;
+        p = DS_MAX(ms, l - ms - 1) + 1;
+    } else {
+        mem0 = l - p;
+    }
+    mem = 0;
+
+    for (;;) {
+        if ((unsigned long)(h - z) + 1 < l) {
+            return len;
+        }
+
+        // Check the last byte first, and shift on a mismatch
+        unsigned char chr = *(h - (l - 1));
+        if (byteset[chr / bits] & (1UL << (chr % bits))) {
+            k = l - shift[chr];
+            if (k) {
+                if (k < mem) {
+                    k = mem;
+                }
+                if ((unsigned long)(h - z) < k) {
+                    return len;
+                }
+                h -= k;
+                mem = 0;
+                continue;
+            }
+        } else {
+            if ((unsigned long)(h - z) < l) {
+                return len;
+            }
+            h -= l;
+            mem = 0;
+            continue;
+        }
+
+        // Compare the right half
+        for (k = DS_MAX(ms + 1, mem); k < l && *(n - k) == *(h - k); k++) {
+        }
+        if (k < l) {
+            if ((unsigned long)(h - z) < k - ms) {
+                return len;
+            }
+            h -= k - ms;
+            mem = 0;
+            continue;
+        }
+
+        // Compare the left half
+        for (k = ms + 1; k > mem && *(n - (k - 1)) == *(h - (k - 1)); k--) {
+        }
+        if (k <= mem) {
+            return (h - (l - 1)) - z;
+        }
+        if ((unsigned long)(h - z) < p) {
+            return len;
+        }
+        h -= p;
+        mem = mem0;
+    }
+}
+
+// Find the index of the last occurrence of needle in str
+//
+// Returns len if the needle is not found.
+static unsigned long ds_string_rfind(const char *str, unsigned long len,
+                                     const char *needle,
+                                     unsigned long needle_len) {
+    if (needle_len == 0) {
+        return len;
+    }
+    if (needle_len > len) {
+        return len;
+    }
+    if (needle_len <= DS_FIND_SHORT_NEEDLE) {
+        return ds_string_rfind_short(str, len, needle, needle_len);
+    }
+    return ds_string_rfind_two_way(str, len, needle, needle_len);
+}
+
+// Find the last occurrence of a needle in the string slice
+//
+// Like ds_string_slice_find, short needles are found with a SIMD filter on
+// their first and last bytes and long needles with the Two-Way algorithm, both
+// scanning from the end. Returns true if the needle was found, and stores its
+// index in index. Returns false otherwise.
+DSHDEF boolean ds_string_slice_rfind(ds_string_slice *ss,
+                                     ds_string_slice *needle,
+                                     unsigned long *index) {
+    unsigned long found = ds_string_rfind(ss->str, ss->len, needle->str,
+                                          needle->len);
+    if (found == ss->len && needle->len > 0) {
+        return false;
+    }
+
+    *index = found;
+    return true;
+}
+
+// Count the non overlapping occurrences of a needle in the string slice
+//
+// Returns the number of occurrences, or 0 for an empty needle.
+DSHDEF unsigned long ds_string_slice_count(ds_string_slice *ss,
+                                           ds_string_slice *needle) {
+    unsigned long count = 0;
+
+    if (needle->len == 0) {
+        return 0;
+    }
+
+    unsigned long offset = 0;
+    while (offset < ss->len) {
+        unsigned long found = ds_string_find(ss->str + offset, ss->len - offset,
+                                             needle->str, needle->len);
+        if (found == ss->len - offset) {
+            break;
+        }
+        count++;
+        offset += found + needle->len;
+    }
+
+    return count;
+}
+
+// Initialize the line iterator over a whole buffer with a custom allocator
+DSHDEF void ds_line_iterator_init_allocator(ds_line_iterator *it, char *buffer,
+                                            unsigned long len,
+                                            DS_ALLOCATOR *allocator) {
+    ds_string_slice_init_allocator(&it->rest, buffer, len, allocator);
+    ds_string_builder_init_allocator(&it->carry, allocator);
+    it->carry_used = false;
+    it->finished = true;
+    it->failed = false;
+}
+
+// Initialize the line iterator over a whole buffer
+DSHDEF void ds_line_iterator_init(ds_line_iterator *it, char *buffer,
+                                  unsigned long len) {
+    ds_line_iterator_init_allocator(it, buffer, len, NULL);
+}
+
+// Initialize the line iterator for incremental input with a custom allocator
+//
+// The input is given with ds_line_iterator_feed, and the end of the input is
+// marked with ds_line_iterator_finish.
+DSHDEF void ds_line_iterator_init_stream_allocator(ds_line_iterator *it,
+                                                   DS_ALLOCATOR *allocator) {
+    ds_line_iterator_init_allocator(it, NULL, 0, allocator);
+    it->finished = false;
+}
+
+// Initialize the line iterator for incremental input
+DSHDEF void ds_line_iterator_init_stream(ds_line_iterator *it) {
+    ds_line_iterator_init_stream_allocator(it, NULL);
+}
+
+// Feed the next chunk of input to the line iterator
+//
+// Should be called once ds_line_iterator_next returns false. The chunk must
+// stay valid until ds_line_iterator_next returns false again.
+DSHDEF void ds_line_iterator_feed(ds_line_iterator *it, char *chunk,
+                                  unsigned long len) {
+    it->rest.str = chunk;
+    it->rest.len = len;
+}
+
+// Mark the end of the input, so the last line is yielded even if it does not
+// end with a newline
+DSHDEF void ds_line_iterator_finish(ds_line_iterator *it) {
+    it->finished = true;
+}
+
+// Strip the carriage return of a "\r\n" line ending from the line
+static void ds_line_iterator_strip(ds_string_slice *line) {
+    if (line->len > 0 && line->str[line->len - 1] == '\r') {
+        line->len--;
+    }
+}
+
+// Get the next line from the line iterator
+//
+// The line does not contain the line ending, and it is valid until the next
+// call. Returns true if a line was found, false if the input is exhausted (or
+// if more input has to be fed, for incremental input) or in case of an error.
+// When it stops, failed tells an error apart; the input that could not be
+// carried over is then left in the iterator.
+DSHDEF boolean ds_line_iterator_next(ds_line_iterator *it,
+                                     ds_string_slice *line) {
+    boolean result = true;
+
+    if (it->carry_used) {
+        it->carry.items.count = 0;
+        it->carry_used = false;
+    }
+
+    unsigned long index = ds_string_index_of(it->rest.str, it->rest.len, '\n');
+
+    if (index < it->rest.len) {
+        if (it->carry.items.count > 0) {
+            if (ds_string_builder_appendn(&it->carry, it->rest.str, index) !=
+                DS_OK) {
+                it->failed = true;
+                return_defer(false);
+            }
+            ds_string_slice_init_allocator(line, it->carry.items.items,
+                                           it->carry.items.count,
+                                           it->rest.allocator);
+            it->carry_used = true;
+        } else {
+            ds_string_slice_init_allocator(line, it->rest.str, index,
+                                           it->rest.allocator);
+        }
+
+        it->rest.str += index + 1;
+        it->rest.len -= index + 1;
+        ds_line_iterator_strip(line);
+        return_defer(true);
+    }
+
+    if (!it->finished) {
+        if (it->rest.len > 0 &&
+            ds_string_builder_appendn(&it->carry, it->rest.str,
+                                      it->rest.len) != DS_OK) {
+            DS_LOG_ERROR("Failed to carry the line over");
+            it->failed = true;
+            return_defer(false);
+        }
+        it->rest.str += it->rest.len;
+        it->rest.len = 0;
+        return_defer(false);
+    }
+
+    if (it->carry.items.count > 0) {
+        if (ds_string_builder_appendn(&it->carry, it->rest.str,
+                                      it->rest.len) != DS_OK) {
+            it->failed = true;
+            return_defer(false);
+        }
+        ds_string_slice_init_allocator(line, it->carry.items.items,
+                                       it->carry.items.count,
+                                       it->rest.allocator);
+        it->carry_used = true;
+    } else if (it->rest.len > 0) {
+        *line = it->rest;
+    } else {
+        return_defer(false);
+    }
+
+    it->rest.str += it->rest.len;
+    it->rest.len = 0;
+    ds_line_iterator_strip(line);
+
+defer:
+    return result;
+}
+
+// Free the line iterator
+DSHDEF void ds_line_iterator_free(ds_line_iterator *it) {
+    ds_string_builder_free(&it->carry);
+    ds_string_slice_free(&it->rest);
+    it->carry_used = false;
+    it->finished = false;
+    it->failed = false;
+}
+
+// Count the lines in the string slice without materializing them
+//
+// Returns the number of lines ds_line_iterator_next would yield.
+DSHDEF unsigned long ds_string_slice_count_lines(ds_string_slice *ss) {
+    unsigned long count = 0;
+    unsigned long i = 0;
+
+#ifdef DS_AVX2
+    __m256i newline256 = _mm256_set1_epi8('\n');
+    for (; i + 32 <= ss->len; i += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(ss->str + i));
+        count += __builtin_popcount((unsigned int)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(block, newline256)));
+    }
+#endif
+
+#ifdef DS_SSE2
+    __m128i newline128 = _mm_set1_epi8('\n');
+    for (; i + 16 <= ss->len; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *)(ss->str + i));
+        count += __builtin_popcount((unsigned int)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(block, newline128)));
+    }
+#endif
+
+    for (; i < ss->len; i++) {
+        count += ss->str[i] == '\n';
+    }
+
+    if (ss->len > 0 && ss->str[ss->len - 1] != '\n') {
+        count++;
+    }
+
+    return count;
+}
+
+// Initialize the rope builder with a custom allocator
+//
+// The chunk_size parameter is the size of each chunk of the rope.
+DSHDEF void ds_rope_builder_init_allocator(ds_rope_builder *rb,
+                                           unsigned long chunk_size,
+                                           DS_ALLOCATOR *allocator) {
+    rb->allocator = allocator;
+    ds_dynamic_array_init_allocator(&rb->chunks, sizeof(ds_rope_chunk),
+                                    allocator);
+    rb->chunk_size = chunk_size;
+    rb->len = 0;
+}
+
+// Initialize the rope builder with chunks of DS_RB_CHUNK_SIZE bytes
+DSHDEF void ds_rope_builder_init(ds_rope_builder *rb) {
+    ds_rope_builder_init_allocator(rb, DS_RB_CHUNK_SIZE, NULL);
+}
+
+// Get the last chunk of the rope builder, or NULL if there are no chunks
+static ds_rope_chunk *ds_rope_builder_tail(ds_rope_builder *rb) {
+    if (rb->chunks.count == 0) {
+        return NULL;
+    }
+
+    return (ds_rope_chunk *)rb->chunks.items + rb->chunks.count - 1;
+}
+
+// Add a new chunk that can hold at least size bytes to the rope builder
+//
+// Returns the new chunk, or NULL if it could not be allocated.
+static ds_rope_chunk *ds_rope_builder_grow(ds_rope_builder *rb,
+                                           unsigned long size) {
+    ds_rope_chunk chunk = {0};
+    chunk.capacity = DS_MAX(size, rb->chunk_size);
+    chunk.data = DS_MALLOC(rb->allocator, chunk.capacity);
+    if (chunk.data == NULL) {
+        DS_LOG_ERROR("Failed to allocate rope chunk");
+        return NULL;
+    }
+
+    if (ds_dynamic_array_append(&rb->chunks, &chunk) != DS_OK) {
+        DS_FREE(rb->allocator, chunk.data);
+        return NULL;
+    }
+
+    return ds_rope_builder_tail(rb);
+}
+
+// Append a formatted string to the rope builder
+//
+// The string is formatted straight into the last chunk. If it does not fit,
+// it is formatted again into a new chunk (which is larger than the chunk size
+// only for strings that do not fit in an empty chunk).
+//
+// Returns 0 if the string was appended successfully.
+DSHDEF ds_result ds_rope_builder_append(ds_rope_builder *rb,
+                                        const char *format, ...) {
+    ds_result result = DS_OK;
+
+    ds_rope_chunk *tail = ds_rope_builder_tail(rb);
+    char *dest = NULL;
+    unsigned long available = 0;
+    if (tail != NULL) {
+        dest = tail->data + tail->len;
+        available = tail->capacity - tail->len;
+    }
+
+    va_list args;
+    va_start(args, format);
+    int needed = vsnprintf(dest, available, format, args);
+    va_end(args);
+
+    if (needed < 0) {
+        DS_LOG_ERROR("Failed to format string");
+        return_defer(DS_ERR);
+    }
+
+    if ((unsigned long)needed >= available) {
+        tail = ds_rope_builder_grow(rb, needed + 1);
+        if (tail == NULL) {
+            return_defer(DS_ERR);
+        }
+
+        va_start(args, format);
+        vsnprintf(tail->data, needed + 1, format, args);
+        va_end(args);
+    }
+
+    tail->len += needed;
+    rb->len += needed;
+
+defer:
+    return result;
+}
+
+// Append a string of len bytes to the rope builder
+//
+// Returns 0 if the string was appended successfully.
+DSHDEF ds_result ds_rope_builder_appendn(ds_rope_builder *rb, const char *str,
+                                         unsigned long len) {
+    ds_result result = DS_OK;
+
+    ds_rope_chunk *tail = ds_rope_builder_tail(rb);
+    while (len > 0) {
+        if (tail == NULL || tail->len == tail->capacity) {
+            tail = ds_rope_builder_grow(rb, 0);
+            if (tail == NULL) {
+                return_defer(DS_ERR);
+            }
+        }
+
+        unsigned long n = DS_MIN(len, tail->capacity - tail->len);
+        DS_MEMCPY(tail->data + tail->len, str, n);
+        tail->len += n;
+        rb->len += n;
+        str += n;
+        len -= n;
+    }
+
+defer:
+    return result;
+}
+
+// Append a character to the rope builder
+//
+// Returns 0 if the character was appended successfully.
+DSHDEF ds_result ds_rope_builder_appendc(ds_rope_builder *rb, char chr) {
+    return ds_rope_builder_appendn(rb, &chr, 1);
+}
+
+// Linearize the rope builder into a single string
+//
+// Returns 0 if the string was built successfully, 1 if the string could not be
+// allocated.
+DSHDEF ds_result ds_rope_builder_build(ds_rope_builder *rb, char **str) {
+    ds_result result = DS_OK;
+
+    *str = DS_MALLOC(rb->allocator, rb->len + 1);
+    if (*str == NULL) {
+        DS_LOG_ERROR("Failed to allocate string");
+        return_defer(DS_ERR);
+    }
+
+    unsigned long offset = 0;
+    for (unsigned long i = 0; i < rb->chunks.count; i++) {
+        ds_rope_chunk *chunk = (ds_rope_chunk *)rb->chunks.items + i;
+        DS_MEMCPY(*str + offset, chunk->data, chunk->len);
+        offset += chunk->len;
+    }
+    (*str)[offset] = '\0';
+
+defer:
+    return result;
+}
+
+// Flush the contents of the rope builder to a file descriptor
+//
+// All the chunks are written with vectored writes (writev), without
+// linearizing them first, and the rope builder is cleared afterwards. If the
+// write fails partway, the bytes that were written are dropped from the rope
+// builder, so the flush can be retried with the rest.
+//
+// Returns the number of bytes written, or -1 in case of an error.
+DSHDEF long ds_rope_builder_flush(ds_rope_builder *rb, int fd) {
+#ifdef DS_POSIX
+    long result = 0;
+    struct iovec *iov = NULL;
+
+    if (rb->chunks.count == 0) {
+        return_defer(0);
+    }
+
+    iov = DS_MALLOC(rb->allocator, rb->chunks.count * sizeof(struct iovec));
+    if (iov == NULL) {
+        DS_LOG_ERROR("Failed to allocate io vectors");
+        return_defer(-1);
+    }
+
+    for (unsigned long i = 0; i < rb->chunks.count; i++) {
+        ds_rope_chunk *chunk = (ds_rope_chunk *)rb->chunks.items + i;
+        iov[i].iov_base = chunk->data;
+        iov[i].iov_len = chunk->len;
+    }
+
+    result = ds_writev_all(fd, iov, rb->chunks.count);
+    if (result >= 0) {
+        ds_rope_builder_clear(rb);
+        return_defer(result);
+    }
+
+    // Drop the chunks that were written, and the written part of the chunk
+    // the error happened in
+    unsigned long written = 0;
+    while (written < rb->chunks.count && iov[written].iov_len == 0) {
+        written++;
+    }
+    ds_rope_chunk *chunks = rb->chunks.items;
+    for (unsigned long i = 0; i < written; i++) {
+        rb->len -= chunks[i].len;
+        DS_FREE(rb->allocator, chunks[i].data);
+    }
+    DS_MEMMOVE(chunks, chunks + written,
+               (rb->chunks.count - written) * sizeof(ds_rope_chunk));
+    rb->chunks.count -= written;
+    if (rb->chunks.count > 0 && iov[written].iov_len < chunks[0].len) {
+        unsigned long rest = iov[written].iov_len;
+        DS_MEMMOVE(chunks[0].data, chunks[0].data + chunks[0].len - rest, rest);
+        rb->len -= chunks[0].len - rest;
+        chunks[0].len = rest;
+    }
+
+defer:
+    if (iov != NULL) {
+        DS_FREE(rb->allocator, iov);
+    }
+    return result;
+#else
+    (void)(rb);
+    (void)(fd);
+    DS_LOG_ERROR("Flushing to a file descriptor requires POSIX");
+    return -1;
+#endif
+}
+
+// Clear the rope builder, freeing all its chunks
+DSHDEF void ds_rope_builder_clear(ds_rope_builder *rb) {
+    for (unsigned long i = 0; i < rb->chunks.count; i++) {
+        ds_rope_chunk *chunk = (ds_rope_chunk *)rb->chunks.items + i;
+        DS_FREE(rb->allocator, chunk->data);
+    }
+
+    rb->chunks.count = 0;
+    rb->len = 0;
+}
+
+// Free the rope builder
+DSHDEF void ds_rope_builder_free(ds_rope_builder *rb) {
+    ds_rope_builder_clear(rb);
+    ds_dynamic_array_free(&rb->chunks);
+
+    rb->allocator = NULL;
+    rb->chunk_size = 0;
+}
+
+typedef struct ds_string_matcher_state {
+        unsigned int parent; // the state before this one in the trie
+        unsigned int fail;   // longest proper suffix that is also a prefix
+        unsigned int output; // pattern id + 1 that ends here, 0 for none
+        unsigned int link;   // next state on the fail chain with an output
+} ds_string_matcher_state;
+
+// Check if the transition of the state is an edge of the trie, and not one
+// that was filled in from the failure links by ds_string_matcher_build (those
+// always lead to a state that is not deeper than the state itself)
+static boolean ds_string_matcher_is_edge(const ds_string_matcher_state *states,
+                                         unsigned int state,
+                                         unsigned int next) {
+    return next != 0 && states[next].parent == state;
+}
+
+// Initialize the string matcher with a custom allocator
+DSHDEF void ds_string_matcher_init_allocator(ds_string_matcher *sm,
+                                             DS_ALLOCATOR *allocator) {
+    sm->allocator = allocator;
+    ds_dynamic_array_init_allocator(&sm->transitions, sizeof(unsigned int),
+                                    allocator);
+    ds_dynamic_array_init_allocator(&sm->states,
+                                    sizeof(ds_string_matcher_state), allocator);
+    ds_dynamic_array_init_allocator(&sm->patterns, sizeof(unsigned long),
+                                    allocator);
+    sm->built = false;
+}
+
+// Initialize the string matcher
+DSHDEF void ds_string_matcher_init(ds_string_matcher *sm) {
+    ds_string_matcher_init_allocator(sm, NULL);
+}
+
+// Add a new state to the trie of the string matcher
+//
+// Returns 0 if the state was added successfully, 1 otherwise.
+static ds_result ds_string_matcher_new_state(ds_string_matcher *sm) {
+    unsigned int transitions[256] = {0};
+    ds_string_matcher_state state = {0};
+
+    if (ds_dynamic_array_append_many(&sm->transitions, (void **)transitions,
+                                     256) != DS_OK ||
+        ds_dynamic_array_append(&sm->states, &state) != DS_OK) {
+        return DS_ERR;
+    }
+
+    return DS_OK;
+}
+
+// Add a pattern to the string matcher
+//
+// The patterns get consecutive ids starting from 0. If the same pattern is
+// added twice, only the first id is reported. The string matcher has to be
+// built again after adding patterns.
+//
+// Returns 0 if the pattern was added successfully, 1 otherwise.
+DSHDEF ds_result ds_string_matcher_add(ds_string_matcher *sm,
+                                       ds_string_slice *pattern) {
+    ds_result result = DS_OK;
+
+    if (pattern->len == 0) {
+        DS_LOG_ERROR("Cannot match an empty pattern");
+        return_defer(DS_ERR);
+    }
+
+    if (sm->states.count == 0 && ds_string_matcher_new_state(sm) != DS_OK) {
+        return_defer(DS_ERR);
+    }
+
+    unsigned int state = 0;
+    for (unsigned long i = 0; i < pattern->len; i++) {
+        unsigned char chr = (unsigned char)pattern->str[i];
+        unsigned int *transitions =
+            (unsigned int *)sm->transitions.items + 256 * state;
+        if (!ds_string_matcher_is_edge(sm->states.items, state,
+                                       transitions[chr])) {
+            if (ds_string_matcher_new_state(sm) != DS_OK) {
+                return_defer(DS_ERR);
+            }
+            transitions = (unsigned int *)sm->transitions.items + 256 * state;
+            transitions[chr] = sm->states.count - 1;
+            ((ds_string_matcher_state *)sm->states.items)[transitions[chr]]
+                .parent = state;
+        }
+        state = transitions[chr];
+    }
+
+    ds_string_matcher_state *end = (ds_string_matcher_state *)sm->states.items + state;
+    if (end->output == 0) {
+        end->output = sm->patterns.count + 1;
+    }
+
+    if (ds_dynamic_array_append(&sm->patterns, &pattern->len) != DS_OK) {
+        return_defer(DS_ERR);
+    }
+
+    sm->built = false;
+
+defer:
+    return result;
+}
+
+// Build the automaton of the string matcher
+//
+// Computes the failure links in breadth first order and turns the trie into a
+// complete transition table, so matching never follows failure links. The
+// string matcher can be built again after adding more patterns.
+//
+// Returns 0 if the automaton was built successfully, 1 otherwise.
+DSHDEF ds_result ds_string_matcher_build(ds_string_matcher *sm) {
+    ds_result result = DS_OK;
+    unsigned int *queue = NULL;
+
+    if (sm->states.count == 0 && ds_string_matcher_new_state(sm) != DS_OK) {
+        return_defer(DS_ERR);
+    }
+
+    queue = DS_MALLOC(sm->allocator, sm->states.count * sizeof(unsigned int));
+    if (queue == NULL) {
+        DS_LOG_ERROR("Failed to allocate string matcher queue");
+        return_defer(DS_ERR);
+    }
+
+    unsigned int *transitions = (unsigned int *)sm->transitions.items;
+    ds_string_matcher_state *states = (ds_string_matcher_state *)sm->states.items;
+    unsigned long head = 0;
+    unsigned long tail = 0;
+
+    for (unsigned int chr = 0; chr < 256; chr++) {
+        unsigned int next = transitions[chr];
+        if (next != 0) {
+            states[next].fail = 0;
+            states[next].link = 0;
+            queue[tail++] = next;
+        }
+    }
+
+    while (head < tail) {
+        unsigned int state = queue[head++];
+        unsigned int fail = states[state].fail;
+
+        for (unsigned int chr = 0; chr < 256; chr++) {
+            unsigned int next = transitions[256 * state + chr];
+            if (!ds_string_matcher_is_edge(states, state, next)) {
+                transitions[256 * state + chr] = transitions[256 * fail + chr];
+                continue;
+            }
+
+            unsigned int next_fail = transitions[256 * fail + chr];
+            states[next].fail = next_fail;
+            states[next].link = states[next_fail].output != 0
+                                    ? next_fail
+                                    : states[next_fail].link;
+            queue[tail++] = next;
+        }
+    }
+
+    sm->built = true;
+
+defer:
+    if (queue != NULL) {
+        DS_FREE(sm->allocator, queue);
+    }
+    return result;
+}
+
+// Find the first match (the one that ends first) in the string slice
+//
+// Returns true if a match was found, and stores it in match. Returns false
+// otherwise.
+DSHDEF boolean ds_string_matcher_find(ds_string_matcher *sm,
+                                      ds_string_slice *ss,
+                                      ds_string_match *match) {
+    if (!sm->built) {
+        DS_LOG_ERROR("The string matcher is not built");
+        return false;
+    }
+
+    const unsigned int *transitions = (const unsigned int *)sm->transitions.items;
+    const ds_string_matcher_state *states =
+        (const ds_string_matcher_state *)sm->states.items;
+
+    unsigned int state = 0;
+    for (unsigned long i = 0; i < ss->len; i++) {
+        state = transitions[256 * state + (unsigned char)ss->str[i]];
+
+        unsigned int found = states[state].output != 0 ? state : states[state].link;
+        if (found != 0) {
+            match->pattern = states[found].output - 1;
+            match->len = ((unsigned long *)sm->patterns.items)[match->pattern];
+            match->index = i + 1 - match->len;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Find all the matches in the string slice, including overlapping ones
+//
+// Appends a ds_string_match for every match to the matches array, ordered by
+// the index where the match ends. Returns 0 if the matches were appended
+// successfully, 1 otherwise.
+DSHDEF ds_result ds_string_matcher_find_all(ds_string_matcher *sm,
+                                            ds_string_slice *ss,
+                                            ds_dynamic_array *matches) {
+    ds_result result = DS_OK;
+
+    if (!sm->built) {
+        DS_LOG_ERROR("The string matcher is not built");
+        return_defer(DS_ERR);
+    }
+
+    const unsigned int *transitions = (const unsigned int *)sm->transitions.items;
+    const ds_string_matcher_state *states =
+        (const ds_string_matcher_state *)sm->states.items;
+
+    unsigned int state = 0;
+    for (unsigned long i = 0; i < ss->len; i++) {
+        state = transitions[256 * state + (unsigned char)ss->str[i]];
+
+        unsigned int found = states[state].output != 0 ? state : states[state].link;
+        while (found != 0) {
+            ds_string_match match = {0};
+            match.pattern = states[found].output - 1;
+            match.len = ((unsigned long *)sm->patterns.items)[match.pattern];
+            match.index = i + 1 - match.len;
+            if (ds_dynamic_array_append(matches, &match) != DS_OK) {
+                return_defer(DS_ERR);
+            }
+            found = states[found].link;
+        }
+    }
+
+defer:
+    return result;
+}
+
+// Free the string matcher
+DSHDEF void ds_string_matcher_free(ds_string_matcher *sm) {
+    ds_dynamic_array_free(&sm->transitions);
+    ds_dynamic_array_free(&sm->states);
+    ds_dynamic_array_free(&sm->patterns);
+
+    sm->allocator = NULL;
+    sm->built = false;
+}
+
+#define DS_PATTERN_CHAR 0
+#define DS_PATTERN_SPLIT 1
+#define DS_PATTERN_EMPTY 2
+#define DS_PATTERN_MATCH 3
+
+#define DS_PATTERN_EPSILON 0xFFFFFFFFu
+#define DS_PATTERN_ANY 0xFFFFFFFEu
+
+#define DS_PATTERN_ACCEPT_ANY 1
+#define DS_PATTERN_ACCEPT_END 2
+
+#ifndef DS_PATTERN_MAX_REPEAT
+#define DS_PATTERN_MAX_REPEAT 1000
+#endif
+
+typedef struct ds_pattern_node {
+        unsigned int type;
+        unsigned int arg; // set for DS_PATTERN_CHAR, pattern for DS_PATTERN_MATCH
+        unsigned int out[2];
+} ds_pattern_node;
+
+typedef struct ds_pattern_info {
+        unsigned int start;
+        unsigned int match;
+        boolean anchor_start;
+        boolean anchor_end;
+} ds_pattern_info;
+
+typedef struct ds_pattern_dfa_state {
+        unsigned int flags;   // DS_PATTERN_ACCEPT_ANY and DS_PATTERN_ACCEPT_END
+        unsigned int accepts; // index of the first accepted pattern in accepts
+        unsigned int count;   // number of accepted patterns
+
+        // The accepted patterns are stored as id << 1, plus 1 if the pattern
+        // is only accepted at the end of the input
+} ds_pattern_dfa_state;
+
+// A fragment of the NFA. The holes are the unset outputs of the fragment,
+// chained through the outputs themselves: a hole is node * 2 + output, and
+// each hole stores the next one plus one (0 ends the chain).
+typedef struct ds_pattern_fragment {
+        unsigned int start;
+        unsigned int holes; // first hole plus one
+} ds_pattern_fragment;
+
+typedef struct ds_pattern_parser {
+        ds_pattern *pt;
+        const char *str;
+        unsigned long len;
+        unsigned long pos;
+        unsigned int flags;
+} ds_pattern_parser;
+
+// The edges of the NFA (or of the reversed NFA) grouped by their source node
+typedef struct ds_pattern_graph {
+        DS_ALLOCATOR *allocator;
+        unsigned int count;
+        unsigned int *offsets;    // count + 1
+        unsigned int *targets;    // for each edge
+        unsigned int *sets;       // for each edge, or DS_PATTERN_EPSILON
+        unsigned int *accepts;    // for each node, pattern + 1 or 0
+        unsigned int *accept_end; // for each node, only accepts at the end
+} ds_pattern_graph;
+
+#define DS_PATTERN_SET_HAS(set, chr) (((set)[(chr) >> 3] >> ((chr)&7)) & 1)
+#define DS_PATTERN_SET_ADD(set, chr) ((set)[(chr) >> 3] |= 1 << ((chr)&7))
+
+// Initialize the pattern with a custom allocator
+DSHDEF void ds_pattern_init_allocator(ds_pattern *pt, DS_ALLOCATOR *allocator) {
+    pt->allocator = allocator;
+    ds_dynamic_array_init_allocator(&pt->nodes, sizeof(ds_pattern_node),
+                                    allocator);
+    ds_dynamic_array_init_allocator(&pt->sets, 32, allocator);
+    ds_dynamic_array_init_allocator(&pt->patterns, sizeof(ds_pattern_info),
+                                    allocator);
+    for (unsigned int chr = 0; chr < 256; chr++) {
+        pt->classes[chr] = 0;
+    }
+    pt->class_count = 1;
+    ds_dynamic_array_init_allocator(&pt->forward.transitions,
+                                    sizeof(unsigned int), allocator);
+    ds_dynamic_array_init_allocator(&pt->forward.states,
+                                    sizeof(ds_pattern_dfa_state), allocator);
+    ds_dynamic_array_init_allocator(&pt->forward.accepts, sizeof(unsigned int),
+                                    allocator);
+    ds_dynamic_array_init_allocator(&pt->reverse.transitions,
+                                    sizeof(unsigned int), allocator);
+    ds_dynamic_array_init_allocator(&pt->reverse.states,
+                                    sizeof(ds_pattern_dfa_state), allocator);
+    ds_dynamic_array_init_allocator(&pt->reverse.accepts, sizeof(unsigned int),
+                                    allocator);
+    pt->match_start = 0;
+    pt->search_start = 0;
+    pt->reverse_start = 0;
+    pt->built = false;
+}
+
+// Initialize the pattern
+DSHDEF void ds_pattern_init(ds_pattern *pt) {
+    ds_pattern_init_allocator(pt, NULL);
+}
+
+static ds_result ds_pattern_new_node(ds_pattern_parser *parser,
+                                     unsigned int type, unsigned int arg,
+                                     unsigned int *node) {
+    ds_pattern_node item = {.type = type, .arg = arg, .out = {0, 0}};
+
+    if (parser->pt->nodes.count >= DS_PATTERN_MAX_NODES) {
+        DS_LOG_ERROR("Pattern is too large");
+        return DS_ERR;
+    }
+
+    *node = parser->pt->nodes.count;
+    return ds_dynamic_array_append(&parser->pt->nodes, &item);
+}
+
+// Add the other case of every ASCII letter in the set, for DS_PATTERN_ICASE
+static void ds_pattern_set_fold(ds_pattern_parser *parser, unsigned char *set) {
+    if (!(parser->flags & DS_PATTERN_ICASE)) {
+        return;
+    }
+
+    for (unsigned int chr = 'a'; chr <= 'z'; chr++) {
+        if (DS_PATTERN_SET_HAS(set, chr) || DS_PATTERN_SET_HAS(set, chr - 32)) {
+            DS_PATTERN_SET_ADD(set, chr);
+            DS_PATTERN_SET_ADD(set, chr - 32);
+        }
+    }
+}
+
+static ds_result ds_pattern_new_set(ds_pattern_parser *parser,
+                                    unsigned char *set, unsigned int *index) {
+    ds_pattern_set_fold(parser, set);
+
+    *index = parser->pt->sets.count;
+    return ds_dynamic_array_append(&parser->pt->sets, set);
+}
+
+static unsigned int *ds_pattern_out(ds_pattern *pt, unsigned int hole) {
+    return &((ds_pattern_node *)pt->nodes.items)[hole / 2].out[hole % 2];
+}
+
+// Point all the holes of the list to target
+static void ds_pattern_patch(ds_pattern *pt, unsigned int holes,
+                             unsigned int target) {
+    while (holes != 0) {
+        unsigned int *out = ds_pattern_out(pt, holes - 1);
+        holes = *out;
+        *out = target;
+    }
+}
+
+// Concatenate two lists of holes
+static unsigned int ds_pattern_join(ds_pattern *pt, unsigned int holes1,
+                                    unsigned int holes2) {
+    if (holes1 == 0) {
+        return holes2;
+    }
+
+    unsigned int *out = ds_pattern_out(pt, holes1 - 1);
+    while (*out != 0) {
+        out = ds_pattern_out(pt, *out - 1);
+    }
+    *out = holes2;
+
+    return holes1;
+}
+
+// Create a fragment that matches one byte of the set
+static ds_result ds_pattern_char(ds_pattern_parser *parser, unsigned char *set,
+                                 ds_pattern_fragment *fragment) {
+    unsigned int index = 0;
+    unsigned int node = 0;
+
+    if (ds_pattern_new_set(parser, set, &index) != DS_OK ||
+        ds_pattern_new_node(parser, DS_PATTERN_CHAR, index, &node) != DS_OK) {
+        return DS_ERR;
+    }
+
+    fragment->start = node;
+    fragment->holes = node * 2 + 1;
+    return DS_OK;
+}
+
+// Create a fragment that matches the empty string
+static ds_result ds_pattern_empty(ds_pattern_parser *parser,
+                                  ds_pattern_fragment *fragment) {
+    unsigned int node = 0;
+
+    if (ds_pattern_new_node(parser, DS_PATTERN_EMPTY, 0, &node) != DS_OK) {
+        return DS_ERR;
+    }
+
+    fragment->start = node;
+    fragment->holes = node * 2 + 1;
+    return DS_OK;
+}
+
+static void ds_pattern_concat(ds_pattern *pt, ds_pattern_fragment *fragment,
+                              ds_pattern_fragment *next) {
+    ds_pattern_patch(pt, fragment->holes, next->start);
+    fragment->holes = next->holes;
+}
+
+static ds_result ds_pattern_alternate(ds_pattern_parser *parser,
+                                      ds_pattern_fragment *fragment,
+                                      ds_pattern_fragment *other) {
+    unsigned int node = 0;
+
+    if (ds_pattern_new_node(parser, DS_PATTERN_SPLIT, 0, &node) != DS_OK) {
+        return DS_ERR;
+    }
+
+    ds_pattern_node *split = (ds_pattern_node *)parser->pt->nodes.items + node;
+    split->out[0] = fragment->start;
+    split->out[1] = other->start;
+
+    fragment->start = node;
+    fragment->holes = ds_pattern_join(parser->pt, fragment->holes, other->holes);
+    return DS_OK;
+}
+
+// Repeat the fragment: "*" (min 0, many), "+" (min 1, many) or "?" (min 0)
+static ds_result ds_pattern_repeat(ds_pattern_parser *parser,
+                                   ds_pattern_fragment *fragment, boolean min,
+                                   boolean many) {
+    unsigned int node = 0;
+
+    if (ds_pattern_new_node(parser, DS_PATTERN_SPLIT, 0, &node) != DS_OK) {
+        return DS_ERR;
+    }
+
+    ((ds_pattern_node *)parser->pt->nodes.items + node)->out[0] =
+        fragment->start;
+
+    if (many) {
+        ds_pattern_patch(parser->pt, fragment->holes, node);
+        fragment->holes = node * 2 + 2;
+    } else {
+        fragment->holes =
+            ds_pattern_join(parser->pt, fragment->holes, node * 2 + 2);
+    }
+
+    if (!min) {
+        fragment->start = node;
+    }
+
+    return DS_OK;
+}
+
+static void ds_pattern_set_range(unsigned char *set, unsigned int from,
+                                 unsigned int to) {
+    for (unsigned int chr = from; chr <= to; chr++) {
+        DS_PATTERN_SET_ADD(set, chr);
+    }
+}
+
+static void ds_pattern_set_invert(unsigned char *set) {
+    for (unsigned int i = 0; i < 32; i++) {
+        set[i] = ~set[i];
+    }
+}
+
+static int ds_pattern_hex(char chr) {
+    if (chr >= '0' && chr <= '9') {
+        return chr - '0';
+    }
+    if (chr >= 'a' && chr <= 'f') {
+        return chr - 'a' + 10;
+    }
+    if (chr >= 'A' && chr <= 'F') {
+        return chr - 'A' + 10;
+    }
+    return -1;
+}
+
+// Parse the escape after a backslash into a set of bytes
+//
+// Returns 0 if the escape was parsed, 1 if the pattern ends after the
+// backslash.
+static ds_result ds_pattern_parse_escape(ds_pattern_parser *parser,
+                                         unsigned char *set) {
+    if (parser->pos >= parser->len) {
+        DS_LOG_ERROR("Pattern ends with a backslash");
+        return DS_ERR;
+    }
+
+    unsigned char chr = (unsigned char)parser->str[parser->pos++];
+    unsigned char negated[32] = {0};
+
+    if (!(parser->flags & DS_PATTERN_REGEX)) {
+        DS_PATTERN_SET_ADD(set, chr);
+        return DS_OK;
+    }
+
+    switch (chr) {
+    case 'd':
+    case 'D':
+        ds_pattern_set_range(negated, '0', '9');
+        break;
+    case 'w':
+    case 'W':
+        ds_pattern_set_range(negated, '0', '9');
+        ds_pattern_set_range(negated, 'a', 'z');
+        ds_pattern_set_range(negated, 'A', 'Z');
+        DS_PATTERN_SET_ADD(negated, '_');
+        break;
+    case 's':
+    case 'S':
+        ds_pattern_set_range(negated, '\t', '\r');
+        DS_PATTERN_SET_ADD(negated, ' ');
+        break;
+    case 'n':
+        DS_PATTERN_SET_ADD(set, '\n');
+        return DS_OK;
+    case 't':
+        DS_PATTERN_SET_ADD(set, '\t');
+        return DS_OK;
+    case 'r':
+        DS_PATTERN_SET_ADD(set, '\r');
+        return DS_OK;
+    case 'f':
+        DS_PATTERN_SET_ADD(set, '\f');
+        return DS_OK;
+    case 'v':
+        DS_PATTERN_SET_ADD(set, '\v');
+        return DS_OK;
+    case 'x':
+        if (parser->pos + 2 > parser->len ||
+            ds_pattern_hex(parser->str[parser->pos]) < 0 ||
+            ds_pattern_hex(parser->str[parser->pos + 1]) < 0) {
+            DS_LOG_ERROR("Invalid \\x escape in pattern");
+            return DS_ERR;
+        }
+        DS_PATTERN_SET_ADD(set, ds_pattern_hex(parser->str[parser->pos]) * 16 +
+                                    ds_pattern_hex(parser->str[parser->pos + 1]));
+        parser->pos += 2;
+        return DS_OK;
+    default:
+        DS_PATTERN_SET_ADD(set, chr);
+        return DS_OK;
+    }
+
+    if (chr == 'D' || chr == 'W' || chr == 'S') {
+        ds_pattern_set_invert(negated);
+    }
+    for (unsigned int i = 0; i < 32; i++) {
+        set[i] |= negated[i];
+    }
+
+    return DS_OK;
+}
+
+// Parse a bracket expression, after the opening bracket, into a set of bytes
+//
+// Returns 0 if the bracket expression was parsed, 1 if it is not closed.
+static ds_result ds_pattern_parse_class(ds_pattern_parser *parser,
+                                        unsigned char *set) {
+    boolean negate = false;
+
+    if (parser->pos < parser->len &&
+        (parser->str[parser->pos] == '^' ||
+         (parser->str[parser->pos] == '!' &&
+          !(parser->flags & DS_PATTERN_REGEX)))) {
+        negate = true;
+        parser->pos++;
+    }
+
+    boolean first = true;
+    while (parser->pos < parser->len &&
+           (first || parser->str[parser->pos] != ']')) {
+        unsigned char item[32] = {0};
+        unsigned int low = (unsigned char)parser->str[parser->pos++];
+        first = false;
+
+        if (low == '\\') {
+            if (ds_pattern_parse_escape(parser, item) != DS_OK) {
+                return DS_ERR;
+            }
+            // A range can only start at an escape that is a single byte
+            unsigned int count = 0;
+            for (unsigned int chr = 0; chr < 256; chr++) {
+                if (DS_PATTERN_SET_HAS(item, chr)) {
+                    count++;
+                    low = chr;
+                }
+            }
+            if (count != 1) {
+                for (unsigned int i = 0; i < 32; i++) {
+                    set[i] |= item[i];
+                }
+                continue;
+            }
+        }
+
+        unsigned int high = low;
+        if (parser->pos + 1 < parser->len && parser->str[parser->pos] == '-' &&
+            parser->str[parser->pos + 1] != ']') {
+            parser->pos++;
+            high = (unsigned char)parser->str[parser->pos++];
+            if (high == '\\') {
+                unsigned char end[32] = {0};
+                if (ds_pattern_parse_escape(parser, end) != DS_OK) {
+                    return DS_ERR;
+                }
+                for (high = 255; high > 0 && !DS_PATTERN_SET_HAS(end, high);
+                     high--) {
+                }
+            }
+            if (high < low) {
+                DS_LOG_ERROR("Invalid range in pattern");
+                return DS_ERR;
+            }
+        }
+
+        ds_pattern_set_range(set, low, high);
+    }
+
+    if (parser->pos >= parser->len) {
+        DS_LOG_ERROR("Unterminated [ in pattern");
+        return DS_ERR;
+    }
+    parser->pos++;
+
+    if (negate) {
+        // Fold first, so [^a] does not match A either
+        ds_pattern_set_fold(parser, set);
+        ds_pattern_set_invert(set);
+    }
+
+    return DS_OK;
+}
+
+static ds_result ds_pattern_parse_glob(ds_pattern_parser *parser,
+                                       unsigned int depth,
+                                       ds_pattern_fragment *fragment);
+static ds_result ds_pattern_parse_alternation(ds_pattern_parser *parser,
+                                              unsigned int depth,
+                                              ds_pattern_fragment *fragment);
+static ds_result ds_pattern_parse_repetition(ds_pattern_parser *parser,
+                                             unsigned int depth,
+                                             unsigned long end,
+                                             ds_pattern_fragment *fragment);
+
+// Parse the alternatives of a glob brace expression, after the opening brace
+static ds_result ds_pattern_parse_braces(ds_pattern_parser *parser,
+                                         unsigned int depth,
+                                         ds_pattern_fragment *fragment) {
+    if (ds_pattern_parse_glob(parser, depth + 1, fragment) != DS_OK) {
+        return DS_ERR;
+    }
+
+    while (parser->pos < parser->len && parser->str[parser->pos] == ',') {
+        ds_pattern_fragment other = {0};
+        parser->pos++;
+        if (ds_pattern_parse_glob(parser, depth + 1, &other) != DS_OK ||
+            ds_pattern_alternate(parser, fragment, &other) != DS_OK) {
+            return DS_ERR;
+        }
+    }
+
+    if (parser->pos >= parser->len) {
+        DS_LOG_ERROR("Unterminated { in pattern");
+        return DS_ERR;
+    }
+    parser->pos++;
+
+    return DS_OK;
+}
+
+// Parse a glob, up to the end of the pattern or of the current alternative
+static ds_result ds_pattern_parse_glob(ds_pattern_parser *parser,
+                                       unsigned int depth,
+                                       ds_pattern_fragment *fragment) {
+    if (ds_pattern_empty(parser, fragment) != DS_OK) {
+        return DS_ERR;
+    }
+
+    while (parser->pos < parser->len) {
+        char chr = parser->str[parser->pos];
+        unsigned char set[32] = {0};
+        ds_pattern_fragment next = {0};
+
+        if (depth > 0 && (chr == ',' || chr == '}')) {
+            break;
+        }
+        parser->pos++;
+
+        if (chr == '{') {
+            if (ds_pattern_parse_braces(parser, depth, &next) != DS_OK) {
+                return DS_ERR;
+            }
+        } else {
+            if (chr == '*' || chr == '?') {
+                ds_pattern_set_invert(set);
+            } else if (chr == '[') {
+                if (ds_pattern_parse_class(parser, set) != DS_OK) {
+                    return DS_ERR;
+                }
+            } else if (chr == '\\') {
+                if (ds_pattern_parse_escape(parser, set) != DS_OK) {
+                    return DS_ERR;
+                }
+            } else {
+                DS_PATTERN_SET_ADD(set, (unsigned char)chr);
+            }
+
+            if (ds_pattern_char(parser, set, &next) != DS_OK) {
+                return DS_ERR;
+            }
+            if (chr == '*' &&
+                ds_pattern_repeat(parser, &next, false, true) != DS_OK) {
+                return DS_ERR;
+            }
+        }
+
+        ds_pattern_concat(parser->pt, fragment, &next);
+    }
+
+    return DS_OK;
+}
+
+// Parse a regex atom: a group, a class, an escape or a single byte
+static ds_result ds_pattern_parse_atom(ds_pattern_parser *parser,
+                                       unsigned int depth,
+                                       ds_pattern_fragment *fragment) {
+    unsigned char set[32] = {0};
+    char chr = parser->str[parser->pos++];
+
+    switch (chr) {
+    case '(':
+        if (parser->pos + 1 < parser->len && parser->str[parser->pos] == '?' &&
+            parser->str[parser->pos + 1] == ':') {
+            parser->pos += 2;
+        }
+        if (ds_pattern_parse_alternation(parser, depth + 1, fragment) !=
+            DS_OK) {
+            return DS_ERR;
+        }
+        if (parser->pos >= parser->len || parser->str[parser->pos] != ')') {
+            DS_LOG_ERROR("Unterminated ( in pattern");
+            return DS_ERR;
+        }
+        parser->pos++;
+        return DS_OK;
+    case '*':
+    case '+':
+    case '?':
+    case '{':
+        DS_LOG_ERROR("Nothing to repeat in pattern");
+        return DS_ERR;
+    case '^':
+    case '$':
+        DS_LOG_ERROR("Anchors are only supported at the ends of a pattern");
+        return DS_ERR;
+    case '.':
+        ds_pattern_set_invert(set);
+        set['\n' >> 3] &= ~(1 << ('\n' & 7));
+        break;
+    case '[':
+        if (ds_pattern_parse_class(parser, set) != DS_OK) {
+            return DS_ERR;
+        }
+        break;
+    case '\\':
+        if (ds_pattern_parse_escape(parser, set) != DS_OK) {
+            return DS_ERR;
+        }
+        break;
+    default:
+        DS_PATTERN_SET_ADD(set, (unsigned char)chr);
+        break;
+    }
+
+    return ds_pattern_char(parser, set, fragment);
+}
+
+// Parse the {m}, {m,} or {m,n} after an atom. A missing n is (unsigned long)-1
+static ds_result ds_pattern_parse_counts(ds_pattern_parser *parser,
+                                         unsigned long *min,
+                                         unsigned long *max) {
+    unsigned long values[2] = {0, 0};
+    boolean digits[2] = {false, false};
+    unsigned int index = 0;
+
+    parser->pos++;
+    while (parser->pos < parser->len && parser->str[parser->pos] != '}') {
+        char chr = parser->str[parser->pos++];
+        if (chr >= '0' && chr <= '9') {
+            values[index] = values[index] * 10 + (chr - '0');
+            digits[index] = true;
+            if (values[index] > DS_PATTERN_MAX_REPEAT) {
+                DS_LOG_ERROR("Repetition count is too large in pattern");
+                return DS_ERR;
+            }
+        } else if (chr == ',' && index == 0) {
+            index = 1;
+        } else {
+            DS_LOG_ERROR("Invalid repetition count in pattern");
+            return DS_ERR;
+        }
+    }
+
+    if (parser->pos >= parser->len || !digits[0]) {
+        DS_LOG_ERROR("Invalid repetition count in pattern");
+        return DS_ERR;
+    }
+    parser->pos++;
+
+    *min = values[0];
+    *max = index == 0  ? values[0]
+           : digits[1] ? values[1]
+                       : (unsigned long)-1;
+    if (*max < *min) {
+        DS_LOG_ERROR("Invalid repetition count in pattern");
+        return DS_ERR;
+    }
+
+    return DS_OK;
+}
+
+// Parse the atom between start and end again, to get a fresh copy of its NFA
+static ds_result ds_pattern_parse_copy(ds_pattern_parser *parser,
+                                       unsigned int depth, unsigned long start,
+                                       unsigned long end,
+                                       ds_pattern_fragment *fragment) {
+    unsigned long pos = parser->pos;
+
+    parser->pos = start;
+    ds_result result = ds_pattern_parse_repetition(parser, depth, end, fragment);
+    parser->pos = pos;
+
+    return result;
+}
+
+// Parse an atom followed by any number of *, +, ? and {m,n}, stopping at end
+static ds_result ds_pattern_parse_repetition(ds_pattern_parser *parser,
+                                             unsigned int depth,
+                                             unsigned long end,
+                                             ds_pattern_fragment *fragment) {
+    unsigned long start = parser->pos;
+
+    if (ds_pattern_parse_atom(parser, depth, fragment) != DS_OK) {
+        return DS_ERR;
+    }
+
+    while (parser->pos < end) {
+        char chr = parser->str[parser->pos];
+        ds_result result = DS_OK;
+
+        if (chr == '*') {
+            result = ds_pattern_repeat(parser, fragment, false, true);
+        } else if (chr == '+') {
+            result = ds_pattern_repeat(parser, fragment, true, true);
+        } else if (chr == '?') {
+            result = ds_pattern_repeat(parser, fragment, false, false);
+        } else if (chr == '{') {
+            unsigned long brace = parser->pos;
+            unsigned long min = 0;
+            unsigned long max = 0;
+
+            if (ds_pattern_parse_counts(parser, &min, &max) != DS_OK) {
+                return DS_ERR;
+            }
+
+            // The first copy is the atom that was already parsed
+            ds_pattern_fragment repeated = *fragment;
+            ds_pattern_fragment copy = *fragment;
+            unsigned long copies = max == (unsigned long)-1 ? min + 1 : max;
+            if (copies == 0 && ds_pattern_empty(parser, &repeated) != DS_OK) {
+                return DS_ERR;
+            }
+
+            for (unsigned long i = 0; i < copies; i++) {
+                if (i > 0 && ds_pattern_parse_copy(parser, depth, start, brace,
+                                                   &copy) != DS_OK) {
+                    return DS_ERR;
+                }
+                if (i >= min &&
+                    ds_pattern_repeat(parser, &copy, false,
+                                      max == (unsigned long)-1) != DS_OK) {
+                    return DS_ERR;
+                }
+                if (i == 0) {
+                    repeated = copy;
+                } else {
+                    ds_pattern_concat(parser->pt, &repeated, &copy);
+                }
+            }
+
+            *fragment = repeated;
+            continue;
+        } else {
+            break;
+        }
+
+        if (result != DS_OK) {
+            return DS_ERR;
+        }
+        parser->pos++;
+    }
+
+    return DS_OK;
+}
+
+// Parse a regex concatenation, up to the end of the pattern, | or )
+static ds_result ds_pattern_parse_concatenation(ds_pattern_parser *parser,
+                                                unsigned int depth,
+                                                ds_pattern_fragment *fragment) {
+    if (ds_pattern_empty(parser, fragment) != DS_OK) {
+        return DS_ERR;
+    }
+
+    while (parser->pos < parser->len && parser->str[parser->pos] != '|' &&
+           parser->str[parser->pos] != ')') {
+        ds_pattern_fragment next = {0};
+        if (ds_pattern_parse_repetition(parser, depth, parser->len, &next) !=
+            DS_OK) {
+            return DS_ERR;
+        }
+        ds_pattern_concat(parser->pt, fragment, &next);
+    }
+
+    return DS_OK;
+}
+
+// Parse a regex alternation, up to the end of the pattern or )
+static ds_result ds_pattern_parse_alternation(ds_pattern_parser *parser,
+                                              unsigned int depth,
+                                              ds_pattern_fragment *fragment) {
+    if (depth > DS_PATTERN_MAX_REPEAT) {
+        DS_LOG_ERROR("Pattern is nested too deeply");
+        return DS_ERR;
+    }
+
+    if (ds_pattern_parse_concatenation(parser, depth, fragment) != DS_OK) {
+        return DS_ERR;
+    }
+
+    while (parser->pos < parser->len && parser->str[parser->pos] == '|') {
+        ds_pattern_fragment other = {0};
+        parser->pos++;
+        if (ds_pattern_parse_concatenation(parser, depth, &other) != DS_OK ||
+            ds_pattern_alternate(parser, fragment, &other) != DS_OK) {
+            return DS_ERR;
+        }
+    }
+
+    return DS_OK;
+}
+
+// Add a pattern
+//
+// The flags select the syntax (DS_PATTERN_GLOB or DS_PATTERN_REGEX) and can
+// include DS_PATTERN_ICASE. The patterns are numbered in the order they are
+// added, starting at 0. The pattern has to be built again after adding.
+//
+// Returns 0 if the pattern was added, 1 if it has a syntax error or could not
+// be allocated.
+DSHDEF ds_result ds_pattern_add(ds_pattern *pt, ds_string_slice *source,
+                                unsigned int flags) {
+    ds_result result = DS_OK;
+    unsigned long nodes = pt->nodes.count;
+    unsigned long sets = pt->sets.count;
+    ds_pattern_parser parser = {.pt = pt,
+                                .str = source->str,
+                                .len = source->len,
+                                .pos = 0,
+                                .flags = flags};
+    ds_pattern_info info = {0};
+    ds_pattern_fragment fragment = {0};
+
+    if (flags & DS_PATTERN_REGEX) {
+        if (parser.len > 0 && parser.str[0] == '^') {
+            info.anchor_start = true;
+            parser.pos++;
+        }
+
+        // The $ is an anchor unless it is escaped by an odd number of \s
+        unsigned long slashes = 0;
+        while (slashes + 1 < parser.len &&
+               parser.str[parser.len - 2 - slashes] == '\\') {
+            slashes++;
+        }
+        if (parser.len > parser.pos && parser.str[parser.len - 1] == '$' &&
+            slashes % 2 == 0) {
+            info.anchor_end = true;
+            parser.len--;
+        }
+
+        if (ds_pattern_parse_alternation(&parser, 0, &fragment) != DS_OK) {
+            return_defer(DS_ERR);
+        }
+        if (parser.pos < parser.len) {
+            DS_LOG_ERROR("Unmatched ) in pattern");
+            return_defer(DS_ERR);
+        }
+    } else {
+        if (ds_pattern_parse_glob(&parser, 0, &fragment) != DS_OK) {
+            return_defer(DS_ERR);
+        }
+    }
+
+    if (ds_pattern_new_node(&parser, DS_PATTERN_MATCH, pt->patterns.count,
+                            &info.match) != DS_OK) {
+        return_defer(DS_ERR);
+    }
+    ds_pattern_patch(pt, fragment.holes, info.match);
+    info.start = fragment.start;
+
+    if (ds_dynamic_array_append(&pt->patterns, &info) != DS_OK) {
+        return_defer(DS_ERR);
+    }
+
+    pt->built = false;
+
+defer:
+    if (result != DS_OK) {
+        pt->nodes.count = nodes;
+        pt->sets.count = sets;
+    }
+    return result;
+}
+
+// Group the bytes that are in exactly the same sets into classes
+static void ds_pattern_build_classes(ds_pattern *pt) {
+    unsigned int keys[512];
+
+    for (unsigned int chr = 0; chr < 256; chr++) {
+        pt->classes[chr] = 0;
+    }
+    pt->class_count = 1;
+
+    // Split every class into the bytes in the set and the bytes out of it,
+    // numbering the new classes in the order of their first byte
+    for (unsigned long i = 0; i < pt->sets.count; i++) {
+        const unsigned char *set = (const unsigned char *)pt->sets.items + 32 * i;
+        unsigned int next = 0;
+
+        for (unsigned int key = 0; key < 512; key++) {
+            keys[key] = 0xFFFFFFFFu;
+        }
+        for (unsigned int chr = 0; chr < 256; chr++) {
+            unsigned int key = pt->classes[chr] * 2 + DS_PATTERN_SET_HAS(set, chr);
+            if (keys[key] == 0xFFFFFFFFu) {
+                keys[key] = next++;
+            }
+            pt->classes[chr] = (unsigned char)keys[key];
+        }
+        pt->class_count = next;
+    }
+}
+
+typedef struct ds_pattern_edge {
+        unsigned int from;
+        unsigned int to;
+        unsigned int set;
+} ds_pattern_edge;
+
+static void ds_pattern_graph_free(ds_pattern_graph *graph) {
+    unsigned int **arrays[] = {&graph->offsets, &graph->targets, &graph->sets,
+                               &graph->accepts, &graph->accept_end};
+
+    for (unsigned long i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++) {
+        if (*arrays[i] != NULL) {
+            DS_FREE(graph->allocator, *arrays[i]);
+            *arrays[i] = NULL;
+        }
+    }
+    graph->count = 0;
+}
+
+// Build the edges of the NFA grouped by their source node. The forward graph
+// gets an extra node that loops on every byte and starts all the patterns
+// that are not anchored at the start, for searching. The reverse graph has all
+// the edges flipped, and accepts at the starts of the patterns. Nodes that
+// cannot be reached from a start (e.g. the atom of x{0}) are left out.
+static ds_result ds_pattern_build_graph(ds_pattern *pt, boolean reverse,
+                                        ds_pattern_graph *graph) {
+    ds_result result = DS_OK;
+    ds_dynamic_array edges;
+    ds_dynamic_array stack;
+    unsigned char *reachable = NULL;
+    unsigned int count = pt->nodes.count + (reverse ? 0 : 1);
+    const ds_pattern_node *nodes = (const ds_pattern_node *)pt->nodes.items;
+    const ds_pattern_info *patterns = (const ds_pattern_info *)pt->patterns.items;
+
+    ds_dynamic_array_init_allocator(&edges, sizeof(ds_pattern_edge),
+                                    pt->allocator);
+    ds_dynamic_array_init_allocator(&stack, sizeof(unsigned int),
+                                    pt->allocator);
+
+    reachable = DS_MALLOC(pt->allocator, pt->nodes.count + 1);
+    if (reachable == NULL) {
+        DS_LOG_ERROR("Failed to allocate pattern graph");
+        return_defer(DS_ERR);
+    }
+    for (unsigned int node = 0; node < pt->nodes.count; node++) {
+        reachable[node] = false;
+    }
+    for (unsigned long i = 0; i < pt->patterns.count; i++) {
+        if (ds_dynamic_array_append(&stack, &patterns[i].start) != DS_OK) {
+            return_defer(DS_ERR);
+        }
+    }
+    while (stack.count > 0) {
+        unsigned int node = ((unsigned int *)stack.items)[--stack.count];
+        if (reachable[node]) {
+            continue;
+        }
+        reachable[node] = true;
+        unsigned int outs = nodes[node].type == DS_PATTERN_SPLIT   ? 2
+                            : nodes[node].type == DS_PATTERN_MATCH ? 0
+                                                                   : 1;
+        for (unsigned int i = 0; i < outs; i++) {
+            if (ds_dynamic_array_append(&stack, &nodes[node].out[i]) != DS_OK) {
+                return_defer(DS_ERR);
+            }
+        }
+    }
+
+    for (unsigned int node = 0; node < pt->nodes.count; node++) {
+        if (!reachable[node]) {
+            continue;
+        }
+
+        ds_pattern_edge edge[2] = {{node, nodes[node].out[0], DS_PATTERN_EPSILON},
+                                   {node, nodes[node].out[1], DS_PATTERN_EPSILON}};
+        unsigned long edge_count = 0;
+
+        switch (nodes[node].type) {
+        case DS_PATTERN_CHAR:
+            edge[0].set = nodes[node].arg;
+            edge_count = 1;
+            break;
+        case DS_PATTERN_SPLIT:
+            edge_count = 2;
+            break;
+        case DS_PATTERN_EMPTY:
+            edge_count = 1;
+            break;
+        default:
+            break;
+        }
+
+        for (unsigned long i = 0; i < edge_count; i++) {
+            if (reverse) {
+                edge[i].from = edge[i].to;
+                edge[i].to = node;
+            }
+            if (ds_dynamic_array_append(&edges, &edge[i]) != DS_OK) {
+                return_defer(DS_ERR);
+            }
+        }
+    }
+
+    if (!reverse) {
+        unsigned int loop = pt->nodes.count;
+        ds_pattern_edge edge = {loop, loop, DS_PATTERN_ANY};
+        if (ds_dynamic_array_append(&edges, &edge) != DS_OK) {
+            return_defer(DS_ERR);
+        }
+        for (unsigned long i = 0; i < pt->patterns.count; i++) {
+            if (patterns[i].anchor_start) {
+                continue;
+            }
+            edge.to = patterns[i].start;
+            edge.set = DS_PATTERN_EPSILON;
+            if (ds_dynamic_array_append(&edges, &edge) != DS_OK) {
+                return_defer(DS_ERR);
+            }
+        }
+    }
+
+    graph->allocator = pt->allocator;
+    graph->count = count;
+    graph->offsets = DS_MALLOC(pt->allocator, (count + 1) * sizeof(unsigned int));
+    graph->targets = DS_MALLOC(pt->allocator,
+                               (edges.count + 1) * sizeof(unsigned int));
+    graph->sets = DS_MALLOC(pt->allocator, (edges.count + 1) * sizeof(unsigned int));
+    graph->accepts = DS_MALLOC(pt->allocator, count * sizeof(unsigned int));
+    graph->accept_end = DS_MALLOC(pt->allocator, count * sizeof(unsigned int));
+    if (graph->offsets == NULL || graph->targets == NULL ||
+        graph->sets == NULL || graph->accepts == NULL ||
+        graph->accept_end == NULL) {
+        DS_LOG_ERROR("Failed to allocate pattern graph");
+        return_defer(DS_ERR);
+    }
+
+    // Counting sort of the edges by their source node
+    for (unsigned int node = 0; node <= count; node++) {
+        graph->offsets[node] = 0;
+    }
+    for (unsigned long i = 0; i < edges.count; i++) {
+        graph->offsets[((ds_pattern_edge *)edges.items)[i].from + 1]++;
+    }
+    for (unsigned int node = 0; node < count; node++) {
+        graph->offsets[node + 1] += graph->offsets[node];
+        graph->accepts[node] = 0;
+        graph->accept_end[node] = false;
+    }
+    for (unsigned long i = 0; i < edges.count; i++) {
+        const ds_pattern_edge *edge = (const ds_pattern_edge *)edges.items + i;
+        unsigned int slot = graph->offsets[edge->from]++;
+        graph->targets[slot] = edge->to;
+        graph->sets[slot] = edge->set;
+    }
+    for (unsigned int node = count; node > 0; node--) {
+        graph->offsets[node] = graph->offsets[node - 1];
+    }
+    graph->offsets[0] = 0;
+
+    for (unsigned long i = 0; i < pt->patterns.count; i++) {
+        unsigned int node = reverse ? patterns[i].start : patterns[i].match;
+        graph->accepts[node] = i + 1;
+        graph->accept_end[node] =
+            reverse ? patterns[i].anchor_start : patterns[i].anchor_end;
+    }
+
+defer:
+    if (reachable != NULL) {
+        DS_FREE(pt->allocator, reachable);
+    }
+    ds_dynamic_array_free(&stack);
+    ds_dynamic_array_free(&edges);
+    return result;
+}
+
+// The subset construction state: the NFA nodes of every DFA state, and a hash
+// table from sets of NFA nodes to DFA states
+typedef struct ds_pattern_builder {
+        ds_pattern *pt;
+        ds_pattern_graph *graph;
+        ds_pattern_dfa *dfa;
+        ds_dynamic_array members; // unsigned int, NFA nodes of the DFA states
+        ds_dynamic_array offsets; // unsigned int, where each DFA state starts
+        ds_dynamic_array next;    // unsigned int, NFA nodes being collected
+        unsigned int *marks;
+        unsigned int generation;
+        unsigned int *table; // DFA state + 1, 0 for an empty slot
+        unsigned long capacity;
+} ds_pattern_builder;
+
+static int ds_pattern_compare_node(const void *a, const void *b) {
+    unsigned int node1 = *(const unsigned int *)a;
+    unsigned int node2 = *(const unsigned int *)b;
+    return (node1 > node2) - (node1 < node2);
+}
+
+static ds_result ds_pattern_builder_add(ds_pattern_builder *builder,
+                                        unsigned int node) {
+    if (builder->marks[node] == builder->generation) {
+        return DS_OK;
+    }
+    builder->marks[node] = builder->generation;
+    return ds_dynamic_array_append(&builder->next, &node);
+}
+
+static ds_result ds_pattern_builder_grow(ds_pattern_builder *builder) {
+    unsigned long capacity = builder->capacity == 0 ? 64 : builder->capacity * 2;
+    unsigned int *table =
+        DS_MALLOC(builder->pt->allocator, capacity * sizeof(unsigned int));
+    if (table == NULL) {
+        DS_LOG_ERROR("Failed to allocate pattern table");
+        return DS_ERR;
+    }
+    for (unsigned long i = 0; i < capacity; i++) {
+        table[i] = 0;
+    }
+
+    const unsigned int *members = (const unsigned int *)builder->members.items;
+    const unsigned int *offsets = (const unsigned int *)builder->offsets.items;
+    for (unsigned long state = 0; state + 1 < builder->offsets.count; state++) {
+        unsigned long slot =
+            ds_hash_bytes(members + offsets[state],
+                          (offsets[state + 1] - offsets[state]) *
+                              sizeof(unsigned int)) &
+            (capacity - 1);
+        while (table[slot] != 0) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        table[slot] = state + 1;
+    }
+
+    if (builder->table != NULL) {
+        DS_FREE(builder->pt->allocator, builder->table);
+    }
+    builder->table = table;
+    builder->capacity = capacity;
+
+    return DS_OK;
+}
+
+// Close the collected NFA nodes over the epsilon edges and find (or create)
+// the DFA state for them
+static ds_result ds_pattern_builder_state(ds_pattern_builder *builder,
+                                          unsigned int *state) {
+    ds_result result = DS_OK;
+    const ds_pattern_graph *graph = builder->graph;
+    ds_pattern_dfa *dfa = builder->dfa;
+
+    for (unsigned long i = 0; i < builder->next.count; i++) {
+        unsigned int node = ((unsigned int *)builder->next.items)[i];
+        for (unsigned int e = graph->offsets[node]; e < graph->offsets[node + 1];
+             e++) {
+            if (graph->sets[e] == DS_PATTERN_EPSILON &&
+                ds_pattern_builder_add(builder, graph->targets[e]) != DS_OK) {
+                return_defer(DS_ERR);
+            }
+        }
+    }
+
+    unsigned int *nodes = (unsigned int *)builder->next.items;
+    unsigned long count = builder->next.count;
+    if (count > 1) {
+        DS_SORT(builder->pt->allocator, nodes, count, sizeof(unsigned int),
+                ds_pattern_compare_node);
+    }
+
+    unsigned long hash = ds_hash_bytes(nodes, count * sizeof(unsigned int));
+    unsigned long slot = hash & (builder->capacity - 1);
+    while (builder->table[slot] != 0) {
+        unsigned int found = builder->table[slot] - 1;
+        const unsigned int *offsets = (const unsigned int *)builder->offsets.items;
+        unsigned long found_count = offsets[found + 1] - offsets[found];
+        if (found_count == count &&
+            (count == 0 ||
+             DS_MEMCMP((unsigned int *)builder->members.items + offsets[found],
+                       nodes, count * sizeof(unsigned int)) == 0)) {
+            *state = found;
+            return_defer(DS_OK);
+        }
+        slot = (slot + 1) & (builder->capacity - 1);
+    }
+
+    if (dfa->states.count >= DS_PATTERN_MAX_STATES) {
+        DS_LOG_ERROR("Pattern needs more than %d states",
+                     DS_PATTERN_MAX_STATES);
+        return_defer(DS_ERR);
+    }
+
+    ds_pattern_dfa_state info = {.flags = 0,
+                                 .accepts = dfa->accepts.count,
+                                 .count = 0};
+    for (unsigned long i = 0; i < count; i++) {
+        unsigned int accept = graph->accepts[nodes[i]];
+        if (accept == 0) {
+            continue;
+        }
+        accept = (accept - 1) << 1 | (graph->accept_end[nodes[i]] ? 1 : 0);
+        if (ds_dynamic_array_append(&dfa->accepts, &accept) != DS_OK) {
+            return_defer(DS_ERR);
+        }
+        info.flags |= graph->accept_end[nodes[i]] ? DS_PATTERN_ACCEPT_END
+                                                  : DS_PATTERN_ACCEPT_ANY;
+        info.count++;
+    }
+
+    *state = dfa->states.count;
+    unsigned int end = builder->members.count + count;
+    if (ds_dynamic_array_append(&dfa->states, &info) != DS_OK ||
+        (count > 0 &&
+         ds_dynamic_array_append_many(&builder->members, (void **)nodes,
+                                      count) != DS_OK) ||
+        ds_dynamic_array_append(&builder->offsets, &end) != DS_OK ||
+        ds_dynamic_array_reserve(&dfa->transitions,
+                                 dfa->transitions.count +
+                                     builder->pt->class_count) != DS_OK) {
+        return_defer(DS_ERR);
+    }
+    for (unsigned int c = 0; c < builder->pt->class_count; c++) {
+        ((unsigned int *)dfa->transitions.items)[dfa->transitions.count++] = 0;
+    }
+
+    builder->table[slot] = *state + 1;
+    if (2 * dfa->states.count > builder->capacity &&
+        ds_pattern_builder_grow(builder) != DS_OK) {
+        return_defer(DS_ERR);
+    }
+
+defer:
+    builder->next.count = 0;
+    builder->generation++;
+    return result;
+}
+
+// Build the DFA of the graph with the subset construction. The DFA state 0 is
+// the dead state (no NFA nodes), and the start states are built by the caller
+// with ds_pattern_builder_add and ds_pattern_builder_state.
+static ds_result ds_pattern_builder_init(ds_pattern_builder *builder,
+                                         ds_pattern *pt,
+                                         ds_pattern_graph *graph,
+                                         ds_pattern_dfa *dfa) {
+    unsigned int dead = 0;
+    unsigned int zero = 0;
+
+    builder->pt = pt;
+    builder->graph = graph;
+    builder->dfa = dfa;
+    ds_dynamic_array_init_allocator(&builder->members, sizeof(unsigned int),
+                                    pt->allocator);
+    ds_dynamic_array_init_allocator(&builder->offsets, sizeof(unsigned int),
+                                    pt->allocator);
+    ds_dynamic_array_init_allocator(&builder->next, sizeof(unsigned int),
+                                    pt->allocator);
+    builder->generation = 1;
+    builder->table = NULL;
+    builder->capacity = 0;
+
+    dfa->transitions.count = 0;
+    dfa->states.count = 0;
+    dfa->accepts.count = 0;
+
+    builder->marks = DS_MALLOC(pt->allocator, graph->count * sizeof(unsigned int));
+    if (builder->marks == NULL) {
+        DS_LOG_ERROR("Failed to allocate pattern marks");
+        return DS_ERR;
+    }
+    for (unsigned int node = 0; node < graph->count; node++) {
+        builder->marks[node] = 0;
+    }
+
+    if (ds_dynamic_array_append(&builder->offsets, &zero) != DS_OK ||
+        ds_pattern_builder_grow(builder) != DS_OK) {
+        return DS_ERR;
+    }
+
+    return ds_pattern_builder_state(builder, &dead);
+}
+
+static ds_result ds_pattern_builder_run(ds_pattern_builder *builder) {
+    const ds_pattern_graph *graph = builder->graph;
+    const unsigned char *sets = (const unsigned char *)builder->pt->sets.items;
+    unsigned int class_count = builder->pt->class_count;
+    unsigned char representative[256];
+
+    for (unsigned int chr = 256; chr > 0; chr--) {
+        representative[builder->pt->classes[chr - 1]] = chr - 1;
+    }
+
+    for (unsigned long state = 0; state < builder->dfa->states.count; state++) {
+        for (unsigned int c = 0; c < class_count; c++) {
+            unsigned int chr = representative[c];
+            const unsigned int *offsets =
+                (const unsigned int *)builder->offsets.items;
+
+            for (unsigned int i = offsets[state]; i < offsets[state + 1]; i++) {
+                unsigned int node = ((unsigned int *)builder->members.items)[i];
+                for (unsigned int e = graph->offsets[node];
+                     e < graph->offsets[node + 1]; e++) {
+                    unsigned int set = graph->sets[e];
+                    if (set == DS_PATTERN_EPSILON ||
+                        (set != DS_PATTERN_ANY &&
+                         !DS_PATTERN_SET_HAS(sets + 32 * set, chr))) {
+                        continue;
+                    }
+                    if (ds_pattern_builder_add(builder, graph->targets[e]) !=
+                        DS_OK) {
+                        return DS_ERR;
+                    }
+                }
+            }
+
+            unsigned int next = 0;
+            if (ds_pattern_builder_state(builder, &next) != DS_OK) {
+                return DS_ERR;
+            }
+            ((unsigned int *)builder->dfa->transitions.items)
+                [state * class_count + c] = next;
+        }
+    }
+
+    return DS_OK;
+}
+
+static void ds_pattern_builder_free(ds_pattern_builder *builder) {
+    ds_dynamic_array_free(&builder->members);
+    ds_dynamic_array_free(&builder->offsets);
+    ds_dynamic_array_free(&builder->next);
+    if (builder->marks != NULL) {
+        DS_FREE(builder->pt->allocator, builder->marks);
+        builder->marks = NULL;
+    }
+    if (builder->table != NULL) {
+        DS_FREE(builder->pt->allocator, builder->table);
+        builder->table = NULL;
+    }
+}
+
+// Build the DFAs of all the patterns that were added
+//
+// Returns 0 if the DFAs were built, 1 if they need more than
+// DS_PATTERN_MAX_STATES states or could not be allocated.
+DSHDEF ds_result ds_pattern_build(ds_pattern *pt) {
+    ds_result result = DS_OK;
+    ds_pattern_graph graph = {0};
+    ds_pattern_builder builder = {0};
+    const ds_pattern_info *patterns = (const ds_pattern_info *)pt->patterns.items;
+
+    pt->built = false;
+    ds_pattern_build_classes(pt);
+
+    // Forward: matching starts at every pattern, searching at the loop node
+    // and at the patterns anchored at the start
+    if (ds_pattern_build_graph(pt, false, &graph) != DS_OK ||
+        ds_pattern_builder_init(&builder, pt, &graph, &pt->forward) != DS_OK) {
+        return_defer(DS_ERR);
+    }
+    for (unsigned long i = 0; i < pt->patterns.count; i++) {
+        if (ds_pattern_builder_add(&builder, patterns[i].start) != DS_OK) {
+            return_defer(DS_ERR);
+        }
+    }
+    if (ds_pattern_builder_state(&builder, &pt->match_start) != DS_OK ||
+        ds_pattern_builder_add(&builder, pt->nodes.count) != DS_OK) {
+        return_defer(DS_ERR);
+    }
+    for (unsigned long i = 0; i < pt->patterns.count; i++) {
+        if (patterns[i].anchor_start &&
+            ds_pattern_builder_add(&builder, patterns[i].start) != DS_OK) {
+            return_defer(DS_ERR);
+        }
+    }
+    if (ds_pattern_builder_state(&builder, &pt->search_start) != DS_OK ||
+        ds_pattern_builder_run(&builder) != DS_OK) {
+        return_defer(DS_ERR);
+    }
+    ds_pattern_builder_free(&builder);
+    ds_pattern_graph_free(&graph);
+
+    // Reverse: starts at the ends of all the patterns
+    if (ds_pattern_build_graph(pt, true, &graph) != DS_OK ||
+        ds_pattern_builder_init(&builder, pt, &graph, &pt->reverse) != DS_OK) {
+        return_defer(DS_ERR);
+    }
+    for (unsigned long i = 0; i < pt->patterns.count; i++) {
+        if (ds_pattern_builder_add(&builder, patterns[i].match) != DS_OK) {
+            return_defer(DS_ERR);
+        }
+    }
+    if (ds_pattern_builder_state(&builder, &pt->reverse_start) != DS_OK ||
+        ds_pattern_builder_run(&builder) != DS_OK) {
+        return_defer(DS_ERR);
+    }
+
+    pt->built = true;
+
+defer:
+    ds_pattern_builder_free(&builder);
+    ds_pattern_graph_free(&graph);
+    return result;
+}
+
+// Run the anchored DFA over the whole string slice
+//
+// Returns the DFA state at the end.
+static unsigned int ds_pattern_run(ds_pattern *pt, ds_string_slice *ss) {
+    const unsigned int *transitions = (const unsigned int *)pt->forward.transitions.items;
+    const unsigned char *classes = pt->classes;
+    const unsigned char *str = (const unsigned char *)ss->str;
+    unsigned long class_count = pt->class_count;
+    unsigned int state = pt->match_start;
+
+    for (unsigned long i = 0; i < ss->len && state != 0; i++) {
+        state = transitions[state * class_count + classes[str[i]]];
+    }
+
+    return state;
+}
+
+// Match the whole string slice against the patterns
+//
+// If pattern is not NULL it is set to the id of the first pattern (in the
+// order they were added) that matches.
+//
+// Returns true if any pattern matches the whole string slice, false otherwise.
+DSHDEF boolean ds_pattern_match(ds_pattern *pt, ds_string_slice *ss,
+                                unsigned long *pattern) {
+    if (!pt->built) {
+        DS_LOG_ERROR("The pattern is not built");
+        return false;
+    }
+
+    unsigned int state = ds_pattern_run(pt, ss);
+    const ds_pattern_dfa_state *info =
+        (const ds_pattern_dfa_state *)pt->forward.states.items + state;
+    if (info->count == 0) {
+        return false;
+    }
+
+    if (pattern != NULL) {
+        *pattern =
+            ((const unsigned int *)pt->forward.accepts.items)[info->accepts] >> 1;
+    }
+
+    return true;
+}
+
+// Match the whole string slice against the patterns, and append the ids of
+// all the patterns that match (unsigned long) to the patterns array
+//
+// Returns 0 if the ids were appended successfully.
+DSHDEF ds_result ds_pattern_match_all(ds_pattern *pt, ds_string_slice *ss,
+                                      ds_dynamic_array *patterns) {
+    ds_result result = DS_OK;
+
+    if (!pt->built) {
+        DS_LOG_ERROR("The pattern is not built");
+        return_defer(DS_ERR);
+    }
+
+    unsigned int state = ds_pattern_run(pt, ss);
+    const ds_pattern_dfa_state *info =
+        (const ds_pattern_dfa_state *)pt->forward.states.items + state;
+    const unsigned int *accepts =
+        (const unsigned int *)pt->forward.accepts.items + info->accepts;
+
+    for (unsigned int i = 0; i < info->count; i++) {
+        unsigned long id = accepts[i] >> 1;
+        if (ds_dynamic_array_append(patterns, &id) != DS_OK) {
+            return_defer(DS_ERR);
+        }
+    }
+
+defer:
+    return result;
+}
+
+// Find the pattern accepted by the DFA state, honoring the anchors
+//
+// Returns the id of the first accepted pattern (or of the pattern wanted, if
+// it is accepted), or -1.
+static long ds_pattern_accepted(const ds_pattern_dfa *dfa, unsigned int state,
+                                boolean at_end, long wanted) {
+    const ds_pattern_dfa_state *info =
+        (const ds_pattern_dfa_state *)dfa->states.items + state;
+
+    if (!(info->flags & DS_PATTERN_ACCEPT_ANY) &&
+        !(at_end && (info->flags & DS_PATTERN_ACCEPT_END))) {
+        return -1;
+    }
+
+    const unsigned int *accepts =
+        (const unsigned int *)dfa->accepts.items + info->accepts;
+    for (unsigned int i = 0; i < info->count; i++) {
+        long id = accepts[i] >> 1;
+        if ((wanted >= 0 && id != wanted) || ((accepts[i] & 1) && !at_end)) {
+            continue;
+        }
+        return id;
+    }
+
+    return -1;
+}
+
+// Search the string slice for the first match of any of the patterns
+//
+// The first match is the one that ends first. Of the matches that end there,
+// the lowest pattern id wins, and then the match that starts leftmost. The
+// forward DFA finds the end in one pass and the reverse DFA walks back from
+// the end to find the start, so there is no backtracking.
+//
+// Returns true if a match was found, and stores it in match. Returns false
+// otherwise.
+DSHDEF boolean ds_pattern_search(ds_pattern *pt, ds_string_slice *ss,
+                                 ds_string_match *match) {
+    if (!pt->built) {
+        DS_LOG_ERROR("The pattern is not built");
+        return false;
+    }
+
+    const unsigned int *transitions = (const unsigned int *)pt->forward.transitions.items;
+    const ds_pattern_dfa_state *states =
+        (const ds_pattern_dfa_state *)pt->forward.states.items;
+    const unsigned char *classes = pt->classes;
+    const unsigned char *str = (const unsigned char *)ss->str;
+    unsigned long class_count = pt->class_count;
+    unsigned int state = pt->search_start;
+    unsigned long end = 0;
+    long pattern = ds_pattern_accepted(&pt->forward, state, ss->len == 0, -1);
+
+    while (pattern < 0 && end < ss->len) {
+        state = transitions[state * class_count + classes[str[end++]]];
+        if (state == 0) {
+            return false;
+        }
+        if (states[state].flags != 0) {
+            pattern = ds_pattern_accepted(&pt->forward, state, end == ss->len, -1);
+        }
+    }
+
+    if (pattern < 0) {
+        return false;
+    }
+
+    // Walk back from the end to the leftmost start of the pattern
+    const unsigned int *reverse = (const unsigned int *)pt->reverse.transitions.items;
+    unsigned long start = end;
+    unsigned long i = end;
+    state = pt->reverse_start;
+    while (true) {
+        if (ds_pattern_accepted(&pt->reverse, state, i == 0, pattern) >= 0) {
+            start = i;
+        }
+        if (i == 0) {
+            break;
+        }
+        state = reverse[state * class_count + classes[str[--i]]];
+        if (state == 0) {
+            break;
+        }
+    }
+
+    match->pattern = pattern;
+    match->index = start;
+    match->len = end - start;
+
+    return true;
+}
+
+// Free the pattern
+DSHDEF void ds_pattern_free(ds_pattern *pt) {
+    ds_dynamic_array_free(&pt->nodes);
+    ds_dynamic_array_free(&pt->sets);
+    ds_dynamic_array_free(&pt->patterns);
+    ds_dynamic_array_free(&pt->forward.transitions);
+    ds_dynamic_array_free(&pt->forward.states);
+    ds_dynamic_array_free(&pt->forward.accepts);
+    ds_dynamic_array_free(&pt->reverse.transitions);
+    ds_dynamic_array_free(&pt->reverse.states);
+    ds_dynamic_array_free(&pt->reverse.accepts);
+
+    pt->allocator = NULL;
+    pt->built = false;
+}
+
+#endif // DS_SB_IMPLEMENTATION
+
+#ifdef DS_UTF8_IMPLEMENTATION
+
+// Decode one code point from the start of the buffer
+//
+// Returns the length of the sequence in bytes, or 0 if the sequence is not
+// well-formed (overlong, surrogate, out of range or truncated).
+static unsigned int ds_utf8_decode(const unsigned char *str, unsigned long len,
+                                   unsigned int *codepoint) {
+    unsigned char c = str[0];
+
+    if (c < 0x80) {
+        *codepoint = c;
+        return 1;
+    }
+
+    if (c < 0xC2) {
+        return 0;
+    }
+
+    if (c < 0xE0) {
+        if (len < 2 || (str[1] & 0xC0) != 0x80) {
+            return 0;
+        }
+        *codepoint = ((unsigned int)(c & 0x1F) << 6) | (str[1] & 0x3F);
+        return 2;
+    }
+
+    if (c < 0xF0) {
+        unsigned char lo = c == 0xE0 ? 0xA0 : 0x80;
+        unsigned char hi = c == 0xED ? 0x9F : 0xBF;
+        if (len < 3 || str[1] < lo || str[1] > hi ||
+            (str[2] & 0xC0) != 0x80) {
+            return 0;
+        }
+        *codepoint = ((unsigned int)(c & 0x0F) << 12) |
+                     ((unsigned int)(str[1] & 0x3F) << 6) | (str[2] & 0x3F);
+        return 3;
+    }
+
+    if (c < 0xF5) {
+        unsigned char lo = c == 0xF0 ? 0x90 : 0x80;
+        unsigned char hi = c == 0xF4 ? 0x8F : 0xBF;
+        if (len < 4 || str[1] < lo || str[1] > hi ||
+            (str[2] & 0xC0) != 0x80 || (str[3] & 0xC0) != 0x80) {
+            return 0;
+        }
+        *codepoint = ((unsigned int)(c & 0x07) << 18) |
+                     ((unsigned int)(str[1] & 0x3F) << 12) |
+                     ((unsigned int)(str[2] & 0x3F) << 6) | (str[3] & 0x3F);
+        return 4;
+    }
+
+    return 0;
+}
+
+// Validate the buffer one sequence at a time starting at index
+//
+// Returns the index of the first invalid sequence, or len if the buffer is
+// valid. ASCII runs are skipped a block at a time.
+static unsigned long ds_utf8_validate_scalar(const unsigned char *str,
+                                             unsigned long len,
+                                             unsigned long index) {
+    unsigned int codepoint = 0;
+
+    while (index < len) {
+        if (str[index] < 0x80) {
+#ifdef DS_SSE2
+            if (index + 16 <= len &&
+                _mm_movemask_epi8(_mm_loadu_si128(
+                    (const __m128i *)(str + index))) == 0) {
+                index += 16;
+                continue;
+            }
+#else
+            unsigned long long word = 0;
+            if (index + 8 <= len) {
+                DS_MEMCPY(&word, str + index, 8);
+                if ((word & 0x8080808080808080ULL) == 0) {
+                    index += 8;
+                    continue;
+                }
+            }
+#endif
+            index++;
+            continue;
+        }
+
+        unsigned int length = ds_utf8_decode(str + index, len - index,
+                                             &codepoint);
+        if (length == 0) {
+            return index;
+        }
+        index += length;
+    }
+
+    return len;
+}
+
+#ifdef DS_AVX2
+// The AVX2 validator classifies every pair of adjacent bytes with three
+// nibble lookups (the high and low nibble of the previous byte and the high
+// nibble of the current byte). Each bit is one kind of error and a pair is
+// invalid when all three lookups agree on a bit. The 0x80 bit marks two
+// continuation bytes in a row, which is only an error when the byte is not
+// the third or fourth byte of a sequence.
+#define DS_UTF8_TOO_SHORT (1 << 0)
+#define DS_UTF8_TOO_LONG (1 << 1)
+#define DS_UTF8_OVERLONG_3 (1 << 2)
+#define DS_UTF8_TOO_LARGE (1 << 3)
+#define DS_UTF8_SURROGATE (1 << 4)
+#define DS_UTF8_OVERLONG_2 (1 << 5)
+#define DS_UTF8_TOO_LARGE_1000 (1 << 6)
+#define DS_UTF8_OVERLONG_4 (1 << 6)
+#define DS_UTF8_TWO_CONTS (1 << 7)
+#define DS_UTF8_CARRY                                                          \
+    (DS_UTF8_TOO_SHORT | DS_UTF8_TOO_LONG | DS_UTF8_TWO_CONTS)
+
+#define DS_UTF8_TABLE(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p)          \
+    _mm256_setr_epi8((char)(a), (char)(b), (char)(c), (char)(d), (char)(e),    \
+                     (char)(f), (char)(g), (char)(h), (char)(i), (char)(j),    \
+                     (char)(k), (char)(l), (char)(m), (char)(n), (char)(o),    \
+                     (char)(p), (char)(a), (char)(b), (char)(c), (char)(d),    \
+                     (char)(e), (char)(f), (char)(g), (char)(h), (char)(i),    \
+                     (char)(j), (char)(k), (char)(l), (char)(m), (char)(n),    \
+                     (char)(o), (char)(p))
+
+// Shift the input right by count bytes, filling in from the previous block
+#define DS_UTF8_PREV(input, prev, count)                                       \
+    _mm256_alignr_epi8((input),                                                \
+                       _mm256_permute2x128_si256((prev), (input), 0x21),       \
+                       16 - (count))
+
+static __m256i ds_utf8_check_block(__m256i input, __m256i prev_input) {
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    const __m256i byte_1_high_table = DS_UTF8_TABLE(
+        DS_UTF8_TOO_LONG, DS_UTF8_TOO_LONG, DS_UTF8_TOO_LONG, DS_UTF8_TOO_LONG,
+        DS_UTF8_TOO_LONG, DS_UTF8_TOO_LONG, DS_UTF8_TOO_LONG, DS_UTF8_TOO_LONG,
+        DS_UTF8_TWO_CONTS, DS_UTF8_TWO_CONTS, DS_UTF8_TWO_CONTS,
+        DS_UTF8_TWO_CONTS, DS_UTF8_TOO_SHORT | DS_UTF8_OVERLONG_2,
+        DS_UTF8_TOO_SHORT,
+        DS_UTF8_TOO_SHORT | DS_UTF8_OVERLONG_3 | DS_UTF8_SURROGATE,
+        DS_UTF8_TOO_SHORT | DS_UTF8_TOO_LARGE | DS_UTF8_TOO_LARGE_1000 |
+            DS_UTF8_OVERLONG_4);
+    const __m256i byte_1_low_table = DS_UTF8_TABLE(
+        DS_UTF8_CARRY | DS_UTF8_OVERLONG_3 | DS_UTF8_OVERLONG_2 |
+            DS_UTF8_OVERLONG_4,
+        DS_UTF8_CARRY | DS_UTF8_OVERLONG_2, DS_UTF8_CARRY, DS_UTF8_CARRY,
+        DS_UTF8_CARRY | DS_UTF8_TOO_LARGE,
+        DS_UTF8_CARRY | DS_UTF8_TOO_LARGE | DS_UTF8_TOO_LARGE_1000,
+        DS_UTF8_CARRY | DS_UTF8_TOO_LARGE | DS_UTF8_TOO_LARGE_1000,
+        DS_UTF8_CARRY | DS_UTF8_TOO_LARGE | DS_UTF8_TOO_LARGE_1000,
+        DS_UTF8_CARRY | DS_UTF8_TOO_LARGE | DS_UTF8_TOO_LARGE_1000,
+        DS_UTF8_CARRY | DS_UTF8_TOO_LARGE | DS_UTF8_TOO_LARGE_1000,
+        DS_UTF8_CARRY | DS_UTF8_TOO_LARGE | DS_UTF8_TOO_LARGE_1000,
+        DS_UTF8_CARRY | DS_UTF8_TOO_LARGE | DS_UTF8_TOO_LARGE_1000,
+        DS_UTF8_CARRY | DS_UTF8_TOO_LARGE | DS_UTF8_TOO_LARGE_1000,
+        DS_UTF8_CARRY | DS_UTF8_TOO_LARGE | DS_UTF8_TOO_LARGE_1000 |
+            DS_UTF8_SURROGATE,
+        DS_UTF8_CARRY | DS_UTF8_TOO_LARGE | DS_UTF8_TOO_LARGE_1000,
+        DS_UTF8_CARRY | DS_UTF8_TOO_LARGE | DS_UTF8_TOO_LARGE_1000);
+    const __m256i byte_2_high_table = DS_UTF8_TABLE(
+        DS_UTF8_TOO_SHORT, DS_UTF8_TOO_SHORT, DS_UTF8_TOO_SHORT,
+        DS_UTF8_TOO_SHORT, DS_UTF8_TOO_SHORT, DS_UTF8_TOO_SHORT,
+        DS_UTF8_TOO_SHORT, DS_UTF8_TOO_SHORT,
+        DS_UTF8_TOO_LONG | DS_UTF8_OVERLONG_2 | DS_UTF8_TWO_CONTS |
+            DS_UTF8_OVERLONG_3 | DS_UTF8_TOO_LARGE_1000 | DS_UTF8_OVERLONG_4,
+        DS_UTF8_TOO_LONG | DS_UTF8_OVERLONG_2 | DS_UTF8_TWO_CONTS |
+            DS_UTF8_OVERLONG_3 | DS_UTF8_TOO_LARGE,
+        DS_UTF8_TOO_LONG | DS_UTF8_OVERLONG_2 | DS_UTF8_TWO_CONTS |
+            DS_UTF8_SURROGATE | DS_UTF8_TOO_LARGE,
+        DS_UTF8_TOO_LONG | DS_UTF8_OVERLONG_2 | DS_UTF8_TWO_CONTS |
+            DS_UTF8_SURROGATE | DS_UTF8_TOO_LARGE,
+        DS_UTF8_TOO_SHORT, DS_UTF8_TOO_SHORT, DS_UTF8_TOO_SHORT,
+        DS_UTF8_TOO_SHORT);
+
+    __m256i prev1 = DS_UTF8_PREV(input, prev_input, 1);
+    __m256i byte_1_high = _mm256_shuffle_epi8(
+        byte_1_high_table,
+        _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+    __m256i byte_1_low = _mm256_shuffle_epi8(byte_1_low_table,
+                                             _mm256_and_si256(prev1, nibble));
+    __m256i byte_2_high = _mm256_shuffle_epi8(
+        byte_2_high_table,
+        _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));
+    __m256i special = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low),
+                                       byte_2_high);
+
+    __m256i prev2 = DS_UTF8_PREV(input, prev_input, 2);
+    __m256i prev3 = DS_UTF8_PREV(input, prev_input, 3);
+    __m256i is_third = _mm256_subs_epu8(prev2, _mm256_set1_epi8(0xE0 - 0x80));
+    __m256i is_fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8(0xF0 - 0x80));
+    __m256i must_continue =
+        _mm256_and_si256(_mm256_or_si256(is_third, is_fourth),
+                         _mm256_set1_epi8((char)0x80));
+
+    return _mm256_xor_si256(must_continue, special);
+}
+#endif
+
+// Validate the buffer
+//
+// Returns the index of the first invalid sequence, or len if the buffer is
+// valid. Blocks are checked 32 bytes at a time with AVX2; once a block fails
+// the scalar validator resumes from the last sequence start before it to
+// find the exact index.
+static unsigned long ds_utf8_validate(const unsigned char *str,
+                                      unsigned long len) {
+    unsigned long index = 0;
+
+#ifdef DS_AVX2
+    const __m256i incomplete = _mm256_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, (char)(0xF0 - 1),
+        (char)(0xE0 - 1), (char)(0xC0 - 1));
+    __m256i prev_input = _mm256_setzero_si256();
+    __m256i prev_incomplete = _mm256_setzero_si256();
+
+    for (; index + 32 <= len; index += 32) {
+        __m256i input = _mm256_loadu_si256((const __m256i *)(str + index));
+        __m256i error = prev_incomplete;
+
+        if (_mm256_movemask_epi8(input) != 0) {
+            error = ds_utf8_check_block(input, prev_input);
+            prev_incomplete = _mm256_subs_epu8(input, incomplete);
+        }
+
+        if (!_mm256_testz_si256(error, error)) {
+            break;
+        }
+
+        prev_input = input;
+    }
+
+    // Step back to the lead byte of a sequence that crosses the block edge
+    unsigned long start = index;
+    for (unsigned long i = index; i > 0 && index - i < 3; i--) {
+        if ((str[i - 1] & 0xC0) != 0x80) {
+            start = i - 1;
+            break;
+        }
+    }
+    index = start;
+#endif
+
+    return ds_utf8_validate_scalar(str, len, index);
+}
+
+// Check if the string slice is valid UTF-8
+//
+// If index is not NULL it is set to the offset of the first invalid sequence,
+// or to the length of the slice if it is valid. Overlong encodings,
+// surrogates and code points above U+10FFFF are rejected.
+//
+// Returns true if the string slice is valid UTF-8, false otherwise.
+DSHDEF boolean ds_string_slice_utf8_valid(ds_string_slice *ss,
+                                          unsigned long *index) {
+    unsigned long offset = 0;
+
+    if (ss->str != NULL) {
+        offset = ds_utf8_validate((const unsigned char *)ss->str, ss->len);
+    }
+
+    if (index != NULL) {
+        *index = offset;
+    }
+
+    return offset == ss->len;
+}
+
+// Count the code points in the string slice
+//
+// The slice is expected to be valid UTF-8. Every byte that is not a
+// continuation byte starts a code point, so the count is a popcount over the
+// bytes that are not of the form 10xxxxxx.
+//
+// Returns the number of code points.
+DSHDEF unsigned long ds_string_slice_utf8_count(ds_string_slice *ss) {
+    const unsigned char *str = (const unsigned char *)ss->str;
+    unsigned long count = 0;
+    unsigned long i = 0;
+
+#ifdef DS_AVX2
+    // Continuation bytes are -128..-65 as signed chars
+    __m256i limit256 = _mm256_set1_epi8(-65);
+    for (; i + 32 <= ss->len; i += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(str + i));
+        count += __builtin_popcount((unsigned int)_mm256_movemask_epi8(
+            _mm256_cmpgt_epi8(block, limit256)));
+    }
+#endif
+
+#ifdef DS_SSE2
+    __m128i limit128 = _mm_set1_epi8(-65);
+    for (; i + 16 <= ss->len; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *)(str + i));
+        count += __builtin_popcount((unsigned int)_mm_movemask_epi8(
+            _mm_cmpgt_epi8(block, limit128)));
+    }
+#endif
+
+    for (; i < ss->len; i++) {
+        count += (str[i] & 0xC0) != 0x80;
+    }
+
+    return count;
+}
+
+// Decode the next code point and step the string slice past it
+//
+// Invalid sequences decode to DS_UTF8_REPLACEMENT and consume a single byte,
+// so the iterator always makes progress.
+//
+// Returns true if a code point was decoded, false if the string slice is
+// empty.
+DSHDEF boolean ds_string_slice_utf8_next(ds_string_slice *ss,
+                                         unsigned int *codepoint) {
+    boolean result = true;
+
+    if (ss->len == 0 || ss->str == NULL) {
+        return_defer(false);
+    }
+
+    unsigned int length =
+        ds_utf8_decode((const unsigned char *)ss->str, ss->len, codepoint);
+    if (length == 0) {
+        *codepoint = DS_UTF8_REPLACEMENT;
+        length = 1;
+    }
+
+    ss->str += length;
+    ss->len -= length;
+
+defer:
+    return result;
+}
+
+#endif // DS_UTF8_IMPLEMENTATION
+
+#ifdef DS_SI_IMPLEMENTATION
+
+#define DS_SI_MAGIC "DSSI"
+
+// Initialize the string interner with a custom allocator
+DSHDEF void ds_string_interner_init_allocator(ds_string_interner *si,
+                                              DS_ALLOCATOR *allocator) {
+    si->allocator = allocator;
+    ds_dynamic_array_init_allocator(&si->strings, sizeof(ds_string_slice),
+                                    allocator);
+    ds_dynamic_array_init_allocator(&si->blocks, sizeof(char *), allocator);
+    si->block_used = 0;
+    si->block_size = 0;
+    si->slots = NULL;
+    si->capacity = 0;
+}
+
+// Initialize the string interner
+DSHDEF void ds_string_interner_init(ds_string_interner *si) {
+    ds_string_interner_init_allocator(si, NULL);
+}
+
+// Find the slot of a string in the hash table
+//
+// Returns the slot that holds the string, or the empty slot where it should
+// be inserted.
+static ds_string_interner_slot *
+ds_string_interner_find(ds_string_interner *si, ds_string_slice *ss,
+                        unsigned long hash) {
+    unsigned long mask = si->capacity - 1;
+    unsigned long index = hash & mask;
+
+    for (;;) {
+        ds_string_interner_slot *slot = si->slots + index;
+        if (slot->id == 0) {
+            return slot;
+        }
+
+        if (slot->hash == hash) {
+            ds_string_slice *item =
+                (ds_string_slice *)si->strings.items + (slot->id - 1);
+            if (ds_string_slice_equals(item, ss)) {
+                return slot;
+            }
+        }
+
+        index = (index + 1) & mask;
+    }
+}
+
+// Grow the hash table to twice its capacity
+//
+// Returns 0 if the table was grown successfully, 1 if it could not be
+// allocated.
+static ds_result ds_string_interner_grow(ds_string_interner *si) {
+    ds_result result = DS_OK;
+
+    unsigned long capacity = si->capacity == 0 ? 64 : si->capacity * 2;
+    ds_string_interner_slot *slots =
+        DS_MALLOC(si->allocator, capacity * sizeof(ds_string_interner_slot));
+    if (slots == NULL) {
+        DS_LOG_ERROR("Failed to allocate string interner table");
+        return_defer(DS_ERR);
+    }
+
+    for (unsigned long i = 0; i < capacity; i++) {
+        slots[i].hash = 0;
+        slots[i].id = 0;
+    }
+
+    for (unsigned long i = 0; i < si->capacity; i++) {
+        ds_string_interner_slot *slot = si->slots + i;
+        if (slot->id == 0) {
+            continue;
+        }
+
+        unsigned long index = slot->hash & (capacity - 1);
+        while (slots[index].id != 0) {
+            index = (index + 1) & (capacity - 1);
+        }
+        slots[index] = *slot;
+    }
+
+    if (si->slots != NULL) {
+        DS_FREE(si->allocator, si->slots);
+    }
+    si->slots = slots;
+    si->capacity = capacity;
+
+defer:
+    return result;
+}
+
+// Copy a string into the block storage of the string interner
+//
+// Returns a pointer to the NUL terminated copy, or NULL if it could not be
+// allocated.
+static char *ds_string_interner_store(ds_string_interner *si,
+                                      ds_string_slice *ss) {
+    unsigned long size = ss->len + 1;
+
+    if (si->blocks.count == 0 || si->block_used + size > si->block_size) {
+        unsigned long block_size = DS_MAX(size, DS_SI_BLOCK_SIZE);
+        char *block = DS_MALLOC(si->allocator, block_size);
+        if (block == NULL) {
+            DS_LOG_ERROR("Failed to allocate string interner block");
+            return NULL;
+        }
+
+        if (ds_dynamic_array_append(&si->blocks, &block) != DS_OK) {
+            DS_FREE(si->allocator, block);
+            return NULL;
+        }
+
+        si->block_used = 0;
+        si->block_size = block_size;
+    }
+
+    char *block = ((char **)si->blocks.items)[si->blocks.count - 1];
+    char *str = block + si->block_used;
+    DS_MEMCPY(str, ss->str, ss->len);
+    str[ss->len] = '\0';
+    si->block_used += size;
+
+    return str;
+}
+
+// Intern a string slice
+//
+// The id of the string is stored in id. Strings get consecutive ids starting
+// from 0, in the order in which they were first interned.
+//
+// Returns 0 if the string was interned successfully, 1 if it could not be
+// allocated.
+DSHDEF ds_result ds_string_interner_intern(ds_string_interner *si,
+                                           ds_string_slice *ss,
+                                           unsigned long *id) {
+    ds_result result = DS_OK;
+
+    if ((si->strings.count + 1) * 2 > si->capacity) {
+        if (ds_string_interner_grow(si) != DS_OK) {
+            return_defer(DS_ERR);
+        }
+    }
+
+    unsigned long hash = ds_hash_string_slice(ss);
+    ds_string_interner_slot *slot = ds_string_interner_find(si, ss, hash);
+    if (slot->id != 0) {
+        *id = slot->id - 1;
+        return_defer(DS_OK);
+    }
+
+    ds_string_slice interned = {0};
+    interned.allocator = si->allocator;
+    interned.len = ss->len;
+    interned.str = ds_string_interner_store(si, ss);
+    if (interned.str == NULL) {
+        return_defer(DS_ERR);
+    }
+
+    if (ds_dynamic_array_append(&si->strings, &interned) != DS_OK) {
+        return_defer(DS_ERR);
+    }
+
+    slot->hash = hash;
+    slot->id = si->strings.count;
+    *id = slot->id - 1;
+
+defer:
+    return result;
+}
+
+// Intern a string slice and get its canonical string slice
+//
+// Returns 0 if the string was interned successfully, 1 if it could not be
+// allocated.
+DSHDEF ds_result ds_string_interner_intern_slice(ds_string_interner *si,
+                                                 ds_string_slice *ss,
+                                                 ds_string_slice *interned) {
+    unsigned long id = 0;
+    if (ds_string_interner_intern(si, ss, &id) != DS_OK) {
+        return DS_ERR;
+    }
+
+    return ds_string_interner_get(si, id, interned);
+}
+
+// Look up the id of a string slice without interning it
+//
+// Returns 0 if the string was found, 1 if it was never interned.
+DSHDEF ds_result ds_string_interner_lookup(ds_string_interner *si,
+                                           ds_string_slice *ss,
+                                           unsigned long *id) {
+    if (si->capacity == 0) {
+        return DS_ERR;
+    }
+
+    ds_string_interner_slot *slot =
+        ds_string_interner_find(si, ss, ds_hash_string_slice(ss));
+    if (slot->id == 0) {
+        return DS_ERR;
+    }
+
+    *id = slot->id - 1;
+    return DS_OK;
+}
+
+// Get the canonical string slice of an id
+//
+// Returns 0 if the id was found, 1 if the id is out of bounds.
+DSHDEF ds_result ds_string_interner_get(ds_string_interner *si,
+                                        unsigned long id,
+                                        ds_string_slice *ss) {
+    return ds_dynamic_array_get(&si->strings, id, ss);
+}
+
+// Get the number of distinct strings in the string interner
+DSHDEF unsigned long ds_string_interner_count(ds_string_interner *si) {
+    return si->strings.count;
+}
+
+// Append an unsigned 64 bit number in little endian to the string builder
+static ds_result ds_string_interner_save_u64(ds_string_builder *sb,
+                                             unsigned long value) {
+    char bytes[8];
+    for (unsigned int i = 0; i < 8; i++) {
+        bytes[i] = (char)((value >> (8 * i)) & 0xFF);
+    }
+    return ds_string_builder_appendn(sb, bytes, 8);
+}
+
+// Read an unsigned 64 bit number in little endian from the string slice
+static boolean ds_string_interner_load_u64(ds_string_slice *ss,
+                                           unsigned long *value) {
+    if (ss->len < 8) {
+        return false;
+    }
+
+    *value = 0;
+    for (unsigned int i = 0; i < 8; i++) {
+        *value |= (unsigned long)(unsigned char)ss->str[i] << (8 * i);
+    }
+    ds_string_slice_step(ss, 8);
+    return true;
+}
+
+// Save the strings of the string interner to a string builder
+//
+// The strings are saved in the order of their ids, so loading them back into
+// an empty string interner gives every string the same id.
+//
+// Returns 0 if the table was saved successfully, 1 otherwise.
+DSHDEF ds_result ds_string_interner_save(ds_string_interner *si,
+                                         ds_string_builder *sb) {
+    ds_result result = DS_OK;
+
+    if (ds_string_builder_appendn(sb, DS_SI_MAGIC, 4) != DS_OK ||
+        ds_string_interner_save_u64(sb, si->strings.count) != DS_OK) {
+        return_defer(DS_ERR);
+    }
+
+    for (unsigned long i = 0; i < si->strings.count; i++) {
+        ds_string_slice *item = (ds_string_slice *)si->strings.items + i;
+        if (ds_string_interner_save_u64(sb, item->len) != DS_OK ||
+            ds_string_builder_appendn(sb, item->str, item->len) != DS_OK) {
+            return_defer(DS_ERR);
+        }
+    }
+
+defer:
+    return result;
+}
+
+// Load strings saved with ds_string_interner_save into the string interner
+//
+// Returns 0 if the table was loaded successfully, 1 if the buffer is malformed
+// or the strings could not be interned.
+DSHDEF ds_result ds_string_interner_load(ds_string_interner *si,
+                                         const char *buffer,
+                                         unsigned long len) {
+    ds_result result = DS_OK;
+
+    ds_string_slice ss = {0};
+    ds_string_slice_init_allocator(&ss, (char *)buffer, len, si->allocator);
+
+    unsigned long count = 0;
+    if (ss.len < 4 || DS_MEMCMP(ss.str, DS_SI_MAGIC, 4) != 0) {
+        DS_LOG_ERROR("Invalid string interner table");
+        return_defer(DS_ERR);
+    }
+    ds_string_slice_step(&ss, 4);
+
+    if (!ds_string_interner_load_u64(&ss, &count)) {
+        DS_LOG_ERROR("Invalid string interner table");
+        return_defer(DS_ERR);
+    }
+
+    for (unsigned long i = 0; i < count; i++) {
+        unsigned long item_len = 0;
+        if (!ds_string_interner_load_u64(&ss, &item_len) ||
+            item_len > ss.len) {
+            DS_LOG_ERROR("Invalid string interner table");
+            return_defer(DS_ERR);
+        }
+
+        ds_string_slice item = {0};
+        ds_string_slice_init_allocator(&item, ss.str, item_len, si->allocator);
+        unsigned long id = 0;
+        if (ds_string_interner_intern(si, &item, &id) != DS_OK) {
+            return_defer(DS_ERR);
+        }
+        ds_string_slice_step(&ss, item_len);
+    }
+
+defer:
+    return result;
+}
+
+// Free the string interner
+//
+// This invalidates all the canonical string slices.
+DSHDEF void ds_string_interner_free(ds_string_interner *si) {
+    for (unsigned long i = 0; i < si->blocks.count; i++) {
+        DS_FREE(si->allocator, ((char **)si->blocks.items)[i]);
+    }
+    ds_dynamic_array_free(&si->blocks);
+    ds_dynamic_array_free(&si->strings);
+
+    if (si->slots != NULL) {
+        DS_FREE(si->allocator, si->slots);
+    }
+
+    si->allocator = NULL;
+    si->block_used = 0;
+    si->block_size = 0;
+    si->slots = NULL;
+    si->capacity = 0;
+}
+
+#endif // DS_SI_IMPLEMENTATION
+
+#ifdef DS_IO_IMPLEMENTATION
+
+#define DS_LZ_MIN_MATCH 4
+#define DS_LZ_LAST_LITERALS 5 // the block ends with at least 5 literals
+#define DS_LZ_MF_LIMIT 12     // the last match starts 12 bytes before the end
+#define DS_LZ_MAX_OFFSET 65535
+#define DS_LZ_WINDOW 65536
+#define DS_LZ_INPUT_MAX 0x7E000000UL
+#define DS_LZ_HASH_LOG 12
+#define DS_LZ_SKIP_TRIGGER 6
+#define DS_LZ_SKIPPABLE 0x184D2A50
+#define DS_LZ_HEADER 7 // magic, flags, block size and checksum
+
+// Frame flags (version 1 in the top bits)
+#define DS_LZ_FLAG_VERSION 0x40
+#define DS_LZ_FLAG_INDEPENDENT 0x20
+#define DS_LZ_FLAG_BLOCK_CHECKSUM 0x10
+#define DS_LZ_FLAG_CONTENT_SIZE 0x08
+#define DS_LZ_FLAG_CONTENT_CHECKSUM 0x04
+#define DS_LZ_FLAG_DICTIONARY 0x01
+#define DS_LZ_RAW_BLOCK 0x80000000UL
+
+static unsigned int ds_lz_read32(const unsigned char *p) {
+    unsigned int value;
+    DS_MEMCPY(&value, p, 4);
+    return value;
+}
+
+static unsigned int ds_lz_hash(unsigned int value) {
+    return (value * 2654435761U) >> (32 - DS_LZ_HASH_LOG);
+}
+
+// Little endian 32 bit integers, as they are stored in files
+static unsigned long ds_io_get32(const unsigned char *p) {
+    return (unsigned long)p[0] | (unsigned long)p[1] << 8 |
+           (unsigned long)p[2] << 16 | (unsigned long)p[3] << 24;
+}
+
+static void ds_io_put32(unsigned char *p, unsigned long value) {
+    p[0] = value & 0xFF;
+    p[1] = (value >> 8) & 0xFF;
+    p[2] = (value >> 16) & 0xFF;
+    p[3] = (value >> 24) & 0xFF;
+}
+
+// The header checksum is the second byte of the xxHash32 (seed 0) of the frame
+// descriptor, which is always shorter than 16 bytes
+static unsigned char ds_lz_header_checksum(const unsigned char *p,
+                                           unsigned long len) {
+    const unsigned int prime1 = 2654435761U, prime2 = 2246822519U,
+                       prime3 = 3266489917U, prime4 = 668265263U,
+                       prime5 = 374761393U;
+    unsigned int h = prime5 + (unsigned int)len;
+
+    for (; len >= 4; p += 4, len -= 4) {
+        h += (unsigned int)ds_io_get32(p) * prime3;
+        h = ((h << 17) | (h >> 15)) * prime4;
+    }
+    for (; len > 0; p++, len--) {
+        h += *p * prime5;
+        h = ((h << 11) | (h >> 21)) * prime1;
+    }
+    h ^= h >> 15;
+    h *= prime2;
+    h ^= h >> 13;
+    h *= prime3;
+    h ^= h >> 16;
+
+    return (h >> 8) & 0xFF;
+}
+
+// The number of equal bytes at p and match, up to limit
+static unsigned long ds_lz_count(const unsigned char *p,
+                                 const unsigned char *match,
+                                 const unsigned char *limit) {
+    const unsigned char *start = p;
+
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) &&                            \
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (limit - p >= 8) {
+        unsigned long long a, b;
+        DS_MEMCPY(&a, p, 8);
+        DS_MEMCPY(&b, match, 8);
+        if (a != b) {
+            return p - start + (__builtin_ctzll(a ^ b) >> 3);
+        }
+        p += 8;
+        match += 8;
+    }
+#endif
+    while (p < limit && *p == *match) {
+        p++;
+        match++;
+    }
+
+    return p - start;
+}
+
+// The number of extra bytes after the token for a length
+static unsigned long ds_lz_length_size(unsigned long len) {
+    return len >= 15 ? (len - 15) / 255 + 1 : 0;
+}
+
+// Write the extra bytes of a length of 15 or more
+static unsigned char *ds_lz_put_length(unsigned char *op, unsigned long len) {
+    for (; len >= 255; len -= 255) {
+        *op++ = 255;
+    }
+    *op++ = (unsigned char)len;
+    return op;
+}
+
+// The largest size of a compressed block of len bytes
+DSHDEF unsigned long ds_lz_compress_bound(unsigned long len) {
+    return len + len / 255 + 16;
+}
+
+// Compress a block
+//
+// Compresses len bytes of src into the LZ4 block format. The output fits in
+// capacity bytes when capacity is at least ds_lz_compress_bound(len).
+//
+// Returns the size of the compressed block, or -1 if it does not fit in
+// capacity bytes (e.g. the input does not compress) or the input is too large.
+DSHDEF long ds_lz_compress(const char *src, unsigned long len, char *dst,
+                           unsigned long capacity) {
+    const unsigned char *base = (const unsigned char *)src;
+    const unsigned char *ip = base;
+    const unsigned char *anchor = base;
+    const unsigned char *end = base + len;
+    unsigned char *op = (unsigned char *)dst;
+    unsigned char *oend = op + capacity;
+    unsigned int table[1 << DS_LZ_HASH_LOG] = {0};
+
+    if (len > DS_LZ_INPUT_MAX) {
+        return -1;
+    }
+
+    if (len > DS_LZ_MF_LIMIT) {
+        const unsigned char *mflimit = end - DS_LZ_MF_LIMIT;
+        const unsigned char *matchlimit = end - DS_LZ_LAST_LITERALS;
+
+        ip++;
+        while (true) {
+            const unsigned char *match;
+            unsigned long attempts = 1 << DS_LZ_SKIP_TRIGGER;
+
+            // Probe one position at a time, and larger steps the longer no
+            // match is found
+            while (true) {
+                if (ip > mflimit) {
+                    goto last;
+                }
+                unsigned int h = ds_lz_hash(ds_lz_read32(ip));
+                match = base + table[h];
+                table[h] = ip - base;
+                if (ip - match <= DS_LZ_MAX_OFFSET &&
+                    ds_lz_read32(match) == ds_lz_read32(ip)) {
+                    break;
+                }
+                ip += attempts++ >> DS_LZ_SKIP_TRIGGER;
+            }
+
+            while (ip > anchor && match > base && ip[-1] == match[-1]) {
+                ip--;
+                match--;
+            }
+
+            // Emit sequences for as long as the next position matches too
+            while (true) {
+                unsigned long literals = ip - anchor;
+                unsigned long length =
+                    DS_LZ_MIN_MATCH + ds_lz_count(ip + DS_LZ_MIN_MATCH,
+                                                  match + DS_LZ_MIN_MATCH,
+                                                  matchlimit);
+                unsigned long offset = ip - match;
+
+                if ((unsigned long)(oend - op) <
+                    1 + ds_lz_length_size(literals) + literals + 2 +
+                        ds_lz_length_size(length - DS_LZ_MIN_MATCH)) {
+                    return -1;
+                }
+
+                unsigned char *token = op++;
+                if (literals >= 15) {
+                    *token = 15 << 4;
+                    op = ds_lz_put_length(op, literals - 15);
+                } else {
+                    *token = literals << 4;
+                }
+                DS_MEMCPY(op, anchor, literals);
+                op += literals;
+
+                *op++ = offset & 0xFF;
+                *op++ = offset >> 8;
+
+                length -= DS_LZ_MIN_MATCH;
+                if (length >= 15) {
+                    *token |= 15;
+                    op = ds_lz_put_length(op, length - 15);
+                } else {
+                    *token |= length;
+                }
+
+                ip += length + DS_LZ_MIN_MATCH;
+                anchor = ip;
+                if (ip > mflimit) {
+                    goto last;
+                }
+
+                table[ds_lz_hash(ds_lz_read32(ip - 2))] = ip - 2 - base;
+                unsigned int h = ds_lz_hash(ds_lz_read32(ip));
+                match = base + table[h];
+                table[h] = ip - base;
+                if (ip - match > DS_LZ_MAX_OFFSET ||
+                    ds_lz_read32(match) != ds_lz_read32(ip)) {
+                    break;
+                }
+            }
+            ip++;
+        }
+    }
+
+last:;
+    unsigned long literals = end - anchor;
+    if ((unsigned long)(oend - op) <
+        1 + ds_lz_length_size(literals) + literals) {
+        return -1;
+    }
+    if (literals >= 15) {
+        *op++ = 15 << 4;
+        op = ds_lz_put_length(op, literals - 15);
+    } else {
+        *op++ = literals << 4;
+    }
+    DS_MEMCPY(op, anchor, literals);
+    op += literals;
+
+    return op - (unsigned char *)dst;
+}
+
+// Decompress a block into dst, with matches reaching up to window bytes in
+// front of dst
+static long ds_lz_decode(const char *src, unsigned long len, char *dst,
+                         unsigned long capacity, unsigned long window) {
+    const unsigned char *ip = (const unsigned char *)src;
+    const unsigned char *iend = ip + len;
+    unsigned char *op = (unsigned char *)dst;
+    unsigned char *oend = op + capacity;
+    unsigned char *low = op - window;
+    unsigned int byte;
+
+    if (len == 0) {
+        return -1;
+    }
+
+    while (true) {
+        unsigned int token = *ip++;
+
+        unsigned long literals = token >> 4;
+        if (literals == 15) {
+            do {
+                if (ip == iend) {
+                    return -1;
+                }
+                byte = *ip++;
+                literals += byte;
+            } while (byte == 255);
+        }
+        // Short literals are copied 16 bytes at a time when there is room
+        if (literals <= 16 && iend - ip >= 32 && oend - op >= 32) {
+            DS_MEMCPY(op, ip, 16);
+        } else if ((unsigned long)(iend - ip) < literals ||
+                   (unsigned long)(oend - op) < literals) {
+            return -1;
+        } else {
+            DS_MEMCPY(op, ip, literals);
+        }
+        ip += literals;
+        op += literals;
+
+        // The last sequence has only literals
+        if (ip == iend) {
+            break;
+        }
+
+        if (iend - ip < 2) {
+            return -1;
+        }
+        unsigned long offset = ip[0] | (unsigned long)ip[1] << 8;
+        ip += 2;
+        if (offset == 0 || offset > (unsigned long)(op - low)) {
+            return -1;
+        }
+
+        unsigned long length = token & 15;
+        if (length == 15) {
+            do {
+                if (ip == iend) {
+                    return -1;
+                }
+                byte = *ip++;
+                length += byte;
+            } while (byte == 255);
+        }
+        length += DS_LZ_MIN_MATCH;
+        if ((unsigned long)(oend - op) < length || ip == iend) {
+            return -1;
+        }
+
+        // Copy 8 bytes at a time from at least 8 bytes behind, so that every
+        // copy reads bytes that are already written. A closer match repeats
+        // with a period of offset, so the first bytes are copied one at a
+        // time until a multiple of offset is at least 8 bytes behind.
+        const unsigned char *match = op - offset;
+        if ((unsigned long)(oend - op) >= length + 16) {
+            unsigned long k = 0;
+            unsigned long distance = offset;
+            if (offset < 8) {
+                distance = (8 + offset - 1) / offset * offset;
+                for (; k < distance; k++) {
+                    op[k] = match[k];
+                }
+            }
+            for (; k < length; k += 8) {
+                DS_MEMCPY(op + k, op + k - distance, 8);
+            }
+        } else {
+            for (unsigned long k = 0; k < length; k++) {
+                op[k] = match[k];
+            }
+        }
+        op += length;
+    }
+
+    return op - (unsigned char *)dst;
+}
+
+// Decompress a block
+//
+// Decompresses an LZ4 block of len bytes into dst, which has room for capacity
+// bytes.
+//
+// Returns the size of the decompressed block, or -1 if the block is malformed
+// or does not fit in capacity bytes.
+DSHDEF long ds_lz_decompress(const char *src, unsigned long len, char *dst,
+                             unsigned long capacity) {
+    return ds_lz_decode(src, len, dst, capacity, 0);
+}
+
+// Write the header of a frame of independent blocks of up to block_max bytes
+// without checksums
+//
+// Returns the size of the header.
+static unsigned long ds_lz_frame_header(char *dst, unsigned long block_max) {
+    unsigned char *p = (unsigned char *)dst;
+    unsigned int code = 4;
+
+    while (code < 7 && (1UL << (8 + 2 * code)) < block_max) {
+        code++;
+    }
+
+    ds_io_put32(p, DS_LZ_MAGIC);
+    p[4] = DS_LZ_FLAG_VERSION | DS_LZ_FLAG_INDEPENDENT;
+    p[5] = code << 4;
+    p[6] = ds_lz_header_checksum(p + 4, 2);
+
+    return DS_LZ_HEADER;
+}
+
+// Write the size of a block of a frame followed by the block compressed, or
+// only the size if the block does not compress, in which case the len bytes
+// of src follow it as they are. dst has room for 4 + len bytes.
+//
+// Returns the number of bytes written to dst.
+static unsigned long ds_lz_frame_block(const char *src, unsigned long len,
+                                       char *dst) {
+    long size = ds_lz_compress(src, len, dst + 4, len);
+    if (size < 0) {
+        ds_io_put32((unsigned char *)dst, DS_LZ_RAW_BLOCK | len);
+        return 4;
+    }
+
+    ds_io_put32((unsigned char *)dst, size);
+    return 4 + size;
+}
+
+// Initialize the decoder with a custom allocator
+//
+// The decoder reads LZ4 frames from the source, which has the same contract
+// as the source of ds_io_reader. The buffers are allocated with the first
+// frame.
+DSHDEF void ds_lz_decoder_init_allocator(
+    ds_lz_decoder *decoder,
+    long (*source)(void *context, char *buffer, unsigned long len),
+    void *context, DS_ALLOCATOR *allocator) {
+    decoder->allocator = allocator;
+    decoder->source = source;
+    decoder->context = context;
+    decoder->input = NULL;
+    decoder->output = NULL;
+    decoder->allocated = 0;
+    decoder->block_max = 0;
+    decoder->history = 0;
+    decoder->start = NULL;
+    decoder->end = NULL;
+    decoder->flags = 0;
+    decoder->in_frame = false;
+    decoder->failed = false;
+}
+
+// Initialize the decoder
+DSHDEF void ds_lz_decoder_init(ds_lz_decoder *decoder,
+                               long (*source)(void *context, char *buffer,
+                                              unsigned long len),
+                               void *context) {
+    ds_lz_decoder_init_allocator(decoder, source, context, NULL);
+}
+
+// Read up to len bytes from the source, stopping short only at the end of the
+// input
+//
+// Returns the number of bytes read, or -1 in case of an error.
+static long ds_lz_decoder_fill(ds_lz_decoder *decoder, char *buffer,
+                               unsigned long len) {
+    unsigned long count = 0;
+
+    while (count < len) {
+        long length =
+            decoder->source(decoder->context, buffer + count, len - count);
+        if (length < 0) {
+            return -1;
+        }
+        if (length == 0) {
+            break;
+        }
+        count += length;
+    }
+
+    return count;
+}
+
+// Read exactly len bytes from the source
+//
+// Returns 0 if the bytes were read, 1 in case of an error or if the input
+// ends first.
+static ds_result ds_lz_decoder_expect(ds_lz_decoder *decoder, char *buffer,
+                                      unsigned long len) {
+    long length = ds_lz_decoder_fill(decoder, buffer, len);
+    if (length >= 0 && (unsigned long)length < len) {
+        DS_LOG_ERROR("Truncated LZ4 frame");
+    }
+    return (unsigned long)length == len ? DS_OK : DS_ERR;
+}
+
+static ds_result ds_lz_decoder_skip(ds_lz_decoder *decoder,
+                                    unsigned long len) {
+    char buffer[256];
+
+    while (len > 0) {
+        unsigned long n = DS_MIN(len, sizeof(buffer));
+        if (ds_lz_decoder_expect(decoder, buffer, n) != DS_OK) {
+            return DS_ERR;
+        }
+        len -= n;
+    }
+
+    return DS_OK;
+}
+
+// Read a frame header, after the magic number
+//
+// Returns 0 if the frame can be decoded, 1 otherwise.
+static ds_result ds_lz_decoder_header(ds_lz_decoder *decoder) {
+    unsigned char descriptor[11];
+
+    if (ds_lz_decoder_expect(decoder, (char *)descriptor, 2) != DS_OK) {
+        return DS_ERR;
+    }
+
+    unsigned int flags = descriptor[0];
+    unsigned int code = (descriptor[1] >> 4) & 7;
+    if ((flags & 0xC2) != DS_LZ_FLAG_VERSION || (descriptor[1] & 0x8F) != 0 ||
+        code < 4) {
+        DS_LOG_ERROR("Unsupported LZ4 frame");
+        return DS_ERR;
+    }
+    if (flags & DS_LZ_FLAG_DICTIONARY) {
+        DS_LOG_ERROR("LZ4 frames with a dictionary are not supported");
+        return DS_ERR;
+    }
+
+    unsigned long len = 2 + ((flags & DS_LZ_FLAG_CONTENT_SIZE) ? 8 : 0);
+    if (ds_lz_decoder_expect(decoder, (char *)descriptor + 2, len - 1) !=
+        DS_OK) {
+        return DS_ERR;
+    }
+    if (descriptor[len] != ds_lz_header_checksum(descriptor, len)) {
+        DS_LOG_ERROR("Corrupted LZ4 frame header");
+        return DS_ERR;
+    }
+
+    decoder->block_max = 1UL << (8 + 2 * code);
+    if (decoder->block_max > decoder->allocated) {
+        ds_lz_decoder_free(decoder);
+        decoder->input = DS_MALLOC(decoder->allocator, decoder->block_max);
+        decoder->output =
+            DS_MALLOC(decoder->allocator, DS_LZ_WINDOW + decoder->block_max);
+        decoder->allocated = decoder->block_max;
+        if (decoder->input == NULL || decoder->output == NULL) {
+            DS_LOG_ERROR("Failed to allocate LZ4 decoder buffers");
+            ds_lz_decoder_free(decoder);
+            return DS_ERR;
+        }
+    }
+
+    decoder->flags = flags;
+    decoder->history = 0;
+    decoder->start = decoder->output + DS_LZ_WINDOW;
+    decoder->end = decoder->start;
+    decoder->in_frame = true;
+
+    return DS_OK;
+}
+
+// Decode the next block. An independent block is decoded straight into
+// target if it has room for it, and into the output of the decoder otherwise.
+//
+// Returns 1 if a block was decoded (written is the number of bytes written to
+// target), 0 at the end of the input or -1 in case of an error.
+static int ds_lz_decoder_next(ds_lz_decoder *decoder, char *target,
+                              unsigned long capacity,
+                              unsigned long *written) {
+    unsigned char bytes[4];
+
+    *written = 0;
+    while (true) {
+        if (!decoder->in_frame) {
+            long length = ds_lz_decoder_fill(decoder, (char *)bytes, 4);
+            if (length == 0) {
+                return 0;
+            }
+            if (length < 0) {
+                return -1;
+            }
+            if (length < 4) {
+                DS_LOG_ERROR("Truncated LZ4 frame");
+                return -1;
+            }
+
+            unsigned long magic = ds_io_get32(bytes);
+            if ((magic & 0xFFFFFFF0UL) == DS_LZ_SKIPPABLE) {
+                if (ds_lz_decoder_expect(decoder, (char *)bytes, 4) != DS_OK ||
+                    ds_lz_decoder_skip(decoder, ds_io_get32(bytes)) !=
+                        DS_OK) {
+                    return -1;
+                }
+                continue;
+            }
+            if (magic != DS_LZ_MAGIC) {
+                DS_LOG_ERROR("Not an LZ4 frame");
+                return -1;
+            }
+            if (ds_lz_decoder_header(decoder) != DS_OK) {
+                return -1;
+            }
+        }
+
+        if (ds_lz_decoder_expect(decoder, (char *)bytes, 4) != DS_OK) {
+            return -1;
+        }
+        unsigned long size = ds_io_get32(bytes);
+        if (size == 0) {
+            if ((decoder->flags & DS_LZ_FLAG_CONTENT_CHECKSUM) &&
+                ds_lz_decoder_skip(decoder, 4) != DS_OK) {
+                return -1;
+            }
+            decoder->in_frame = false;
+            continue;
+        }
+
+        boolean raw = (size & DS_LZ_RAW_BLOCK) != 0;
+        size &= ~DS_LZ_RAW_BLOCK;
+        if (size > decoder->block_max) {
+            DS_LOG_ERROR("Corrupted LZ4 block");
+            return -1;
+        }
+
+        // Linked blocks are decoded after the last 64 KB of the output
+        boolean linked = !(decoder->flags & DS_LZ_FLAG_INDEPENDENT);
+        char *block = decoder->output + DS_LZ_WINDOW;
+        if (linked) {
+            unsigned long last = decoder->end - block;
+            unsigned long keep = DS_MIN(decoder->history + last, DS_LZ_WINDOW);
+            DS_MEMMOVE(block - keep, block + last - keep, keep);
+            decoder->history = keep;
+        } else if (capacity >= decoder->block_max) {
+            block = target;
+        }
+
+        long length = size;
+        if (raw) {
+            if (ds_lz_decoder_expect(decoder, block, size) != DS_OK) {
+                return -1;
+            }
+        } else {
+            if (ds_lz_decoder_expect(decoder, decoder->input, size) != DS_OK) {
+                return -1;
+            }
+            length = ds_lz_decode(decoder->input, size, block,
+                                  decoder->block_max,
+                                  linked ? decoder->history : 0);
+            if (length < 0) {
+                DS_LOG_ERROR("Corrupted LZ4 block");
+                return -1;
+            }
+        }
+
+        if ((decoder->flags & DS_LZ_FLAG_BLOCK_CHECKSUM) &&
+            ds_lz_decoder_skip(decoder, 4) != DS_OK) {
+            return -1;
+        }
+
+        if (block == target) {
+            *written = length;
+        } else {
+            decoder->start = block;
+            decoder->end = block + length;
+        }
+        return 1;
+    }
+}
+
+// Read decompressed bytes
+//
+// Reads up to len bytes of the decompressed stream into buffer. The context is
+// the decoder, so this can be used as the source of a ds_io_reader.
+//
+// Returns the number of bytes read, 0 at the end of the input or -1 in case of
+// an error.
+DSHDEF long ds_lz_decoder_read(void *context, char *buffer, unsigned long len) {
+    ds_lz_decoder *decoder = (ds_lz_decoder *)context;
+    unsigned long count = 0;
+
+    while (count < len) {
+        if (decoder->start == decoder->end) {
+            unsigned long written;
+            int status;
+
+            if (decoder->failed) {
+                return -1;
+            }
+            status = ds_lz_decoder_next(decoder, buffer + count, len - count,
+                                        &written);
+            if (status < 0) {
+                decoder->failed = true;
+                return -1;
+            }
+            if (status == 0) {
+                break;
+            }
+            count += written;
+            continue;
+        }
+
+        unsigned long available = decoder->end - decoder->start;
+        unsigned long n = DS_MIN(len - count, available);
+        DS_MEMCPY(buffer + count, decoder->start, n);
+        decoder->start += n;
+        count += n;
+    }
+
+    return count;
+}
+
+// Free the decoder
+DSHDEF void ds_lz_decoder_free(ds_lz_decoder *decoder) {
+    if (decoder->input != NULL) {
+        DS_FREE(decoder->allocator, decoder->input);
+        decoder->input = NULL;
+    }
+    if (decoder->output != NULL) {
+        DS_FREE(decoder->allocator, decoder->output);
+        decoder->output = NULL;
+    }
+    decoder->allocated = 0;
+    decoder->start = NULL;
+    decoder->end = NULL;
+    decoder->in_frame = false;
+}
+
+static long ds_io_reader_source_file(void *context, char *buffer,
+                                     unsigned long len);
+
+// Copy the mode of ds_io_read or ds_io_write without the "z", which is not a
+// mode of fopen
+//
+// Returns true if the mode has a "z".
+static boolean ds_io_mode(const char *mode, char *buffer) {
+    boolean compressed = false;
+    unsigned long count = 0;
+
+    for (; *mode != '\0'; mode++) {
+        if (*mode == 'z') {
+            compressed = true;
+        } else if (count < 15) {
+            buffer[count++] = *mode;
+        }
+    }
+    buffer[count] = '\0';
+
+    return compressed;
+}
+
+// Read a file
+//
+// Reads the contents of a binary file into a buffer. Regular files are read
+// with a single read into a buffer of exactly the size of the file. Pipes and
+// terminals are read straight into a growing buffer. With "z" in the mode the
+// file is an LZ4 frame and the buffer gets the decompressed contents. The
+// buffer is NUL terminated and is taken out of a string builder, so it must
+// be freed with ds_string_builder_release(NULL, buffer, size).
+//
+// Arguments:
+// - filename: name of the file to read
+// - buffer: pointer to the buffer to store the contents of the file
+// - mode: the mode to read in
+//
+// Returns:
+// - the number of bytes read
+DSHDEF long ds_io_read(const char *filename, char **buffer, const char *mode) {
+    long result = 0;
+
+    long line_size;
+    FILE *file = NULL;
+    char file_mode[16];
+    boolean compressed = ds_io_mode(mode, file_mode);
+    ds_lz_decoder decoder;
+    ds_lz_decoder_init(&decoder, ds_io_reader_source_file, NULL);
+    ds_string_builder sb;
+    ds_string_builder_init(&sb);
+
+    if (filename != NULL) {
+        file = fopen(filename, file_mode);
+        if (file == NULL) {
+            DS_LOG_ERROR("Failed to open file: %s", filename);
+            return_defer(-1);
+        }
+    } else {
+        file = stdin;
+    }
+    decoder.context = file;
+
+#ifdef DS_POSIX
+    struct stat st;
+    long offset = ftell(file);
+    if (!compressed && fstat(fileno(file), &st) == 0 && S_ISREG(st.st_mode) &&
+        offset >= 0 && st.st_size >= offset) {
+        unsigned long size = st.st_size - offset;
+
+        if (ds_dynamic_array_resize(&sb.items, size + 1) != DS_OK) {
+            DS_LOG_ERROR("Failed to allocate buffer for file");
+            return_defer(-1);
+        }
+
+        while (sb.items.count < size) {
+            line_size = fread((char *)sb.items.items + sb.items.count,
+                              sizeof(char), size - sb.items.count, file);
+            if (line_size == 0) {
+                break;
+            }
+            sb.items.count += line_size;
+        }
+    } else
+#endif
+    {
+        // The size is not known, so read into the spare capacity of the
+        // string builder
+        do {
+            if (ds_dynamic_array_reserve(&sb.items,
+                                         sb.items.count + LINE_MAX) != DS_OK) {
+                DS_LOG_ERROR("Failed to grow buffer for file");
+                return_defer(-1);
+            }
+
+            char *spare = (char *)sb.items.items + sb.items.count;
+            unsigned long len = sb.items.capacity - sb.items.count;
+            if (compressed) {
+                line_size = ds_lz_decoder_read(&decoder, spare, len);
+            } else {
+                line_size = fread(spare, sizeof(char), len, file);
+            }
+            if (line_size < 0) {
+                return_defer(-1);
+            }
+            sb.items.count += line_size;
+        } while (line_size > 0);
+    }
+
+    if (ferror(file)) {
+        DS_LOG_ERROR("Failed to read file");
+        return_defer(-1);
+    }
+
+    result = sb.items.count;
+    if (ds_string_builder_take(&sb, buffer) != 0) {
+        DS_LOG_ERROR("Failed to build string from string builder");
+        return_defer(-1);
+    }
+
+defer:
+    if (filename != NULL && file != NULL)
+        fclose(file);
+    ds_lz_decoder_free(&decoder);
+    ds_string_builder_free(&sb);
+
+    return result;
+}
+
+// Write a file
+//
+// Writes the contents of a buffer into a binary file. With "z" in the mode the
+// buffer is compressed into an LZ4 frame.
+//
+// Arguments:
+// - filename: name of the file to read
+// - buffer: pointer to the buffer to use on write
+// - buffer_len: the size of the buffer
+// - mode: the mode to write in
+//
+// Returns:
+// - the number of bytes written (before compression)
+DSHDEF long ds_io_write(const char *filename, char *buffer,
+                        unsigned long buffer_len, const char *mode) {
+    long result = 0;
+
+    unsigned long buffer_size;
+    FILE *file = NULL;
+    char *frame = NULL;
+    char file_mode[16];
+    boolean compressed = ds_io_mode(mode, file_mode);
+
+    if (filename != NULL) {
+        file = fopen(filename, file_mode);
+        if (file == NULL) {
+            DS_LOG_ERROR("Failed to open file: %s", filename);
+            return_defer(-1);
+        }
+    } else {
+        file = stdout;
+    }
+
+    if (!compressed) {
+        buffer_size = fwrite(buffer, sizeof(char), buffer_len, file);
+        return_defer(buffer_size);
+    }
+
+    unsigned long block_max = DS_MIN(buffer_len, DS_LZ_BLOCK_MAX);
+    frame = DS_MALLOC(NULL, DS_LZ_HEADER + 4 + block_max);
+    if (frame == NULL) {
+        DS_LOG_ERROR("Failed to allocate buffer for frame");
+        return_defer(-1);
+    }
+
+    unsigned long size = ds_lz_frame_header(frame, block_max);
+    if (fwrite(frame, sizeof(char), size, file) != size) {
+        return_defer(-1);
+    }
+    for (unsigned long offset = 0; offset < buffer_len; offset += block_max) {
+        unsigned long len = DS_MIN(block_max, buffer_len - offset);
+        size = ds_lz_frame_block(buffer + offset, len, frame);
+        if (fwrite(frame, sizeof(char), size, file) != size ||
+            (size == 4 &&
+             fwrite(buffer + offset, sizeof(char), len, file) != len)) {
+            return_defer(-1);
+        }
+    }
+    ds_io_put32((unsigned char *)frame, 0);
+    if (fwrite(frame, sizeof(char), 4, file) != 4) {
+        return_defer(-1);
+    }
+    result = buffer_len;
+
+defer:
+    if (result < 0 && file != NULL) {
+        DS_LOG_ERROR("Failed to write file");
+    }
+    if (filename != NULL && file != NULL)
+        fclose(file);
+    if (frame != NULL) {
+        DS_FREE(NULL, frame);
+    }
+
+    return result;
+}
+
+// Map a file into memory
+//
+// Maps the whole file read-only and stores a view of it in the string slice.
+// The kernel is told that the mapping will be read sequentially and soon, so
+// it reads ahead aggressively. An empty file gives an empty string slice.
+//
+// Returns 0 if the file was mapped, 1 if it could not be opened or mapped.
+DSHDEF ds_result ds_io_map(const char *filename, ds_string_slice *ss) {
+    ds_result result = DS_OK;
+
+    ss->allocator = NULL;
+    ss->str = NULL;
+    ss->len = 0;
+
+#ifdef DS_POSIX
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        DS_LOG_ERROR("Failed to open file: %s", filename);
+        return_defer(DS_ERR);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        DS_LOG_ERROR("Failed to stat file: %s", filename);
+        return_defer(DS_ERR);
+    }
+    if (st.st_size == 0) {
+        return_defer(DS_OK);
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        DS_LOG_ERROR("Failed to map file: %s", filename);
+        return_defer(DS_ERR);
+    }
+#ifdef MADV_SEQUENTIAL
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+#endif
+#ifdef MADV_WILLNEED
+    madvise(data, st.st_size, MADV_WILLNEED);
+#endif
+
+    ss->str = (char *)data;
+    ss->len = st.st_size;
+
+defer:
+    if (fd >= 0) {
+        close(fd);
+    }
+#else
+    char *buffer = NULL;
+    long size = ds_io_read(filename, &buffer, "rb");
+    if (size < 0) {
+        return_defer(DS_ERR);
+    }
+
+    ss->str = buffer;
+    ss->len = size;
+
+defer:
+#endif
+    return result;
+}
+
+// Unmap a file mapped with ds_io_map
+DSHDEF void ds_io_unmap(ds_string_slice *ss) {
+#ifdef DS_POSIX
+    if (ss->str != NULL && ss->len > 0) {
+        munmap(ss->str, ss->len);
+    }
+#else
+    if (ss->str != NULL) {
+        DS_FREE(NULL, ss->str);
+    }
+#endif
+    ss->str = NULL;
+    ss->len = 0;
+}
+
+static long ds_io_reader_source_fd(void *context, char *buffer,
+                                   unsigned long len) {
+#ifdef DS_POSIX
+    while (true) {
+        ssize_t length = read((int)(long)context, buffer, len);
+        if (length >= 0) {
+            return length;
+        }
+        if (errno != EINTR) {
+            DS_LOG_ERROR("Failed to read from file descriptor %d",
+                         (int)(long)context);
+            return -1;
+        }
+    }
+#else
+    (void)(context);
+    (void)(buffer);
+    (void)(len);
+    DS_LOG_ERROR("Reading from a file descriptor requires POSIX");
+    return -1;
+#endif
+}
+
+#ifndef DS_NO_STDIO
+static long ds_io_reader_source_file(void *context, char *buffer,
+                                     unsigned long len) {
+    FILE *file = (FILE *)context;
+    unsigned long length = fread(buffer, sizeof(char), len, file);
+    if (length == 0 && ferror(file)) {
+        DS_LOG_ERROR("Failed to read from file");
+        return -1;
+    }
+    return length;
+}
+#endif
+
+#ifdef DS_THREADS
+// The read-ahead thread reads into the block that is not being consumed each
+// time it is requested to
+static void *ds_io_reader_thread(void *arg) {
+    ds_io_reader *reader = (ds_io_reader *)arg;
+
+    pthread_mutex_lock(&reader->mutex);
+    while (true) {
+        while (!reader->requested && !reader->stop) {
+            pthread_cond_wait(&reader->cond, &reader->mutex);
+        }
+        if (reader->stop) {
+            break;
+        }
+
+        char *area = reader->blocks[1 - reader->current] + reader->carry;
+        pthread_mutex_unlock(&reader->mutex);
+        long length = reader->source(reader->context, area, reader->capacity);
+        pthread_mutex_lock(&reader->mutex);
+
+        reader->length = length;
+        reader->requested = false;
+        reader->ready = true;
+        pthread_cond_broadcast(&reader->cond);
+    }
+    pthread_mutex_unlock(&reader->mutex);
+
+    return NULL;
+}
+
+static void ds_io_reader_request(ds_io_reader *reader) {
+    pthread_mutex_lock(&reader->mutex);
+    reader->requested = true;
+    pthread_cond_broadcast(&reader->cond);
+    pthread_mutex_unlock(&reader->mutex);
+}
+#endif
+
+// Initialize the reader with a source and a custom allocator
+//
+// The capacity is the size of a read and the longest record that can be read
+// (DS_IO_READER_CAPACITY if capacity is 0). If the read-ahead thread cannot be
+// started the reads are done inline.
+//
+// Returns 0 if the reader was initialized, 1 if the buffers could not be
+// allocated.
+DSHDEF ds_result ds_io_reader_init_source_allocator(
+    ds_io_reader *reader,
+    long (*source)(void *context, char *buffer, unsigned long len),
+    void *context, unsigned long capacity, boolean read_ahead,
+    DS_ALLOCATOR *allocator) {
+    ds_result result = DS_OK;
+
+    reader->allocator = allocator;
+    reader->source = source;
+    reader->context = context;
+    reader->capacity = capacity > 0 ? capacity : DS_IO_READER_CAPACITY;
+    reader->carry = reader->capacity;
+    reader->max_record = reader->capacity;
+    reader->blocks[0] = NULL;
+    reader->blocks[1] = NULL;
+    reader->current = 0;
+    reader->start = NULL;
+    reader->end = NULL;
+    reader->eof = false;
+    reader->failed = false;
+    reader->owned = -1;
+    reader->decoder = NULL;
+#ifndef DS_NO_STDIO
+    reader->owned_file = NULL;
+#endif
+#ifdef DS_THREADS
+    reader->read_ahead = false;
+    reader->requested = false;
+    reader->ready = false;
+    reader->stop = false;
+    reader->length = 0;
+#endif
+
+    reader->blocks[0] = DS_MALLOC(allocator, reader->carry + reader->capacity);
+    if (reader->blocks[0] == NULL) {
+        DS_LOG_ERROR("Failed to allocate reader buffer");
+        return_defer(DS_ERR);
+    }
+    reader->start = reader->blocks[0] + reader->carry;
+    reader->end = reader->start;
+
+    if (!read_ahead) {
+        return_defer(DS_OK);
+    }
+
+#ifdef DS_THREADS
+    reader->blocks[1] = DS_MALLOC(allocator, reader->carry + reader->capacity);
+    if (reader->blocks[1] == NULL) {
+        DS_LOG_ERROR("Failed to allocate reader buffer");
+        return_defer(DS_ERR);
+    }
+
+    pthread_mutex_init(&reader->mutex, NULL);
+    pthread_cond_init(&reader->cond, NULL);
+    if (pthread_create(&reader->thread, NULL, ds_io_reader_thread, reader) !=
+        0) {
+        pthread_cond_destroy(&reader->cond);
+        pthread_mutex_destroy(&reader->mutex);
+        return_defer(DS_OK);
+    }
+    reader->read_ahead = true;
+    ds_io_reader_request(reader);
+#endif
+
+defer:
+    if (result != DS_OK) {
+        ds_io_reader_free(reader);
+    }
+    return result;
+}
+
+// Initialize the reader with a source
+DSHDEF ds_result ds_io_reader_init_source(
+    ds_io_reader *reader,
+    long (*source)(void *context, char *buffer, unsigned long len),
+    void *context, unsigned long capacity, boolean read_ahead) {
+    return ds_io_reader_init_source_allocator(reader, source, context,
+                                              capacity, read_ahead, NULL);
+}
+
+#ifndef DS_NO_STDIO
+// Initialize the reader to read from a file
+//
+// The file is not closed by ds_io_reader_free.
+DSHDEF ds_result ds_io_reader_init_file(ds_io_reader *reader, FILE *file,
+                                        unsigned long capacity,
+                                        boolean read_ahead) {
+    return ds_io_reader_init_source(reader, ds_io_reader_source_file, file,
+                                    capacity, read_ahead);
+}
+#endif
+
+// Initialize the reader to read from a file descriptor
+//
+// The file descriptor is not closed by ds_io_reader_free.
+DSHDEF ds_result ds_io_reader_init_fd(ds_io_reader *reader, int fd,
+                                      unsigned long capacity,
+                                      boolean read_ahead) {
+    return ds_io_reader_init_source(reader, ds_io_reader_source_fd,
+                                    (void *)(long)fd, capacity, read_ahead);
+}
+
+// Open a file with the reader, through an LZ4 decoder if compressed is true
+static ds_result ds_io_reader_setup_file(ds_io_reader *reader,
+                                         const char *filename,
+                                         unsigned long capacity,
+                                         boolean read_ahead,
+                                         boolean compressed) {
+    ds_result result = DS_OK;
+    ds_lz_decoder *decoder = NULL;
+
+    if (compressed) {
+        decoder = DS_MALLOC(NULL, sizeof(ds_lz_decoder));
+        if (decoder == NULL) {
+            DS_LOG_ERROR("Failed to allocate LZ4 decoder");
+            return DS_ERR;
+        }
+    }
+
+#ifdef DS_POSIX
+    int fd = STDIN_FILENO;
+    if (filename != NULL) {
+        fd = open(filename, O_RDONLY);
+        if (fd < 0) {
+            DS_LOG_ERROR("Failed to open file: %s", filename);
+            return_defer(DS_ERR);
+        }
+#ifdef POSIX_FADV_SEQUENTIAL
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    }
+
+    if (decoder != NULL) {
+        ds_lz_decoder_init(decoder, ds_io_reader_source_fd, (void *)(long)fd);
+        result = ds_io_reader_init_source(reader, ds_lz_decoder_read, decoder,
+                                          capacity, read_ahead);
+    } else {
+        result = ds_io_reader_init_fd(reader, fd, capacity, read_ahead);
+    }
+    if (result != DS_OK) {
+        if (filename != NULL) {
+            close(fd);
+        }
+        return_defer(DS_ERR);
+    }
+    reader->owned = filename != NULL ? fd : -1;
+#else
+    FILE *file = stdin;
+    if (filename != NULL) {
+        file = fopen(filename, "rb");
+        if (file == NULL) {
+            DS_LOG_ERROR("Failed to open file: %s", filename);
+            return_defer(DS_ERR);
+        }
+    }
+
+    if (decoder != NULL) {
+        ds_lz_decoder_init(decoder, ds_io_reader_source_file, file);
+        result = ds_io_reader_init_source(reader, ds_lz_decoder_read, decoder,
+                                          capacity, read_ahead);
+    } else {
+        result = ds_io_reader_init_file(reader, file, capacity, read_ahead);
+    }
+    if (result != DS_OK) {
+        if (filename != NULL) {
+            fclose(file);
+        }
+        return_defer(DS_ERR);
+    }
+    reader->owned_file = filename != NULL ? file : NULL;
+#endif
+    reader->decoder = decoder;
+
+defer:
+    if (result != DS_OK && decoder != NULL) {
+        DS_FREE(NULL, decoder);
+    }
+    return result;
+}
+
+// Open a file for reading with the reader
+//
+// If filename is NULL it reads from the standard input. The file is closed by
+// ds_io_reader_free.
+//
+// Returns 0 if the file was opened, 1 otherwise.
+DSHDEF ds_result ds_io_reader_open(ds_io_reader *reader, const char *filename,
+                                   unsigned long capacity, boolean read_ahead) {
+    return ds_io_reader_setup_file(reader, filename, capacity, read_ahead,
+                                   false);
+}
+
+// Open a file compressed in the LZ4 frame format for reading with the reader
+//
+// The reader yields the decompressed bytes. With read_ahead the blocks are
+// decompressed on the read-ahead thread, while the previous ones are consumed.
+//
+// Returns 0 if the file was opened, 1 otherwise.
+DSHDEF ds_result ds_io_reader_open_lz(ds_io_reader *reader,
+                                      const char *filename,
+                                      unsigned long capacity,
+                                      boolean read_ahead) {
+    return ds_io_reader_setup_file(reader, filename, capacity, read_ahead,
+                                   true);
+}
+
+// Grow the carry area of the blocks to fit rest bytes. The bytes not consumed
+// yet and the filled bytes of the other block are moved to the new blocks.
+//
+// Returns 0 if the blocks were grown, 1 if they could not be allocated.
+static ds_result ds_io_reader_grow(ds_io_reader *reader, unsigned long rest,
+                                   long filled) {
+    unsigned long carry =
+        DS_MIN(DS_MAX(rest, 2 * reader->carry), reader->max_record);
+    char *blocks[2] = {NULL, NULL};
+
+    for (unsigned int i = 0; i < 2; i++) {
+        if (reader->blocks[i] == NULL) {
+            continue;
+        }
+        blocks[i] = DS_MALLOC(reader->allocator, carry + reader->capacity);
+        if (blocks[i] == NULL) {
+            DS_LOG_ERROR("Failed to grow reader buffer");
+            if (i > 0 && blocks[0] != NULL) {
+                DS_FREE(reader->allocator, blocks[0]);
+            }
+            return DS_ERR;
+        }
+    }
+
+    for (unsigned int i = 0; i < 2; i++) {
+        if (blocks[i] == NULL) {
+            continue;
+        }
+        if (i == reader->current) {
+            DS_MEMCPY(blocks[i] + carry - rest, reader->start, rest);
+            reader->start = blocks[i] + carry - rest;
+            reader->end = blocks[i] + carry;
+        } else if (filled > 0) {
+            DS_MEMCPY(blocks[i] + carry, reader->blocks[i] + reader->carry,
+                      filled);
+        }
+        DS_FREE(reader->allocator, reader->blocks[i]);
+        reader->blocks[i] = blocks[i];
+    }
+    reader->carry = carry;
+
+    return DS_OK;
+}
+
+// Read more input after the bytes that are not consumed yet, which are moved in
+// front of the read area first
+//
+// Returns the number of bytes read, 0 at the end of the input or -1 in case of
+// an error.
+static long ds_io_reader_fill(ds_io_reader *reader) {
+    unsigned long rest = reader->end - reader->start;
+    long length = 0;
+
+    if (reader->eof) {
+        return 0;
+    }
+    if (rest > reader->max_record) {
+        DS_LOG_ERROR("Record is longer than the maximum record length %lu",
+                     reader->max_record);
+        reader->eof = true;
+        reader->failed = true;
+        return -1;
+    }
+
+#ifdef DS_THREADS
+    if (reader->read_ahead) {
+        pthread_mutex_lock(&reader->mutex);
+        while (!reader->ready) {
+            pthread_cond_wait(&reader->cond, &reader->mutex);
+        }
+        reader->ready = false;
+        length = reader->length;
+        pthread_mutex_unlock(&reader->mutex);
+    }
+#endif
+
+    // The read-ahead thread is idle here, so the blocks can be replaced
+    if (rest > reader->carry && ds_io_reader_grow(reader, rest, length) != DS_OK) {
+        reader->eof = true;
+        reader->failed = true;
+        return -1;
+    }
+
+#ifdef DS_THREADS
+    if (reader->read_ahead) {
+        // The other block was just read into, and this one is free for the
+        // thread once the rest is copied out of it
+        char *area = reader->blocks[1 - reader->current] + reader->carry;
+        DS_MEMCPY(area - rest, reader->start, rest);
+        reader->current = 1 - reader->current;
+        reader->start = area - rest;
+        reader->end = area + (length > 0 ? length : 0);
+        if (length > 0) {
+            ds_io_reader_request(reader);
+        }
+    } else
+#endif
+    {
+        char *area = reader->blocks[reader->current] + reader->carry;
+        DS_MEMMOVE(area - rest, reader->start, rest);
+        reader->start = area - rest;
+        reader->end = area;
+        length = reader->source(reader->context, area, reader->capacity);
+        reader->end += length > 0 ? length : 0;
+    }
+
+    if (length <= 0) {
+        reader->eof = true;
+        reader->failed = length < 0;
+    }
+
+    return length;
+}
+
+// Set the longest record the reader can read
+//
+// The carry area of the reader grows up to max_record bytes when a record
+// does not fit. It never shrinks below capacity bytes.
+DSHDEF void ds_io_reader_set_max_record(ds_io_reader *reader,
+                                        unsigned long max_record) {
+    reader->max_record = DS_MAX(max_record, reader->carry);
+}
+
+// Read the next chunk of the input
+//
+// The chunk is all the input that is buffered and not consumed yet, or the
+// next read if there is none. It stays valid until the next call.
+//
+// Returns true if a chunk was read, false at the end of the input or in case of
+// an error.
+DSHDEF boolean ds_io_reader_read(ds_io_reader *reader, ds_string_slice *chunk) {
+    if (reader->start == reader->end && ds_io_reader_fill(reader) <= 0) {
+        return false;
+    }
+
+    chunk->allocator = reader->allocator;
+    chunk->str = reader->start;
+    chunk->len = reader->end - reader->start;
+    reader->start = reader->end;
+
+    return true;
+}
+
+// Read the next record of the input, up to the delimiter
+//
+// The record does not include the delimiter, and the last record does not need
+// to end with one, the same as with ds_string_slice_tokenize. It stays valid
+// until the next call.
+//
+// Returns true if a record was read, false at the end of the input or in case
+// of an error (including a record longer than the maximum record length).
+DSHDEF boolean ds_io_reader_read_record(ds_io_reader *reader, char delimiter,
+                                        ds_string_slice *record) {
+    unsigned long searched = 0;
+
+    while (true) {
+        unsigned long len = reader->end - reader->start;
+        unsigned long index =
+            searched + ds_string_index_of(reader->start + searched,
+                                          len - searched, delimiter);
+        if (index < len) {
+            record->allocator = reader->allocator;
+            record->str = reader->start;
+            record->len = index;
+            reader->start += index + 1;
+            return true;
+        }
+        searched = len;
+
+        long length = ds_io_reader_fill(reader);
+        if (length < 0) {
+            return false;
+        }
+        if (length == 0) {
+            if (len == 0) {
+                return false;
+            }
+            record->allocator = reader->allocator;
+            record->str = reader->start;
+            record->len = len;
+            reader->start = reader->end;
+            return true;
+        }
+    }
+}
+
+// Read the next line of the input
+//
+// This is ds_io_reader_read_record with a newline delimiter, and a trailing
+// carriage return is dropped from the line, so "\r\n" line endings work too.
+//
+// Returns true if a line was read, false at the end of the input or in case of
+// an error.
+DSHDEF boolean ds_io_reader_read_line(ds_io_reader *reader,
+                                      ds_string_slice *line) {
+    if (!ds_io_reader_read_record(reader, '\n', line)) {
+        return false;
+    }
+    if (line->len > 0 && line->str[line->len - 1] == '\r') {
+        line->len--;
+    }
+
+    return true;
+}
+
+// Free the reader
+//
+// Waits for the read of the read-ahead thread, and closes the file if it was
+// opened by ds_io_reader_open or ds_io_reader_open_lz.
+DSHDEF void ds_io_reader_free(ds_io_reader *reader) {
+#ifdef DS_THREADS
+    if (reader->read_ahead) {
+        pthread_mutex_lock(&reader->mutex);
+        reader->stop = true;
+        pthread_cond_broadcast(&reader->cond);
+        pthread_mutex_unlock(&reader->mutex);
+        pthread_join(reader->thread, NULL);
+        pthread_cond_destroy(&reader->cond);
+        pthread_mutex_destroy(&reader->mutex);
+        reader->read_ahead = false;
+    }
+#endif
+
+    for (unsigned int i = 0; i < 2; i++) {
+        if (reader->blocks[i] != NULL) {
+            DS_FREE(reader->allocator, reader->blocks[i]);
+            reader->blocks[i] = NULL;
+        }
+    }
+    reader->start = NULL;
+    reader->end = NULL;
+
+    if (reader->decoder != NULL) {
+        ds_lz_decoder_free(reader->decoder);
+        DS_FREE(NULL, reader->decoder);
+        reader->decoder = NULL;
+    }
+
+#ifdef DS_POSIX
+    if (reader->owned >= 0) {
+        close(reader->owned);
+    }
+#endif
+    reader->owned = -1;
+#ifndef DS_NO_STDIO
+    if (reader->owned_file != NULL) {
+        fclose(reader->owned_file);
+        reader->owned_file = NULL;
+    }
+#endif
+}
+
+// Initialize the CSV reader over a buffer with a custom allocator
+DSHDEF void ds_io_csv_init_allocator(ds_io_csv *csv, char *buffer,
+                                     unsigned long len, char delimiter,
+                                     DS_ALLOCATOR *allocator) {
+    csv->allocator = allocator;
+    csv->reader = NULL;
+    csv->start = buffer;
+    csv->end = buffer + len;
+    csv->delimiter = delimiter;
+    ds_dynamic_array_init_allocator(&csv->ends, sizeof(unsigned long),
+                                    allocator);
+    ds_string_builder_init_allocator(&csv->unescaped, allocator);
+    csv->pending = 0;
+    csv->newlines = 0;
+    csv->quoted = 0;
+    csv->block = 0;
+    csv->scanned = 0;
+    csv->failed = false;
+}
+
+// Initialize the CSV reader over a buffer
+DSHDEF void ds_io_csv_init(ds_io_csv *csv, char *buffer, unsigned long len,
+                           char delimiter) {
+    ds_io_csv_init_allocator(csv, buffer, len, delimiter, NULL);
+}
+
+// Initialize the CSV reader over a reader
+//
+// The records are read from the reader as they are needed, so the fields are
+// slices into the buffer of the reader. The reader is not freed with the CSV
+// reader.
+DSHDEF void ds_io_csv_init_reader(ds_io_csv *csv, ds_io_reader *reader,
+                                  char delimiter) {
+    ds_io_csv_init_allocator(csv, NULL, 0, delimiter, reader->allocator);
+    csv->reader = reader;
+}
+
+// Classify up to 64 bytes into bitmasks of the quotes, the delimiters and the
+// newlines (bit i is set for str[i])
+static void ds_io_csv_classify(const char *str, unsigned long len,
+                               char delimiter, unsigned long long *quotes,
+                               unsigned long long *delimiters,
+                               unsigned long long *newlines) {
+    unsigned long long q = 0, d = 0, n = 0;
+    unsigned long i = 0;
+
+#ifdef DS_AVX2
+    __m256i quote256 = _mm256_set1_epi8('"');
+    __m256i delimiter256 = _mm256_set1_epi8(delimiter);
+    __m256i newline256 = _mm256_set1_epi8('\n');
+    for (; i + 32 <= len; i += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(str + i));
+        q |= (unsigned long long)(unsigned int)_mm256_movemask_epi8(
+                 _mm256_cmpeq_epi8(block, quote256))
+             << i;
+        d |= (unsigned long long)(unsigned int)_mm256_movemask_epi8(
+                 _mm256_cmpeq_epi8(block, delimiter256))
+             << i;
+        n |= (unsigned long long)(unsigned int)_mm256_movemask_epi8(
+                 _mm256_cmpeq_epi8(block, newline256))
+             << i;
+    }
+#endif
+
+#ifdef DS_SSE2
+    __m128i quote128 = _mm_set1_epi8('"');
+    __m128i delimiter128 = _mm_set1_epi8(delimiter);
+    __m128i newline128 = _mm_set1_epi8('\n');
+    for (; i + 16 <= len; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *)(str + i));
+        q |= (unsigned long long)(unsigned int)_mm_movemask_epi8(
+                 _mm_cmpeq_epi8(block, quote128))
+             << i;
+        d |= (unsigned long long)(unsigned int)_mm_movemask_epi8(
+                 _mm_cmpeq_epi8(block, delimiter128))
+             << i;
+        n |= (unsigned long long)(unsigned int)_mm_movemask_epi8(
+                 _mm_cmpeq_epi8(block, newline128))
+             << i;
+    }
+#endif
+
+    for (; i < len; i++) {
+        q |= (unsigned long long)(str[i] == '"') << i;
+        d |= (unsigned long long)(str[i] == delimiter) << i;
+        n |= (unsigned long long)(str[i] == '\n') << i;
+    }
+
+    *quotes = q;
+    *delimiters = d;
+    *newlines = n;
+}
+
+// Classify the next block of the record, after the bytes that were already
+// classified
+//
+// Bit i of the prefix xor of the quotes is set if there is an odd number of
+// quotes up to str[i], which is inside a quoted region (counting the opening
+// quote but not the closing one). Only the separators outside of the quoted
+// regions are kept, and the state is carried over to the next block.
+static void ds_io_csv_scan(ds_io_csv *csv, const char *record,
+                           unsigned long len) {
+    unsigned long long quotes, delimiters, newlines;
+    unsigned long block = csv->scanned;
+    unsigned long size = DS_MIN(len - block, 64);
+
+    ds_io_csv_classify(record + block, size, csv->delimiter, &quotes,
+                       &delimiters, &newlines);
+
+    unsigned long long inside = quotes;
+    for (unsigned int shift = 1; shift < 64; shift *= 2) {
+        inside ^= inside << shift;
+    }
+    inside ^= csv->quoted;
+
+    csv->quoted = 0 - (inside >> 63);
+    csv->pending = (delimiters | newlines) & ~inside;
+    csv->newlines = newlines & ~inside;
+    csv->block = block;
+    csv->scanned = block + size;
+}
+
+// Get the field without its quotes, and unescape the "" quotes in it
+//
+// The unescaped fields are copied into the unescaped builder, which has room
+// for the whole record so the fields before do not move.
+static ds_result ds_io_csv_field(ds_io_csv *csv, char *str, unsigned long len,
+                                 unsigned long record_len,
+                                 ds_string_slice *field) {
+    ds_string_slice_init_allocator(field, str, len, csv->allocator);
+    if (len == 0 || str[0] != '"') {
+        return DS_OK;
+    }
+    if (len >= 2 && str[len - 1] == '"' &&
+        ds_string_index_of(str + 1, len - 2, '"') == len - 2) {
+        field->str = str + 1;
+        field->len = len - 2;
+        return DS_OK;
+    }
+
+    ds_dynamic_array *items = &csv->unescaped.items;
+    if (ds_dynamic_array_reserve(items, record_len) != DS_OK) {
+        DS_LOG_ERROR("Failed to unescape the field");
+        return DS_ERR;
+    }
+
+    char *out = (char *)items->items + items->count;
+    unsigned long count = 0;
+    boolean inside = false;
+    unsigned long i = 0;
+    while (i < len) {
+        unsigned long run = ds_string_index_of(str + i, len - i, '"');
+        DS_MEMCPY(out + count, str + i, run);
+        count += run;
+        i += run;
+        if (i == len) {
+            break;
+        }
+        if (inside && i + 1 < len && str[i + 1] == '"') {
+            out[count++] = '"';
+            i += 2;
+        } else {
+            inside = !inside;
+            i++;
+        }
+    }
+
+    items->count += count;
+    field->str = out;
+    field->len = count;
+    return DS_OK;
+}
+
+// Split the record of len bytes into its fields, then consume the record and
+// its line ending (consumed bytes) from the input
+static boolean ds_io_csv_record(ds_io_csv *csv, char *record, unsigned long len,
+                                unsigned long consumed,
+                                ds_dynamic_array *fields) {
+    boolean result = true;
+    unsigned long *ends = csv->ends.items;
+    unsigned long count = csv->ends.count;
+
+    if (len > 0 && record[len - 1] == '\r') {
+        len--;
+    }
+
+    // An empty line is a record without fields
+    csv->unescaped.items.count = 0;
+    if (len > 0 || count > 0) {
+        if (ds_dynamic_array_reserve(fields, count + 1) != DS_OK) {
+            return_defer(false);
+        }
+
+        unsigned long start = 0;
+        for (unsigned long i = 0; i <= count; i++) {
+            unsigned long end = i < count ? ends[i] : len;
+            ds_string_slice field;
+            if (ds_io_csv_field(csv, record + start, end - start, len,
+                                &field) != DS_OK ||
+                ds_dynamic_array_append(fields, &field) != DS_OK) {
+                return_defer(false);
+            }
+            start = end + 1;
+        }
+    }
+
+    if (csv->reader != NULL) {
+        csv->reader->start += consumed;
+    } else {
+        csv->start += consumed;
+    }
+
+    // The separators of the block after the record are now relative to the
+    // start of the next record
+    unsigned long shift = consumed - csv->block;
+    csv->pending = shift < 64 ? csv->pending >> shift : 0;
+    csv->newlines = shift < 64 ? csv->newlines >> shift : 0;
+    csv->block = 0;
+    csv->scanned -= consumed;
+
+defer:
+    if (!result) {
+        csv->failed = true;
+    }
+    return result;
+}
+
+// Get the input that is not parsed yet
+static void ds_io_csv_input(ds_io_csv *csv, char **record,
+                            unsigned long *len) {
+    if (csv->reader != NULL) {
+        *record = csv->reader->start;
+        *len = csv->reader->end - csv->reader->start;
+    } else {
+        *record = csv->start;
+        *len = csv->end - csv->start;
+    }
+}
+
+// Read the next record of the CSV input
+//
+// The fields array (of ds_string_slice) is cleared and filled with the fields
+// of the record, which stay valid until the next call. An empty line is a
+// record without fields, and the last record does not need to end with a
+// newline.
+//
+// Returns true if a record was read, false at the end of the input or in case
+// of an error. When it stops, failed tells an error apart from the end of the
+// input.
+DSHDEF boolean ds_io_csv_next(ds_io_csv *csv, ds_dynamic_array *fields) {
+    char *record;
+    unsigned long len;
+
+    fields->count = 0;
+    csv->ends.count = 0;
+
+    while (true) {
+        ds_io_csv_input(csv, &record, &len);
+
+        while (csv->pending != 0 || csv->scanned < len) {
+            if (csv->pending == 0) {
+                ds_io_csv_scan(csv, record, len);
+                continue;
+            }
+
+#if defined(__GNUC__)
+            unsigned int bit = __builtin_ctzll(csv->pending);
+#else
+            unsigned int bit = 0;
+            while (((csv->pending >> bit) & 1) == 0) {
+                bit++;
+            }
+#endif
+            unsigned long end = csv->block + bit;
+            csv->pending &= csv->pending - 1;
+            if ((csv->newlines >> bit) & 1) {
+                return ds_io_csv_record(csv, record, end, end + 1, fields);
+            }
+            if (ds_dynamic_array_append(&csv->ends, &end) != DS_OK) {
+                csv->failed = true;
+                return false;
+            }
+        }
+
+        // The record goes on past the input that is buffered
+        if (csv->reader == NULL || ds_io_reader_fill(csv->reader) <= 0) {
+            break;
+        }
+    }
+
+    if (csv->reader != NULL && csv->reader->failed) {
+        csv->failed = true;
+        return false;
+    }
+
+    ds_io_csv_input(csv, &record, &len);
+    if (len == 0) {
+        return false;
+    }
+
+    return ds_io_csv_record(csv, record, len, len, fields);
+}
+
+// Free the CSV reader
+DSHDEF void ds_io_csv_free(ds_io_csv *csv) {
+    ds_dynamic_array_free(&csv->ends);
+    ds_string_builder_free(&csv->unescaped);
+    csv->reader = NULL;
+    csv->start = NULL;
+    csv->end = NULL;
+}
+
+#ifndef DS_IO_WRITER_IOV
+#define DS_IO_WRITER_IOV 64
+#endif
+
+// Write the first count bytes of the buffer followed by the slices, batching
+// them into as few writev calls as possible
+//
+// Returns 0 if everything was written, 1 otherwise.
+static ds_result ds_io_writer_send(ds_io_writer *writer, unsigned long count,
+                                   const ds_string_slice *slices,
+                                   unsigned long slice_count) {
+#ifdef DS_POSIX
+    struct iovec iov[DS_IO_WRITER_IOV];
+    unsigned long used = 0;
+
+    if (count > 0) {
+        iov[used].iov_base = writer->buffer;
+        iov[used].iov_len = count;
+        used++;
+    }
+    for (unsigned long i = 0; i <= slice_count; i++) {
+        if (used == DS_IO_WRITER_IOV || (i == slice_count && used > 0)) {
+            if (ds_writev_all(writer->fd, iov, used) < 0) {
+                return DS_ERR;
+            }
+            used = 0;
+        }
+        if (i < slice_count && slices[i].len > 0) {
+            iov[used].iov_base = slices[i].str;
+            iov[used].iov_len = slices[i].len;
+            used++;
+        }
+    }
+
+    return DS_OK;
+#else
+    (void)(writer);
+    (void)(count);
+    (void)(slices);
+    (void)(slice_count);
+    DS_LOG_ERROR("Writing to a file descriptor requires POSIX");
+    return DS_ERR;
+#endif
+}
+
+// Compress the buffer into a block of the frame, starting the frame first if
+// needed, and end the frame if end is true
+//
+// Returns 0 if the block was written, 1 otherwise.
+static ds_result ds_io_writer_compress(ds_io_writer *writer, boolean end) {
+    static char end_mark[4] = {0};
+    ds_string_slice slices[3];
+    unsigned long count = 0;
+
+    if (writer->count > 0) {
+        char *start = writer->frame + DS_LZ_HEADER;
+        if (!writer->framed) {
+            ds_lz_frame_header(writer->frame, writer->capacity);
+            start = writer->frame;
+            writer->framed = true;
+        }
+
+        unsigned long size = ds_lz_frame_block(writer->buffer, writer->count,
+                                               writer->frame + DS_LZ_HEADER);
+        slices[count++] = (ds_string_slice){
+            .allocator = NULL,
+            .str = start,
+            .len = writer->frame + DS_LZ_HEADER + size - start};
+        if (size == 4) {
+            slices[count++] = (ds_string_slice){
+                .allocator = NULL, .str = writer->buffer, .len = writer->count};
+        }
+    }
+    if (end && writer->framed) {
+        slices[count++] = (ds_string_slice){
+            .allocator = NULL, .str = end_mark, .len = sizeof(end_mark)};
+        writer->framed = false;
+    }
+
+    if (count > 0 && ds_io_writer_send(writer, 0, slices, count) != DS_OK) {
+        return DS_ERR;
+    }
+    writer->count = 0;
+
+    return DS_OK;
+}
+
+static ds_result ds_io_writer_setup(ds_io_writer *writer, int fd,
+                                    unsigned long capacity,
+                                    unsigned long alignment,
+                                    boolean compressed,
+                                    DS_ALLOCATOR *allocator) {
+    writer->allocator = allocator;
+    writer->fd = fd;
+    writer->owned = false;
+    writer->capacity = capacity > 0 ? capacity : DS_IO_WRITER_CAPACITY;
+    writer->count = 0;
+    writer->alignment = alignment;
+    writer->memory = NULL;
+    writer->frame = NULL;
+    writer->framed = false;
+
+    if (compressed) {
+        writer->capacity = DS_MIN(writer->capacity, DS_LZ_BLOCK_MAX);
+        writer->frame = DS_MALLOC(allocator,
+                                  DS_LZ_HEADER + 4 + writer->capacity);
+        if (writer->frame == NULL) {
+            DS_LOG_ERROR("Failed to allocate writer buffer");
+            return DS_ERR;
+        }
+    }
+
+    if (alignment > 0) {
+        writer->capacity = (writer->capacity + alignment - 1) / alignment *
+                           alignment;
+    }
+
+    writer->memory = DS_MALLOC(allocator, writer->capacity + alignment);
+    if (writer->memory == NULL) {
+        DS_LOG_ERROR("Failed to allocate writer buffer");
+        ds_io_writer_free(writer);
+        return DS_ERR;
+    }
+
+    writer->buffer = writer->memory;
+    if (alignment > 0) {
+        unsigned long address = (unsigned long)writer->memory;
+        writer->buffer += (alignment - address % alignment) % alignment;
+    }
+
+    return DS_OK;
+}
+
+// Initialize the writer with a custom allocator
+//
+// The capacity is the size of the buffer (DS_IO_WRITER_CAPACITY if capacity
+// is 0). The file descriptor is not closed by ds_io_writer_free.
+//
+// Returns 0 if the writer was initialized, 1 if the buffer could not be
+// allocated.
+DSHDEF ds_result ds_io_writer_init_allocator(ds_io_writer *writer, int fd,
+                                             unsigned long capacity,
+                                             DS_ALLOCATOR *allocator) {
+    return ds_io_writer_setup(writer, fd, capacity, 0, false, allocator);
+}
+
+// Initialize the writer
+DSHDEF ds_result ds_io_writer_init(ds_io_writer *writer, int fd,
+                                   unsigned long capacity) {
+    return ds_io_writer_init_allocator(writer, fd, capacity, NULL);
+}
+
+// Open a file for writing with the writer
+//
+// The file is truncated, unless the flags have DS_IO_WRITER_APPEND. With
+// DS_IO_WRITER_DIRECT the writes bypass the page cache if the file system
+// allows it, and go through it otherwise. With DS_IO_WRITER_LZ the output is
+// compressed. If filename is NULL it writes to the standard output. The file
+// is closed by ds_io_writer_free.
+//
+// Returns 0 if the file was opened, 1 otherwise.
+DSHDEF ds_result ds_io_writer_open(ds_io_writer *writer, const char *filename,
+                                   unsigned int flags, unsigned long capacity) {
+    ds_result result = DS_OK;
+
+#ifdef DS_POSIX
+    int fd = STDOUT_FILENO;
+    unsigned long alignment = 0;
+    boolean compressed = (flags & DS_IO_WRITER_LZ) != 0;
+
+    if (filename != NULL) {
+        int mode = O_WRONLY | O_CREAT |
+                   ((flags & DS_IO_WRITER_APPEND) ? O_APPEND : O_TRUNC);
+        fd = -1;
+#ifdef DS_O_DIRECT
+        if ((flags & DS_IO_WRITER_DIRECT) && !compressed) {
+            struct stat st;
+            fd = open(filename, mode | DS_O_DIRECT, 0644);
+            if (fd >= 0 && fstat(fd, &st) == 0 &&
+                st.st_size % DS_IO_WRITER_ALIGNMENT == 0) {
+                alignment = DS_IO_WRITER_ALIGNMENT;
+            } else if (fd >= 0) {
+                // Appending at an unaligned offset, use the page cache
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~DS_O_DIRECT);
+            }
+        }
+#endif
+        if (fd < 0) {
+            fd = open(filename, mode, 0644);
+        }
+        if (fd < 0) {
+            DS_LOG_ERROR("Failed to open file: %s", filename);
+            return_defer(DS_ERR);
+        }
+    }
+
+    if (ds_io_writer_setup(writer, fd, capacity, alignment, compressed,
+                           NULL) != DS_OK) {
+        if (filename != NULL) {
+            close(fd);
+        }
+        return_defer(DS_ERR);
+    }
+    writer->owned = filename != NULL;
+#else
+    (void)(writer);
+    (void)(filename);
+    (void)(flags);
+    (void)(capacity);
+    DS_LOG_ERROR("Opening a writer requires POSIX");
+    return_defer(DS_ERR);
+#endif
+
+defer:
+    return result;
+}
+
+// Write bytes with the writer
+//
+// Returns 0 if the bytes were buffered or written, 1 if the write failed.
+DSHDEF ds_result ds_io_writer_write(ds_io_writer *writer, const char *str,
+                                    unsigned long len) {
+    ds_string_slice slice = {.allocator = NULL, .str = (char *)str, .len = len};
+    return ds_io_writer_writev(writer, &slice, 1);
+}
+
+// Write many slices with the writer
+//
+// Slices that fit are copied into the buffer. Otherwise the buffered bytes
+// and all the slices are written together with writev. With DS_IO_WRITER_LZ
+// everything is copied into the buffer and compressed a block at a time.
+//
+// Returns 0 if the slices were buffered or written, 1 if the write failed.
+DSHDEF ds_result ds_io_writer_writev(ds_io_writer *writer,
+                                     const ds_string_slice *slices,
+                                     unsigned long count) {
+    unsigned long total = 0;
+    for (unsigned long i = 0; i < count; i++) {
+        total += slices[i].len;
+    }
+
+    if (writer->alignment == 0 && writer->frame == NULL &&
+        writer->count + total > writer->capacity) {
+        if (ds_io_writer_send(writer, writer->count, slices, count) != DS_OK) {
+            return DS_ERR;
+        }
+        writer->count = 0;
+        return DS_OK;
+    }
+
+    // Copy into the buffer, and in direct or compressed mode write it every
+    // time it fills
+    for (unsigned long i = 0; i < count; i++) {
+        const char *str = slices[i].str;
+        unsigned long len = slices[i].len;
+        while (len > 0) {
+            unsigned long n = DS_MIN(len, writer->capacity - writer->count);
+            DS_MEMCPY(writer->buffer + writer->count, str, n);
+            writer->count += n;
+            str += n;
+            len -= n;
+            if (writer->count == writer->capacity) {
+                ds_result sent =
+                    writer->frame != NULL
+                        ? ds_io_writer_compress(writer, false)
+                        : ds_io_writer_send(writer, writer->count, NULL, 0);
+                if (sent != DS_OK) {
+                    return DS_ERR;
+                }
+                writer->count = 0;
+            }
+        }
+    }
+
+    return DS_OK;
+}
+
+// Write out everything buffered in the writer
+//
+// In direct mode the whole blocks are written directly and the tail through
+// the page cache, and the writer stays in buffered mode afterwards. In
+// compressed mode the buffer is written as the last block of the frame.
+//
+// Returns 0 if the buffer was written, 1 if the write failed.
+DSHDEF ds_result ds_io_writer_flush(ds_io_writer *writer) {
+    unsigned long whole = 0;
+
+    if (writer->frame != NULL) {
+        return ds_io_writer_compress(writer, true);
+    }
+    if (writer->count == 0) {
+        return DS_OK;
+    }
+
+    if (writer->alignment > 0) {
+        whole = writer->count - writer->count % writer->alignment;
+        if (whole > 0 && ds_io_writer_send(writer, whole, NULL, 0) != DS_OK) {
+            return DS_ERR;
+        }
+        if (whole < writer->count) {
+#if defined(DS_POSIX) && defined(DS_O_DIRECT)
+            fcntl(writer->fd, F_SETFL,
+                  fcntl(writer->fd, F_GETFL) & ~DS_O_DIRECT);
+#endif
+            writer->alignment = 0;
+        }
+    }
+
+    ds_string_slice tail = {.allocator = NULL,
+                            .str = writer->buffer + whole,
+                            .len = writer->count - whole};
+    if (ds_io_writer_send(writer, 0, &tail, 1) != DS_OK) {
+        return DS_ERR;
+    }
+    writer->count = 0;
+
+    return DS_OK;
+}
+
+// Free the writer
+//
+// The buffered bytes are not written, call ds_io_writer_flush first. Closes the
+// file if it was opened by ds_io_writer_open.
+DSHDEF void ds_io_writer_free(ds_io_writer *writer) {
+    if (writer->memory != NULL) {
+        DS_FREE(writer->allocator, writer->memory);
+        writer->memory = NULL;
+    }
+    if (writer->frame != NULL) {
+        DS_FREE(writer->allocator, writer->frame);
+        writer->frame = NULL;
+    }
+    writer->buffer = NULL;
+    writer->count = 0;
+
+#ifdef DS_POSIX
+    if (writer->owned) {
+        close(writer->fd);
+    }
+#endif
+    writer->owned = false;
+}
+
+#ifndef DS_IO_BATCH_DEPTH
+#define DS_IO_BATCH_DEPTH 64
+#endif
+
+#ifdef DS_IO_URING
+// The parts of the io_uring ABI used by the batch (see linux/io_uring.h)
+#ifndef SYS_io_uring_setup
+#define SYS_io_uring_setup 425
+#endif
+#ifndef SYS_io_uring_enter
+#define SYS_io_uring_enter 426
+#endif
+
+#define DS_IO_URING_OP_READ 22
+#define DS_IO_URING_OP_WRITE 23
+#define DS_IO_URING_FEAT_SINGLE_MMAP 1
+#define DS_IO_URING_FEAT_RW_CUR_POS 8
+#define DS_IO_URING_ENTER_GETEVENTS 1
+#define DS_IO_URING_OFF_SQ_RING 0
+#define DS_IO_URING_OFF_CQ_RING 0x8000000L
+#define DS_IO_URING_OFF_SQES 0x10000000L
+#define DS_IO_URING_MAX_LEN 0x7FFFF000UL
+
+typedef struct ds_io_uring_sqe {
+        unsigned char opcode;
+        unsigned char flags;
+        unsigned short ioprio;
+        int fd;
+        unsigned long long off;
+        unsigned long long addr;
+        unsigned int len;
+        unsigned int rw_flags;
+        unsigned long long user_data;
+        unsigned long long pad[3];
+} ds_io_uring_sqe;
+
+typedef struct ds_io_uring_cqe {
+        unsigned long long user_data;
+        int res;
+        unsigned int flags;
+} ds_io_uring_cqe;
+
+typedef struct ds_io_uring_params {
+        unsigned int sq_entries;
+        unsigned int cq_entries;
+        unsigned int flags;
+        unsigned int sq_thread_cpu;
+        unsigned int sq_thread_idle;
+        unsigned int features;
+        unsigned int wq_fd;
+        unsigned int resv[3];
+        unsigned int sq_off[8]; // head, tail, ring_mask, ring_entries, flags,
+                                // dropped, array, resv
+        unsigned long long sq_off_resv;
+        unsigned int cq_off[8]; // head, tail, ring_mask, ring_entries,
+                                // overflow, cqes, flags, resv
+        unsigned long long cq_off_resv;
+} ds_io_uring_params;
+
+static void ds_io_batch_free_uring(ds_io_batch *batch) {
+    if (batch->sqes != NULL) {
+        munmap(batch->sqes, batch->sqes_size);
+    }
+    if (batch->cq_map != NULL && batch->cq_map != batch->sq_map) {
+        munmap(batch->cq_map, batch->cq_map_size);
+    }
+    if (batch->sq_map != NULL) {
+        munmap(batch->sq_map, batch->sq_map_size);
+    }
+    if (batch->ring >= 0) {
+        close(batch->ring);
+    }
+    batch->sqes = NULL;
+    batch->cq_map = NULL;
+    batch->sq_map = NULL;
+    batch->ring = -1;
+}
+
+// Set up the io_uring of the batch
+//
+// Returns 0 if io_uring can be used, 1 otherwise.
+static ds_result ds_io_batch_setup_uring(ds_io_batch *batch) {
+    ds_io_uring_params params = {0};
+
+    int ring = (int)syscall(SYS_io_uring_setup, batch->depth, &params);
+    if (ring < 0) {
+        return DS_ERR;
+    }
+    batch->ring = ring;
+
+    // IORING_OP_READ and IORING_OP_WRITE came with the same kernel as this
+    if (!(params.features & DS_IO_URING_FEAT_RW_CUR_POS)) {
+        ds_io_batch_free_uring(batch);
+        return DS_ERR;
+    }
+
+    batch->sq_map_size = params.sq_off[6] + params.sq_entries * sizeof(unsigned int);
+    batch->cq_map_size =
+        params.cq_off[5] + params.cq_entries * sizeof(ds_io_uring_cqe);
+    if (params.features & DS_IO_URING_FEAT_SINGLE_MMAP) {
+        batch->sq_map_size = DS_MAX(batch->sq_map_size, batch->cq_map_size);
+        batch->cq_map_size = batch->sq_map_size;
+    }
+
+    void *map = mmap(NULL, batch->sq_map_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED, ring, DS_IO_URING_OFF_SQ_RING);
+    if (map == MAP_FAILED) {
+        ds_io_batch_free_uring(batch);
+        return DS_ERR;
+    }
+    batch->sq_map = map;
+
+    if (params.features & DS_IO_URING_FEAT_SINGLE_MMAP) {
+        batch->cq_map = batch->sq_map;
+    } else {
+        map = mmap(NULL, batch->cq_map_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED, ring, DS_IO_URING_OFF_CQ_RING);
+        if (map == MAP_FAILED) {
+            ds_io_batch_free_uring(batch);
+            return DS_ERR;
+        }
+        batch->cq_map = map;
+    }
+
+    batch->sqes_size = params.sq_entries * sizeof(ds_io_uring_sqe);
+    map = mmap(NULL, batch->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+               ring, DS_IO_URING_OFF_SQES);
+    if (map == MAP_FAILED) {
+        ds_io_batch_free_uring(batch);
+        return DS_ERR;
+    }
+    batch->sqes = map;
+
+    char *sq = (char *)batch->sq_map;
+    char *cq = (char *)batch->cq_map;
+    batch->sq_head = (unsigned int *)(sq + params.sq_off[0]);
+    batch->sq_tail = (unsigned int *)(sq + params.sq_off[1]);
+    batch->sq_mask = (unsigned int *)(sq + params.sq_off[2]);
+    batch->sq_array = (unsigned int *)(sq + params.sq_off[6]);
+    batch->cq_head = (unsigned int *)(cq + params.cq_off[0]);
+    batch->cq_tail = (unsigned int *)(cq + params.cq_off[1]);
+    batch->cq_mask = (unsigned int *)(cq + params.cq_off[2]);
+    batch->cqes = cq + params.cq_off[5];
+
+    return DS_OK;
+}
+
+// Hand the queued submissions to the kernel, and wait for min_complete
+// completions
+//
+// Returns 0 on success, 1 if io_uring_enter failed.
+static ds_result ds_io_batch_enter(ds_io_batch *batch,
+                                   unsigned int min_complete) {
+    long submitted;
+    do {
+        submitted = syscall(SYS_io_uring_enter, batch->ring, batch->unsubmitted,
+                            min_complete,
+                            min_complete > 0 ? DS_IO_URING_ENTER_GETEVENTS : 0,
+                            NULL, 0);
+    } while (submitted < 0 && errno == EINTR);
+
+    if (submitted < 0) {
+        if (errno == EAGAIN || errno == EBUSY) {
+            return DS_OK;
+        }
+        DS_LOG_ERROR("Failed to enter io_uring: %d", errno);
+        return DS_ERR;
+    }
+    batch->unsubmitted -= submitted;
+
+    return DS_OK;
+}
+#endif
+
+// Run a request on the calling thread
+static void ds_io_batch_execute(ds_io_request *request) {
+#ifdef DS_POSIX
+    ssize_t length;
+    do {
+        length = request->op == DS_IO_OP_READ
+                     ? pread(request->fd, request->buffer, request->len,
+                             request->offset)
+                     : pwrite(request->fd, request->buffer, request->len,
+                              request->offset);
+    } while (length < 0 && errno == EINTR);
+    request->result = length < 0 ? -errno : length;
+#else
+    request->result = -1;
+#endif
+}
+
+#ifdef DS_THREADS
+static void *ds_io_batch_worker(void *arg) {
+    ds_io_batch *batch = (ds_io_batch *)arg;
+
+    pthread_mutex_lock(&batch->mutex);
+    while (true) {
+        while (batch->queue_count == 0 && !batch->stop) {
+            pthread_cond_wait(&batch->work, &batch->mutex);
+        }
+        if (batch->stop) {
+            break;
+        }
+
+        ds_io_request *request = batch->queue[batch->queue_head];
+        batch->queue_head = (batch->queue_head + 1) % batch->depth;
+        batch->queue_count--;
+        pthread_mutex_unlock(&batch->mutex);
+
+        ds_io_batch_execute(request);
+
+        pthread_mutex_lock(&batch->mutex);
+        batch->done[(batch->done_head + batch->done_count) % batch->depth] =
+            request;
+        batch->done_count++;
+        pthread_cond_signal(&batch->finished);
+    }
+    pthread_mutex_unlock(&batch->mutex);
+
+    return NULL;
+}
+#endif
+
+// Initialize the batch with a custom allocator
+//
+// The depth is the number of requests that can be in flight
+// (DS_IO_BATCH_DEPTH if depth is 0).
+//
+// Returns 0 if the batch was initialized, 1 if it could not be allocated.
+DSHDEF ds_result ds_io_batch_init_allocator(ds_io_batch *batch,
+                                            unsigned int depth,
+                                            DS_ALLOCATOR *allocator) {
+    ds_result result = DS_OK;
+
+    batch->allocator = allocator;
+    batch->depth = depth > 0 ? depth : DS_IO_BATCH_DEPTH;
+    batch->pending = 0;
+    batch->ring = -1;
+#ifdef DS_IO_URING
+    batch->sq_map = NULL;
+    batch->cq_map = NULL;
+    batch->sqes = NULL;
+    batch->unsubmitted = 0;
+#endif
+    batch->queue = NULL;
+    batch->queue_head = 0;
+    batch->queue_count = 0;
+    batch->done = NULL;
+    batch->done_head = 0;
+    batch->done_count = 0;
+#ifdef DS_THREADS
+    batch->threads = NULL;
+    batch->thread_count = 0;
+    batch->stop = false;
+#endif
+
+#ifdef DS_IO_URING
+    if (ds_io_batch_setup_uring(batch) == DS_OK) {
+        return_defer(DS_OK);
+    }
+#endif
+
+    batch->queue = DS_MALLOC(allocator, batch->depth * sizeof(ds_io_request *));
+    batch->done = DS_MALLOC(allocator, batch->depth * sizeof(ds_io_request *));
+    if (batch->queue == NULL || batch->done == NULL) {
+        DS_LOG_ERROR("Failed to allocate the batch queues");
+        return_defer(DS_ERR);
+    }
+
+#ifdef DS_THREADS
+    unsigned long count = DS_MIN(batch->depth, DS_IO_BATCH_THREADS);
+    batch->threads = DS_MALLOC(allocator, count * sizeof(pthread_t));
+    if (batch->threads == NULL) {
+        DS_LOG_ERROR("Failed to allocate the batch threads");
+        return_defer(DS_ERR);
+    }
+
+    pthread_mutex_init(&batch->mutex, NULL);
+    pthread_cond_init(&batch->work, NULL);
+    pthread_cond_init(&batch->finished, NULL);
+    while (batch->thread_count < count &&
+           pthread_create(&batch->threads[batch->thread_count], NULL,
+                          ds_io_batch_worker, batch) == 0) {
+        batch->thread_count++;
+    }
+
+    // Without any thread the requests are run inline
+    if (batch->thread_count == 0) {
+        pthread_cond_destroy(&batch->finished);
+        pthread_cond_destroy(&batch->work);
+        pthread_mutex_destroy(&batch->mutex);
+    }
+#endif
+
+defer:
+    if (result != DS_OK) {
+        ds_io_batch_free(batch);
+    }
+    return result;
+}
+
+// Initialize the batch
+DSHDEF ds_result ds_io_batch_init(ds_io_batch *batch, unsigned int depth) {
+    return ds_io_batch_init_allocator(batch, depth, NULL);
+}
+
+// Submit requests to the batch
+//
+// The requests start right away and complete in any order, see
+// ds_io_batch_complete. Reads with a NULL buffer get one from the allocator of
+// the batch.
+//
+// Returns 0 if the requests were submitted, 1 if they would exceed the depth
+// of the batch or a buffer could not be allocated.
+DSHDEF ds_result ds_io_batch_submit(ds_io_batch *batch,
+                                    ds_io_request *requests,
+                                    unsigned long count) {
+    if (batch->pending + count > batch->depth) {
+        DS_LOG_ERROR("Too many requests in flight for a batch of depth %u",
+                     batch->depth);
+        return DS_ERR;
+    }
+
+    // Allocate the missing buffers first, so that nothing is submitted if
+    // one of them cannot be allocated (result marks the allocated ones)
+    for (unsigned long i = 0; i < count; i++) {
+        requests[i].result = 0;
+        if (requests[i].op != DS_IO_OP_READ || requests[i].buffer != NULL) {
+            continue;
+        }
+        requests[i].buffer = DS_MALLOC(batch->allocator, requests[i].len);
+        if (requests[i].buffer == NULL) {
+            DS_LOG_ERROR("Failed to allocate the buffer of a read");
+            while (i-- > 0) {
+                if (requests[i].result == 1) {
+                    DS_FREE(batch->allocator, requests[i].buffer);
+                    requests[i].buffer = NULL;
+                }
+            }
+            return DS_ERR;
+        }
+        requests[i].result = 1;
+    }
+
+    batch->pending += count;
+
+#ifdef DS_IO_URING
+    if (batch->ring >= 0) {
+        unsigned int tail = *batch->sq_tail;
+        for (unsigned long i = 0; i < count; i++) {
+            unsigned int index = tail & *batch->sq_mask;
+            ds_io_uring_sqe *sqe = (ds_io_uring_sqe *)batch->sqes + index;
+            *sqe = (ds_io_uring_sqe){0};
+            sqe->opcode = requests[i].op == DS_IO_OP_READ
+                              ? DS_IO_URING_OP_READ
+                              : DS_IO_URING_OP_WRITE;
+            sqe->fd = requests[i].fd;
+            sqe->off = requests[i].offset;
+            sqe->addr = (unsigned long)requests[i].buffer;
+            sqe->len = DS_MIN(requests[i].len, DS_IO_URING_MAX_LEN);
+            sqe->user_data = (unsigned long)&requests[i];
+            batch->sq_array[index] = index;
+            tail++;
+        }
+        __atomic_store_n(batch->sq_tail, tail, __ATOMIC_RELEASE);
+        batch->unsubmitted += count;
+
+        return ds_io_batch_enter(batch, 0);
+    }
+#endif
+
+#ifdef DS_THREADS
+    if (batch->thread_count > 0) {
+        pthread_mutex_lock(&batch->mutex);
+        for (unsigned long i = 0; i < count; i++) {
+            batch->queue[(batch->queue_head + batch->queue_count) %
+                         batch->depth] = &requests[i];
+            batch->queue_count++;
+        }
+        pthread_cond_broadcast(&batch->work);
+        pthread_mutex_unlock(&batch->mutex);
+        return DS_OK;
+    }
+#endif
+
+    for (unsigned long i = 0; i < count; i++) {
+        ds_io_batch_execute(&requests[i]);
+        batch->done[(batch->done_head + batch->done_count) % batch->depth] =
+            &requests[i];
+        batch->done_count++;
+    }
+
+    return DS_OK;
+}
+
+// Wait for the next request of the batch to complete
+//
+// Returns true if a request completed, and stores it in request. Returns false
+// if there are no requests in flight or waiting failed.
+DSHDEF boolean ds_io_batch_complete(ds_io_batch *batch,
+                                    ds_io_request **request) {
+    if (batch->pending == 0) {
+        return false;
+    }
+
+#ifdef DS_IO_URING
+    if (batch->ring >= 0) {
+        while (true) {
+            unsigned int head = *batch->cq_head;
+            unsigned int tail = __atomic_load_n(batch->cq_tail, __ATOMIC_ACQUIRE);
+            if (head != tail) {
+                ds_io_uring_cqe *cqe =
+                    (ds_io_uring_cqe *)batch->cqes + (head & *batch->cq_mask);
+                *request = (ds_io_request *)(unsigned long)cqe->user_data;
+                (*request)->result = cqe->res;
+                __atomic_store_n(batch->cq_head, head + 1, __ATOMIC_RELEASE);
+                break;
+            }
+            if (ds_io_batch_enter(batch, 1) != DS_OK) {
+                return false;
+            }
+        }
+        batch->pending--;
+        return true;
+    }
+#endif
+
+#ifdef DS_THREADS
+    if (batch->thread_count > 0) {
+        pthread_mutex_lock(&batch->mutex);
+        while (batch->done_count == 0) {
+            pthread_cond_wait(&batch->finished, &batch->mutex);
+        }
+    }
+#endif
+
+    *request = batch->done[batch->done_head];
+    batch->done_head = (batch->done_head + 1) % batch->depth;
+    batch->done_count--;
+
+#ifdef DS_THREADS
+    if (batch->thread_count > 0) {
+        pthread_mutex_unlock(&batch->mutex);
+    }
+#endif
+
+    batch->pending--;
+    return true;
+}
+
+// Run all the requests with the batch and wait for them to complete
+//
+// The requests are kept at the depth of the batch until they are all done.
+// The batch should have no other requests in flight.
+//
+// Returns 0 if all the requests completed (check their results), 1 if one of
+// them could not be submitted.
+DSHDEF ds_result ds_io_batch_run(ds_io_batch *batch, ds_io_request *requests,
+                                 unsigned long count) {
+    ds_result result = DS_OK;
+    unsigned long submitted = 0;
+    unsigned long completed = 0;
+    ds_io_request *request = NULL;
+
+    while (completed < count) {
+        unsigned long room = batch->depth - batch->pending;
+        unsigned long next = DS_MIN(room, count - submitted);
+        if (result == DS_OK && next > 0) {
+            if (ds_io_batch_submit(batch, requests + submitted, next) != DS_OK) {
+                result = DS_ERR;
+            } else {
+                submitted += next;
+            }
+        }
+        if (completed == submitted ||
+            !ds_io_batch_complete(batch, &request)) {
+            break;
+        }
+        completed++;
+    }
+
+    if (completed < count) {
+        result = DS_ERR;
+    }
+
+    return result;
+}
+
+// Free the batch
+//
+// The requests still in flight are abandoned.
+DSHDEF void ds_io_batch_free(ds_io_batch *batch) {
+#ifdef DS_THREADS
+    if (batch->thread_count > 0) {
+        pthread_mutex_lock(&batch->mutex);
+        batch->stop = true;
+        pthread_cond_broadcast(&batch->work);
+        pthread_mutex_unlock(&batch->mutex);
+        for (unsigned long i = 0; i < batch->thread_count; i++) {
+            pthread_join(batch->threads[i], NULL);
+        }
+        pthread_cond_destroy(&batch->finished);
+        pthread_cond_destroy(&batch->work);
+        pthread_mutex_destroy(&batch->mutex);
+        batch->thread_count = 0;
+    }
+    if (batch->threads != NULL) {
+        DS_FREE(batch->allocator, batch->threads);
+        batch->threads = NULL;
+    }
+#endif
+#ifdef DS_IO_URING
+    ds_io_batch_free_uring(batch);
+#endif
+    if (batch->queue != NULL) {
+        DS_FREE(batch->allocator, batch->queue);
+        batch->queue = NULL;
+    }
+    if (batch->done != NULL) {
+        DS_FREE(batch->allocator, batch->done);
+        batch->done = NULL;
+    }
+    batch->pending = 0;
+}
+
+// Get the size of a file
+//
+// Returns the size, or -1 and sets error.
+static long ds_io_file_size(const char *path, int *error) {
+#ifdef DS_POSIX
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        *error = errno;
+        return -1;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        *error = EISDIR;
+        return -1;
+    }
+    return st.st_size;
+#else
+    FILE *file = fopen(path, "rb");
+    long size = -1;
+    if (file != NULL && fseek(file, 0, SEEK_END) == 0) {
+        size = ftell(file);
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
+    if (size < 0) {
+        *error = 1;
+    }
+    return size;
+#endif
+}
+
+// Read up to size bytes of a file into the buffer
+//
+// Returns the number of bytes read, or -1 and sets error.
+static long ds_io_file_read(const char *path, char *buffer, unsigned long size,
+                            int *error) {
+    unsigned long count = 0;
+
+#ifdef DS_POSIX
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        *error = errno;
+        return -1;
+    }
+    while (count < size) {
+        ssize_t length = read(fd, buffer + count, size - count);
+        if (length < 0 && errno == EINTR) {
+            continue;
+        }
+        if (length < 0) {
+            *error = errno;
+            close(fd);
+            return -1;
+        }
+        if (length == 0) {
+            break;
+        }
+        count += length;
+    }
+    close(fd);
+#else
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        *error = 1;
+        return -1;
+    }
+    count = fread(buffer, sizeof(char), size, file);
+    if (ferror(file)) {
+        *error = 1;
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+#endif
+
+    return count;
+}
+
+// Size or read the files of the loader until there are none left. The files
+// are read once the memory of the loader is allocated.
+static void *ds_io_loader_worker(void *arg) {
+    ds_io_loader *loader = (ds_io_loader *)arg;
+
+    while (true) {
+#ifdef DS_THREADS
+        unsigned long i = __atomic_fetch_add(&loader->next, 1, __ATOMIC_RELAXED);
+#else
+        unsigned long i = loader->next++;
+#endif
+        if (i >= loader->count) {
+            break;
+        }
+
+        ds_io_file *file = &loader->files[i];
+        if (loader->memory == NULL) {
+            long size = ds_io_file_size(file->path, &file->error);
+            file->content.len = size > 0 ? size : 0;
+        } else if (file->error == 0) {
+            long length = ds_io_file_read(file->path, file->content.str,
+                                          file->content.len, &file->error);
+            file->content.len = length > 0 ? length : 0;
+            file->content.str[file->content.len] = '\0';
+        }
+    }
+
+    return NULL;
+}
+
+// Run the worker on threads threads, including the calling thread
+static void ds_io_loader_run(ds_io_loader *loader, unsigned long threads) {
+    loader->next = 0;
+
+#ifdef DS_THREADS
+    pthread_t handles[DS_IO_LOADER_THREADS];
+    unsigned long started = 0;
+
+    threads = DS_MIN(threads, DS_IO_LOADER_THREADS);
+    for (unsigned long i = 1; i < threads; i++) {
+        if (pthread_create(&handles[started], NULL, ds_io_loader_worker,
+                           loader) == 0) {
+            started++;
+        }
+    }
+    ds_io_loader_worker(loader);
+    for (unsigned long i = 0; i < started; i++) {
+        pthread_join(handles[i], NULL);
+    }
+#else
+    (void)(threads);
+    ds_io_loader_worker(loader);
+#endif
+}
+
+// Initialize the loader with a custom allocator
+DSHDEF void ds_io_loader_init_allocator(ds_io_loader *loader,
+                                        DS_ALLOCATOR *allocator) {
+    loader->allocator = allocator;
+    loader->files = NULL;
+    loader->count = 0;
+    loader->memory = NULL;
+    loader->next = 0;
+}
+
+// Initialize the loader
+DSHDEF void ds_io_loader_init(ds_io_loader *loader) {
+    ds_io_loader_init_allocator(loader, NULL);
+}
+
+// Load the files into the loader
+//
+// Reads the files on up to threads threads (DS_IO_LOADER_THREADS if threads
+// is 0, and at most that many). The files of the loader are then in the order
+// of the paths, and the paths must outlive the loader. A file that could not be
+// read has an error and empty content. Anything loaded before is freed.
+//
+// Returns 0 if the files were loaded (check their errors), 1 if the memory
+// could not be allocated.
+DSHDEF ds_result ds_io_loader_load(ds_io_loader *loader, const char **paths,
+                                   unsigned long count, unsigned long threads) {
+    ds_result result = DS_OK;
+
+    ds_io_loader_free(loader);
+    if (count == 0) {
+        return_defer(DS_OK);
+    }
+
+    loader->files = DS_MALLOC(loader->allocator, count * sizeof(ds_io_file));
+    if (loader->files == NULL) {
+        DS_LOG_ERROR("Failed to allocate the loader files");
+        return_defer(DS_ERR);
+    }
+    loader->count = count;
+    for (unsigned long i = 0; i < count; i++) {
+        loader->files[i].path = paths[i];
+        loader->files[i].content.allocator = loader->allocator;
+        loader->files[i].content.str = NULL;
+        loader->files[i].content.len = 0;
+        loader->files[i].error = 0;
+    }
+
+    threads = DS_MIN(threads > 0 ? threads : DS_IO_LOADER_THREADS, count);
+    ds_io_loader_run(loader, threads);
+
+    // One block for all the files, each followed by a NUL
+    unsigned long size = 0;
+    for (unsigned long i = 0; i < count; i++) {
+        size += loader->files[i].content.len + 1;
+    }
+    loader->memory = DS_MALLOC(loader->allocator, size);
+    if (loader->memory == NULL) {
+        DS_LOG_ERROR("Failed to allocate %lu bytes for the files", size);
+        return_defer(DS_ERR);
+    }
+
+    char *str = loader->memory;
+    for (unsigned long i = 0; i < count; i++) {
+        loader->files[i].content.str = str;
+        str[0] = '\0';
+        str += loader->files[i].content.len + 1;
+    }
+
+    ds_io_loader_run(loader, threads);
+
+defer:
+    if (result != DS_OK) {
+        ds_io_loader_free(loader);
+    }
+    return result;
+}
+
+// Free the loader and the contents of its files
+DSHDEF void ds_io_loader_free(ds_io_loader *loader) {
+    if (loader->memory != NULL) {
+        DS_FREE(loader->allocator, loader->memory);
+        loader->memory = NULL;
+    }
+    if (loader->files != NULL) {
+        DS_FREE(loader->allocator, loader->files);
+        loader->files = NULL;
+    }
+    loader->count = 0;
+}
+
+#define DS_IO_WALK_STAGE 1024 // the entries a worker appends at once
+
+// The directory entry types, fstatat and the open flags below are not
+// declared by glibc in the strict modes (e.g. -std=c99 without feature test
+// macros)
+#ifdef DS_POSIX
+#ifndef DT_DIR
+#define DT_UNKNOWN 0
+#define DT_DIR 4
+#define DT_REG 8
+#define DT_LNK 10
+#endif
+#if !defined(O_DIRECTORY) && defined(__O_DIRECTORY)
+#define O_DIRECTORY __O_DIRECTORY
+#endif
+#if !defined(O_CLOEXEC) && defined(__O_CLOEXEC)
+#define O_CLOEXEC __O_CLOEXEC
+#endif
+#if defined(__GLIBC__) && !defined(__USE_ATFILE)
+#define AT_SYMLINK_NOFOLLOW 0x100
+extern int fstatat(int dirfd, const char *path, struct stat *buf, int flags);
+#endif
+#endif
+
+#if defined(__linux__) && defined(DS_POSIX)
+#define DS_IO_GETDENTS
+#include <sys/syscall.h>
+#if defined(__GLIBC__) && !defined(__USE_MISC)
+extern long syscall(long number, ...);
+#endif
+
+// A record of getdents64 (see getdents64(2))
+typedef struct ds_io_dirent64 {
+        unsigned long long d_ino;
+        long long d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[];
+} ds_io_dirent64;
+#endif
+
+#ifdef DS_POSIX
+typedef struct ds_io_walk_worker {
+        ds_io_walker *walker;
+        unsigned long relative; // the offset of the relative paths
+        char path[DS_IO_WALK_PATH];
+        ds_io_entry staged[DS_IO_WALK_STAGE]; // paths in stage
+        unsigned long staged_count;
+        char stage[DS_IO_WALK_PATH * 16];
+        unsigned long stage_len;
+#ifdef DS_IO_GETDENTS
+        unsigned long long buffer[DS_IO_WALK_BUFFER / 8];
+#endif
+} ds_io_walk_worker;
+
+static void ds_io_walker_lock(ds_io_walker *walker) {
+#ifdef DS_THREADS
+    pthread_mutex_lock(&walker->mutex);
+#else
+    (void)(walker);
+#endif
+}
+
+static void ds_io_walker_unlock(ds_io_walker *walker) {
+#ifdef DS_THREADS
+    pthread_mutex_unlock(&walker->mutex);
+#else
+    (void)(walker);
+#endif
+}
+
+static boolean ds_io_walker_stopped(ds_io_walker *walker) {
+#ifdef DS_THREADS
+    return __atomic_load_n(&walker->stop, __ATOMIC_RELAXED);
+#else
+    return walker->stop;
+#endif
+}
+
+static void ds_io_walker_stop(ds_io_walker *walker) {
+#ifdef DS_THREADS
+    __atomic_store_n(&walker->stop, true, __ATOMIC_RELAXED);
+#else
+    walker->stop = true;
+#endif
+}
+
+static void ds_io_walker_error(ds_io_walker *walker) {
+#ifdef DS_THREADS
+    __atomic_fetch_add(&walker->errors, 1, __ATOMIC_RELAXED);
+#else
+    walker->errors++;
+#endif
+}
+
+// Queue a directory to be read. The allocator is only used with the lock
+// held, so it does not have to be thread safe.
+static void ds_io_walker_push(ds_io_walker *walker, const char *path,
+                              unsigned long len) {
+    ds_io_walker_lock(walker);
+    char *directory = DS_MALLOC(walker->allocator, len + 1);
+    if (directory == NULL ||
+        ds_dynamic_array_append(&walker->queue, &directory) != DS_OK) {
+        DS_LOG_ERROR("Failed to queue a directory");
+        if (directory != NULL) {
+            DS_FREE(walker->allocator, directory);
+        }
+        walker->failed = true;
+        ds_io_walker_stop(walker);
+    } else {
+        DS_MEMCPY(directory, path, len);
+        directory[len] = '\0';
+        walker->active++;
+#ifdef DS_THREADS
+        pthread_cond_signal(&walker->cond);
+#endif
+    }
+    ds_io_walker_unlock(walker);
+}
+
+// Append the staged entries to the entries of the walker, with their paths
+// copied into one block
+static void ds_io_walker_flush(ds_io_walk_worker *worker) {
+    ds_io_walker *walker = worker->walker;
+
+    if (worker->staged_count == 0) {
+        return;
+    }
+
+    ds_io_walker_lock(walker);
+    char *block = DS_MALLOC(walker->allocator, worker->stage_len);
+    if (block == NULL ||
+        ds_dynamic_array_append(&walker->blocks, &block) != DS_OK) {
+        DS_LOG_ERROR("Failed to allocate the paths of the entries");
+        if (block != NULL) {
+            DS_FREE(walker->allocator, block);
+        }
+        walker->failed = true;
+        ds_io_walker_stop(walker);
+    } else {
+        DS_MEMCPY(block, worker->stage, worker->stage_len);
+        for (unsigned long i = 0; i < worker->staged_count; i++) {
+            ds_io_entry entry = worker->staged[i];
+            entry.path.str = block + (entry.path.str - worker->stage);
+            if (ds_dynamic_array_append(&walker->entries, &entry) != DS_OK) {
+                walker->failed = true;
+                ds_io_walker_stop(walker);
+                break;
+            }
+        }
+    }
+    ds_io_walker_unlock(walker);
+
+    worker->staged_count = 0;
+    worker->stage_len = 0;
+}
+
+// Report the entry in the path of the worker, which is len bytes long
+static void ds_io_walker_report(ds_io_walk_worker *worker, unsigned long len,
+                                unsigned int type) {
+    ds_io_walker *walker = worker->walker;
+    ds_io_entry entry = {.path = {.allocator = walker->allocator,
+                                  .str = worker->path,
+                                  .len = len},
+                         .relative = worker->relative,
+                         .type = type};
+
+    if (walker->callback != NULL) {
+        if (!walker->callback(walker->context, &entry)) {
+            ds_io_walker_stop(walker);
+        }
+        return;
+    }
+
+    if (worker->staged_count == DS_IO_WALK_STAGE ||
+        worker->stage_len + len + 1 > sizeof(worker->stage)) {
+        ds_io_walker_flush(worker);
+    }
+    entry.path.str = worker->stage + worker->stage_len;
+    DS_MEMCPY(entry.path.str, worker->path, len + 1);
+    worker->stage_len += len + 1;
+    worker->staged[worker->staged_count++] = entry;
+}
+
+// Visit an entry of the directory fd, whose path is the first len bytes of
+// the path of the worker
+static void ds_io_walker_visit(ds_io_walk_worker *worker, int fd,
+                               unsigned long len, const char *name,
+                               unsigned char d_type) {
+    ds_io_walker *walker = worker->walker;
+
+    if (name[0] == '.' &&
+        (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+        return;
+    }
+
+    // The root / is the only directory that ends with a /
+    unsigned long start = worker->path[len - 1] == '/' ? len : len + 1;
+    unsigned long name_len = DS_STRLEN(name);
+    if (start + name_len >= DS_IO_WALK_PATH) {
+        ds_io_walker_error(walker);
+        return;
+    }
+    worker->path[len] = '/';
+    DS_MEMCPY(worker->path + start, name, name_len + 1);
+    unsigned long total = start + name_len;
+
+    unsigned int type = DS_IO_WALK_OTHER;
+    if (d_type == DT_DIR) {
+        type = DS_IO_WALK_DIRECTORY;
+    } else if (d_type == DT_REG) {
+        type = DS_IO_WALK_FILE;
+    } else if (d_type == DT_LNK) {
+        type = DS_IO_WALK_LINK;
+    } else if (d_type == DT_UNKNOWN) {
+        struct stat st;
+        if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            ds_io_walker_error(walker);
+            worker->path[len] = '\0';
+            return;
+        }
+        type = S_ISDIR(st.st_mode)   ? DS_IO_WALK_DIRECTORY
+               : S_ISREG(st.st_mode) ? DS_IO_WALK_FILE
+               : S_ISLNK(st.st_mode) ? DS_IO_WALK_LINK
+                                     : DS_IO_WALK_OTHER;
+    }
+
+    ds_string_slice relative = {.allocator = NULL,
+                                .str = worker->path + worker->relative,
+                                .len = total - worker->relative};
+    if (walker->exclude == NULL ||
+        !ds_pattern_match(walker->exclude, &relative, NULL)) {
+        if (type == DS_IO_WALK_DIRECTORY) {
+            ds_io_walker_push(walker, worker->path, total);
+        }
+        if (walker->include == NULL ||
+            ds_pattern_match(walker->include, &relative, NULL)) {
+            ds_io_walker_report(worker, total, type);
+        }
+    }
+
+    worker->path[len] = '\0';
+}
+
+// Read the directory in the path of the worker, which is len bytes long
+static void ds_io_walker_read(ds_io_walk_worker *worker, unsigned long len) {
+    ds_io_walker *walker = worker->walker;
+
+    int fd = open(worker->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        ds_io_walker_error(walker);
+        return;
+    }
+
+#ifdef DS_IO_GETDENTS
+    while (!ds_io_walker_stopped(walker)) {
+        long length =
+            syscall(SYS_getdents64, fd, worker->buffer, sizeof(worker->buffer));
+        if (length < 0 && errno == EINTR) {
+            continue;
+        }
+        if (length <= 0) {
+            if (length < 0) {
+                ds_io_walker_error(walker);
+            }
+            break;
+        }
+
+        for (long offset = 0;
+             offset < length && !ds_io_walker_stopped(walker);) {
+            ds_io_dirent64 *entry =
+                (ds_io_dirent64 *)((char *)worker->buffer + offset);
+            ds_io_walker_visit(worker, fd, len, entry->d_name, entry->d_type);
+            offset += entry->d_reclen;
+        }
+    }
+    close(fd);
+#else
+    DIR *dir = fdopendir(fd);
+    if (dir == NULL) {
+        ds_io_walker_error(walker);
+        close(fd);
+        return;
+    }
+
+    struct dirent *entry;
+    while (!ds_io_walker_stopped(walker) && (entry = readdir(dir)) != NULL) {
+        ds_io_walker_visit(worker, fd, len, entry->d_name, entry->d_type);
+    }
+    closedir(dir);
+#endif
+}
+
+// Read directories from the queue until there are none left and none being
+// read that could add more
+static void *ds_io_walker_worker(void *arg) {
+    ds_io_walk_worker *worker = (ds_io_walk_worker *)arg;
+    ds_io_walker *walker = worker->walker;
+
+    ds_io_walker_lock(walker);
+    while (true) {
+#ifdef DS_THREADS
+        while (walker->queue.count == 0 && walker->active > 0 &&
+               !ds_io_walker_stopped(walker)) {
+            pthread_cond_wait(&walker->cond, &walker->mutex);
+        }
+#endif
+        if (walker->queue.count == 0 || ds_io_walker_stopped(walker)) {
+            break;
+        }
+
+        const void *item = NULL;
+        ds_dynamic_array_pop(&walker->queue, &item);
+        char *directory = *(char **)item;
+        unsigned long len = DS_STRLEN(directory);
+        DS_MEMCPY(worker->path, directory, len + 1);
+        DS_FREE(walker->allocator, directory);
+        ds_io_walker_unlock(walker);
+
+        ds_io_walker_read(worker, len);
+
+        ds_io_walker_lock(walker);
+        walker->active--;
+#ifdef DS_THREADS
+        if (walker->active == 0) {
+            pthread_cond_broadcast(&walker->cond);
+        }
+#endif
+    }
+#ifdef DS_THREADS
+    pthread_cond_broadcast(&walker->cond);
+#endif
+    ds_io_walker_unlock(walker);
+
+    ds_io_walker_flush(worker);
+
+    return NULL;
+}
+#endif
+
+// Initialize the walker with a custom allocator
+DSHDEF void ds_io_walker_init_allocator(ds_io_walker *walker,
+                                        DS_ALLOCATOR *allocator) {
+    walker->allocator = allocator;
+    walker->include = NULL;
+    walker->exclude = NULL;
+    walker->callback = NULL;
+    walker->context = NULL;
+    ds_dynamic_array_init_allocator(&walker->entries, sizeof(ds_io_entry),
+                                    allocator);
+    ds_dynamic_array_init_allocator(&walker->blocks, sizeof(char *),
+                                    allocator);
+    ds_dynamic_array_init_allocator(&walker->queue, sizeof(char *), allocator);
+    walker->errors = 0;
+    walker->active = 0;
+    walker->stop = false;
+    walker->failed = false;
+}
+
+// Initialize the walker
+DSHDEF void ds_io_walker_init(ds_io_walker *walker) {
+    ds_io_walker_init_allocator(walker, NULL);
+}
+
+// Set the patterns that select the entries
+//
+// The patterns must be built, and must outlive the walk.
+DSHDEF void ds_io_walker_set_filters(ds_io_walker *walker, ds_pattern *include,
+                                     ds_pattern *exclude) {
+    walker->include = include;
+    walker->exclude = exclude;
+}
+
+// Report the entries to a callback instead of the entries of the walker
+//
+// The entry is only valid during the call.
+DSHDEF void ds_io_walker_set_callback(
+    ds_io_walker *walker,
+    boolean (*callback)(void *context, const ds_io_entry *entry),
+    void *context) {
+    walker->callback = callback;
+    walker->context = context;
+}
+
+// Walk a directory tree
+//
+// Walks the tree below root (not including root) on up to threads threads
+// (DS_IO_WALK_THREADS if threads is 0, and at most that many). The entries
+// are appended to the entries of earlier walks. The entries and directories
+// that cannot be read are skipped and counted in errors.
+//
+// Returns 0 if the tree was walked, 1 if the root is not a directory or the
+// memory could not be allocated.
+DSHDEF ds_result ds_io_walker_walk(ds_io_walker *walker, const char *root,
+                                   unsigned long threads) {
+    ds_result result = DS_OK;
+
+#ifdef DS_POSIX
+    ds_io_walk_worker *workers = NULL;
+
+    unsigned long len = DS_STRLEN(root);
+    while (len > 1 && root[len - 1] == '/') {
+        len--;
+    }
+
+    struct stat st;
+    if (len == 0 || len >= DS_IO_WALK_PATH || stat(root, &st) != 0 ||
+        !S_ISDIR(st.st_mode)) {
+        DS_LOG_ERROR("Not a directory: %s", root);
+        return_defer(DS_ERR);
+    }
+
+    threads = DS_MIN(threads > 0 ? threads : DS_IO_WALK_THREADS,
+                     DS_IO_WALK_THREADS);
+    workers = DS_MALLOC(walker->allocator, threads * sizeof(ds_io_walk_worker));
+    if (workers == NULL) {
+        DS_LOG_ERROR("Failed to allocate the walker workers");
+        return_defer(DS_ERR);
+    }
+    for (unsigned long i = 0; i < threads; i++) {
+        workers[i].walker = walker;
+        workers[i].relative = root[len - 1] == '/' ? len : len + 1;
+        workers[i].staged_count = 0;
+        workers[i].stage_len = 0;
+    }
+
+    walker->active = 0;
+    walker->stop = false;
+    walker->failed = false;
+
+#ifdef DS_THREADS
+    pthread_t handles[DS_IO_WALK_THREADS];
+    unsigned long started = 0;
+
+    pthread_mutex_init(&walker->mutex, NULL);
+    pthread_cond_init(&walker->cond, NULL);
+
+    ds_io_walker_push(walker, root, len);
+    for (unsigned long i = 1; i < threads; i++) {
+        if (pthread_create(&handles[started], NULL, ds_io_walker_worker,
+                           &workers[i]) == 0) {
+            started++;
+        }
+    }
+    ds_io_walker_worker(&workers[0]);
+    for (unsigned long i = 0; i < started; i++) {
+        pthread_join(handles[i], NULL);
+    }
+
+    pthread_cond_destroy(&walker->cond);
+    pthread_mutex_destroy(&walker->mutex);
+#else
+    ds_io_walker_push(walker, root, len);
+    ds_io_walker_worker(&workers[0]);
+#endif
+
+    // A walk that stopped early leaves directories in the queue
+    while (walker->queue.count > 0) {
+        const void *item = NULL;
+        ds_dynamic_array_pop(&walker->queue, &item);
+        DS_FREE(walker->allocator, *(char **)item);
+    }
+    walker->active = 0;
+
+    if (walker->failed) {
+        return_defer(DS_ERR);
+    }
+
+defer:
+    if (workers != NULL) {
+        DS_FREE(walker->allocator, workers);
+    }
+#else
+    (void)(walker);
+    (void)(root);
+    (void)(threads);
+    DS_LOG_ERROR("Walking a directory requires POSIX");
+    return_defer(DS_ERR);
+
+defer:
+#endif
+    return result;
+}
+
+// Free the walker and the paths of its entries
+DSHDEF void ds_io_walker_free(ds_io_walker *walker) {
+    for (unsigned long i = 0; i < walker->blocks.count; i++) {
+        DS_FREE(walker->allocator, ((char **)walker->blocks.items)[i]);
+    }
+    ds_dynamic_array_free(&walker->blocks);
+    ds_dynamic_array_free(&walker->entries);
+    ds_dynamic_array_free(&walker->queue);
+}
+
+#ifdef DS_POSIX
+static ds_result ds_io_log_sync(int fd) {
+#ifdef __APPLE__
+    return fsync(fd) == 0 ? DS_OK : DS_ERR;
+#else
+    return fdatasync(fd) == 0 ? DS_OK : DS_ERR;
+#endif
+}
+
+// Write the length and the checksum of a record in front of it
+static void ds_io_log_frame(char *header, const char *record,
+                            unsigned long len) {
+    ds_io_put32((unsigned char *)header, len);
+    unsigned int crc = ds_crc32c(0, header, 4);
+    ds_io_put32((unsigned char *)header + 4, ds_crc32c(crc, record, len));
+}
+#endif
+
+// Open a log with a custom allocator
 //
-// Returns 0 if the string was converted successfully, 1 if the string could not
-// be allocated.
-DSHDEF ds_result ds_string_slice_to_owned(ds_string_slice *ss, char **str) {
+// The file is created if it does not exist. The records are scanned up to the
+// first torn one, and the file is truncated there. The allocator is used for
+// the pending records with DS_IO_LOG_GROUP_COMMIT.
+//
+// Returns 0 if the log was opened, 1 otherwise.
+DSHDEF ds_result ds_io_log_open_allocator(ds_io_log *log, const char *filename,
+                                          unsigned int flags,
+                                          DS_ALLOCATOR *allocator) {
     ds_result result = DS_OK;
 
-    *str = DS_MALLOC(ss->allocator, ss->len + 1);
-    if (*str == NULL) {
-        DS_LOG_ERROR("Failed to allocate string");
+    log->allocator = allocator;
+    log->fd = -1;
+    log->size = 0;
+    log->group_commit = false;
+    log->failed = false;
+#ifdef DS_THREADS
+    log->pending = NULL;
+    log->pending_count = 0;
+    log->pending_capacity = 0;
+    log->committing = NULL;
+    log->committing_capacity = 0;
+    log->started = 0;
+    log->committed = 0;
+    log->leader = false;
+#endif
+
+#ifdef DS_POSIX
+    log->fd = open(filename, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (log->fd < 0) {
+        DS_LOG_ERROR("Failed to open log: %s", filename);
         return_defer(DS_ERR);
     }
 
-    DS_MEMCPY(*str, ss->str, ss->len);
-    (*str)[ss->len] = '\0';
-
-defer:
-    return result;
-}
+    struct stat st;
+    if (fstat(log->fd, &st) != 0) {
+        DS_LOG_ERROR("Failed to stat log: %s", filename);
+        return_defer(DS_ERR);
+    }
 
-// Check if the string slice is equal to a specific string
-//
-// Returns 1 in case the string slice equals str. Returns 0 otherwise
-DSHDEF boolean ds_string_slice_equals(ds_string_slice *ss, ds_string_slice *so) {
-    return ss->len == so->len && DS_MEMCMP(ss->str, so->str, ss->len) == 0;
-}
+    if (st.st_size > 0) {
+        void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, log->fd, 0);
+        if (data == MAP_FAILED) {
+            DS_LOG_ERROR("Failed to map log: %s", filename);
+            return_defer(DS_ERR);
+        }
+#ifdef MADV_SEQUENTIAL
+        madvise(data, st.st_size, MADV_SEQUENTIAL);
+#endif
 
-// Check if the string slice starts with a specific string
-//
-// Returns 1 in case the string slice starts with str. Returns 0 otherwise
-DSHDEF boolean ds_string_slice_starts_with(ds_string_slice *ss,
-                                           ds_string_slice *prefix) {
-    return DS_MEMCMP(ss->str, prefix->str, prefix->len) == 0;
-}
+        ds_string_slice rest = {
+            .allocator = NULL, .str = (char *)data, .len = st.st_size};
+        ds_string_slice record;
+        while (ds_io_log_next(&rest, &record)) {
+        }
+        log->size = st.st_size - rest.len;
+        munmap(data, st.st_size);
+    }
 
-// Check if the string slice starts with a char that matches a predicate function
-//
-// Returns 1 if the string slice starts with a predicate. Returns 0 otherwise.
-DSHDEF boolean ds_string_slice_starts_with_pred(ds_string_slice *ss,
-                                                boolean (*predicate)(char)) {
-    return predicate(*ss->str);
-}
+    if (log->size < (unsigned long)st.st_size) {
+        DS_LOG_WARN("Truncating %lu bytes of torn records from log: %s",
+                    (unsigned long)st.st_size - log->size, filename);
+        if (ftruncate(log->fd, log->size) != 0 ||
+            ds_io_log_sync(log->fd) != DS_OK) {
+            DS_LOG_ERROR("Failed to truncate log: %s", filename);
+            return_defer(DS_ERR);
+        }
+    }
 
-// Step the string slice by one character forward
-DSHDEF void ds_string_slice_step(ds_string_slice *ss, int count) {
-    ss->str += count;
-    ss->len -= count;
-}
+#ifdef DS_THREADS
+    if (flags & DS_IO_LOG_GROUP_COMMIT) {
+        pthread_mutex_init(&log->mutex, NULL);
+        pthread_cond_init(&log->cond, NULL);
+        log->group_commit = true;
+    }
+#else
+    (void)(flags);
+#endif
+#else
+    (void)(filename);
+    (void)(flags);
+    DS_LOG_ERROR("Opening a log requires POSIX");
+    return_defer(DS_ERR);
+#endif
 
-// Check if the string slice is empty
-DSHDEF boolean ds_string_slice_empty(ds_string_slice *ss) {
-    return ss->len == 0;
+defer:
+    if (result != DS_OK) {
+        ds_io_log_free(log);
+    }
+    return result;
 }
 
-// Free the string slice
-DSHDEF void ds_string_slice_free(ds_string_slice *ss) {
-    ss->allocator = NULL;
-    ss->str = NULL;
-    ss->len = 0;
+// Open a log
+DSHDEF ds_result ds_io_log_open(ds_io_log *log, const char *filename,
+                                unsigned int flags) {
+    return ds_io_log_open_allocator(log, filename, flags, NULL);
 }
 
-#endif // DS_SB_IMPLEMENTATION
-
-#ifdef DS_IO_IMPLEMENTATION
+#ifdef DS_THREADS
+// Append a record with group commit. The record joins the pending records,
+// and the first thread to find no commit in progress becomes the leader: it
+// writes and syncs all the pending records while the others wait, and the
+// records that arrive in the meantime queue up for the next commit.
+static ds_result ds_io_log_append_group(ds_io_log *log, const char *record,
+                                        unsigned long len) {
+    ds_result result = DS_OK;
 
-// Read a file
-//
-// Reads the contents of a binary file into a buffer.
-//
-// Arguments:
-// - filename: name of the file to read
-// - buffer: pointer to the buffer to store the contents of the file
-// - mode: the mode to read in
-//
-// Returns:
-// - the number of bytes read
-DSHDEF long ds_io_read(const char *filename, char **buffer, const char *mode) {
-    long result = 0;
+    pthread_mutex_lock(&log->mutex);
+    if (log->failed) {
+        return_defer(DS_ERR);
+    }
 
-    unsigned long line_size;
-    FILE *file = NULL;
-    ds_string_builder sb;
-    ds_string_builder_init(&sb);
+    unsigned long count = log->pending_count + DS_IO_LOG_HEADER + len;
+    if (count > log->pending_capacity) {
+        unsigned long capacity = DS_MAX(count, log->pending_capacity * 2);
+        char *pending = DS_REALLOC(log->allocator, log->pending,
+                                   log->pending_capacity, capacity);
+        if (pending == NULL) {
+            DS_LOG_ERROR("Failed to grow the pending records of the log");
+            return_defer(DS_ERR);
+        }
+        log->pending = pending;
+        log->pending_capacity = capacity;
+    }
+    char *header = log->pending + log->pending_count;
+    ds_io_log_frame(header, record, len);
+    DS_MEMCPY(header + DS_IO_LOG_HEADER, record, len);
+    log->pending_count = count;
+
+    unsigned long commit = log->started + 1;
+    while (!log->failed && log->committed < commit) {
+        if (log->leader) {
+            pthread_cond_wait(&log->cond, &log->mutex);
+            continue;
+        }
 
-    if (filename != NULL) {
-        file = fopen(filename, mode);
-        if (file == NULL) {
-            DS_LOG_ERROR("Failed to open file: %s", filename);
-            return_defer(-1);
+        // Swap the buffers, so the next records go to the other one
+        char *buffer = log->pending;
+        unsigned long size = log->pending_count;
+        unsigned long capacity = log->pending_capacity;
+        log->pending = log->committing;
+        log->pending_capacity = log->committing_capacity;
+        log->pending_count = 0;
+        log->committing = buffer;
+        log->committing_capacity = capacity;
+        log->leader = true;
+        log->started++;
+        pthread_mutex_unlock(&log->mutex);
+
+        struct iovec iov = {.iov_base = buffer, .iov_len = size};
+        boolean written = ds_writev_all(log->fd, &iov, 1) >= 0 &&
+                          ds_io_log_sync(log->fd) == DS_OK;
+
+        pthread_mutex_lock(&log->mutex);
+        log->leader = false;
+        if (written) {
+            log->committed = log->started;
+            log->size += size;
+        } else {
+            DS_LOG_ERROR("Failed to commit to the log");
+            log->failed = true;
         }
-    } else {
-        file = stdin;
+        pthread_cond_broadcast(&log->cond);
     }
 
-    char line[LINE_MAX] = {0};
-    do {
-        line_size = fread(line, sizeof(char), LINE_MAX, file);
+    if (log->committed < commit) {
+        result = DS_ERR;
+    }
 
-        if (ds_string_builder_appendn(&sb, line, line_size) != 0) {
-            DS_LOG_ERROR("Failed to append line to string builder");
-            return_defer(-1);
-        }
+defer:
+    pthread_mutex_unlock(&log->mutex);
+    return result;
+}
+#endif
 
-        memset(line, 0, sizeof(line));
-    } while (line_size > 0);
+// Append a record to the log
+//
+// Returns 0 when the record is on disk, 1 if it could not be written, in which
+// case the log must be reopened.
+DSHDEF ds_result ds_io_log_append(ds_io_log *log, const char *record,
+                                  unsigned long len) {
+    if (len > 0xFFFFFFFFUL - DS_IO_LOG_HEADER) {
+        DS_LOG_ERROR("Record is too long for the log");
+        return DS_ERR;
+    }
 
-    if (ds_string_builder_build(&sb, buffer) != 0) {
-        DS_LOG_ERROR("Failed to build string from string builder");
-        return_defer(-1);
+#ifdef DS_THREADS
+    if (log->group_commit) {
+        return ds_io_log_append_group(log, record, len);
     }
+#endif
 
-    result = sb.items.count;
+#ifdef DS_POSIX
+    char header[DS_IO_LOG_HEADER];
+    if (log->failed) {
+        return DS_ERR;
+    }
 
-defer:
-    if (filename != NULL && file != NULL)
-        fclose(file);
-    ds_string_builder_free(&sb);
+    ds_io_log_frame(header, record, len);
+    struct iovec iov[2] = {{.iov_base = header, .iov_len = DS_IO_LOG_HEADER},
+                           {.iov_base = (char *)record, .iov_len = len}};
+    if (ds_writev_all(log->fd, iov, 2) < 0 ||
+        ds_io_log_sync(log->fd) != DS_OK) {
+        DS_LOG_ERROR("Failed to append to the log");
+        log->failed = true;
+        return DS_ERR;
+    }
+    log->size += DS_IO_LOG_HEADER + len;
 
-    return result;
+    return DS_OK;
+#else
+    (void)(record);
+    log->failed = true;
+    return DS_ERR;
+#endif
 }
 
-// Write a file
-//
-// Writes the contents of a buffer into a binary file.
+// Read the next record of a log
 //
-// Arguments:
-// - filename: name of the file to read
-// - buffer: pointer to the buffer to use on write
-// - buffer_len: the size of the buffer
-// - mode: the mode to write in
+// The log is a view of the records (e.g. mapped with ds_io_map), and it is
+// advanced past the record. The record is a view into the log.
 //
-// Returns:
-// - the number of bytes written
-DSHDEF long ds_io_write(const char *filename, char *buffer,
-                        unsigned long buffer_len, const char *mode) {
-    long result = 0;
-
-    unsigned long buffer_size;
-    FILE *file = NULL;
+// Returns true if a complete record was read, false at the end of the log or
+// at a torn record.
+DSHDEF boolean ds_io_log_next(ds_string_slice *log, ds_string_slice *record) {
+    const unsigned char *header = (const unsigned char *)log->str;
 
-    if (filename != NULL) {
-        file = fopen(filename, mode);
-        if (file == NULL) {
-            DS_LOG_ERROR("Failed to open file: %s", filename);
-            return_defer(-1);
-        }
-    } else {
-        file = stdout;
+    if (log->len < DS_IO_LOG_HEADER) {
+        return false;
+    }
+    unsigned long len = ds_io_get32(header);
+    if (len > log->len - DS_IO_LOG_HEADER) {
+        return false;
+    }
+    unsigned int crc = ds_crc32c(0, header, 4);
+    if (ds_crc32c(crc, header + DS_IO_LOG_HEADER, len) !=
+        ds_io_get32(header + 4)) {
+        return false;
     }
 
-    buffer_size = fwrite(buffer, sizeof(char), buffer_len, file);
-    result = buffer_size;
+    record->allocator = NULL;
+    record->str = log->str + DS_IO_LOG_HEADER;
+    record->len = len;
+    log->str += DS_IO_LOG_HEADER + len;
+    log->len -= DS_IO_LOG_HEADER + len;
 
-defer:
-    if (filename != NULL && file != NULL)
-        fclose(file);
+    return true;
+}
 
-    return result;
+// Free the log
+//
+// Closes the file. Every append that returned has its record on disk.
+DSHDEF void ds_io_log_free(ds_io_log *log) {
+#ifdef DS_THREADS
+    if (log->group_commit) {
+        pthread_cond_destroy(&log->cond);
+        pthread_mutex_destroy(&log->mutex);
+        log->group_commit = false;
+    }
+    if (log->pending != NULL) {
+        DS_FREE(log->allocator, log->pending);
+        log->pending = NULL;
+    }
+    if (log->committing != NULL) {
+        DS_FREE(log->allocator, log->committing);
+        log->committing = NULL;
+    }
+    log->pending_count = 0;
+    log->pending_capacity = 0;
+    log->committing_capacity = 0;
+#endif
+
+#ifdef DS_POSIX
+    if (log->fd >= 0) {
+        close(log->fd);
+    }
+#endif
+    log->fd = -1;
 }
 
 #endif // DS_IO_IMPLEMENTATION
@@ -1621,48 +10990,50 @@ DSHDEF void ds_priority_queue_init(ds_priority_queue *pq,
 
 // Insert an item into the priority queue
 //
-// Returns 0 if the item was inserted successfully.
+// The item is sifted up by moving the parents with a lower priority down one
+// level into the hole, so each level costs one copy, and the item is copied
+// once into the hole where it belongs.
+//
+// Returns 0 if the item was inserted successfully, 1 if the priority queue
+// could not be reallocated.
 DSHDEF ds_result ds_priority_queue_insert(ds_priority_queue *pq, void *item) {
     ds_result result = DS_OK;
-    ds_dynamic_array_append(&pq->items, item);
-
-    int index = pq->items.count - 1;
-    int parent = (index - 1) / 2;
-
-    void *index_item = NULL;
-    if (ds_dynamic_array_get_ref(&pq->items, index, &index_item) != DS_OK) {
-        DS_LOG_ERROR("Could not get item");
-        return_defer(DS_ERR);
-    }
 
-    void *parent_item = NULL;
-    if (ds_dynamic_array_get_ref(&pq->items, parent, &parent_item) != DS_OK) {
-        DS_LOG_ERROR("Could not get item");
+    if (ds_dynamic_array_reserve(&pq->items, pq->items.count + 1) != DS_OK) {
+        DS_LOG_ERROR("Could not insert item");
         return_defer(DS_ERR);
     }
 
-    while (index != 0 && pq->compare(index_item, parent_item) > 0) {
-        ds_dynamic_array_swap(&pq->items, index, parent);
-
-        index = parent;
-        parent = (index - 1) / 2;
+    int (*compare)(const void *, const void *) = pq->compare;
+    unsigned long item_size = pq->items.item_size;
+    char *items = pq->items.items;
 
-        if (ds_dynamic_array_get_ref(&pq->items, index, &index_item) != DS_OK) {
-            DS_LOG_ERROR("Could not get item");
-            return_defer(DS_ERR);
-        }
-        if (ds_dynamic_array_get_ref(&pq->items, parent, &parent_item) != DS_OK) {
-            DS_LOG_ERROR("Could not get item");
-            return_defer(DS_ERR);
+    unsigned long hole = pq->items.count;
+    while (hole != 0) {
+        unsigned long parent = (hole - 1) / 2;
+        char *parent_item = items + parent * item_size;
+        if (compare(item, parent_item) <= 0) {
+            break;
         }
+        DS_MEMCPY(items + hole * item_size, parent_item, item_size);
+        hole = parent;
     }
 
+    DS_MEMCPY(items + hole * item_size, item, item_size);
+    pq->items.count++;
+
 defer:
     return result;
 }
 
 // Pull the item with the highest priority from the priority queue
 //
+// The hole left by the item is moved down to a leaf along the children with
+// the higher priority, which takes one comparison per level, and the last item
+// is then sifted up from there. The last item usually belongs near the
+// leaves, so this makes about half the comparisons of checking it against both
+// children at every level.
+//
 // Returns 0 if an item was pulled successfully, 1 if the priority queue is
 // empty.
 DSHDEF ds_result ds_priority_queue_pull(ds_priority_queue *pq, void *item) {
@@ -1673,53 +11044,45 @@ DSHDEF ds_result ds_priority_queue_pull(ds_priority_queue *pq, void *item) {
         return_defer(DS_ERR);
     }
 
-    if (ds_dynamic_array_get(&pq->items, 0, item) != DS_OK) {
-        return_defer(DS_ERR);
-    }
-    ds_dynamic_array_swap(&pq->items, 0, pq->items.count - 1);
+    int (*compare)(const void *, const void *) = pq->compare;
+    unsigned long item_size = pq->items.item_size;
+    char *items = pq->items.items;
 
-    unsigned int index = 0;
-    unsigned int swap = index;
-    void *swap_item = NULL;
-    do {
-        index = swap;
+    DS_MEMCPY(item, items, item_size);
 
-        unsigned int left = 2 * index + 1;
-        if (left < pq->items.count - 1) {
-            void *left_item = NULL;
-            if (ds_dynamic_array_get_ref(&pq->items, swap, &swap_item) != DS_OK) {
-                DS_LOG_ERROR("Could not get item");
-                return_defer(DS_ERR);
-            }
-            if (ds_dynamic_array_get_ref(&pq->items, left, &left_item) != DS_OK) {
-                DS_LOG_ERROR("Could not get item");
-                return_defer(DS_ERR);
-            }
-            if (pq->compare(left_item, swap_item) > 0) {
-                swap = left;
-            }
+    // The last item stays in place past the end of the heap until it is
+    // copied into the hole
+    unsigned long count = --pq->items.count;
+    if (count == 0) {
+        return_defer(DS_OK);
+    }
+    char *last = items + count * item_size;
+
+    unsigned long hole = 0;
+    unsigned long child = 1;
+    while (child < count) {
+        char *child_item = items + child * item_size;
+        if (child + 1 < count &&
+            compare(child_item + item_size, child_item) > 0) {
+            child++;
+            child_item += item_size;
         }
+        DS_MEMCPY(items + hole * item_size, child_item, item_size);
+        hole = child;
+        child = 2 * hole + 1;
+    }
 
-        unsigned int right = 2 * index + 2;
-        if (right < pq->items.count - 1) {
-            void *right_item = NULL;
-            if (ds_dynamic_array_get_ref(&pq->items, swap, &swap_item) != DS_OK) {
-                DS_LOG_ERROR("Could not get item");
-                return_defer(DS_ERR);
-            }
-            if (ds_dynamic_array_get_ref(&pq->items, right, &right_item) != DS_OK) {
-                DS_LOG_ERROR("Could not get item");
-                return_defer(DS_ERR);
-            }
-            if (pq->compare(right_item, swap_item) > 0) {
-                swap = right;
-            }
+    while (hole != 0) {
+        unsigned long parent = (hole - 1) / 2;
+        char *parent_item = items + parent * item_size;
+        if (compare(last, parent_item) <= 0) {
+            break;
         }
+        DS_MEMCPY(items + hole * item_size, parent_item, item_size);
+        hole = parent;
+    }
 
-        ds_dynamic_array_swap(&pq->items, index, swap);
-    } while (swap != index);
-
-    pq->items.count--;
+    DS_MEMCPY(items + hole * item_size, last, item_size);
 
 defer:
     return result;
@@ -1960,6 +11323,264 @@ DSHDEF void ds_linked_list_free(ds_linked_list *ll) {
 
 #endif // DS_LL_IMPLEMENTATION
 
+#ifdef DS_HASH_IMPLEMENTATION
+
+static unsigned long long ds_hash_global_seed = 0xa0761d6478bd642fULL;
+
+static const unsigned long long ds_hash_secret[4] = {
+    0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL, 0x4b33a62ed433d4a3ULL,
+    0x4d5a2da51de1aa47ULL};
+
+// Set the global seed used by the hash functions that do not take a seed
+DSHDEF void ds_hash_set_seed(unsigned long seed) {
+    ds_hash_global_seed = seed;
+}
+
+// Multiply two 64 bit numbers into a 128 bit result (low half in a, high half
+// in b)
+static void ds_hash_mum(unsigned long long *a, unsigned long long *b) {
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = (__uint128_t)*a * *b;
+    *a = (unsigned long long)r;
+    *b = (unsigned long long)(r >> 64);
+#else
+    unsigned long long ha = *a >> 32, hb = *b >> 32;
+    unsigned long long la = (unsigned int)*a, lb = (unsigned int)*b;
+    unsigned long long rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    unsigned long long t = rl + (rm0 << 32);
+    unsigned long long c = t < rl;
+    unsigned long long lo = t + (rm1 << 32);
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static unsigned long long ds_hash_mix(unsigned long long a,
+                                      unsigned long long b) {
+    ds_hash_mum(&a, &b);
+    return a ^ b;
+}
+
+static unsigned long long ds_hash_read8(const unsigned char *p) {
+    unsigned long long v;
+    DS_MEMCPY(&v, p, 8);
+    return v;
+}
+
+static unsigned long long ds_hash_read4(const unsigned char *p) {
+    unsigned int v;
+    DS_MEMCPY(&v, p, 4);
+    return v;
+}
+
+// Hash a range of bytes with an explicit seed
+//
+// This is wyhash: keys of up to 16 bytes are read with at most four
+// overlapping loads and mixed with a single 64x64->128 bit multiplication,
+// and longer keys are consumed 48 bytes at a time in three lanes.
+DSHDEF unsigned long ds_hash_bytes_seeded(const void *data, unsigned long len,
+                                          unsigned long seed) {
+    const unsigned char *p = (const unsigned char *)data;
+    const unsigned long long *secret = ds_hash_secret;
+    unsigned long long a, b;
+    unsigned long long s = seed;
+
+    s ^= ds_hash_mix(s ^ secret[0], secret[1]);
+
+    if (len <= 16) {
+        if (len >= 4) {
+            a = (ds_hash_read4(p) << 32) | ds_hash_read4(p + ((len >> 3) << 2));
+            b = (ds_hash_read4(p + len - 4) << 32) |
+                ds_hash_read4(p + len - 4 - ((len >> 3) << 2));
+        } else if (len > 0) {
+            a = ((unsigned long long)p[0] << 16) |
+                ((unsigned long long)p[len >> 1] << 8) | p[len - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        unsigned long i = len;
+        if (i > 48) {
+            unsigned long long see1 = s, see2 = s;
+            do {
+                s = ds_hash_mix(ds_hash_read8(p) ^ secret[1],
+                                ds_hash_read8(p + 8) ^ s);
+                see1 = ds_hash_mix(ds_hash_read8(p + 16) ^ secret[2],
+                                   ds_hash_read8(p + 24) ^ see1);
+                see2 = ds_hash_mix(ds_hash_read8(p + 32) ^ secret[3],
+                                   ds_hash_read8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            s ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            s = ds_hash_mix(ds_hash_read8(p) ^ secret[1],
+                            ds_hash_read8(p + 8) ^ s);
+            i -= 16;
+            p += 16;
+        }
+        a = ds_hash_read8(p + i - 16);
+        b = ds_hash_read8(p + i - 8);
+    }
+
+    a ^= secret[1];
+    b ^= s;
+    ds_hash_mum(&a, &b);
+    return (unsigned long)ds_hash_mix(a ^ secret[0] ^ len, b ^ secret[1]);
+}
+
+// Hash a range of bytes with the global seed
+DSHDEF unsigned long ds_hash_bytes(const void *data, unsigned long len) {
+    return ds_hash_bytes_seeded(data, len, ds_hash_global_seed);
+}
+
+// Hash the contents of a string slice with the global seed
+DSHDEF unsigned long ds_hash_string_slice(ds_string_slice *ss) {
+    return ds_hash_bytes_seeded(ss->str, ss->len, ds_hash_global_seed);
+}
+
+// Mix an integer with an explicit seed
+DSHDEF unsigned long ds_hash_ulong_seeded(unsigned long value,
+                                          unsigned long seed) {
+    return (unsigned long)ds_hash_mix(value ^ seed ^ ds_hash_secret[0],
+                                      ds_hash_secret[1]);
+}
+
+// Mix an integer with the global seed
+DSHDEF unsigned long ds_hash_ulong(unsigned long value) {
+    return ds_hash_ulong_seeded(value, ds_hash_global_seed);
+}
+
+static const unsigned int ds_crc32c_table[256] = {
+    0x00000000, 0xF26B8303, 0xE13B70F7, 0x1350F3F4, 0xC79A971F, 0x35F1141C,
+    0x26A1E7E8, 0xD4CA64EB, 0x8AD958CF, 0x78B2DBCC, 0x6BE22838, 0x9989AB3B,
+    0x4D43CFD0, 0xBF284CD3, 0xAC78BF27, 0x5E133C24, 0x105EC76F, 0xE235446C,
+    0xF165B798, 0x030E349B, 0xD7C45070, 0x25AFD373, 0x36FF2087, 0xC494A384,
+    0x9A879FA0, 0x68EC1CA3, 0x7BBCEF57, 0x89D76C54, 0x5D1D08BF, 0xAF768BBC,
+    0xBC267848, 0x4E4DFB4B, 0x20BD8EDE, 0xD2D60DDD, 0xC186FE29, 0x33ED7D2A,
+    0xE72719C1, 0x154C9AC2, 0x061C6936, 0xF477EA35, 0xAA64D611, 0x580F5512,
+    0x4B5FA6E6, 0xB93425E5, 0x6DFE410E, 0x9F95C20D, 0x8CC531F9, 0x7EAEB2FA,
+    0x30E349B1, 0xC288CAB2, 0xD1D83946, 0x23B3BA45, 0xF779DEAE, 0x05125DAD,
+    0x1642AE59, 0xE4292D5A, 0xBA3A117E, 0x4851927D, 0x5B016189, 0xA96AE28A,
+    0x7DA08661, 0x8FCB0562, 0x9C9BF696, 0x6EF07595, 0x417B1DBC, 0xB3109EBF,
+    0xA0406D4B, 0x522BEE48, 0x86E18AA3, 0x748A09A0, 0x67DAFA54, 0x95B17957,
+    0xCBA24573, 0x39C9C670, 0x2A993584, 0xD8F2B687, 0x0C38D26C, 0xFE53516F,
+    0xED03A29B, 0x1F682198, 0x5125DAD3, 0xA34E59D0, 0xB01EAA24, 0x42752927,
+    0x96BF4DCC, 0x64D4CECF, 0x77843D3B, 0x85EFBE38, 0xDBFC821C, 0x2997011F,
+    0x3AC7F2EB, 0xC8AC71E8, 0x1C661503, 0xEE0D9600, 0xFD5D65F4, 0x0F36E6F7,
+    0x61C69362, 0x93AD1061, 0x80FDE395, 0x72966096, 0xA65C047D, 0x5437877E,
+    0x4767748A, 0xB50CF789, 0xEB1FCBAD, 0x197448AE, 0x0A24BB5A, 0xF84F3859,
+    0x2C855CB2, 0xDEEEDFB1, 0xCDBE2C45, 0x3FD5AF46, 0x7198540D, 0x83F3D70E,
+    0x90A324FA, 0x62C8A7F9, 0xB602C312, 0x44694011, 0x5739B3E5, 0xA55230E6,
+    0xFB410CC2, 0x092A8FC1, 0x1A7A7C35, 0xE811FF36, 0x3CDB9BDD, 0xCEB018DE,
+    0xDDE0EB2A, 0x2F8B6829, 0x82F63B78, 0x709DB87B, 0x63CD4B8F, 0x91A6C88C,
+    0x456CAC67, 0xB7072F64, 0xA457DC90, 0x563C5F93, 0x082F63B7, 0xFA44E0B4,
+    0xE9141340, 0x1B7F9043, 0xCFB5F4A8, 0x3DDE77AB, 0x2E8E845F, 0xDCE5075C,
+    0x92A8FC17, 0x60C37F14, 0x73938CE0, 0x81F80FE3, 0x55326B08, 0xA759E80B,
+    0xB4091BFF, 0x466298FC, 0x1871A4D8, 0xEA1A27DB, 0xF94AD42F, 0x0B21572C,
+    0xDFEB33C7, 0x2D80B0C4, 0x3ED04330, 0xCCBBC033, 0xA24BB5A6, 0x502036A5,
+    0x4370C551, 0xB11B4652, 0x65D122B9, 0x97BAA1BA, 0x84EA524E, 0x7681D14D,
+    0x2892ED69, 0xDAF96E6A, 0xC9A99D9E, 0x3BC21E9D, 0xEF087A76, 0x1D63F975,
+    0x0E330A81, 0xFC588982, 0xB21572C9, 0x407EF1CA, 0x532E023E, 0xA145813D,
+    0x758FE5D6, 0x87E466D5, 0x94B49521, 0x66DF1622, 0x38CC2A06, 0xCAA7A905,
+    0xD9F75AF1, 0x2B9CD9F2, 0xFF56BD19, 0x0D3D3E1A, 0x1E6DCDEE, 0xEC064EED,
+    0xC38D26C4, 0x31E6A5C7, 0x22B65633, 0xD0DDD530, 0x0417B1DB, 0xF67C32D8,
+    0xE52CC12C, 0x1747422F, 0x49547E0B, 0xBB3FFD08, 0xA86F0EFC, 0x5A048DFF,
+    0x8ECEE914, 0x7CA56A17, 0x6FF599E3, 0x9D9E1AE0, 0xD3D3E1AB, 0x21B862A8,
+    0x32E8915C, 0xC083125F, 0x144976B4, 0xE622F5B7, 0xF5720643, 0x07198540,
+    0x590AB964, 0xAB613A67, 0xB831C993, 0x4A5A4A90, 0x9E902E7B, 0x6CFBAD78,
+    0x7FAB5E8C, 0x8DC0DD8F, 0xE330A81A, 0x115B2B19, 0x020BD8ED, 0xF0605BEE,
+    0x24AA3F05, 0xD6C1BC06, 0xC5914FF2, 0x37FACCF1, 0x69E9F0D5, 0x9B8273D6,
+    0x88D28022, 0x7AB90321, 0xAE7367CA, 0x5C18E4C9, 0x4F48173D, 0xBD23943E,
+    0xF36E6F75, 0x0105EC76, 0x12551F82, 0xE03E9C81, 0x34F4F86A, 0xC69F7B69,
+    0xD5CF889D, 0x27A40B9E, 0x79B737BA, 0x8BDCB4B9, 0x988C474D, 0x6AE7C44E,
+    0xBE2DA0A5, 0x4C4623A6, 0x5F16D052, 0xAD7D5351};
+
+// Compute the CRC32C (Castagnoli) of len bytes of data, continuing from crc
+// (0 for the first call). With SSE4.2 the bytes are checksummed 8 at a time by
+// the crc32 instruction.
+DSHDEF unsigned int ds_crc32c(unsigned int crc, const void *data,
+                              unsigned long len) {
+    const unsigned char *p = (const unsigned char *)data;
+
+    crc = ~crc;
+#if defined(DS_SSE42) && defined(__x86_64__)
+    for (; len >= 8; p += 8, len -= 8) {
+        unsigned long long value;
+        DS_MEMCPY(&value, p, 8);
+        crc = (unsigned int)_mm_crc32_u64(crc, value);
+    }
+#endif
+    for (; len > 0; p++, len--) {
+        crc = ds_crc32c_table[(crc ^ *p) & 0xFF] ^ (crc >> 8);
+    }
+
+    return ~crc;
+}
+
+// Hash map callback for keys that are NUL terminated strings
+DSHDEF unsigned long ds_hashmap_hash_str(const void *key) {
+    return ds_hash_bytes(key, DS_STRLEN((const char *)key));
+}
+
+// Hash map callback for keys that point to a ds_string_slice
+DSHDEF unsigned long ds_hashmap_hash_string_slice(const void *key) {
+    return ds_hash_string_slice((ds_string_slice *)key);
+}
+
+// Hash map callback for keys that point to an unsigned long
+DSHDEF unsigned long ds_hashmap_hash_ulong(const void *key) {
+    return ds_hash_ulong(*(const unsigned long *)key);
+}
+
+// Hash map callback for keys that point to a ds_string
+//
+// Short strings are hashed straight from the inline storage of the key.
+DSHDEF unsigned long ds_hashmap_hash_string(const void *key) {
+    const ds_string *string = (const ds_string *)key;
+    return ds_hash_bytes(DS_STRING_STR(string), DS_STRING_LEN(string));
+}
+
+// Hash map callback that compares NUL terminated strings
+DSHDEF int ds_hashmap_compare_str(const void *key1, const void *key2) {
+    return DS_STRCMP((const char *)key1, (const char *)key2);
+}
+
+// Hash map callback that compares keys that point to a ds_string_slice
+DSHDEF int ds_hashmap_compare_string_slice(const void *key1,
+                                           const void *key2) {
+    const ds_string_slice *ss1 = (const ds_string_slice *)key1;
+    const ds_string_slice *ss2 = (const ds_string_slice *)key2;
+    if (ss1->len != ss2->len) {
+        return ss1->len < ss2->len ? -1 : 1;
+    }
+    return DS_MEMCMP(ss1->str, ss2->str, ss1->len);
+}
+
+// Hash map callback that compares keys that point to a ds_string
+DSHDEF int ds_hashmap_compare_string(const void *key1, const void *key2) {
+    const ds_string *string1 = (const ds_string *)key1;
+    const ds_string *string2 = (const ds_string *)key2;
+    unsigned long len1 = DS_STRING_LEN(string1);
+    unsigned long len2 = DS_STRING_LEN(string2);
+    if (len1 != len2) {
+        return len1 < len2 ? -1 : 1;
+    }
+    return DS_MEMCMP(DS_STRING_STR(string1), DS_STRING_STR(string2), len1);
+}
+
+// Hash map callback that compares keys that point to an unsigned long
+DSHDEF int ds_hashmap_compare_ulong(const void *key1, const void *key2) {
+    unsigned long value1 = *(const unsigned long *)key1;
+    unsigned long value2 = *(const unsigned long *)key2;
+    return (value1 > value2) - (value1 < value2);
+}
+
+#endif // DS_HASH_IMPLEMENTATION
+
 #ifdef DS_HM_IMPLEMENTATION
 
 // Initialize the hashmap using an allocator
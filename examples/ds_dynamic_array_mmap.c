@@ -0,0 +1,78 @@
+#define DS_DA_IMPLEMENTATION
+#define DS_DA_INIT_CAPACITY 16
+#define DS_DA_MMAP_THRESHOLD 4096
+#include "../ds.h"
+
+// Check that the array holds the numbers from first, in order
+static boolean check_numbers(ds_dynamic_array *array, long first,
+                             unsigned long count) {
+    if (array->count != count) {
+        return false;
+    }
+    for (unsigned long i = 0; i < count; i++) {
+        if (((long *)array->items)[i] != first + (long)i) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main() {
+    int result = 0;
+
+    ds_dynamic_array array = {0};
+    ds_dynamic_array_init(&array, sizeof(long));
+    ds_dynamic_array copy = {0};
+    ds_dynamic_array_init(&copy, sizeof(long));
+
+    // Grow well past the threshold, so the items are moved into their own
+    // mapping and then grown with mremap
+    for (long i = 0; i < 10000; i++) {
+        if (ds_dynamic_array_append(&array, &i) != DS_OK) {
+            DS_LOG_ERROR("Failed to append %ld", i);
+            return_defer(1);
+        }
+    }
+    if (!check_numbers(&array, 0, 10000)) {
+        DS_LOG_ERROR("The array does not have the numbers");
+        return_defer(1);
+    }
+#ifdef DS_DA_MMAP
+    if (!array.mapped) {
+        DS_LOG_ERROR("Expected the array to be mapped");
+        return_defer(1);
+    }
+#endif
+    DS_LOG_INFO("Appended %lu numbers (%s)", array.count,
+                array.mapped ? "mapped" : "allocated");
+
+    // The copy is as large, so it is mapped as well
+    if (ds_dynamic_array_copy(&array, &copy) != DS_OK ||
+        !check_numbers(&copy, 0, 10000) || copy.mapped != array.mapped) {
+        DS_LOG_ERROR("Failed to copy the array");
+        return_defer(1);
+    }
+
+    // Deleting from the front shifts the items down in the mapping
+    for (int i = 0; i < 100; i++) {
+        if (ds_dynamic_array_delete(&copy, 0) != DS_OK) {
+            DS_LOG_ERROR("Failed to delete from the copy");
+            return_defer(1);
+        }
+    }
+    if (!check_numbers(&copy, 100, 9900) || !check_numbers(&array, 0, 10000)) {
+        DS_LOG_ERROR("Unexpected numbers after deleting");
+        return_defer(1);
+    }
+
+    ds_dynamic_array_free(&copy);
+    if (copy.items != NULL || copy.mapped) {
+        DS_LOG_ERROR("Expected the copy to be empty after free");
+        return_defer(1);
+    }
+
+defer:
+    ds_dynamic_array_free(&copy);
+    ds_dynamic_array_free(&array);
+    return result;
+}
@@ -5,19 +5,6 @@
 
 #define MAX_CAPACITY 100
 
-unsigned long my_hash(const void *key) {
-    unsigned long hash = 0;
-    char *name = (char *)key;
-    for (unsigned int i = 0; i < strlen(name); i++) {
-        hash = 31 * hash + name[i];
-    }
-    return hash % MAX_CAPACITY;
-}
-
-int my_compare(const void *k1, const void *k2) {
-    return strcmp((char *)k1, (char *)k2);
-}
-
 void my_map_print(ds_hashmap map) {
     for (unsigned int i = 0; i < map.capacity; i++) {
         if (map.buckets[i].count == 0) {
@@ -37,7 +24,8 @@ int main() {
     int result = 0;
     ds_hashmap map = {0};
 
-    if (ds_hashmap_init(&map, MAX_CAPACITY, my_hash, my_compare) != DS_OK) {
+    if (ds_hashmap_init(&map, MAX_CAPACITY, ds_hashmap_hash_str,
+                        ds_hashmap_compare_str) != DS_OK) {
         DS_LOG_ERROR("Error initializing hashmap");
         return_defer(-1);
     }
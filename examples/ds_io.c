@@ -6,25 +6,22 @@ int main() {
     int result = 0;
 
     char *buffer = NULL;
-
     long size = ds_io_read(NULL, &buffer, "r");
     if (size < 0) {
         DS_LOG_ERROR("Failed to read file");
         return_defer(1);
     }
 
-    size = ds_io_write(NULL, buffer, size, "w");
-    if (size < 0) {
+    long written = ds_io_write(NULL, buffer, size, "w");
+    if (written < 0) {
         DS_LOG_ERROR("Failed to write file");
         return_defer(1);
     }
 
-    DS_LOG_INFO("Wrote %ld bytes", size);
+    DS_LOG_INFO("Wrote %ld bytes", written);
 
 defer:
-    if (buffer != NULL) {
-        DS_FREE(NULL, buffer);
-    }
+    ds_string_builder_release(NULL, buffer, size);
     return result;
 }
 
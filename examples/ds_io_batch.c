@@ -0,0 +1,97 @@
+#define _POSIX_C_SOURCE 200809L // mkdtemp
+#define DS_IO_IMPLEMENTATION
+#include "../ds.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define BLOCKS 8
+#define BLOCK_SIZE 4096
+
+int main() {
+    int result = 0;
+
+    char directory[] = "/tmp/ds_io_batch_XXXXXX";
+    char path[64] = {0};
+    int fd = -1;
+    boolean initialized = false;
+
+    ds_io_batch batch = {0};
+    ds_io_request requests[BLOCKS] = {0};
+    static char blocks[BLOCKS][BLOCK_SIZE];
+
+    if (mkdtemp(directory) == NULL) {
+        DS_LOG_ERROR("Failed to create a directory");
+        return_defer(1);
+    }
+    snprintf(path, sizeof(path), "%s/blocks.bin", directory);
+
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        DS_LOG_ERROR("Failed to open %s", path);
+        return_defer(1);
+    }
+
+    if (ds_io_batch_init(&batch, 4) != DS_OK) {
+        DS_LOG_ERROR("Failed to initialize the batch");
+        return_defer(1);
+    }
+    initialized = true;
+
+    // Write every block of the file at once, 4 at a time
+    for (int i = 0; i < BLOCKS; i++) {
+        memset(blocks[i], 'a' + i, BLOCK_SIZE);
+        requests[i].op = DS_IO_OP_WRITE;
+        requests[i].fd = fd;
+        requests[i].buffer = blocks[i];
+        requests[i].len = BLOCK_SIZE;
+        requests[i].offset = (unsigned long)i * BLOCK_SIZE;
+    }
+    if (ds_io_batch_run(&batch, requests, BLOCKS) != DS_OK) {
+        DS_LOG_ERROR("Failed to write the blocks");
+        return_defer(1);
+    }
+
+    // Read some of them back into buffers of the batch, and take them as they
+    // complete, in any order
+    for (int i = 0; i < 4; i++) {
+        requests[i].op = DS_IO_OP_READ;
+        requests[i].buffer = NULL;
+        requests[i].offset = (unsigned long)(2 * i) * BLOCK_SIZE;
+    }
+    if (ds_io_batch_submit(&batch, requests, 4) != DS_OK) {
+        DS_LOG_ERROR("Failed to submit the reads");
+        return_defer(1);
+    }
+
+    ds_io_request *request = NULL;
+    unsigned long completed = 0;
+    while (ds_io_batch_complete(&batch, &request)) {
+        char expected = 'a' + (char)(request->offset / BLOCK_SIZE);
+        DS_LOG_INFO("Read %ld bytes at %lu: %c", request->result,
+                    request->offset, request->buffer[0]);
+        if (request->result != BLOCK_SIZE || request->buffer[0] != expected) {
+            DS_LOG_ERROR("Unexpected read at %lu", request->offset);
+            result = 1;
+        }
+        DS_FREE(NULL, request->buffer);
+        completed++;
+    }
+
+    if (completed != 4) {
+        DS_LOG_ERROR("Expected 4 reads, completed %lu", completed);
+        return_defer(1);
+    }
+
+defer:
+    if (initialized) {
+        ds_io_batch_free(&batch);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (path[0] != '\0') {
+        unlink(path);
+        rmdir(directory);
+    }
+    return result;
+}
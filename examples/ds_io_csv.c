@@ -0,0 +1,91 @@
+#define _POSIX_C_SOURCE 200809L // mkdtemp
+#define DS_IO_IMPLEMENTATION
+#include "../ds.h"
+#include <stdlib.h>
+
+// Read all the records of the CSV reader, and count the records and fields
+static void read_records(ds_io_csv *csv, ds_dynamic_array *fields,
+                         unsigned long *records, unsigned long *count) {
+    *records = 0;
+    *count = 0;
+    while (ds_io_csv_next(csv, fields)) {
+        for (unsigned long i = 0; i < fields->count; i++) {
+            ds_string_slice *field = (ds_string_slice *)fields->items + i;
+            DS_LOG_INFO("Record %lu, field %lu: [%.*s]", *records, i,
+                        (int)field->len, field->str);
+        }
+        *records += 1;
+        *count += fields->count;
+    }
+}
+
+int main() {
+    int result = 0;
+
+    char directory[] = "/tmp/ds_io_csv_XXXXXX";
+    char path[64] = {0};
+    boolean opened = false;
+
+    ds_io_csv csv = {0};
+    ds_io_reader reader = {0};
+    ds_dynamic_array fields = {0};
+    ds_dynamic_array_init(&fields, sizeof(ds_string_slice));
+
+    // Quoted delimiters and newlines, "" escapes, a "\r\n" line ending and a
+    // last record without a newline
+    char text[] = "name,quote,city\r\n"
+                  "Ada,\"Hello, world\",London\n"
+                  "Grace,\"She said \"\"hi\"\"\",\"New\nYork\"\n"
+                  "Linus,,Helsinki";
+
+    ds_io_csv_init(&csv, text, sizeof(text) - 1, ',');
+    unsigned long records = 0;
+    unsigned long count = 0;
+    read_records(&csv, &fields, &records, &count);
+    ds_io_csv_free(&csv);
+
+    if (csv.failed || records != 4 || count != 12) {
+        DS_LOG_ERROR("Expected 4 records of 3 fields, got %lu fields in %lu",
+                     count, records);
+        return_defer(1);
+    }
+
+    // The same input streamed through a reader that reads 8 bytes at a time,
+    // so the records span many reads
+    if (mkdtemp(directory) == NULL) {
+        DS_LOG_ERROR("Failed to create a directory");
+        return_defer(1);
+    }
+    snprintf(path, sizeof(path), "%s/people.csv", directory);
+    if (ds_io_write(path, text, sizeof(text) - 1, "w") < 0) {
+        DS_LOG_ERROR("Failed to write %s", path);
+        return_defer(1);
+    }
+
+    if (ds_io_reader_open(&reader, path, 8, false) != DS_OK) {
+        DS_LOG_ERROR("Failed to open %s", path);
+        return_defer(1);
+    }
+    opened = true;
+    ds_io_reader_set_max_record(&reader, 64);
+
+    ds_io_csv_init_reader(&csv, &reader, ',');
+    read_records(&csv, &fields, &records, &count);
+    ds_io_csv_free(&csv);
+
+    if (csv.failed || records != 4 || count != 12) {
+        DS_LOG_ERROR("Expected 4 streamed records, got %lu", records);
+        return_defer(1);
+    }
+
+defer:
+    if (opened) {
+        ds_io_reader_free(&reader);
+    }
+    ds_dynamic_array_free(&fields);
+    if (path[0] != '\0') {
+        unlink(path);
+        rmdir(directory);
+    }
+    return result;
+}
@@ -0,0 +1,71 @@
+#define _POSIX_C_SOURCE 200809L // mkdtemp
+#define DS_IO_IMPLEMENTATION
+#include "../ds.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define FILES 4
+
+int main() {
+    int result = 0;
+
+    char directory[] = "/tmp/ds_io_loader_XXXXXX";
+    char paths[FILES][64] = {0};
+    const char *names[FILES] = {0};
+    boolean created = false;
+
+    ds_io_loader loader = {0};
+    ds_io_loader_init(&loader);
+
+    if (mkdtemp(directory) == NULL) {
+        DS_LOG_ERROR("Failed to create a directory");
+        return_defer(1);
+    }
+    created = true;
+
+    // The last file is never written, so it fails to load
+    for (int i = 0; i < FILES; i++) {
+        snprintf(paths[i], sizeof(paths[i]), "%s/config%d.txt", directory, i);
+        names[i] = paths[i];
+        if (i == FILES - 1) {
+            continue;
+        }
+
+        char content[32];
+        int len = snprintf(content, sizeof(content), "setting = %d\n", i);
+        if (ds_io_write(paths[i], content, len, "w") < 0) {
+            DS_LOG_ERROR("Failed to write %s", paths[i]);
+            return_defer(1);
+        }
+    }
+
+    if (ds_io_loader_load(&loader, names, FILES, 0) != DS_OK) {
+        DS_LOG_ERROR("Failed to load the files");
+        return_defer(1);
+    }
+
+    for (unsigned long i = 0; i < loader.count; i++) {
+        ds_io_file *file = &loader.files[i];
+        if (file->error != 0) {
+            DS_LOG_INFO("%s: %s", file->path, strerror(file->error));
+            continue;
+        }
+        DS_LOG_INFO("%s: %.*s", file->path, (int)file->content.len - 1,
+                    file->content.str);
+    }
+
+    if (loader.files[0].error != 0 || loader.files[FILES - 1].error == 0) {
+        DS_LOG_ERROR("Expected only the last file to fail");
+        return_defer(1);
+    }
+
+defer:
+    ds_io_loader_free(&loader);
+    if (created) {
+        for (int i = 0; i < FILES - 1; i++) {
+            unlink(paths[i]);
+        }
+        rmdir(directory);
+    }
+    return result;
+}
@@ -0,0 +1,131 @@
+#define _POSIX_C_SOURCE 200809L // mkdtemp
+#define DS_IO_IMPLEMENTATION
+#include "../ds.h"
+#include <stdlib.h>
+
+#define THREADS 4
+#define RECORDS 25
+
+static ds_io_log log_file = {0};
+
+// Append the records of one writer; with group commit, the records of the
+// writers that arrive during a commit share the next write and fdatasync
+static void *append_records(void *context) {
+    unsigned long writer = (unsigned long)context;
+
+    for (unsigned long i = 0; i < RECORDS; i++) {
+        char record[64];
+        int len = snprintf(record, sizeof(record), "writer %lu: event %lu",
+                           writer, i);
+        if (ds_io_log_append(&log_file, record, len) != DS_OK) {
+            DS_LOG_ERROR("Failed to append a record");
+            return (void *)1;
+        }
+    }
+
+    return NULL;
+}
+
+int main() {
+    int result = 0;
+
+    char directory[] = "/tmp/ds_io_log_XXXXXX";
+    char path[64] = {0};
+    boolean opened = false;
+    ds_string_slice records = {0};
+
+    if (mkdtemp(directory) == NULL) {
+        DS_LOG_ERROR("Failed to create a directory");
+        return_defer(1);
+    }
+    snprintf(path, sizeof(path), "%s/events.log", directory);
+
+    if (ds_io_log_open(&log_file, path, DS_IO_LOG_GROUP_COMMIT) != DS_OK) {
+        DS_LOG_ERROR("Failed to open %s", path);
+        return_defer(1);
+    }
+    opened = true;
+
+#ifdef DS_THREADS
+    pthread_t threads[THREADS];
+    for (unsigned long i = 0; i < THREADS; i++) {
+        pthread_create(&threads[i], NULL, append_records, (void *)i);
+    }
+    for (unsigned long i = 0; i < THREADS; i++) {
+        void *failed = NULL;
+        pthread_join(threads[i], &failed);
+        if (failed != NULL) {
+            result = 1;
+        }
+    }
+#else
+    for (unsigned long i = 0; i < THREADS; i++) {
+        if (append_records((void *)i) != NULL) {
+            result = 1;
+        }
+    }
+#endif
+    if (result != 0) {
+        return_defer(1);
+    }
+
+    unsigned long size = log_file.size;
+    ds_io_log_free(&log_file);
+    opened = false;
+    DS_LOG_INFO("Appended %d records, %lu bytes", THREADS * RECORDS, size);
+
+    // Simulate a crash in the middle of an append: a header that promises
+    // more bytes than were written
+    int fd = open(path, O_WRONLY | O_APPEND);
+    if (fd < 0 || write(fd, "\x40\x00\x00\x00\x12\x34\x56\x78torn", 12) != 12) {
+        DS_LOG_ERROR("Failed to tear the tail of %s", path);
+        return_defer(1);
+    }
+    close(fd);
+
+    // Reopening truncates the torn tail, and the log ends after the last
+    // complete record again
+    if (ds_io_log_open(&log_file, path, 0) != DS_OK) {
+        DS_LOG_ERROR("Failed to reopen %s", path);
+        return_defer(1);
+    }
+    opened = true;
+    DS_LOG_INFO("Reopened with %lu bytes, truncated %lu", log_file.size,
+                size + 12 - log_file.size);
+    if (log_file.size != size) {
+        DS_LOG_ERROR("The torn tail was not truncated");
+        return_defer(1);
+    }
+
+    if (ds_io_map(path, &records) != DS_OK) {
+        DS_LOG_ERROR("Failed to map %s", path);
+        return_defer(1);
+    }
+
+    unsigned long count = 0;
+    ds_string_slice view = records;
+    ds_string_slice record = {0};
+    while (ds_io_log_next(&view, &record)) {
+        if (count == 0) {
+            DS_LOG_INFO("First record: %.*s", (int)record.len, record.str);
+        }
+        count++;
+    }
+    if (count != THREADS * RECORDS) {
+        DS_LOG_ERROR("Expected %d records, read %lu", THREADS * RECORDS, count);
+        return_defer(1);
+    }
+
+defer:
+    if (records.str != NULL) {
+        ds_io_unmap(&records);
+    }
+    if (opened) {
+        ds_io_log_free(&log_file);
+    }
+    if (path[0] != '\0') {
+        unlink(path);
+        rmdir(directory);
+    }
+    return result;
+}
@@ -0,0 +1,59 @@
+#define _POSIX_C_SOURCE 200809L // mkdtemp
+#define DS_IO_IMPLEMENTATION
+#include "../ds.h"
+#include <stdlib.h>
+
+int main() {
+    int result = 0;
+
+    char directory[] = "/tmp/ds_io_reader_XXXXXX";
+    char path[64] = {0};
+    boolean opened = false;
+
+    ds_io_reader reader = {0};
+
+    if (mkdtemp(directory) == NULL) {
+        DS_LOG_ERROR("Failed to create a directory");
+        return_defer(1);
+    }
+    snprintf(path, sizeof(path), "%s/lines.txt", directory);
+
+    char text[] = "first line\r\nsecond line\n"
+                  "a line that is longer than the buffer of the reader\n"
+                  "last line without a newline";
+    if (ds_io_write(path, text, sizeof(text) - 1, "w") < 0) {
+        DS_LOG_ERROR("Failed to write %s", path);
+        return_defer(1);
+    }
+
+    // A tiny buffer, so lines are carried over between reads; the long line
+    // needs a larger maximum record length
+    if (ds_io_reader_open(&reader, path, 16, false) != DS_OK) {
+        DS_LOG_ERROR("Failed to open %s", path);
+        return_defer(1);
+    }
+    opened = true;
+    ds_io_reader_set_max_record(&reader, 128);
+
+    unsigned long count = 0;
+    ds_string_slice line = {0};
+    while (ds_io_reader_read_line(&reader, &line)) {
+        DS_LOG_INFO("Line %lu: %.*s", count, (int)line.len, line.str);
+        count++;
+    }
+
+    if (reader.failed || count != 4) {
+        DS_LOG_ERROR("Expected 4 lines, read %lu", count);
+        return_defer(1);
+    }
+
+defer:
+    if (opened) {
+        ds_io_reader_free(&reader);
+    }
+    if (path[0] != '\0') {
+        unlink(path);
+        rmdir(directory);
+    }
+    return result;
+}
@@ -0,0 +1,85 @@
+#define _POSIX_C_SOURCE 200809L // mkdtemp
+#define DS_IO_IMPLEMENTATION
+#include "../ds.h"
+#include <stdlib.h>
+
+int main() {
+    int result = 0;
+
+    char root[] = "/tmp/ds_io_walk_XXXXXX";
+    char path[128] = {0};
+    boolean created = false;
+
+    char *directories[] = {"src", "src/util", "build"};
+    char *files[] = {"README", "src/main.c", "src/util/list.c",
+                     "src/util/list.h", "build/main.c"};
+
+    ds_pattern include = {0};
+    ds_pattern_init(&include);
+    ds_pattern exclude = {0};
+    ds_pattern_init(&exclude);
+    ds_io_walker walker = {0};
+    ds_io_walker_init(&walker);
+
+    if (mkdtemp(root) == NULL) {
+        DS_LOG_ERROR("Failed to create a directory");
+        return_defer(1);
+    }
+    created = true;
+
+    for (unsigned long i = 0; i < 3; i++) {
+        snprintf(path, sizeof(path), "%s/%s", root, directories[i]);
+        mkdir(path, 0755);
+    }
+    for (unsigned long i = 0; i < 5; i++) {
+        snprintf(path, sizeof(path), "%s/%s", root, files[i]);
+        if (ds_io_write(path, "", 0, "w") < 0) {
+            DS_LOG_ERROR("Failed to write %s", path);
+            return_defer(1);
+        }
+    }
+
+    // Report the C sources, and skip the build directory and all below it
+    ds_string_slice sources = DS_STRING_SLICE("*.c");
+    ds_string_slice build = DS_STRING_SLICE("build");
+    if (ds_pattern_add(&include, &sources, DS_PATTERN_GLOB) != DS_OK ||
+        ds_pattern_build(&include) != DS_OK ||
+        ds_pattern_add(&exclude, &build, DS_PATTERN_GLOB) != DS_OK ||
+        ds_pattern_build(&exclude) != DS_OK) {
+        DS_LOG_ERROR("Failed to build the filters");
+        return_defer(1);
+    }
+    ds_io_walker_set_filters(&walker, &include, &exclude);
+
+    if (ds_io_walker_walk(&walker, root, 0) != DS_OK) {
+        DS_LOG_ERROR("Failed to walk %s", root);
+        return_defer(1);
+    }
+
+    for (unsigned long i = 0; i < walker.entries.count; i++) {
+        ds_io_entry *entry = (ds_io_entry *)walker.entries.items + i;
+        DS_LOG_INFO("Found %s", entry->path.str + entry->relative);
+    }
+
+    if (walker.entries.count != 2) {
+        DS_LOG_ERROR("Expected 2 sources, found %lu", walker.entries.count);
+        return_defer(1);
+    }
+
+defer:
+    ds_io_walker_free(&walker);
+    ds_pattern_free(&exclude);
+    ds_pattern_free(&include);
+    if (created) {
+        for (unsigned long i = 5; i > 0; i--) {
+            snprintf(path, sizeof(path), "%s/%s", root, files[i - 1]);
+            unlink(path);
+        }
+        for (unsigned long i = 3; i > 0; i--) {
+            snprintf(path, sizeof(path), "%s/%s", root, directories[i - 1]);
+            rmdir(path);
+        }
+        rmdir(root);
+    }
+    return result;
+}
@@ -0,0 +1,66 @@
+#define _POSIX_C_SOURCE 200809L // mkdtemp
+#define DS_IO_IMPLEMENTATION
+#include "../ds.h"
+#include <stdlib.h>
+#include <string.h>
+
+int main() {
+    int result = 0;
+
+    char directory[] = "/tmp/ds_io_writer_XXXXXX";
+    char path[64] = {0};
+    char *buffer = NULL;
+    long size = 0;
+    boolean opened = false;
+
+    ds_io_writer writer = {0};
+
+    if (mkdtemp(directory) == NULL) {
+        DS_LOG_ERROR("Failed to create a directory");
+        return_defer(1);
+    }
+    snprintf(path, sizeof(path), "%s/records.csv", directory);
+
+    if (ds_io_writer_open(&writer, path, 0, 64) != DS_OK) {
+        DS_LOG_ERROR("Failed to open %s", path);
+        return_defer(1);
+    }
+    opened = true;
+
+    // Small writes are gathered in the buffer, and the slices of a record go
+    // out with the buffered bytes in one writev
+    if (ds_io_writer_write(&writer, "id,name\n", 8) != DS_OK) {
+        DS_LOG_ERROR("Failed to write the header");
+        return_defer(1);
+    }
+    ds_string_slice record[] = {DS_STRING_SLICE("1"), DS_STRING_SLICE(","),
+                                DS_STRING_SLICE("alpha"), DS_STRING_SLICE("\n")};
+    for (int i = 0; i < 20; i++) {
+        if (ds_io_writer_writev(&writer, record, 4) != DS_OK) {
+            DS_LOG_ERROR("Failed to write a record");
+            return_defer(1);
+        }
+    }
+    if (ds_io_writer_flush(&writer) != DS_OK) {
+        DS_LOG_ERROR("Failed to flush the writer");
+        return_defer(1);
+    }
+
+    size = ds_io_read(path, &buffer, "r");
+    DS_LOG_INFO("Wrote %ld bytes", size);
+    if (size != 8 + 20 * 8 || strncmp(buffer, "id,name\n1,alpha\n", 16) != 0) {
+        DS_LOG_ERROR("The file does not have the records");
+        return_defer(1);
+    }
+
+defer:
+    if (opened) {
+        ds_io_writer_free(&writer);
+    }
+    ds_string_builder_release(NULL, buffer, size);
+    if (path[0] != '\0') {
+        unlink(path);
+        rmdir(directory);
+    }
+    return result;
+}
@@ -0,0 +1,84 @@
+#define DS_SB_IMPLEMENTATION
+#include "../ds.h"
+
+int main() {
+    int result = 0;
+
+    char text[] = "alpha\r\nbeta\ngamma with a long tail\n\ndelta";
+    char *expected[] = {"alpha", "beta", "gamma with a long tail", "",
+                        "delta"};
+    unsigned long count = sizeof(expected) / sizeof(expected[0]);
+    unsigned long len = sizeof(text) - 1;
+
+    ds_line_iterator it = {0};
+    ds_string_slice line = {0};
+    unsigned long lines = 0;
+
+    // The whole buffer at once
+    ds_string_slice ss = {0};
+    ds_string_slice_init(&ss, text, len);
+    if (ds_string_slice_count_lines(&ss) != count) {
+        DS_LOG_ERROR("Expected %lu lines", count);
+        return_defer(1);
+    }
+
+    ds_line_iterator_init(&it, text, len);
+    while (ds_line_iterator_next(&it, &line)) {
+        if (lines >= count || line.len != DS_STRLEN(expected[lines]) ||
+            DS_MEMCMP(line.str, expected[lines], line.len) != 0) {
+            DS_LOG_ERROR("Unexpected line %lu: %.*s", lines, (int)line.len,
+                         line.str);
+            return_defer(1);
+        }
+        lines++;
+    }
+    ds_line_iterator_free(&it);
+    if (lines != count) {
+        DS_LOG_ERROR("Expected %lu lines, got %lu", count, lines);
+        return_defer(1);
+    }
+
+    // The same text fed in chunks of a few bytes, so that lines (and the
+    // "\r\n" line ending) are split across chunks and have to be carried over
+    for (unsigned long size = 1; size <= 8; size++) {
+        ds_line_iterator_init_stream(&it);
+        lines = 0;
+
+        for (unsigned long offset = 0; offset < len; offset += size) {
+            ds_line_iterator_feed(&it, text + offset,
+                                  DS_MIN(size, len - offset));
+            if (offset + size >= len) {
+                ds_line_iterator_finish(&it);
+            }
+
+            while (ds_line_iterator_next(&it, &line)) {
+                if (lines >= count ||
+                    line.len != DS_STRLEN(expected[lines]) ||
+                    DS_MEMCMP(line.str, expected[lines], line.len) != 0) {
+                    DS_LOG_ERROR("Unexpected line %lu with chunks of %lu: "
+                                 "%.*s",
+                                 lines, size, (int)line.len, line.str);
+                    return_defer(1);
+                }
+                lines++;
+            }
+            if (it.failed) {
+                DS_LOG_ERROR("Failed to carry a line over");
+                return_defer(1);
+            }
+        }
+
+        ds_line_iterator_free(&it);
+        if (lines != count) {
+            DS_LOG_ERROR("Expected %lu lines with chunks of %lu, got %lu",
+                         count, size, lines);
+            return_defer(1);
+        }
+    }
+
+    DS_LOG_INFO("Read %lu lines from a stream", lines);
+
+defer:
+    ds_line_iterator_free(&it);
+    return result;
+}
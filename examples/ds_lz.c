@@ -0,0 +1,145 @@
+#define _POSIX_C_SOURCE 200809L // mkdtemp
+#define DS_IO_IMPLEMENTATION
+#include "../ds.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define TEXT_SIZE (256 * 1024)
+
+int main() {
+    int result = 0;
+
+    char directory[] = "/tmp/ds_lz_XXXXXX";
+    char path[64] = {0};
+    char *text = NULL;
+    char *compressed = NULL;
+    char *decompressed = NULL;
+    char *buffer = NULL;
+    long buffer_len = 0;
+    boolean writer_opened = false;
+    boolean reader_opened = false;
+
+    ds_io_writer writer = {0};
+    ds_io_reader reader = {0};
+
+    if (mkdtemp(directory) == NULL) {
+        DS_LOG_ERROR("Failed to create a directory");
+        return_defer(1);
+    }
+    snprintf(path, sizeof(path), "%s/dump.lz4", directory);
+
+    text = DS_MALLOC(NULL, TEXT_SIZE);
+    decompressed = DS_MALLOC(NULL, TEXT_SIZE);
+    compressed = DS_MALLOC(NULL, ds_lz_compress_bound(TEXT_SIZE));
+    if (text == NULL || decompressed == NULL || compressed == NULL) {
+        DS_LOG_ERROR("Failed to allocate the buffers");
+        return_defer(1);
+    }
+
+    unsigned long len = 0;
+    unsigned long count = 1;
+    len += snprintf(text, 64, "abcabcabcabcabcabc\n");
+    for (; len + 64 < TEXT_SIZE; count++) {
+        len += snprintf(text + len, 64, "abc %lu: some text that repeats\n",
+                        count % 1000);
+    }
+
+    // A single block
+    long size = ds_lz_compress(text, len, compressed,
+                               ds_lz_compress_bound(TEXT_SIZE));
+    if (size < 0 ||
+        ds_lz_decompress(compressed, size, decompressed, TEXT_SIZE) !=
+            (long)len ||
+        DS_MEMCMP(text, decompressed, len) != 0) {
+        DS_LOG_ERROR("Failed to round trip a block");
+        return_defer(1);
+    }
+    DS_LOG_INFO("Compressed %lu bytes into %ld", len, size);
+
+    // The block starts with the literals "abc" and a match of them, so the
+    // offset of the match is right after the token and the literals. Pointing
+    // it before the start of the output makes the block invalid.
+    compressed[4] = (char)0xFF;
+    compressed[5] = (char)0xFF;
+    if (ds_lz_decompress(compressed, size, decompressed, TEXT_SIZE) != -1) {
+        DS_LOG_ERROR("A corrupted block was not rejected");
+        return_defer(1);
+    }
+
+    // A whole file with "z" in the mode
+    if (ds_io_write(path, text, len, "wz") < 0 ||
+        (buffer_len = ds_io_read(path, &buffer, "rz")) != (long)len ||
+        DS_MEMCMP(text, buffer, len) != 0) {
+        DS_LOG_ERROR("Failed to round trip %s", path);
+        return_defer(1);
+    }
+    ds_string_builder_release(NULL, buffer, buffer_len);
+    buffer = NULL;
+
+    // Streaming, with a writer and a reader
+    if (ds_io_writer_open(&writer, path, DS_IO_WRITER_LZ, 64 * 1024) !=
+        DS_OK) {
+        DS_LOG_ERROR("Failed to open %s", path);
+        return_defer(1);
+    }
+    writer_opened = true;
+    for (unsigned long i = 0; i < len; i += 1000) {
+        if (ds_io_writer_write(&writer, text + i, DS_MIN(len - i, 1000)) !=
+            DS_OK) {
+            DS_LOG_ERROR("Failed to write %s", path);
+            return_defer(1);
+        }
+    }
+    if (ds_io_writer_flush(&writer) != DS_OK) {
+        DS_LOG_ERROR("Failed to flush %s", path);
+        return_defer(1);
+    }
+
+    if (ds_io_reader_open_lz(&reader, path, 4096, false) != DS_OK) {
+        DS_LOG_ERROR("Failed to open %s", path);
+        return_defer(1);
+    }
+    reader_opened = true;
+    unsigned long lines = 0;
+    ds_string_slice line = {0};
+    while (ds_io_reader_read_line(&reader, &line)) {
+        lines++;
+    }
+    DS_LOG_INFO("Read %lu lines back", lines);
+    if (reader.failed || lines != count) {
+        DS_LOG_ERROR("Failed to read %s back", path);
+        return_defer(1);
+    }
+
+    // An empty frame (as written by lz4 for an empty file)
+    char empty[] = {0x04, 0x22, 0x4D, 0x18, 0x60, 0x40, (char)0x82,
+                    0x00, 0x00, 0x00, 0x00};
+    if (ds_io_write(path, empty, sizeof(empty), "w") < 0 ||
+        (buffer_len = ds_io_read(path, &buffer, "rz")) != 0) {
+        DS_LOG_ERROR("Failed to read an empty frame");
+        return_defer(1);
+    }
+
+defer:
+    if (reader_opened) {
+        ds_io_reader_free(&reader);
+    }
+    if (writer_opened) {
+        ds_io_writer_free(&writer);
+    }
+    ds_string_builder_release(NULL, buffer, buffer_len);
+    if (text != NULL) {
+        DS_FREE(NULL, text);
+    }
+    if (compressed != NULL) {
+        DS_FREE(NULL, compressed);
+    }
+    if (decompressed != NULL) {
+        DS_FREE(NULL, decompressed);
+    }
+    if (path[0] != '\0') {
+        unlink(path);
+        rmdir(directory);
+    }
+    return result;
+}
@@ -0,0 +1,78 @@
+#define DS_SB_IMPLEMENTATION
+#include "../ds.h"
+
+int main() {
+    int result = 0;
+
+    ds_pattern pt = {0};
+    ds_pattern_init(&pt);
+
+    ds_dynamic_array ids = {0};
+    ds_dynamic_array_init(&ids, sizeof(unsigned long));
+
+    struct {
+            char *source;
+            unsigned int flags;
+    } patterns[] = {
+        {"*.log", DS_PATTERN_GLOB},
+        {"access-{2023,2024}-??.log", DS_PATTERN_GLOB},
+        {"error|warn(ing)?", DS_PATTERN_REGEX | DS_PATTERN_ICASE},
+        {"\\d{1,3}(\\.\\d{1,3}){3}", DS_PATTERN_REGEX},
+    };
+    for (unsigned long i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++) {
+        ds_string_slice source = DS_STRING_SLICE(patterns[i].source);
+        if (ds_pattern_add(&pt, &source, patterns[i].flags) != DS_OK) {
+            DS_LOG_ERROR("Failed to add pattern %s", patterns[i].source);
+            return_defer(1);
+        }
+    }
+
+    if (ds_pattern_build(&pt) != DS_OK) {
+        DS_LOG_ERROR("Failed to build the patterns");
+        return_defer(1);
+    }
+
+    // Match whole strings: the first pattern that matches is reported
+    char *names[] = {"server.log", "access-2024-03.log", "WARNING", "10.0.0.1",
+                     "notes.txt"};
+    for (unsigned long i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        ds_string_slice name = DS_STRING_SLICE(names[i]);
+        unsigned long id = 0;
+        if (ds_pattern_match(&pt, &name, &id)) {
+            DS_LOG_INFO("%s matches %s", names[i], patterns[id].source);
+        } else {
+            DS_LOG_INFO("%s does not match", names[i]);
+        }
+    }
+
+    // The globs overlap, so both of them match this name
+    ds_string_slice name = DS_STRING_SLICE("access-2023-12.log");
+    if (ds_pattern_match_all(&pt, &name, &ids) != DS_OK) {
+        DS_LOG_ERROR("Failed to match the patterns");
+        return_defer(1);
+    }
+    if (ids.count != 2) {
+        DS_LOG_ERROR("Expected 2 patterns to match, got %lu", ids.count);
+        return_defer(1);
+    }
+
+    // Search a line for the first match of any pattern. The first match is
+    // the one that ends first, so the address is cut short at 192.168.1.2
+    ds_string_slice line = DS_STRING_SLICE("from 192.168.1.20: Error: disk full");
+    ds_string_match match = {0};
+    if (!ds_pattern_search(&pt, &line, &match)) {
+        DS_LOG_ERROR("Expected a match in the line");
+        return_defer(1);
+    }
+    DS_LOG_INFO("Found %.*s (%s)", (int)match.len, line.str + match.index,
+                patterns[match.pattern].source);
+    if (match.pattern != 3 || match.index != 5 || match.len != 11) {
+        DS_LOG_ERROR("Expected the address at 5");
+        return_defer(1);
+    }
+
+defer:
+    ds_dynamic_array_free(&ids);
+    ds_pattern_free(&pt);
+    return result;
+}
@@ -0,0 +1,86 @@
+#define DS_SB_IMPLEMENTATION
+#include "../ds.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+int main() {
+    int result = 0;
+
+    int fds[2] = {-1, -1};
+    char *expected = NULL;
+    char buffer[4096];
+
+    ds_rope_builder rb = {0};
+    ds_rope_builder_init_allocator(&rb, 4096, NULL);
+    ds_string_builder out = {0};
+    ds_string_builder_init(&out);
+
+    for (int i = 0; i < 20000; i++) {
+        if (ds_rope_builder_append(&rb, "record %d\n", i) != DS_OK) {
+            DS_LOG_ERROR("Failed to append a record");
+            return_defer(1);
+        }
+    }
+    unsigned long len = rb.len;
+    if (ds_rope_builder_build(&rb, &expected) != DS_OK) {
+        DS_LOG_ERROR("Failed to build the rope");
+        return_defer(1);
+    }
+
+    // A flush that fails right away keeps all of the contents
+    if (ds_rope_builder_flush(&rb, -1) != -1 || rb.len != len) {
+        DS_LOG_ERROR("Expected the flush to fail without losing anything");
+        return_defer(1);
+    }
+
+    // A pipe that is not read from fills up, so the flush fails partway; the
+    // written part is dropped and the flush is retried once the pipe is
+    // drained
+    if (pipe(fds) != 0 || fcntl(fds[0], F_SETFL, O_NONBLOCK) != 0 ||
+        fcntl(fds[1], F_SETFL, O_NONBLOCK) != 0) {
+        DS_LOG_ERROR("Failed to create a pipe");
+        return_defer(1);
+    }
+
+    int retries = 0;
+    while (rb.len > 0) {
+        if (ds_rope_builder_flush(&rb, fds[1]) < 0) {
+            if (errno != EAGAIN) {
+                DS_LOG_ERROR("Failed to flush the rope");
+                return_defer(1);
+            }
+            retries++;
+        }
+
+        long size = 0;
+        while ((size = read(fds[0], buffer, sizeof(buffer))) > 0) {
+            if (ds_string_builder_appendn(&out, buffer, size) != DS_OK) {
+                DS_LOG_ERROR("Failed to append the output");
+                return_defer(1);
+            }
+        }
+    }
+
+    DS_LOG_INFO("Flushed %lu bytes with %d retries", out.items.count,
+                retries);
+    if (retries == 0 || out.items.count != len ||
+        DS_MEMCMP(out.items.items, expected, len) != 0) {
+        DS_LOG_ERROR("The pipe does not have the contents of the rope");
+        return_defer(1);
+    }
+
+defer:
+    if (fds[0] >= 0) {
+        close(fds[0]);
+    }
+    if (fds[1] >= 0) {
+        close(fds[1]);
+    }
+    if (expected != NULL) {
+        DS_FREE(NULL, expected);
+    }
+    ds_string_builder_free(&out);
+    ds_rope_builder_free(&rb);
+    return result;
+}
@@ -0,0 +1,88 @@
+#define DS_HM_IMPLEMENTATION
+#define DS_SB_IMPLEMENTATION
+#include "../ds.h"
+#include <string.h>
+
+int main() {
+    int result = 0;
+
+    char *words[] = {"", "id", "name", "a key of 22 bytes long",
+                     "a key that is long enough to be allocated"};
+    unsigned long count = sizeof(words) / sizeof(words[0]);
+    ds_string strings[sizeof(words) / sizeof(words[0])] = {0};
+    ds_string lookup = {0};
+    ds_string copy = {0};
+
+    ds_hashmap map = {0};
+    if (ds_hashmap_init(&map, 16, ds_hashmap_hash_string,
+                        ds_hashmap_compare_string) != DS_OK) {
+        DS_LOG_ERROR("Failed to initialize the hash map");
+        return_defer(1);
+    }
+
+    // The string is as large as three pointers
+    if (sizeof(ds_string) != 3 * sizeof(void *)) {
+        DS_LOG_ERROR("Expected the string to be %lu bytes, got %lu",
+                     (unsigned long)(3 * sizeof(void *)),
+                     (unsigned long)sizeof(ds_string));
+        return_defer(1);
+    }
+
+    for (unsigned long i = 0; i < count; i++) {
+        unsigned long len = strlen(words[i]);
+        if (ds_string_init(&strings[i], words[i], len) != DS_OK) {
+            DS_LOG_ERROR("Failed to initialize %s", words[i]);
+            return_defer(1);
+        }
+
+        // Short strings are stored inline, longer ones are allocated
+        ds_string *string = &strings[i];
+        if (DS_STRING_LEN(string) != len ||
+            strcmp(DS_STRING_STR(string), words[i]) != 0 ||
+            DS_STRING_IS_HEAP(string) != (len > DS_STRING_SMALL_CAPACITY)) {
+            DS_LOG_ERROR("Unexpected string for %s", words[i]);
+            return_defer(1);
+        }
+        DS_LOG_INFO("\"%s\" is %s", DS_STRING_STR(string),
+                    DS_STRING_IS_HEAP(string) ? "allocated" : "inline");
+
+        ds_hashmap_kv kv = {.key = string, .value = words[i]};
+        if (ds_hashmap_insert(&map, &kv) != DS_OK) {
+            DS_LOG_ERROR("Failed to insert %s", words[i]);
+            return_defer(1);
+        }
+    }
+
+    // A string built from a slice finds the key with the same contents
+    ds_string_slice ss = {0};
+    ds_string_slice_init(&ss, "the name of the key", 19);
+    ds_string_slice_step(&ss, 4);
+    ss.len = 4;
+    if (ds_string_slice_to_string(&ss, &lookup) != DS_OK) {
+        DS_LOG_ERROR("Failed to build the lookup key");
+        return_defer(1);
+    }
+    ds_hashmap_kv kv = {.key = &lookup, .value = NULL};
+    if (ds_hashmap_get(&map, &kv) != DS_OK ||
+        strcmp((char *)kv.value, "name") != 0) {
+        DS_LOG_ERROR("Failed to find %s", DS_STRING_STR(&lookup));
+        return_defer(1);
+    }
+
+    // A copy of a long string has its own allocation
+    if (ds_string_copy(&strings[count - 1], &copy) != DS_OK ||
+        !ds_string_equals(&copy, &strings[count - 1]) ||
+        DS_STRING_STR(&copy) == DS_STRING_STR(&strings[count - 1])) {
+        DS_LOG_ERROR("Failed to copy the string");
+        return_defer(1);
+    }
+
+defer:
+    ds_string_free(&copy);
+    ds_string_free(&lookup);
+    for (unsigned long i = 0; i < count; i++) {
+        ds_string_free(&strings[i]);
+    }
+    ds_hashmap_free(&map);
+    return result;
+}
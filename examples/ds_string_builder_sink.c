@@ -0,0 +1,85 @@
+#define _POSIX_C_SOURCE 200809L // mkdtemp
+#define DS_IO_IMPLEMENTATION
+#define DS_DA_INIT_CAPACITY 16
+#include "../ds.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define THRESHOLD 64
+
+int main() {
+    int result = 0;
+
+    char directory[] = "/tmp/ds_string_builder_sink_XXXXXX";
+    char path[64] = {0};
+    char *buffer = NULL;
+    long size = 0;
+    FILE *file = NULL;
+    char line[256] = {0};
+
+    ds_string_builder sb = {0};
+    ds_string_builder expected = {0};
+    ds_string_builder_init(&expected);
+
+    if (mkdtemp(directory) == NULL) {
+        DS_LOG_ERROR("Failed to create a directory");
+        return_defer(1);
+    }
+    snprintf(path, sizeof(path), "%s/output.txt", directory);
+
+    file = fopen(path, "w");
+    if (file == NULL) {
+        DS_LOG_ERROR("Failed to open %s", path);
+        return_defer(1);
+    }
+    ds_string_builder_init_file(&sb, file, THRESHOLD);
+    unsigned long capacity = sb.items.capacity;
+
+    // Many short appends, and a few that are larger than the threshold
+    memset(line, 'x', sizeof(line) - 1);
+    for (int i = 0; i < 1000; i++) {
+        if (ds_string_builder_append(&sb, "line %d\n", i) != DS_OK ||
+            ds_string_builder_append(&expected, "line %d\n", i) != DS_OK) {
+            DS_LOG_ERROR("Failed to append a line");
+            return_defer(1);
+        }
+        if (i % 100 == 0 &&
+            (ds_string_builder_append(&sb, "%s %d\n", line, i) != DS_OK ||
+             ds_string_builder_append(&expected, "%s %d\n", line, i) !=
+                 DS_OK)) {
+            DS_LOG_ERROR("Failed to append a long line");
+            return_defer(1);
+        }
+        if (sb.items.count > THRESHOLD || sb.items.capacity != capacity) {
+            DS_LOG_ERROR("The buffer grew to %lu bytes", sb.items.capacity);
+            return_defer(1);
+        }
+    }
+    if (ds_string_builder_flush(&sb) != DS_OK) {
+        DS_LOG_ERROR("Failed to flush %s", path);
+        return_defer(1);
+    }
+    fclose(file);
+    file = NULL;
+
+    size = ds_io_read(path, &buffer, "r");
+    DS_LOG_INFO("Wrote %ld bytes with a buffer of %lu", size, capacity);
+    if (size != (long)expected.items.count ||
+        DS_MEMCMP(buffer, expected.items.items, size) != 0) {
+        DS_LOG_ERROR("The file does not have the output");
+        return_defer(1);
+    }
+
+defer:
+    if (file != NULL) {
+        fclose(file);
+    }
+    ds_string_builder_release(NULL, buffer, size);
+    ds_string_builder_free(&sb);
+    ds_string_builder_free(&expected);
+    if (path[0] != '\0') {
+        unlink(path);
+    }
+    rmdir(directory);
+    return result;
+}
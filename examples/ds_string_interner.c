@@ -0,0 +1,56 @@
+#define DS_SI_IMPLEMENTATION
+#include "../ds.h"
+
+int main() {
+    int result = 0;
+
+    ds_string_interner si = {0};
+    ds_string_interner_init(&si);
+
+    ds_string_builder sb = {0};
+    ds_string_builder_init(&sb);
+
+    ds_string_interner copy = {0};
+    ds_string_interner_init(&copy);
+
+    char *hosts[] = {"alpha", "beta", "alpha", "gamma", "beta"};
+    for (unsigned long i = 0; i < sizeof(hosts) / sizeof(hosts[0]); i++) {
+        ds_string_slice ss = DS_STRING_SLICE(hosts[i]);
+
+        unsigned long id = 0;
+        if (ds_string_interner_intern(&si, &ss, &id) != DS_OK) {
+            DS_LOG_ERROR("Failed to intern string");
+            return_defer(1);
+        }
+
+        DS_LOG_INFO("%s -> %lu", hosts[i], id);
+    }
+
+    DS_LOG_INFO("Distinct strings: %lu", ds_string_interner_count(&si));
+
+    if (ds_string_interner_save(&si, &sb) != DS_OK) {
+        DS_LOG_ERROR("Failed to save the string interner");
+        return_defer(1);
+    }
+
+    if (ds_string_interner_load(&copy, sb.items.items, sb.items.count) !=
+        DS_OK) {
+        DS_LOG_ERROR("Failed to load the string interner");
+        return_defer(1);
+    }
+
+    ds_string_slice gamma = DS_STRING_SLICE("gamma");
+    unsigned long id = 0;
+    if (ds_string_interner_lookup(&copy, &gamma, &id) != DS_OK) {
+        DS_LOG_ERROR("Failed to find string");
+        return_defer(1);
+    }
+
+    DS_LOG_INFO("Reloaded gamma -> %lu", id);
+
+defer:
+    ds_string_interner_free(&copy);
+    ds_string_builder_free(&sb);
+    ds_string_interner_free(&si);
+    return result;
+}
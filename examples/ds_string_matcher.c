@@ -0,0 +1,59 @@
+#define DS_SB_IMPLEMENTATION
+#include "../ds.h"
+
+int main() {
+    int result = 0;
+
+    ds_string_matcher sm = {0};
+    ds_string_matcher_init(&sm);
+
+    ds_dynamic_array matches = {0};
+    ds_dynamic_array_init(&matches, sizeof(ds_string_match));
+
+    char *patterns[] = {"he", "she", "his", "hers"};
+    for (unsigned long i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++) {
+        ds_string_slice pattern = DS_STRING_SLICE(patterns[i]);
+        if (ds_string_matcher_add(&sm, &pattern) != DS_OK) {
+            DS_LOG_ERROR("Failed to add pattern");
+            return_defer(1);
+        }
+    }
+
+    if (ds_string_matcher_build(&sm) != DS_OK) {
+        DS_LOG_ERROR("Failed to build string matcher");
+        return_defer(1);
+    }
+
+    // Patterns can still be added once the string matcher is built, as long
+    // as it is built again
+    ds_string_slice pattern = DS_STRING_SLICE("sher");
+    if (ds_string_matcher_add(&sm, &pattern) != DS_OK ||
+        ds_string_matcher_build(&sm) != DS_OK) {
+        DS_LOG_ERROR("Failed to add pattern after building");
+        return_defer(1);
+    }
+
+    ds_string_slice text = DS_STRING_SLICE("ushers and his sheriff");
+    if (ds_string_matcher_find_all(&sm, &text, &matches) != DS_OK) {
+        DS_LOG_ERROR("Failed to find matches");
+        return_defer(1);
+    }
+
+    for (unsigned long i = 0; i < matches.count; i++) {
+        ds_string_match *match = (ds_string_match *)matches.items + i;
+        DS_LOG_INFO("%s at %lu", match->pattern < 4 ? patterns[match->pattern]
+                                                    : "sher",
+                    match->index);
+    }
+
+    // she, he, sher, hers, his, she, he, sher
+    if (matches.count != 8) {
+        DS_LOG_ERROR("Expected 8 matches, found %lu", matches.count);
+        return_defer(1);
+    }
+
+defer:
+    ds_dynamic_array_free(&matches);
+    ds_string_matcher_free(&sm);
+    return result;
+}
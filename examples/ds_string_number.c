@@ -0,0 +1,97 @@
+#define DS_SB_IMPLEMENTATION
+#include "../ds.h"
+#include <string.h>
+
+int main() {
+    int result = 0;
+
+    char expected[64];
+    ds_string_builder sb = {0};
+    ds_string_builder_init(&sb);
+
+    // Formatting matches printf, including the rounding of ties to even
+    struct {
+            double value;
+            int precision;
+    } numbers[] = {{3.14159, 4}, {0.125, 2},  {2.5, 0},  {-0.0005, 3},
+                   {1e20, 3},    {1234.5, 1}, {0.1, 17}, {-7.0, 0}};
+    for (unsigned long i = 0; i < sizeof(numbers) / sizeof(numbers[0]); i++) {
+        sb.items.count = 0;
+        if (ds_string_builder_append_double(&sb, numbers[i].value,
+                                            numbers[i].precision) != DS_OK) {
+            DS_LOG_ERROR("Failed to append a number");
+            return_defer(1);
+        }
+        int len = snprintf(expected, sizeof(expected), "%.*f",
+                           numbers[i].precision, numbers[i].value);
+        if (sb.items.count != (unsigned long)len ||
+            DS_MEMCMP(sb.items.items, expected, len) != 0) {
+            DS_LOG_ERROR("Expected %s, got %.*s", expected,
+                         (int)sb.items.count, (char *)sb.items.items);
+            return_defer(1);
+        }
+    }
+
+    sb.items.count = 0;
+    if (ds_string_builder_append_long(&sb, -1234567) != DS_OK ||
+        ds_string_builder_appendc(&sb, ' ') != DS_OK ||
+        ds_string_builder_append_ulong(&sb, 18446744073709551615UL) != DS_OK ||
+        sb.items.count != 29 ||
+        DS_MEMCMP(sb.items.items, "-1234567 18446744073709551615", 29) != 0) {
+        DS_LOG_ERROR("Failed to format the integers");
+        return_defer(1);
+    }
+
+    // Parsing
+    ds_string_slice ss = {0};
+    double value = 0;
+    long number = 0;
+
+    ds_string_slice_init(&ss, "-42", 3);
+    if (ds_string_slice_to_long(&ss, &number) != DS_OK || number != -42) {
+        DS_LOG_ERROR("Failed to parse -42");
+        return_defer(1);
+    }
+
+    ds_string_slice_init(&ss, "1.5e3", 5);
+    if (ds_string_slice_to_double(&ss, &value) != DS_OK || value != 1500.0) {
+        DS_LOG_ERROR("Failed to parse 1.5e3");
+        return_defer(1);
+    }
+
+    ds_string_slice_init(&ss, "0.1", 3);
+    if (ds_string_slice_to_double(&ss, &value) != DS_OK || value != 0.1) {
+        DS_LOG_ERROR("Failed to parse 0.1");
+        return_defer(1);
+    }
+
+    ds_string_slice_init(&ss, "12abc", 5);
+    if (ds_string_slice_to_double(&ss, &value) != DS_ERR) {
+        DS_LOG_ERROR("Expected 12abc to be rejected");
+        return_defer(1);
+    }
+
+    // nan is a quiet NaN with the sign of the input
+    char *nans[] = {"nan", "-nan"};
+    for (int i = 0; i < 2; i++) {
+        unsigned long long bits = 0;
+        ds_string_slice_init(&ss, nans[i], DS_STRLEN(nans[i]));
+        if (ds_string_slice_to_double(&ss, &value) != DS_OK) {
+            DS_LOG_ERROR("Failed to parse %s", nans[i]);
+            return_defer(1);
+        }
+        memcpy(&bits, &value, sizeof(bits));
+        if (value == value || (bits >> 63) != (unsigned long long)i ||
+            (bits & 0x0008000000000000ULL) == 0) {
+            DS_LOG_ERROR("Expected %s to be a quiet NaN with its sign",
+                         nans[i]);
+            return_defer(1);
+        }
+    }
+
+    DS_LOG_INFO("Formatted and parsed the numbers");
+
+defer:
+    ds_string_builder_free(&sb);
+    return result;
+}
@@ -0,0 +1,87 @@
+#define DS_SB_IMPLEMENTATION
+#define DS_SPLIT_PARALLEL_MIN 64
+#include "../ds.h"
+
+// Check that two token arrays point at the same parts of the input
+static boolean same_tokens(ds_dynamic_array *a, ds_dynamic_array *b) {
+    if (a->count != b->count) {
+        return false;
+    }
+    for (unsigned long i = 0; i < a->count; i++) {
+        ds_string_slice *ta = (ds_string_slice *)a->items + i;
+        ds_string_slice *tb = (ds_string_slice *)b->items + i;
+        if (ta->str != tb->str || ta->len != tb->len) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main() {
+    int result = 0;
+
+    ds_string_builder sb = {0};
+    ds_string_builder_init(&sb);
+
+    ds_dynamic_array expected = {0};
+    ds_dynamic_array_init(&expected, sizeof(ds_string_slice));
+    ds_dynamic_array tokens = {0};
+    ds_dynamic_array_init(&tokens, sizeof(ds_string_slice));
+
+    // Words of varying length, with runs of delimiters and delimiters at both
+    // ends, so the chunk boundaries of the threads land everywhere
+    char separators[] = ",,;, ;";
+    ds_string_builder_appendc(&sb, ',');
+    for (unsigned long i = 0; i < 5000; i++) {
+        for (unsigned long j = 0; j < i % 7; j++) {
+            ds_string_builder_appendc(&sb, (char)('a' + (i + j) % 26));
+        }
+        ds_string_builder_appendc(&sb, separators[i % 6]);
+    }
+
+    ds_string_slice ss = {0};
+    ds_string_slice_init(&ss, sb.items.items, sb.items.count);
+
+    ds_char_class cc = {0};
+    ds_char_class_init(&cc, ",; ");
+
+    for (int class = 0; class < 2; class++) {
+        expected.count = 0;
+        ds_result split =
+            class ? ds_string_slice_split_class(&ss, &cc, &expected)
+                  : ds_string_slice_split(&ss, ',', &expected);
+        if (split != DS_OK) {
+            DS_LOG_ERROR("Failed to split the input");
+            return_defer(1);
+        }
+
+        unsigned long threads[] = {0, 1, 2, 3, 4, 7, 16};
+        for (unsigned long i = 0; i < sizeof(threads) / sizeof(threads[0]);
+             i++) {
+            tokens.count = 0;
+            split = class ? ds_string_slice_split_class_parallel(
+                                &ss, &cc, &tokens, threads[i])
+                          : ds_string_slice_split_parallel(&ss, ',', &tokens,
+                                                           threads[i]);
+            if (split != DS_OK) {
+                DS_LOG_ERROR("Failed to split the input on %lu threads",
+                             threads[i]);
+                return_defer(1);
+            }
+            if (!same_tokens(&expected, &tokens)) {
+                DS_LOG_ERROR("The split on %lu threads does not match",
+                             threads[i]);
+                return_defer(1);
+            }
+        }
+
+        DS_LOG_INFO("Split %lu bytes into %lu tokens%s", ss.len, expected.count,
+                    class ? " by class" : "");
+    }
+
+defer:
+    ds_dynamic_array_free(&tokens);
+    ds_dynamic_array_free(&expected);
+    ds_string_builder_free(&sb);
+    return result;
+}
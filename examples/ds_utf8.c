@@ -0,0 +1,85 @@
+#define DS_SB_IMPLEMENTATION
+#include "../ds.h"
+#include <string.h>
+
+int main() {
+    int result = 0;
+
+    ds_string_slice ss = {0};
+    unsigned long index = 0;
+    char buffer[128];
+
+    // Valid text, long enough to go through the SIMD paths
+    char text[] = "h\xC3\xA9llo, w\xC3\xB6rld \xE2\x82\xAC \xF0\x9D\x84\x9E "
+                  "h\xC3\xA9llo, w\xC3\xB6rld \xE2\x82\xAC \xF0\x9D\x84\x9E";
+    ds_string_slice_init(&ss, text, sizeof(text) - 1);
+    if (!ds_string_slice_utf8_valid(&ss, &index) || index != ss.len) {
+        DS_LOG_ERROR("Expected the text to be valid at %lu", index);
+        return_defer(1);
+    }
+    if (ds_string_slice_utf8_count(&ss) != 33) {
+        DS_LOG_ERROR("Expected 33 code points, got %lu",
+                     ds_string_slice_utf8_count(&ss));
+        return_defer(1);
+    }
+
+    // Invalid sequences, after a run of ASCII so that the SIMD paths have to
+    // find them too
+    struct {
+            char *str;
+            unsigned long index;
+    } invalid[] = {
+        {"ab\xC0\xAF", 2},         // overlong "/"
+        {"ab\xE0\x80\xAF", 2},     // overlong "/" in three bytes
+        {"x\xED\xA0\x80", 1},      // surrogate U+D800
+        {"\xF4\x90\x80\x80", 0},   // above U+10FFFF
+        {"abc\xE2\x82", 3},        // truncated euro sign
+        {"\x80", 0},               // lone continuation byte
+    };
+    for (unsigned long i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        for (unsigned long run = 0; run <= 96; run += 96) {
+            unsigned long len = DS_STRLEN(invalid[i].str);
+            memset(buffer, 'a', run);
+            memcpy(buffer + run, invalid[i].str, len);
+            ds_string_slice_init(&ss, buffer, run + len);
+            if (ds_string_slice_utf8_valid(&ss, &index) ||
+                index != run + invalid[i].index) {
+                DS_LOG_ERROR("Expected sequence %lu to be invalid at %lu, "
+                             "got %lu",
+                             i, run + invalid[i].index, index);
+                return_defer(1);
+            }
+        }
+    }
+
+    // Decoding, where every invalid byte becomes a replacement character
+    char mixed[] = "a\xE2\x82\xAC\xF0\x9D\x84\x9E\xC0\xAF\xE2\x82";
+    unsigned int expected[] = {'a',
+                               0x20AC,
+                               0x1D11E,
+                               DS_UTF8_REPLACEMENT,
+                               DS_UTF8_REPLACEMENT,
+                               DS_UTF8_REPLACEMENT,
+                               DS_UTF8_REPLACEMENT};
+    unsigned long count = 0;
+    unsigned int codepoint = 0;
+    ds_string_slice_init(&ss, mixed, sizeof(mixed) - 1);
+    while (ds_string_slice_utf8_next(&ss, &codepoint)) {
+        if (count >= sizeof(expected) / sizeof(expected[0]) ||
+            codepoint != expected[count]) {
+            DS_LOG_ERROR("Unexpected code point U+%04X", codepoint);
+            return_defer(1);
+        }
+        count++;
+    }
+    if (count != sizeof(expected) / sizeof(expected[0])) {
+        DS_LOG_ERROR("Expected %lu code points, got %lu",
+                     sizeof(expected) / sizeof(expected[0]), count);
+        return_defer(1);
+    }
+
+    DS_LOG_INFO("Validated and decoded the UTF-8 samples");
+
+defer:
+    return result;
+}